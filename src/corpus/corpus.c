@@ -9,21 +9,61 @@
 #include "../utils/logger.h"
 #include "../utils/vector.h"
 
-// Copy input data to the shared corpus in a thread safe manner.
+// Copy input data to the shared corpus in a thread safe manner. The inputs
+// array has room for all of them from the start, so it never moves under the
+// readers, which do not take the lock. They only see an input once its length
+// is published, after it has been written.
 bool
-corpus_add_input(corpus_t* corpus, input_t* input_ptr)
+corpus_add_input(corpus_t* corpus, input_t* input_ptr, uint64_t* idx)
 {
-    if (corpus->inputs->length >= MAX_NB_CORPUS_INPUTS) {
+    pthread_mutex_lock(&corpus->lock);
+    const uint64_t new_idx = corpus->inputs->length;
+    if (new_idx >= MAX_NB_CORPUS_INPUTS) {
+        pthread_mutex_unlock(&corpus->lock);
         ginger_log(ERROR, "Corpus is full!\n");
         return false;
     }
-
-    pthread_mutex_lock(&corpus->lock);
-    vector_append(corpus->inputs, input_ptr);
+    // Not published yet, so index the data directly rather than through
+    // `corpus_get_input`.
+    memcpy((input_t*)corpus->inputs->data + new_idx, input_ptr, sizeof(input_t));
+    __atomic_store_n(&corpus->inputs->length, new_idx + 1, __ATOMIC_RELEASE);
     pthread_mutex_unlock(&corpus->lock);
+
+    if (idx) {
+        *idx = new_idx;
+    }
     return true;
 }
 
+uint64_t
+corpus_nb_inputs(const corpus_t* corpus)
+{
+    return __atomic_load_n(&corpus->inputs->length, __ATOMIC_ACQUIRE);
+}
+
+input_t*
+corpus_get_input(const corpus_t* corpus, uint64_t idx)
+{
+    if (idx >= corpus_nb_inputs(corpus)) {
+        ginger_log(ERROR, "Out of bounds read of corpus input %lu!\n", idx);
+        abort();
+    }
+    return (input_t*)corpus->inputs->data + idx;
+}
+
+void
+corpus_set_effector(corpus_t* corpus, uint64_t idx, effector_t* effector)
+{
+    input_t* input = corpus_get_input(corpus, idx);
+    __atomic_store_n(&input->effector, effector, __ATOMIC_RELEASE);
+}
+
+const effector_t*
+corpus_input_effector(const input_t* input)
+{
+    return __atomic_load_n(&input->effector, __ATOMIC_ACQUIRE);
+}
+
 // Recursively load all the files in the provided directory and subdirectories
 // into the corpus.
 static void
@@ -35,7 +75,7 @@ corpus_load_inputs(const char* base_path, corpus_t* corpus)
 
     // Basecase. Not a dir. Add file contents to corpus.
     if (!dir) {
-        if (corpus->inputs->length >= MAX_NB_CORPUS_INPUTS) {
+        if (corpus_nb_inputs(corpus) >= MAX_NB_CORPUS_INPUTS) {
             ginger_log(ERROR, "Corpus is full!\n");
             abort();
         }
@@ -62,7 +102,7 @@ corpus_load_inputs(const char* base_path, corpus_t* corpus)
         fclose(fileptr);
         new_input.length = input_len;
 
-        if (!corpus_add_input(corpus, &new_input)) {
+        if (!corpus_add_input(corpus, &new_input, NULL)) {
             ginger_log(ERROR, "Corpus to big!\n");
             abort();
         }
@@ -89,9 +129,10 @@ corpus_load_inputs(const char* base_path, corpus_t* corpus)
 void
 corpus_print(corpus_t* corpus)
 {
-    printf("Corpus length: %lu\n", corpus->inputs->length);
-    for (size_t i = 0; i < corpus->inputs->length; i++) {
-        const input_t* input = vector_get(corpus->inputs, i);
+    const uint64_t nb_inputs = corpus_nb_inputs(corpus);
+    printf("Corpus length: %lu\n", nb_inputs);
+    for (uint64_t i = 0; i < nb_inputs; i++) {
+        const input_t* input = corpus_get_input(corpus, i);
         printf("input %lu data: %s\n", i, input->data);
     }
     printf("\n");
@@ -107,21 +148,22 @@ corpus_t*
 corpus_create(const char* corpus_dir)
 {
     corpus_t* corpus = calloc(1, sizeof(corpus_t));
-    corpus->inputs   = vector_create(sizeof(input_t));
-    corpus_load_inputs(corpus_dir, corpus);
-    corpus->coverage = coverage_create();
+    corpus->inputs   = vector_create_with_capacity(sizeof(input_t), MAX_NB_CORPUS_INPUTS);
     if (pthread_mutex_init(&corpus->lock, NULL) != 0) {
         ginger_log(ERROR, "Failed to init corpus mutex!\n");
         abort();
     }
+    corpus_load_inputs(corpus_dir, corpus);
+    corpus->coverage = coverage_create();
     return corpus;
 }
 
 void
 corpus_destroy(corpus_t* corpus)
 {
-    for (uint64_t i = 0; i < vector_length(corpus->inputs); i++) {
-        corpus_input_destroy(vector_get(corpus->inputs, i));
+    const uint64_t nb_inputs = corpus_nb_inputs(corpus);
+    for (uint64_t i = 0; i < nb_inputs; i++) {
+        corpus_input_destroy(corpus_get_input(corpus, i));
     }
     vector_destroy(corpus->inputs);
     free(corpus);
@@ -144,6 +186,8 @@ corpus_input_destroy(input_t* input)
     if (input->data) {
         free(input->data);
     }
+    tree_destroy(input->tree);
+    free(input->effector);
 
     // The `input` structure itself should however always be allcated.
     if (input) {
@@ -157,5 +201,8 @@ corpus_input_copy(const input_t* src)
     input_t* dst = corpus_input_create(src->length);
     dst->length  = src->length;
     memcpy(dst->data, src->data, dst->length);
+    if (src->tree) {
+        dst->tree = tree_copy(src->tree);
+    }
     return dst;
 }
@@ -7,20 +7,34 @@
 
 #include "coverage.h"
 
+#include "../grammar/grammar.h"
 #include "../utils/vector.h"
 
 #define MAX_NB_CORPUS_INPUTS 1024
 
+// Offsets of an input where flipping the byte changes the path the target
+// takes, found by its deterministic stage.
 typedef struct {
-    uint8_t* data;
-    uint64_t length;
+    uint64_t nb_offsets;
+    uint32_t offsets[];
+} effector_t;
+
+typedef struct {
+    uint8_t*    data;
+    uint64_t    length;
+    tree_t*     tree;      // Derivation tree the data was serialized from, if any.
+    effector_t* effector;  // Set once the deterministic stage of the input is done.
 } input_t;
 
 typedef struct {
-    vector_t*       inputs;
-    coverage_t*     coverage;
-    // Lock for synchronization of writes to the `inputs` vector.
-    pthread_mutex_t lock;
+    vector_t*        inputs;
+    coverage_t*      coverage;
+    // Grammar to generate inputs from, or NULL.
+    const grammar_t* grammar;
+    // Lock for synchronization of writes to the `inputs` vector. It is created
+    // with room for `MAX_NB_CORPUS_INPUTS`, so that the inputs never move, and
+    // is read without the lock, through `corpus_get_input`.
+    pthread_mutex_t  lock;
 } corpus_t;
 
 // Create corpus structure, containing one input per file in the provided
@@ -33,9 +47,29 @@ corpus_destroy(corpus_t* corpus);
 
 // Copies the data from the input pointed to by `input_ptr` to the corpus.
 // This needs to be thread safe, as multiple fuzzers can add inputs
-// simultaneously.
+// simultaneously. The index of the input is written to `idx`, unless it is
+// NULL.
 bool
-corpus_add_input(corpus_t* corpus, input_t* input_ptr);
+corpus_add_input(corpus_t* corpus, input_t* input_ptr, uint64_t* idx);
+
+// Number of inputs which other threads have finished adding, and which can be
+// read without the lock.
+uint64_t
+corpus_nb_inputs(const corpus_t* corpus);
+
+// Input `idx`, which has to be below `corpus_nb_inputs`. Safe without the
+// lock, unlike `vector_get`, which reads the length non-atomically.
+input_t*
+corpus_get_input(const corpus_t* corpus, uint64_t idx);
+
+// Attach the effector map of input `idx`. Other threads may read it as soon
+// as this returns.
+void
+corpus_set_effector(corpus_t* corpus, uint64_t idx, effector_t* effector);
+
+// The effector map of `input`, or NULL if it has none yet.
+const effector_t*
+corpus_input_effector(const input_t* input);
 
 void
 corpus_print(corpus_t*);
@@ -17,6 +17,15 @@ typedef struct {
     uint8_t hashes[MAX_NB_COVERAGE_HASHES];
 } coverage_t;
 
+// Fold a taken branch into the hash of the path of a fuzzcase. The hash
+// depends on the order of the branches and on how often each is taken, so
+// that fuzzcases taking the same path hash the same.
+static inline uint64_t
+coverage_path_hash(uint64_t hash, uint64_t from, uint64_t to)
+{
+    return (hash ^ (from * 0x9e3779b97f4a7c15ULL) ^ to) * 0xff51afd7ed558ccdULL;
+}
+
 // Returns true and marks the branch as covered if it has not been taken before.
 // Otherwise, return false.
 bool
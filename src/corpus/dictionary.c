@@ -0,0 +1,144 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dictionary.h"
+
+#include "../utils/logger.h"
+
+bool
+dictionary_add(dictionary_t* dict, const uint8_t* data, size_t length)
+{
+    if (length == 0 || length > DICTIONARY_MAX_TOKEN_LEN || dict->nb_tokens >= DICTIONARY_MAX_NB_TOKENS) {
+        return false;
+    }
+    // The dictionary is small and only built at startup, a linear search for
+    // duplicates is fine.
+    for (size_t i = 0; i < dict->nb_tokens; i++) {
+        const token_t* token = &dict->tokens[i];
+        if (token->length == length && memcmp(token->data, data, length) == 0) {
+            return true;
+        }
+    }
+    token_t* token = &dict->tokens[dict->nb_tokens++];
+    memcpy(token->data, data, length);
+    token->length = length;
+    return true;
+}
+
+static int
+hex_digit(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+// Parse the quoted token of a dictionary line. Returns the length of the
+// token, or -1 if the line is malformed.
+static int
+parse_line(const char* line, uint8_t token[DICTIONARY_MAX_TOKEN_LEN])
+{
+    const char* c = strchr(line, '"');
+    if (!c) {
+        return -1;
+    }
+    c++;
+
+    int length = 0;
+    while (*c != '"') {
+        if (*c == '\0' || length == DICTIONARY_MAX_TOKEN_LEN) {
+            return -1;
+        }
+        if (*c != '\\') {
+            token[length++] = *c++;
+            continue;
+        }
+        c++;
+        if (*c == '\\' || *c == '"') {
+            token[length++] = *c++;
+        }
+        else if (*c == 'x' && hex_digit(c[1]) >= 0 && hex_digit(c[2]) >= 0) {
+            token[length++] = (hex_digit(c[1]) << 4) | hex_digit(c[2]);
+            c += 3;
+        }
+        else {
+            return -1;
+        }
+    }
+    return length;
+}
+
+bool
+dictionary_load_file(dictionary_t* dict, const char* path)
+{
+    FILE* fp = fopen(path, "r");
+    if (!fp) {
+        ginger_log(ERROR, "Could not open dictionary file %s\n", path);
+        return false;
+    }
+
+    bool    ok       = true;
+    char*   line     = NULL;
+    size_t  line_len = 0;
+    size_t  line_nb  = 0;
+    while (getline(&line, &line_len, fp) != -1) {
+        line_nb++;
+
+        const char* start = line;
+        while (isspace((unsigned char)*start)) {
+            start++;
+        }
+        if (*start == '\0' || *start == '#') {
+            continue;
+        }
+
+        uint8_t token[DICTIONARY_MAX_TOKEN_LEN];
+        const int length = parse_line(start, token);
+        if (length <= 0) {
+            ginger_log(ERROR, "Malformed token on line %lu of dictionary file %s\n", line_nb, path);
+            ok = false;
+            break;
+        }
+        if (!dictionary_add(dict, token, length)) {
+            ginger_log(WARNING, "Dictionary is full, ignoring the rest of %s\n", path);
+            break;
+        }
+    }
+    free(line);
+    fclose(fp);
+    return ok;
+}
+
+dictionary_t*
+dictionary_create(void)
+{
+    dictionary_t* dict = calloc(1, sizeof(dictionary_t));
+    if (!dict) {
+        ginger_log(ERROR, "[%s] Could not allocate dictionary!\n", __func__);
+        abort();
+    }
+    dict->tokens = calloc(DICTIONARY_MAX_NB_TOKENS, sizeof(token_t));
+    if (!dict->tokens) {
+        ginger_log(ERROR, "[%s] Could not allocate dictionary tokens!\n", __func__);
+        abort();
+    }
+    return dict;
+}
+
+void
+dictionary_destroy(dictionary_t* dict)
+{
+    if (dict) {
+        free(dict->tokens);
+        free(dict);
+    }
+}
@@ -0,0 +1,51 @@
+/**
+ * Token dictionary.
+ *
+ * Byte sequences which the target is likely to compare its input against,
+ * such as strings, magic numbers and the constants of comparisons. The
+ * mutator inserts tokens into fuzzcases and overwrites parts of them with
+ * tokens, which reaches checks random byte mutations practically never get
+ * past. Tokens are extracted from the target ELF when it is loaded, and can be
+ * extended with a dictionary file.
+ */
+
+#ifndef DICTIONARY_H
+#define DICTIONARY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define DICTIONARY_MAX_NB_TOKENS 1024
+#define DICTIONARY_MAX_TOKEN_LEN 64
+
+typedef struct {
+    uint8_t data[DICTIONARY_MAX_TOKEN_LEN];
+    size_t  length;
+} token_t;
+
+typedef struct {
+    token_t* tokens;
+    size_t   nb_tokens;
+} dictionary_t;
+
+// Add a token, unless it is already in the dictionary. Returns false if the
+// token is empty or too long, or the dictionary is full.
+bool
+dictionary_add(dictionary_t* dict, const uint8_t* data, size_t length);
+
+// Add the tokens of a dictionary file, in the format used by AFL. Every line
+// holds a token as a double quoted string, optionally preceded by a name and
+// `=`. `\\`, `\"` and `\xNN` are the escapes. Lines starting with `#` are
+// comments. Returns false if the file could not be read or a line is
+// malformed.
+bool
+dictionary_load_file(dictionary_t* dict, const char* path);
+
+dictionary_t*
+dictionary_create(void);
+
+void
+dictionary_destroy(dictionary_t* dict);
+
+#endif
@@ -9,6 +9,7 @@
 
 #include "../emu/emu_generic.h"
 #include "../utils/cli.h"
+#include "../utils/endianess.h"
 #include "../utils/logger.h"
 #include "../utils/print_utils.h"
 #include "../utils/vector.h"
@@ -16,10 +17,35 @@
 #define MAX_NB_BREAKPOINTS 256
 #define MAX_LEN_REG_STR    4
 
+// Longest byte sequence `smem` can search for.
+#define MAX_LEN_SEARCH_NEEDLE 256
+
 // Required amount of characters to display the larges integer supported by an
 // 64 bit system.
 #define MAX_NB_EXAMINE_ADDRESS 19
 
+// Guest memory range watched for accesses.
+typedef struct {
+    uint64_t adr;
+    uint64_t len;
+    uint8_t  perms; // MMU_PERM_WATCH_WRITE and/or MMU_PERM_WATCH_READ.
+} mem_watchpoint_t;
+
+typedef enum {
+    DEBUG_CLI_STATUS_OK,
+    DEBUG_CLI_STATUS_FAILED,
+    DEBUG_CLI_STATUS_GO,
+} enum_debug_cli_status_t;
+
+// What the commands have set up, which lasts across runs of the CLI and of
+// scripts.
+typedef struct {
+    vector_t*           breakpoints;
+    vector_t*           watchpoints;
+    vector_t*           mem_watchpoints;
+    debug_cli_result_t* result;
+} debug_cli_session_t;
+
 static const char size_letters[]              = { 'b', 'h', 'w', 'g' };
 static const int  nb_size_letters             = sizeof(size_letters) / sizeof (size_letters[0]);
 static const char reg_strs[][MAX_LEN_REG_STR] = { "ra", "sp", "gp", "tp", "t0", "t1", "t2", "fp", "s1", "a0", "a1",
@@ -34,10 +60,17 @@ static const char* debug_instructions = "\n"                      \
     " ir        Show emulator registers.\n"                       \
     " break     Set breakpoint.\n"                                \
     " sbreak    Show all breakpoints.\n"                          \
+    " mwatch    Set memory watchpoint.\n"                         \
+    " swatch    Show all watchpoints.\n"                          \
     " continue  Run emulator until breakpoint or program exit.\n" \
     " snapshot  Take a snapshot of the current emulator state.\n" \
+    " autosnap  Snapshot before the first read of the buffer.\n"  \
     " adr       Set the address of the target buffer to fuzz.\n"  \
     " length    Set the length of the target buffer to fuzz.\n"   \
+    " inject    Add a slot or a sink to the injection layout.\n"  \
+    " end       Add an address which ends the fuzzcases.\n"      \
+    " save      Save the snapshot and the layout to a file.\n"   \
+    " load      Load a snapshot and its layout from a file.\n"   \
     " go        Start the fuzzer.\n"                              \
     " options   Show values of the adjustable options.\n"         \
     " help      Print this help.\n"                               \
@@ -102,7 +135,58 @@ is_reg_str(const char* reg_str)
     return false;
 }
 
+// Whether `len` bytes at `adr` are all in the heap and stack, below
+// `curr_alloc_adr`, or all in the mmap regions, from `mmap_floor_adr` up.
+static bool
+is_allocated(const mmu_t* mmu, uint64_t adr, uint64_t len)
+{
+    if (len == 0) {
+        return false;
+    }
+    if (adr < mmu->curr_alloc_adr) {
+        return len <= mmu->curr_alloc_adr - adr;
+    }
+    return adr >= mmu->mmap_floor_adr && adr < mmu->memory_size && len <= mmu->memory_size - adr;
+}
+
+// Parse the name of a guest register into its number. Risc V registers go by
+// their ABI names, MIPS registers by `r0` - `r31`.
+static bool
+parse_reg(const char* reg_str, uint8_t* reg)
+{
+    if (global_config_get_arch() == ENUM_SUPPORTED_ARCHS_MIPS64_MSB) {
+        if (reg_str[0] != 'r' || reg_str[1] == '\0' || !is_number(reg_str + 1, 10)) {
+            return false;
+        }
+        const uint64_t nb = strtoul(reg_str + 1, NULL, 10);
+        if (nb > 31) {
+            return false;
+        }
+        *reg = MIPS64MSB_REG_R0 + nb;
+        return true;
+    }
+    // The program counter is not a register a fuzzcase can be put in.
+    for (int i = 0; i < nb_reg_strs - 1; i++) {
+        if (strcmp(reg_str, reg_strs[i]) == 0) {
+            *reg = i + 1;
+            return true;
+        }
+    }
+    return false;
+}
+
 static void
+print_reg(uint8_t reg)
+{
+    if (global_config_get_arch() == ENUM_SUPPORTED_ARCHS_MIPS64_MSB) {
+        printf("r%u", reg);
+    }
+    else {
+        printf("%s", reg_strs[reg - 1]);
+    }
+}
+
+static bool
 debug_cli_handle_xmem(emu_t* emu, const token_str_t* xmem_args)
 {
     char     size_letter = 'w';
@@ -112,121 +196,217 @@ debug_cli_handle_xmem(emu_t* emu, const token_str_t* xmem_args)
     if (xmem_args->nb_tokens == 4) {
         if (!is_number(xmem_args->tokens[3], 16)) {
             printf("\nInvalid address!\n");
-            return;
+            return false;
         }
         adr = strtoul(xmem_args->tokens[3], NULL, 16);
         if (strlen(xmem_args->tokens[2]) > 1) {
             printf("\nInvalid size letter!\n");
-            return;
+            return false;
         }
         size_letter = xmem_args->tokens[2][0];
         if (!is_number(xmem_args->tokens[1], 10)) {
             printf("\nInvalid range!\n");
-            return;
+            return false;
         }
         range = strtoul(xmem_args->tokens[1], NULL, 10);
     }
     else if (xmem_args->nb_tokens == 3) {
         if (!is_number(xmem_args->tokens[2], 16)) {
             printf("\nInvalid address!\n");
-            return;
+            return false;
         }
         adr = strtoul(xmem_args->tokens[2], NULL, 16);
         if (strlen(xmem_args->tokens[1]) > 1) { // TODO
             printf("\nInvalid size letter!\n");
-            return;
+            return false;
         }
         size_letter = xmem_args->tokens[1][0];
     }
     else if (xmem_args->nb_tokens == 2) {
         if (!is_number(xmem_args->tokens[1], 16)) {
             printf("\nInvalid address!\n");
-            return;
+            return false;
         }
         adr = strtoul(xmem_args->tokens[1], NULL, 16);
     }
     else {
         printf("\nInvalid number of args to xmem!\n");
-        return;
+        return false;
     }
     mmu_t* mmu = emu->get_mmu(emu);
     mmu->print(mmu, adr, range, size_letter);
+    return true;
+}
+
+// Parse a permission filter like `rw` or `x`. Returns false on invalid letters.
+static bool
+parse_perm_filter(const char* perm_str, uint8_t* perms)
+{
+    *perms = 0;
+    for (size_t i = 0; perm_str[i]; i++) {
+        switch (perm_str[i]) {
+            case 'r':
+                *perms |= MMU_PERM_READ;
+                break;
+            case 'w':
+                *perms |= MMU_PERM_WRITE;
+                break;
+            case 'x':
+                *perms |= MMU_PERM_EXEC;
+                break;
+            default:
+                return false;
+        }
+    }
+    return true;
+}
+
+// Parse a string of hex digits, like `deadbeef`, into bytes in the order they
+// are written. Returns the number of bytes, or 0 if the string is invalid.
+static size_t
+parse_hex_bytes(const char* hex_str, uint8_t* bytes, size_t max_nb_bytes)
+{
+    if (strncmp(hex_str, "0x", 2) == 0) {
+        hex_str += 2;
+    }
+    const size_t len = strlen(hex_str);
+    if (len == 0 || len % 2 != 0 || len / 2 > max_nb_bytes || !is_number(hex_str, 16)) {
+        return 0;
+    }
+    for (size_t i = 0; i < len / 2; i++) {
+        const char byte_str[3] = { hex_str[2 * i], hex_str[(2 * i) + 1], '\0' };
+        bytes[i] = strtoul(byte_str, NULL, 16);
+    }
+    return len / 2;
 }
 
 // Search emulator memory for user specified value.
-static void
+static bool
 debug_cli_handle_smem(emu_t* emu, token_str_t* smem_args)
 {
-    char     size_letter = 'b';
-    uint64_t needle      = 0;
+    char    search_letter = 'b';
+    uint8_t needle[MAX_LEN_SEARCH_NEEDLE] = {0};
+    size_t  needle_len    = 0;
+    size_t  alignment     = 1;
+    uint8_t perms         = 0;
+    int     arg_idx       = 1;
 
-    // Three tokens: smem <size_letter> <needle>
-    if (smem_args->nb_tokens == 3) {
-        if (is_number(smem_args->tokens[2], 16)) {
-            needle = strtoul(smem_args->tokens[2], NULL, 16);
+    // smem [search_letter] <needle> [perms]
+    if (smem_args->nb_tokens < 2 || smem_args->nb_tokens > 4) {
+        printf("\nInvalid number of args to smem!\n");
+        return false;
+    }
+    // A single letter is only taken as the search letter when a needle
+    // follows it, so that `smem 5 r` searches for the byte 5.
+    const char* first = smem_args->tokens[arg_idx];
+    if (smem_args->nb_tokens > 2 && strlen(first) == 1 &&
+        (is_size_letter(first[0]) || first[0] == 's' || first[0] == 'a')) {
+        search_letter = first[0];
+        arg_idx++;
+    }
+    if (arg_idx >= smem_args->nb_tokens) {
+        printf("\nMissing needle!\n");
+        return false;
+    }
+    const char* needle_str = smem_args->tokens[arg_idx++];
+    if (arg_idx < smem_args->nb_tokens) {
+        if (!parse_perm_filter(smem_args->tokens[arg_idx++], &perms)) {
+            printf("\nInvalid permissions, use a combination of r, w and x!\n");
+            return false;
         }
-        else {
+    }
+    if (arg_idx != smem_args->nb_tokens) {
+        printf("\nInvalid number of args to smem!\n");
+        return false;
+    }
+
+    if (search_letter == 'a') {
+        // ASCII string, searched for without the terminating null byte.
+        needle_len = strlen(needle_str);
+        if (needle_len > MAX_LEN_SEARCH_NEEDLE) {
+            printf("\nNeedle is too long!\n");
+            return false;
+        }
+        memcpy(needle, needle_str, needle_len);
+    }
+    else if (search_letter == 's') {
+        // Sequence of bytes, searched for in the order they are written.
+        needle_len = parse_hex_bytes(needle_str, needle, MAX_LEN_SEARCH_NEEDLE);
+        if (needle_len == 0) {
+            printf("\nInvalid byte sequence!\n");
+            return false;
+        }
+    }
+    else {
+        if (!is_number(needle_str, 16)) {
             printf("\nInvalid needle!\n");
-            return;
+            return false;
         }
-        if (is_size_letter(smem_args->tokens[1][0])) {
-            size_letter = smem_args->tokens[1][0];
+
+        // Values are searched for aligned to their size and in the byte order
+        // of the guest.
+        switch (search_letter) {
+            case 'b': needle_len = BYTE_SIZE;     break;
+            case 'h': needle_len = HALFWORD_SIZE; break;
+            case 'w': needle_len = WORD_SIZE;     break;
+            case 'g': needle_len = GIANT_SIZE;    break;
         }
-        else {
-            printf("\nInvalid size letter!\n");
-            return;
+        alignment = needle_len;
+
+        const uint64_t value = strtoul(needle_str, NULL, 16);
+        if (needle_len < 8 && (value >> (8 * needle_len)) != 0) {
+            printf("\nNeedle does not fit in size!\n");
+            return false;
         }
-    }
-    // Two tokens: smem <needle>
-    else if (smem_args->nb_tokens == 2) {
-        if (is_number(smem_args->tokens[1], 16)) {
-            needle = strtoul(smem_args->tokens[1], NULL, 16);
+
+        uint8_t value_bytes[8] = {0};
+        if (global_config_get_arch() == ENUM_SUPPORTED_ARCHS_MIPS64_MSB) {
+            u64_to_byte_arr(value, value_bytes, ENUM_ENDIANESS_MSB);
+            memcpy(needle, value_bytes + (8 - needle_len), needle_len);
         }
         else {
-            printf("\nInvalid needle!\n");
-            return;
+            u64_to_byte_arr(value, value_bytes, ENUM_ENDIANESS_LSB);
+            memcpy(needle, value_bytes, needle_len);
         }
     }
-    // Invalid command.
-    else {
-        printf("\nInvalid number of args to smem!\n");
-        return;
-    }
 
     mmu_t* mmu = emu->get_mmu(emu);
-    vector_t* search_result = mmu->search(mmu, needle, size_letter);
+    vector_t* search_result = mmu->search(mmu, needle, needle_len, alignment, perms);
     if (search_result) {
-        printf("\n%zu hit(s) of 0x%zx\n", vector_length(search_result), needle);
+        printf("\n%zu hit(s) of %s\n", vector_length(search_result), needle_str);
         for (size_t i = 0; i < search_result->length; i++) {
             printf("%zu: 0x%lx\n", i + 1, *(size_t*)vector_get(search_result, i));
         }
         vector_destroy(search_result);
     }
     else {
-        printf("\nDid not find 0x%zx in emulator memory\n", needle);
+        printf("\nDid not find %s in emulator memory\n", needle_str);
     }
+    return true;
 }
 
-static void
+static bool
 debug_cli_handle_ni(emu_t* emu)
 {
     emu->execute(emu);
+    return true;
 }
 
-static void
+static bool
 debug_cli_handle_ir(emu_t* emu)
 {
     emu->print_regs(emu);
+    return true;
 }
 
-static void
+static bool
 debug_cli_handle_break(emu_t* emu, token_str_t* break_args, vector_t* breakpoints)
 {
     mmu_t* mmu = emu->get_mmu(emu);
 
     if (break_args->nb_tokens != 2) {
         printf("\nInvalid number of args to break!\n");
-        return;
+        return false;
     }
 
     size_t break_adr = 0;
@@ -236,53 +416,111 @@ debug_cli_handle_break(emu_t* emu, token_str_t* break_args, vector_t* breakpoint
 
     if (break_adr > mmu->memory_size) {
         printf("\nCould not set breakpoint at 0x%zx as it is outside of emulator memory!\n", break_adr);
-        return;
+        return false;
     }
 
     if ((mmu->permissions[break_adr] & MMU_PERM_EXEC) == 0) {
         printf("\nCould not set breakpoint at 0x%zx! No execute permissions!\n", break_adr);
-        return;
+        return false;
     }
     vector_append(breakpoints, &break_adr);
+    return true;
 }
 
-static void
+static bool
 debug_cli_handle_sbreak(emu_t* emu, vector_t* breakpoints)
 {
     size_t nb_breakpoints = vector_length(breakpoints);
     if (nb_breakpoints == 0) {
         printf("\nNo breakpoints\n");
-        return;
+        return true;
     }
 
     printf("\nBreakpoints:\n");
     for (size_t i = 0; i < nb_breakpoints; i++) {
         printf("%zu\t0x%zx\n", i, *(size_t*)vector_get(breakpoints, i));
     }
+    return true;
 }
 
-static void
+static bool
 debug_cli_handle_watch(emu_t* emu, token_str_t* watch_args, vector_t* watchpoints)
 {
     if (watch_args->nb_tokens != 2) {
         printf("\nInvalid number of args to watch!\n");
-        return;
+        return false;
     }
 
     if (!is_reg_str(watch_args->tokens[1])) {
         printf("\nInvalid register!\n");
-        return;
+        return false;
     }
     vector_append(watchpoints, watch_args->tokens[1]);
+    return true;
 }
 
-static void
-debug_cli_handle_swatch(emu_t* emu, vector_t* watchpoints)
+// Watch accesses to a range of guest memory by setting watchpoint bits in its
+// permissions.
+static bool
+debug_cli_handle_mwatch(emu_t* emu, token_str_t* mwatch_args, vector_t* mem_watchpoints)
+{
+    mem_watchpoint_t watchpoint = { .len = 1, .perms = MMU_PERM_WATCH_WRITE };
+
+    // mwatch <adr> [len] [r|w|rw]
+    if (mwatch_args->nb_tokens < 2 || mwatch_args->nb_tokens > 4) {
+        printf("\nInvalid number of args to mwatch!\n");
+        return false;
+    }
+    if (!is_number(mwatch_args->tokens[1], 16)) {
+        printf("\nInvalid address!\n");
+        return false;
+    }
+    watchpoint.adr = strtoul(mwatch_args->tokens[1], NULL, 16);
+
+    if (mwatch_args->nb_tokens > 2) {
+        if (!is_number(mwatch_args->tokens[2], 10)) {
+            printf("\nInvalid length!\n");
+            return false;
+        }
+        watchpoint.len = strtoul(mwatch_args->tokens[2], NULL, 10);
+    }
+    if (mwatch_args->nb_tokens > 3) {
+        const char* mode = mwatch_args->tokens[3];
+        if (strcmp(mode, "r") == 0) {
+            watchpoint.perms = MMU_PERM_WATCH_READ;
+        }
+        else if (strcmp(mode, "w") == 0) {
+            watchpoint.perms = MMU_PERM_WATCH_WRITE;
+        }
+        else if (strcmp(mode, "rw") == 0) {
+            watchpoint.perms = MMU_PERM_WATCH_READ | MMU_PERM_WATCH_WRITE;
+        }
+        else {
+            printf("\nInvalid access mode, use r, w or rw!\n");
+            return false;
+        }
+    }
+
+    mmu_t* mmu = emu->get_mmu(emu);
+    if (!is_allocated(mmu, watchpoint.adr, watchpoint.len)) {
+        printf("\nCould not set watchpoint at 0x%lx as it is outside of allocated memory!\n", watchpoint.adr);
+        return false;
+    }
+    for (uint64_t i = 0; i < watchpoint.len; i++) {
+        mmu->permissions[watchpoint.adr + i] |= watchpoint.perms;
+    }
+    vector_append(mem_watchpoints, &watchpoint);
+    return true;
+}
+
+static bool
+debug_cli_handle_swatch(emu_t* emu, vector_t* watchpoints, vector_t* mem_watchpoints)
 {
-    size_t nb_watchpoints = vector_length(watchpoints);
-    if (nb_watchpoints == 0) {
+    size_t nb_watchpoints     = vector_length(watchpoints);
+    size_t nb_mem_watchpoints = vector_length(mem_watchpoints);
+    if (nb_watchpoints == 0 && nb_mem_watchpoints == 0) {
         printf("\nNo watchpoints\n");
-        return;
+        return true;
     }
 
     printf("\nWatchpoints:\n");
@@ -290,72 +528,481 @@ debug_cli_handle_swatch(emu_t* emu, vector_t* watchpoints)
         char* curr_watchpoint = vector_get(watchpoints, i);
         printf("%zu\t%s\n", i, curr_watchpoint);
     }
+    for (size_t i = 0; i < nb_mem_watchpoints; i++) {
+        const mem_watchpoint_t* curr_watchpoint = vector_get(mem_watchpoints, i);
+        printf("%zu\t0x%lx - 0x%lx\t%s%s\n", nb_watchpoints + i,
+               curr_watchpoint->adr, curr_watchpoint->adr + curr_watchpoint->len - 1,
+               (curr_watchpoint->perms & MMU_PERM_WATCH_READ)  ? "r" : "",
+               (curr_watchpoint->perms & MMU_PERM_WATCH_WRITE) ? "w" : "");
+    }
+    return true;
 }
 
+// Print the value of a watched access, in the byte order of the guest.
+static uint64_t
+watch_value(const uint8_t* value, uint64_t size)
+{
+    const size_t nb_bytes = size < MMU_WATCH_VALUE_SIZE ? size : MMU_WATCH_VALUE_SIZE;
+    if (global_config_get_arch() == ENUM_SUPPORTED_ARCHS_MIPS64_MSB) {
+        return byte_arr_to_u64((uint8_t*)value, nb_bytes, ENUM_ENDIANESS_MSB);
+    }
+    return byte_arr_to_u64((uint8_t*)value, nb_bytes, ENUM_ENDIANESS_LSB);
+}
+
+// Fails if the target exits before a breakpoint or a watchpoint is hit.
 // TODO: Break on register watchpoints.
-static void
+static bool
 debug_cli_handle_continue(emu_t* emu, vector_t* breakpoints)
 {
+    mmu_t* mmu = emu->get_mmu(emu);
+    mmu->watch_hit.hit = false;
+
     for (;;) {
+        const uint64_t prev_pc = emu->get_pc(emu);
         emu->execute(emu);
+        if (emu->get_exit_reason(emu) != EMU_EXIT_REASON_NO_EXIT) {
+            printf("\nTarget exited at PC 0x%lx\n", prev_pc);
+            return false;
+        }
+
+        // Stop after the instruction which accessed watched memory.
+        if (mmu->watch_hit.hit) {
+            const mmu_watch_hit_t* hit = &mmu->watch_hit;
+            printf("\nHit memory watchpoint at PC 0x%lx\n", prev_pc);
+            printf("%s of %lu byte(s) at 0x%lx\n", hit->is_write ? "Write" : "Read", hit->size, hit->adr);
+            if (hit->is_write) {
+                printf("Old value: 0x%lx\nNew value: 0x%lx\n",
+                       watch_value(hit->old_value, hit->size), watch_value(hit->new_value, hit->size));
+            }
+            else {
+                printf("Value: 0x%lx\n", watch_value(hit->old_value, hit->size));
+            }
+            mmu->watch_hit.hit = false;
+            return true;
+        }
+
         for (size_t i = 0; i < vector_length(breakpoints); i++) {
             uint64_t curr_pc = emu->get_pc(emu);
 
             if (curr_pc == *(uint64_t*)vector_get(breakpoints, i)) {
                 printf("\nHit breakpoint %zu\t0x%zx\n", i, curr_pc);
-                return;
+                return true;
             }
         }
     }
 }
 
-static void
+// End addresses are only applied to the snapshot when fuzzing starts, so that
+// they do not stop the emulator while it is being debugged.
+static bool
+debug_cli_handle_end(emu_t* emu, debug_cli_result_t* res, token_str_t* end_args)
+{
+    mmu_t* mmu = emu->get_mmu(emu);
+
+    if (end_args->nb_tokens != 2) {
+        printf("\nInvalid number of args to end!\n");
+        return false;
+    }
+    if (!is_number(end_args->tokens[1], 16)) {
+        printf("\nInvalid end address!\n");
+        return false;
+    }
+    if (res->nb_end_adrs == DEBUG_CLI_MAX_NB_END_ADRS) {
+        printf("\nCan not set more than %d end addresses!\n", DEBUG_CLI_MAX_NB_END_ADRS);
+        return false;
+    }
+
+    const uint64_t end_adr = strtoul(end_args->tokens[1], NULL, 16);
+    if (end_adr >= mmu->memory_size || (mmu->permissions[end_adr] & MMU_PERM_EXEC) == 0) {
+        printf("\nCould not set end address 0x%lx! No execute permissions!\n", end_adr);
+        return false;
+    }
+    res->end_adrs[res->nb_end_adrs++] = end_adr;
+    return true;
+}
+
+static bool
 debug_cli_handle_snapshot(debug_cli_result_t* res, emu_t* snapshot)
 {
     res->snapshot     = snapshot;
     res->snapshot_set = true;
+    return true;
 }
 
-static void
-debug_cli_handle_adr(debug_cli_result_t* res, token_str_t* adr_args)
+// Add the memory slot set by `adr` and `length` to the layout once both are
+// set, and update it when they change. Returns false if the slot is not inside
+// of emulator memory.
+static bool
+debug_cli_update_fuzz_buf_slot(const emu_t* emu, debug_cli_result_t* res)
+{
+    if (!res->fuzz_buf_adr_set || !res->fuzz_buf_size_set) {
+        return true;
+    }
+    const inject_slot_t slot = {
+        .kind     = INJECT_SLOT_MEM,
+        .adr      = res->fuzz_buf_adr,
+        .capacity = res->fuzz_buf_size,
+    };
+    if (res->fuzz_buf_slot_set) {
+        return inject_layout_set_slot(&res->layout, emu, res->fuzz_buf_slot, &slot);
+    }
+    if (!inject_layout_add_slot(&res->layout, emu, &slot)) {
+        return false;
+    }
+    res->fuzz_buf_slot     = res->layout.nb_slots - 1;
+    res->fuzz_buf_slot_set = true;
+    return true;
+}
+
+static bool
+debug_cli_handle_adr(const emu_t* emu, debug_cli_result_t* res, token_str_t* adr_args)
 {
     if (adr_args->nb_tokens != 2) {
         printf("\nInvalid number of args to adr!\n");
-        return;
+        return false;
     }
 
     if (!is_number(adr_args->tokens[1], 16)) {
         printf("\nInvalid address!\n");
-        return;
+        return false;
     }
+    const uint64_t prev_adr     = res->fuzz_buf_adr;
+    const bool     prev_adr_set = res->fuzz_buf_adr_set;
     res->fuzz_buf_adr     = strtoul(adr_args->tokens[1], NULL, 16);
     res->fuzz_buf_adr_set = true;
+    if (!debug_cli_update_fuzz_buf_slot(emu, res)) {
+        res->fuzz_buf_adr     = prev_adr;
+        res->fuzz_buf_adr_set = prev_adr_set;
+        return false;
+    }
+    return true;
 }
 
-static void
-debug_cli_handle_length(debug_cli_result_t* res, token_str_t* length_args)
+static bool
+debug_cli_handle_length(const emu_t* emu, debug_cli_result_t* res, token_str_t* length_args)
 {
     if (length_args->nb_tokens != 2) {
         printf("\nInvalid number of args to length!\n");
-        return;
+        return false;
     }
 
     if (!is_number(length_args->tokens[1], 10)) {
         printf("\nInvalid length!\n");
-        return;
+        return false;
     }
+    const uint64_t prev_size     = res->fuzz_buf_size;
+    const bool     prev_size_set = res->fuzz_buf_size_set;
     res->fuzz_buf_size     = strtoul(length_args->tokens[1], NULL, 10);
     res->fuzz_buf_size_set = true;
+    if (!debug_cli_update_fuzz_buf_slot(emu, res)) {
+        res->fuzz_buf_size     = prev_size;
+        res->fuzz_buf_size_set = prev_size_set;
+        return false;
+    }
+    return true;
 }
 
-static debug_cli_result_t*
-debug_cli_handle_go(debug_cli_result_t* res)
+// Run until the instruction which first reads from [adr, adr + len), and
+// leave the emulator right before it. Loads do not write memory, so restoring
+// the registers the instruction ran with undoes it. Returns the number of
+// instructions run before it, or false if the target exited first.
+static bool
+debug_cli_run_to_first_read(emu_t* emu, uint64_t adr, uint64_t len, uint64_t* nb_instructions)
 {
-    printf("\n");
-    return res;
+    mmu_t* mmu = emu->get_mmu(emu);
+    for (uint64_t i = 0; i < len; i++) {
+        mmu->permissions[adr + i] |= MMU_PERM_WATCH_READ;
+    }
+    mmu->watch_hit.hit = false;
+
+    uint64_t regs[EMU_MAX_NB_REGS];
+    bool     found = false;
+    *nb_instructions = 0;
+    while (emu->get_exit_reason(emu) == EMU_EXIT_REASON_NO_EXIT) {
+        for (uint8_t i = 0; i < emu->get_nb_regs(emu); i++) {
+            regs[i] = emu->get_reg(emu, i);
+        }
+        emu->execute(emu);
+
+        // Reads of other watched memory do not count.
+        const mmu_watch_hit_t* hit = &mmu->watch_hit;
+        if (hit->hit && !hit->is_write && hit->adr < adr + len && hit->adr + hit->size > adr) {
+            for (uint8_t i = 0; i < emu->get_nb_regs(emu); i++) {
+                emu->set_reg(emu, i, regs[i]);
+            }
+            found = true;
+            break;
+        }
+        mmu->watch_hit.hit = false;
+        (*nb_instructions)++;
+    }
+
+    // Only the watch bit goes, the target may have changed the rest of the
+    // permissions, e.g. by writing to raw memory, before the first read.
+    for (uint64_t i = 0; i < len; i++) {
+        mmu->permissions[adr + i] &= ~MMU_PERM_WATCH_READ;
+    }
+    mmu->watch_hit.hit = false;
+    return found;
+}
+
+// Snapshot right before the first read of the fuzzed buffer, which is as late
+// as the fuzzcases can be injected, and inject them there.
+static bool
+debug_cli_handle_autosnap(emu_t* emu, debug_cli_result_t* res, token_str_t* autosnap_args)
+{
+    const mmu_t* mmu = emu->get_mmu(emu);
+    bool         is_arg = false;
+    uint64_t     adr    = 0;
+    uint64_t     len    = 0;
+
+    // autosnap arg <index>
+    if (autosnap_args->nb_tokens == 3 && strcmp(autosnap_args->tokens[1], "arg") == 0) {
+        if (!is_number(autosnap_args->tokens[2], 10)) {
+            printf("\nUsage: autosnap arg <index>\n");
+            return false;
+        }
+        const uint64_t idx = strtoul(autosnap_args->tokens[2], NULL, 10);
+        if (idx >= mmu->nb_args) {
+            printf("\nNo program argument %lu!\n", idx);
+            return false;
+        }
+        is_arg = true;
+        adr    = mmu->arg_adrs[idx];
+        len    = strlen((const char*)mmu->memory + adr) + 1;
+    }
+    // autosnap <adr> <length>
+    else if (autosnap_args->nb_tokens == 3 &&
+             is_number(autosnap_args->tokens[1], 16) &&
+             is_number(autosnap_args->tokens[2], 10)) {
+        adr = strtoul(autosnap_args->tokens[1], NULL, 16);
+        len = strtoul(autosnap_args->tokens[2], NULL, 10);
+    }
+    else {
+        printf("\nUsage: autosnap <address> <length>\n"
+               "       autosnap arg <index>\n");
+        return false;
+    }
+    if (!is_allocated(mmu, adr, len)) {
+        printf("\nBuffer at 0x%lx is outside of allocated memory!\n", adr);
+        return false;
+    }
+
+    const uint64_t start_pc = emu->get_pc(emu);
+    uint64_t       nb_instructions;
+    if (!debug_cli_run_to_first_read(emu, adr, len, &nb_instructions)) {
+        printf("\nTarget exited after %lu instructions without reading 0x%lx - 0x%lx!\n",
+               nb_instructions, adr, adr + len - 1);
+        return false;
+    }
+
+    debug_cli_handle_snapshot(res, emu);
+    if (is_arg) {
+        const inject_slot_t slot = {
+            .kind     = INJECT_SLOT_ARG,
+            .adr      = adr,
+            .capacity = ARG_MAX - 1,
+        };
+        if (!inject_layout_add_slot(&res->layout, emu, &slot)) {
+            return false;
+        }
+    }
+    else {
+        res->fuzz_buf_adr      = adr;
+        res->fuzz_buf_size     = len;
+        res->fuzz_buf_adr_set  = true;
+        res->fuzz_buf_size_set = true;
+        if (!debug_cli_update_fuzz_buf_slot(emu, res)) {
+            return false;
+        }
+    }
+    printf("\nFirst read of 0x%lx - 0x%lx at PC 0x%lx\n", adr, adr + len - 1, emu->get_pc(emu));
+    printf("Snapshot set. Fuzzcases skip the %lu instructions from 0x%lx\n", nb_instructions, start_pc);
+    return true;
+}
+
+// Save everything `go` would hand to the fuzzer, so that later runs can start
+// from the file with `--snapshot` or `load`.
+static bool
+debug_cli_handle_save(const debug_cli_result_t* res, token_str_t* save_args)
+{
+    if (save_args->nb_tokens != 2) {
+        printf("\nInvalid number of args to save!\n");
+        return false;
+    }
+    if (!res->snapshot_set || res->layout.nb_slots == 0) {
+        printf("\nSet a snapshot and an injection slot before saving!\n");
+        return false;
+    }
+    return snapshot_file_save(save_args->tokens[1], res->snapshot, &res->layout, res->end_adrs, res->nb_end_adrs);
+}
+
+// Bring the emulator to a saved snapshot, replacing the layout and the end
+// addresses.
+static bool
+debug_cli_handle_load(emu_t* emu, debug_cli_result_t* res, token_str_t* load_args)
+{
+    if (load_args->nb_tokens != 2) {
+        printf("\nInvalid number of args to load!\n");
+        return false;
+    }
+    snapshot_file_t* file = snapshot_file_open(load_args->tokens[1]);
+    if (!file) {
+        return false;
+    }
+    const bool ok = snapshot_file_load(file, emu, &res->layout, res->end_adrs, &res->nb_end_adrs);
+    snapshot_file_close(file);
+    if (!ok) {
+        printf("\nThe emulator may be in a partially loaded state!\n");
+        return false;
+    }
+    debug_cli_handle_snapshot(res, emu);
+
+    // A single memory slot is what `adr` and `length` set.
+    res->fuzz_buf_adr_set  = inject_layout_is_raw(&res->layout);
+    res->fuzz_buf_size_set = res->fuzz_buf_adr_set;
+    res->fuzz_buf_slot_set = res->fuzz_buf_adr_set;
+    if (res->fuzz_buf_adr_set) {
+        res->fuzz_buf_adr  = res->layout.slots[0].adr;
+        res->fuzz_buf_size = res->layout.slots[0].capacity;
+        res->fuzz_buf_slot = 0;
+    }
+    printf("\nSnapshot loaded. PC: 0x%lx\n", emu->get_pc(emu));
+    return true;
+}
+
+// Parse the destination of a sink, `<reg>` or `<adr> <width>`.
+static bool
+parse_sink_dst(const token_str_t* args, int arg_idx, inject_sink_t* sink)
+{
+    if (args->nb_tokens == arg_idx + 1 && parse_reg(args->tokens[arg_idx], &sink->reg)) {
+        sink->to_reg = true;
+        return true;
+    }
+    if (args->nb_tokens != arg_idx + 2 ||
+        !is_number(args->tokens[arg_idx], 16) ||
+        !is_number(args->tokens[arg_idx + 1], 10)) {
+        return false;
+    }
+    sink->adr   = strtoul(args->tokens[arg_idx], NULL, 16);
+    sink->width = strtoul(args->tokens[arg_idx + 1], NULL, 10);
+    return true;
+}
+
+static bool
+debug_cli_handle_inject(emu_t* emu, debug_cli_result_t* res, token_str_t* inject_args)
+{
+    const mmu_t* mmu = emu->get_mmu(emu);
+
+    if (inject_args->nb_tokens < 3) {
+        printf("\nInvalid number of args to inject!\n");
+        return false;
+    }
+    const char* kind = inject_args->tokens[1];
+
+    // inject mem <adr> <length>
+    if (strcmp(kind, "mem") == 0) {
+        if (inject_args->nb_tokens != 4 ||
+            !is_number(inject_args->tokens[2], 16) ||
+            !is_number(inject_args->tokens[3], 10)) {
+            printf("\nUsage: inject mem <address> <length>\n");
+            return false;
+        }
+        const inject_slot_t slot = {
+            .kind     = INJECT_SLOT_MEM,
+            .adr      = strtoul(inject_args->tokens[2], NULL, 16),
+            .capacity = strtoul(inject_args->tokens[3], NULL, 10),
+        };
+        return inject_layout_add_slot(&res->layout, emu, &slot);
+    }
+    // inject arg <index>
+    else if (strcmp(kind, "arg") == 0) {
+        if (inject_args->nb_tokens != 3 || !is_number(inject_args->tokens[2], 10)) {
+            printf("\nUsage: inject arg <index>\n");
+            return false;
+        }
+        const uint64_t idx = strtoul(inject_args->tokens[2], NULL, 10);
+        if (idx >= mmu->nb_args) {
+            printf("\nNo program argument %lu!\n", idx);
+            return false;
+        }
+        // Leave room for the terminating null byte.
+        const inject_slot_t slot = {
+            .kind     = INJECT_SLOT_ARG,
+            .adr      = mmu->arg_adrs[idx],
+            .capacity = ARG_MAX - 1,
+        };
+        return inject_layout_add_slot(&res->layout, emu, &slot);
+    }
+    // inject reg <reg>
+    else if (strcmp(kind, "reg") == 0) {
+        inject_slot_t slot = { .kind = INJECT_SLOT_REG };
+        if (inject_args->nb_tokens != 3 || !parse_reg(inject_args->tokens[2], &slot.reg)) {
+            printf("\nUsage: inject reg <register>\n");
+            return false;
+        }
+        return inject_layout_add_slot(&res->layout, emu, &slot);
+    }
+    // inject len|ptr <slot> <reg>
+    // inject len|ptr <slot> <adr> <width>
+    else if (strcmp(kind, "len") == 0 || strcmp(kind, "ptr") == 0) {
+        inject_sink_t sink = { .kind = strcmp(kind, "len") == 0 ? INJECT_SINK_LEN : INJECT_SINK_PTR };
+        if (!is_number(inject_args->tokens[2], 10) || !parse_sink_dst(inject_args, 3, &sink)) {
+            printf("\nUsage: inject %s <slot> <register>\n"
+                   "       inject %s <slot> <address> <width>\n", kind, kind);
+            return false;
+        }
+        sink.slot = strtoul(inject_args->tokens[2], NULL, 10);
+        return inject_layout_add_sink(&res->layout, emu, &sink);
+    }
+    printf("\nUnknown injection target '%s', use mem, arg, reg, len or ptr!\n", kind);
+    return false;
 }
 
 static void
+debug_cli_print_layout(const inject_layout_t* layout)
+{
+    static const char* sink_strs[] = { "len", "ptr" };
+
+    printf("\nInjection slots:\n");
+    for (size_t i = 0; i < layout->nb_slots; i++) {
+        const inject_slot_t* slot = &layout->slots[i];
+        switch (slot->kind)
+        {
+        case INJECT_SLOT_MEM:
+            printf("%zu\tmem\t0x%lx\t%lu bytes\n", i, slot->adr, slot->capacity);
+            break;
+        case INJECT_SLOT_ARG:
+            printf("%zu\targ\t0x%lx\t%lu bytes\n", i, slot->adr, slot->capacity);
+            break;
+        case INJECT_SLOT_REG:
+            printf("%zu\treg\t", i);
+            print_reg(slot->reg);
+            printf("\n");
+            break;
+        }
+    }
+    for (size_t i = 0; i < layout->nb_sinks; i++) {
+        const inject_sink_t* sink = &layout->sinks[i];
+        printf("%s of %zu -> ", sink_strs[sink->kind], sink->slot);
+        if (sink->to_reg) {
+            print_reg(sink->reg);
+            printf("\n");
+        }
+        else {
+            printf("0x%lx, %u bytes\n", sink->adr, sink->width);
+        }
+    }
+    printf("Largest fuzzcase: %lu bytes", inject_layout_capacity(layout));
+}
+
+static void
+debug_cli_handle_go(void)
+{
+    printf("\n");
+}
+
+static bool
 debug_cli_handle_options(debug_cli_result_t* res)
 {
     if (res->fuzz_buf_adr_set) {
@@ -372,6 +1019,14 @@ debug_cli_handle_options(debug_cli_result_t* res)
         printf("\nTarget buffer length NOT set.");
     }
 
+    if (res->layout.nb_slots > 0) {
+        debug_cli_print_layout(&res->layout);
+    }
+
+    for (size_t i = 0; i < res->nb_end_adrs; i++) {
+        printf("\nEnd address:  0x%lx", res->end_adrs[i]);
+    }
+
     if (res->snapshot_set) {
         switch (global_config_get_arch())
         {
@@ -390,28 +1045,30 @@ debug_cli_handle_options(debug_cli_result_t* res)
         printf("\nSnapshot NOT set.");
     }
     printf("\n");
+    return true;
 }
 
-static void
+static bool
 debug_cli_handle_help(cli_t* cli, token_str_t* help_args)
 {
     if (help_args->nb_tokens == 1) {
         printf("%s", debug_instructions);
-        return;
+        return true;
     }
     else if (help_args->nb_tokens > 2) {
         printf("\nInvalid number of args to help!\n");
-        return;
+        return false;
     }
 
     for (int i = 0; i < vector_length(cli->commands); i++) {
         struct cli_cmd* cmd = vector_get(cli->commands, i);
         if (strcmp(cmd->cmd_str, help_args->tokens[1]) == 0) {
             printf("\n%s", cmd->description);
-            return;
+            return true;
         }
     }
     printf("\nNo help for '%s' found.\n", help_args->tokens[1]);
+    return false;
 }
 
 static void
@@ -436,13 +1093,20 @@ debug_cli_create(void)
         },
         {
             .cmd_str = "smem",
-            .description = "Search for sequence of bytes in guest memory.\n"                      \
-                           "Examples:\n"                                                          \
-                           "smem b 0xff               // Byte aligned search of '0xff'.\n"        \
-                           "smem h 0xabcd             // Half word aligned search of '0xabcd'.\n" \
-                           "smem w 0xcafebabe         // Word aligned search of '0xcafebabe'.\n"  \
-                           "smem g 0xdeadc0dedeadbeef // Double word aligned search of '0xdeadc0dedeadbeef'.\n"
-                           "sm 0xff                   // Byte aligned search of '0xff'.\n"        \
+            .description = "Search for sequence of bytes in the allocated parts of guest memory.\n"      \
+                           "Values are searched for in the byte order of the guest. An optional\n"     \
+                           "permission filter of r, w and x only reports hits with those permissions.\n" \
+                           "Examples:\n"                                                                \
+                           "smem b 0xff               // Byte aligned search of '0xff'.\n"              \
+                           "smem h 0xabcd             // Half word aligned search of '0xabcd'.\n"       \
+                           "smem w 0xcafebabe         // Word aligned search of '0xcafebabe'.\n"        \
+                           "smem g 0xdeadc0dedeadbeef // Double word aligned search of '0xdeadc0dedeadbeef'.\n" \
+                           "smem s deadbeef           // Search for the bytes 'de ad be ef', in that order.\n" \
+                           "smem a AAAA rw            // Search for 'AAAA' in readable and writeable memory.\n" \
+                           "sm 0xff                   // Byte aligned search of '0xff'.\n"              \
+                           "smem 5 r                  // Byte aligned search of '0x5' in readable memory.\n" \
+                           "smem b a x                // A single letter before the needle is the size,\n" \
+                           "                          // so the byte '0xa' needs it.\n"                \
         },
         {
             .cmd_str = "ni",
@@ -462,6 +1126,15 @@ debug_cli_create(void)
             .description = "Set register watchpoint.\n" \
                            "Example: watch sp\n"
         },
+        {
+            .cmd_str = "mwatch",
+            .description = "Set memory watchpoint. Stops `continue` after the instruction accessing\n" \
+                           "the watched range. Watches writes by default.\n"                        \
+                           "Usage: mwatch <address> [length] [r|w|rw]\n"                             \
+                           "Examples:\n"                                                              \
+                           "mwatch 0x1ffea8           // Watch writes to 0x1ffea8.\n"                \
+                           "mwatch 0x1ffea8 4 rw      // Watch reads and writes of 0x1ffea8 - 0x1ffeab.\n"
+        },
         {
             .cmd_str = "sbreak",
             .description = "Show all breakpoints.\n"
@@ -472,12 +1145,24 @@ debug_cli_create(void)
         },
         {
             .cmd_str = "continue",
-            .description = "Run emulator until breakpoint or program exit.\n"
+            .description = "Run emulator until breakpoint, memory watchpoint or program exit.\n"
         },
         {
             .cmd_str = "snapshot",
             .description = "Take a snapshot.\n"
         },
+        {
+            .cmd_str = "autosnap",
+            .description = "Run until the first instruction which reads the buffer to fuzz, take the\n" \
+                           "snapshot right before it and inject the fuzzcases to the buffer. The\n"   \
+                           "buffer is watched with a bit in its permissions, like `mwatch`. A\n"      \
+                           "program argument is watched up to its null byte.\n"                      \
+                           "Usage: autosnap <address> <length>\n"                                    \
+                           "       autosnap arg <index>\n"                                           \
+                           "Examples:\n"                                                              \
+                           "autosnap 0x1ffea8 64      // Snapshot before 0x1ffea8 - 0x1ffee7 is read.\n" \
+                           "autosnap arg 1            // Snapshot before the first argument is read.\n"
+        },
         {
             .cmd_str = "adr",
             .description = "Set the address in guest memory where fuzzed input will be injected.\n" \
@@ -489,6 +1174,45 @@ debug_cli_create(void)
             .description = "Set the fuzzer injection input length.\n" \
                            "Example: length 4\n"
         },
+        {
+            .cmd_str = "inject",
+            .description = "Add a slot the fuzzcases are split across, or a sink which writes the\n"     \
+                           "length or address of a slot to a register or a variable. Memory and\n"     \
+                           "argument slots but the last are preceded in the fuzzcase by a 16 bit\n"    \
+                           "little endian length, register slots take 8 bytes. `adr` and `length`\n"  \
+                           "add a memory slot too.\n"                                                   \
+                           "Usage: inject mem <address> <length>\n"                                    \
+                           "       inject arg <index>\n"                                               \
+                           "       inject reg <register>\n"                                            \
+                           "       inject len|ptr <slot> <register>\n"                                 \
+                           "       inject len|ptr <slot> <address> <width>\n"                          \
+                           "Examples:\n"                                                                \
+                           "inject mem 0x1ffea8 64    // Fuzz 64 bytes at 0x1ffea8.\n"                 \
+                           "inject ptr 0 a0           // Point a0 to slot 0.\n"                        \
+                           "inject len 0 a1           // Put the length of slot 0 in a1.\n"            \
+                           "inject arg 1              // Fuzz the first program argument.\n"           \
+                           "inject len 1 0x1ffe00 4   // Write its length to a 32 bit variable.\n"
+        },
+        {
+            .cmd_str = "end",
+            .description = "Add an address which ends the fuzzcases gracefully when it is reached,\n" \
+                           "before the instruction there runs. Use it to skip cleanup which never\n"  \
+                           "has the bugs you are after. Takes effect once fuzzing starts.\n"          \
+                           "Example: end 0x10240\n"
+        },
+        {
+            .cmd_str = "save",
+            .description = "Save the snapshot, the injection layout and the end addresses to a file,\n" \
+                           "to fuzz from with `--snapshot` or `load` without running the target up\n"  \
+                           "to the snapshot again. Only pages which are not all zero are stored.\n"   \
+                           "Example: save target6.snap\n"
+        },
+        {
+            .cmd_str = "load",
+            .description = "Load a snapshot saved with `save`, with its injection layout and end\n"     \
+                           "addresses. The guest memory size has to be the one it was saved with.\n"  \
+                           "Example: load target6.snap\n"
+        },
         {
             .cmd_str = "go",
             .description = "Try to start the fuzzer.\n"
@@ -519,14 +1243,109 @@ debug_cli_create(void)
     return debug_cli;
 }
 
+static debug_cli_session_t*
+debug_cli_session_get(void)
+{
+    static debug_cli_session_t session; // Static variables are zero initialized, at program start.
+    if (!session.result) {
+        session.breakpoints     = vector_create(sizeof(uint64_t));
+        session.watchpoints     = vector_create(sizeof(MAX_LEN_REG_STR));
+        session.mem_watchpoints = vector_create(sizeof(mem_watchpoint_t));
+        session.result          = calloc(1, sizeof(debug_cli_result_t));
+        if (!session.breakpoints || !session.watchpoints || !session.mem_watchpoints || !session.result) {
+            ginger_log(ERROR, "[%s] Out of memory!\n", __func__);
+            abort();
+        }
+    }
+    return &session;
+}
+
+// Run a single command, given by its full name.
+static enum_debug_cli_status_t
+debug_cli_execute(emu_t* emu, cli_t* cli, debug_cli_session_t* session, token_str_t* tokens)
+{
+    const char* command_str = tokens->tokens[0];
+    bool        ok          = false;
+
+    if (strncmp(command_str, "xmem", 4) == 0) {
+        ok = debug_cli_handle_xmem(emu, tokens);
+    }
+    else if (strncmp(command_str, "smem", 4) == 0) {
+        ok = debug_cli_handle_smem(emu, tokens);
+    }
+    else if (strncmp(command_str, "ni", 2) == 0) {
+        ok = debug_cli_handle_ni(emu);
+    }
+    else if (strncmp(command_str, "ir", 2) == 0) {
+        ok = debug_cli_handle_ir(emu);
+    }
+    else if (strncmp(command_str, "break", 5) == 0) {
+        ok = debug_cli_handle_break(emu, tokens, session->breakpoints);
+    }
+    else if (strncmp(command_str, "sbreak", 5) == 0) {
+        ok = debug_cli_handle_sbreak(emu, session->breakpoints);
+    }
+    else if (strncmp(command_str, "watch", 5) == 0) {
+        ok = debug_cli_handle_watch(emu, tokens, session->watchpoints);
+    }
+    else if (strncmp(command_str, "swatch", 5) == 0) {
+        ok = debug_cli_handle_swatch(emu, session->watchpoints, session->mem_watchpoints);
+    }
+    else if (strncmp(command_str, "mwatch", 6) == 0) {
+        ok = debug_cli_handle_mwatch(emu, tokens, session->mem_watchpoints);
+    }
+    else if (strncmp(command_str, "continue", 8) == 0) {
+        ok = debug_cli_handle_continue(emu, session->breakpoints);
+    }
+    else if (strncmp(command_str, "snapshot", 8) == 0) {
+        ok = debug_cli_handle_snapshot(session->result, emu);
+    }
+    else if (strncmp(command_str, "autosnap", 8) == 0) {
+        ok = debug_cli_handle_autosnap(emu, session->result, tokens);
+    }
+    else if (strncmp(command_str, "adr", 3) == 0) {
+        ok = debug_cli_handle_adr(emu, session->result, tokens);
+    }
+    else if (strncmp(command_str, "length", 6) == 0) {
+        ok = debug_cli_handle_length(emu, session->result, tokens);
+    }
+    else if (strncmp(command_str, "inject", 6) == 0) {
+        ok = debug_cli_handle_inject(emu, session->result, tokens);
+    }
+    else if (strncmp(command_str, "end", 3) == 0) {
+        ok = debug_cli_handle_end(emu, session->result, tokens);
+    }
+    else if (strncmp(command_str, "save", 4) == 0) {
+        ok = debug_cli_handle_save(session->result, tokens);
+    }
+    else if (strncmp(command_str, "load", 4) == 0) {
+        ok = debug_cli_handle_load(emu, session->result, tokens);
+    }
+    else if (strncmp(command_str, "go", 2) == 0) {
+        debug_cli_handle_go();
+        return DEBUG_CLI_STATUS_GO;
+    }
+    else if (strncmp(command_str, "options", 7) == 0) {
+        ok = debug_cli_handle_options(session->result);
+    }
+    else if (strncmp(command_str, "help", 4) == 0) {
+        ok = debug_cli_handle_help(cli, tokens);
+    }
+    else if (strncmp(command_str, "quit", 4) == 0) {
+        debug_cli_handle_quit();
+    }
+    else {
+        printf("\nUnknown command '%s'!\n", command_str);
+    }
+    return ok ? DEBUG_CLI_STATUS_OK : DEBUG_CLI_STATUS_FAILED;
+}
+
 // Run the debug CLI. If all result values are set, return a `debug_cli_result_t*`.
 debug_cli_result_t*
 debug_cli_run(emu_t* emu, cli_t* cli)
 {
-    static token_str_t* prev_cli_tokens; // Static variables are zero initialized, at program start.
-    vector_t*           breakpoints = vector_create(sizeof(uint64_t));
-    vector_t*           watchpoints = vector_create(sizeof(MAX_LEN_REG_STR));
-    debug_cli_result_t* cli_result  = calloc(1, sizeof(debug_cli_result_t));
+    static token_str_t*  prev_cli_tokens; // Static variables are zero initialized, at program start.
+    debug_cli_session_t* session = debug_cli_session_get();
 
     for (;;) {
         printf("\n");
@@ -538,73 +1357,110 @@ debug_cli_run(emu_t* emu, cli_t* cli)
 
         // We got no new command but enter was pressed, use the last command instead.
         if (!cli_tokens) {
-            // Use the last command.
-            if (prev_cli_tokens) {
-                cli_tokens = token_str_copy(prev_cli_tokens);
-
-                // Clean up earlier saved command tokens.
-                token_str_destroy(prev_cli_tokens);
-            }
             // If we got no new command, and we have no previous command,
             // simply skip this iteration.
-            else {
+            if (!prev_cli_tokens) {
                 continue;
             }
+            cli_tokens = token_str_copy(prev_cli_tokens);
         }
-        char* command_str = cli_tokens->tokens[0];
 
-        if (strncmp(command_str, "xmem", 4) == 0) {
-            debug_cli_handle_xmem(emu, cli_tokens);
-        }
-        else if (strncmp(command_str, "smem", 4) == 0) {
-            debug_cli_handle_smem(emu, cli_tokens);
-        }
-        else if (strncmp(command_str, "ni", 2) == 0) {
-            debug_cli_handle_ni(emu);
-        }
-        else if (strncmp(command_str, "ir", 2) == 0) {
-            debug_cli_handle_ir(emu);
-        }
-        else if (strncmp(command_str, "break", 5) == 0) {
-            debug_cli_handle_break(emu, cli_tokens, breakpoints);
-        }
-        else if (strncmp(command_str, "sbreak", 5) == 0) {
-            debug_cli_handle_sbreak(emu, breakpoints);
-        }
-        else if (strncmp(command_str, "watch", 5) == 0) {
-            debug_cli_handle_watch(emu, cli_tokens, watchpoints);
-        }
-        else if (strncmp(command_str, "swatch", 5) == 0) {
-            debug_cli_handle_swatch(emu, watchpoints);
-        }
-        else if (strncmp(command_str, "continue", 8) == 0) {
-            debug_cli_handle_continue(emu, breakpoints);
+        const enum_debug_cli_status_t status = debug_cli_execute(emu, cli, session, cli_tokens);
+
+        // Keep the command to repeat it on enter, and free the one before it.
+        token_str_destroy(prev_cli_tokens);
+        prev_cli_tokens = cli_tokens;
+
+        if (status == DEBUG_CLI_STATUS_GO) {
+            session->result->go = true;
+            return session->result;
         }
-        else if (strncmp(command_str, "snapshot", 8) == 0) {
-            debug_cli_handle_snapshot(cli_result, emu);
+    }
+}
+
+// Run the commands of a script, which are completed like in the CLI. Lines
+// which are empty or start with `#` are skipped.
+static debug_cli_result_t*
+debug_cli_run_lines(emu_t* emu, cli_t* cli, char* lines, char delim, const char* source)
+{
+    debug_cli_session_t* session = debug_cli_session_get();
+    size_t               nb_line = 0;
+
+    for (char* line = lines, *next = NULL; line; line = next) {
+        next = strchr(line, delim);
+        if (next) {
+            *next++ = '\0';
         }
-        else if (strncmp(command_str, "adr", 3) == 0) {
-            debug_cli_handle_adr(cli_result, cli_tokens);
+        nb_line++;
+
+        while (*line == ' ' || *line == '\t') {
+            line++;
         }
-        else if (strncmp(command_str, "length", 6) == 0) {
-            debug_cli_handle_length(cli_result, cli_tokens);
+        size_t len = strlen(line);
+        while (len > 0 && (line[len - 1] == ' ' || line[len - 1] == '\t' || line[len - 1] == '\r')) {
+            line[--len] = '\0';
         }
-        else if (strncmp(command_str, "go", 2) == 0) {
-            return debug_cli_handle_go(cli_result);
+        if (len == 0 || *line == '#') {
+            continue;
         }
-        else if (strncmp(command_str, "options", 7) == 0) {
-            debug_cli_handle_options(cli_result);
+
+        printf("\n%s%s", cli->prompt_str, line);
+        token_str_t* tokens = cli->parse_command(cli, line);
+        if (!tokens) {
+            printf("\n");
+            ginger_log(ERROR, "%s:%lu: Unknown command '%s'\n", source, nb_line, line);
+            return NULL;
         }
-        else if (strncmp(command_str, "help", 4) == 0) {
-            debug_cli_handle_help(cli, cli_tokens);
+        const enum_debug_cli_status_t status = debug_cli_execute(emu, cli, session, tokens);
+        token_str_destroy(tokens);
+
+        if (status == DEBUG_CLI_STATUS_FAILED) {
+            ginger_log(ERROR, "%s:%lu: Command failed: %s\n", source, nb_line, line);
+            return NULL;
         }
-        else if (strncmp(command_str, "quit", 4) == 0) {
-            debug_cli_handle_quit();
+        if (status == DEBUG_CLI_STATUS_GO) {
+            session->result->go = true;
+            break;
         }
+    }
+    return session->result;
+}
 
-        // Free the heap allocated user input string.
-        cli->free_user_input(cli_tokens);
+debug_cli_result_t*
+debug_cli_run_script(emu_t* emu, cli_t* cli, const char* path)
+{
+    FILE* fp = fopen(path, "rb");
+    if (!fp) {
+        ginger_log(ERROR, "Could not open script %s!\n", path);
+        return NULL;
+    }
+    fseek(fp, 0, SEEK_END);
+    const long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    char* script = calloc(size + 1, 1);
+    if (!script || fread(script, 1, size, fp) != (size_t)size) {
+        ginger_log(ERROR, "Could not read script %s!\n", path);
+        fclose(fp);
+        free(script);
+        return NULL;
+    }
+    fclose(fp);
+
+    debug_cli_result_t* result = debug_cli_run_lines(emu, cli, script, '\n', path);
+    free(script);
+    return result;
+}
+
+debug_cli_result_t*
+debug_cli_run_commands(emu_t* emu, cli_t* cli, const char* commands)
+{
+    char* copy = strdup(commands);
+    if (!copy) {
+        ginger_log(ERROR, "[%s] Could not copy the commands!\n", __func__);
+        return NULL;
     }
-    vector_destroy(breakpoints);
-    vector_destroy(watchpoints);
+    debug_cli_result_t* result = debug_cli_run_lines(emu, cli, copy, ';', "--commands");
+    free(copy);
+    return result;
 }
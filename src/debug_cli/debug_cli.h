@@ -3,8 +3,14 @@
 
 #include "../emu/emu_generic.h"
 #include "../main/config.h"
+#include "../snap/inject.h"
+#include "../snap/snapshot_file.h"
 #include "../utils/cli.h"
 
+// Most end addresses which can be set with `end`, all of which fit in a
+// snapshot file.
+#define DEBUG_CLI_MAX_NB_END_ADRS SNAPSHOT_FILE_MAX_NB_END_ADRS
+
 typedef struct {
     emu_t*                 snapshot;          // The starting point of the fuzzcases.
     enum_supported_archs_t arch;              // The arch to cast the snapshot to.
@@ -13,6 +19,12 @@ typedef struct {
     bool                   snapshot_set;      // If the snapshot has been set.
     bool                   fuzz_buf_adr_set;  // If the starting address has been set.
     bool                   fuzz_buf_size_set; // If the fuzzing buffer size has been set.
+    inject_layout_t        layout;            // Where fuzzcases are injected. `adr` and `length` set one of its memory slots.
+    size_t                 fuzz_buf_slot;     // The slot set by `adr` and `length`.
+    bool                   fuzz_buf_slot_set; // If both have been set, and the slot added.
+    uint64_t               end_adrs[DEBUG_CLI_MAX_NB_END_ADRS]; // Addresses which end the fuzzcases, set once fuzzing starts.
+    size_t                 nb_end_adrs;
+    bool                   go;                // If `go` has been run.
 } debug_cli_result_t;
 
 // Give the user the ability to show values in the emulator memory, print
@@ -21,6 +33,17 @@ typedef struct {
 debug_cli_result_t*
 debug_cli_run(emu_t* emu, cli_t* cli);
 
+// Run debug CLI commands without prompting for them, from a script with one
+// per line, or separated by `;`. Commands may be shortened like in the CLI,
+// and empty lines and lines starting with `#` are skipped. Stops after `go`.
+// Returns NULL, after logging the failing line, if a command fails. What the
+// commands set up carries over to later runs of the CLI.
+debug_cli_result_t*
+debug_cli_run_script(emu_t* emu, cli_t* cli, const char* path);
+
+debug_cli_result_t*
+debug_cli_run_commands(emu_t* emu, cli_t* cli, const char* commands);
+
 cli_t*
 debug_cli_create(void);
 
@@ -5,8 +5,15 @@
 #include "elf_loader.h"
 #include "program_header.h"
 
+#include "../corpus/dictionary.h"
 #include "../utils/endianess.h"
 
+// Shortest printable string which is added to the dictionary.
+#define ELF_MIN_STRING_LEN 4
+
+// Section header type of a symbol table.
+#define ELF_SECTION_TYPE_SYMTAB 2
+
 static enum_elf_type_t
 parse_type(uint8_t* elf_bytes, enum_bitsize_t bitsize, enum_endianess_t endianess)
 {
@@ -130,6 +137,228 @@ parse_program_headers(elf_t* elf)
 {
 }
 
+// Add the NUL terminated printable strings of a segment to the dictionary.
+static void
+extract_strings(elf_t* elf, const program_header_t* segment)
+{
+    const uint8_t* bytes = elf->data + segment->offset;
+    size_t         start = 0;
+
+    for (size_t i = 0; i < segment->file_size; i++) {
+        if (bytes[i] >= 0x20 && bytes[i] < 0x7f) {
+            continue;
+        }
+        const size_t length = i - start;
+        if (bytes[i] == '\0' && length >= ELF_MIN_STRING_LEN && length <= DICTIONARY_MAX_TOKEN_LEN) {
+            dictionary_add(elf->dictionary, bytes + start, length);
+        }
+        start = i + 1;
+    }
+}
+
+// Add a constant which the code compares against to the dictionary, encoded
+// the way the target stores it, in the narrowest width which holds it.
+static void
+add_constant(elf_t* elf, int64_t value)
+{
+    // These are compared against everywhere, and are found by the mutator's
+    // arithmetic anyway.
+    if (value >= -1 && value <= 1) {
+        return;
+    }
+
+    size_t width = 8;
+    if (value >= INT8_MIN && value <= UINT8_MAX) {
+        width = 1;
+    }
+    else if (value >= INT16_MIN && value <= UINT16_MAX) {
+        width = 2;
+    }
+    else if (value >= INT32_MIN && value <= UINT32_MAX) {
+        width = 4;
+    }
+
+    uint8_t bytes[8] = {0};
+    u64_to_byte_arr(value, bytes, elf->endianess);
+    const uint8_t* token = elf->endianess == ENUM_ENDIANESS_LSB ? bytes : bytes + 8 - width;
+    dictionary_add(elf->dictionary, token, width);
+}
+
+// Find constants which are loaded into registers and then compared against,
+// by following the registers which hold known constants through straight-line
+// code.
+static void
+extract_cmp_immediates_riscv(elf_t* elf, const program_header_t* segment)
+{
+    bool    known[32]     = {0};
+    int64_t constants[32] = {0};
+
+    for (uint64_t offset = 0; offset + 4 <= segment->file_size; offset += 4) {
+        const uint32_t inst   = byte_arr_to_u64(elf->data + segment->offset + offset, 4, elf->endianess);
+        const uint8_t  opcode = inst & 0x7f;
+        const uint8_t  rd     = (inst >> 7) & 0x1f;
+        const uint8_t  funct3 = (inst >> 12) & 0x7;
+        const uint8_t  rs1    = (inst >> 15) & 0x1f;
+        const uint8_t  rs2    = (inst >> 20) & 0x1f;
+        const int64_t  imm    = (int32_t)inst >> 20;
+
+        // Register zero is always the constant 0.
+        const bool    rs1_known = rs1 == 0 || known[rs1];
+        const int64_t rs1_value = rs1 == 0 ? 0 : constants[rs1];
+
+        switch (opcode)
+        {
+        // LUI.
+        case 0x37:
+            known[rd]     = true;
+            constants[rd] = (int32_t)(inst & 0xfffff000);
+            break;
+        // ADDI, SLTI, SLTIU, XORI, ORI and the rest of OP-IMM.
+        case 0x13:
+            if (funct3 == 2 || funct3 == 3) {
+                add_constant(elf, imm);
+                known[rd] = false;
+            }
+            else if ((funct3 == 0 || funct3 == 4 || funct3 == 6) && rs1_known) {
+                known[rd]     = true;
+                constants[rd] = funct3 == 0 ? rs1_value + imm : funct3 == 4 ? rs1_value ^ imm : rs1_value | imm;
+            }
+            else {
+                known[rd] = false;
+            }
+            break;
+        // ADDIW.
+        case 0x1b:
+            known[rd]     = funct3 == 0 && rs1_known;
+            constants[rd] = (int32_t)(rs1_value + imm);
+            break;
+        // Branches compare two registers.
+        case 0x63:
+            if (rs1 != 0 && known[rs1]) {
+                add_constant(elf, constants[rs1]);
+            }
+            if (rs2 != 0 && known[rs2]) {
+                add_constant(elf, constants[rs2]);
+            }
+            break;
+        // Stores and fences do not write a register.
+        case 0x23:
+        case 0x0f:
+            break;
+        // JAL and JALR. Constants do not survive calls.
+        case 0x6f:
+        case 0x67:
+            memset(known, 0, sizeof(known));
+            break;
+        default:
+            known[rd] = false;
+            break;
+        }
+        known[0] = false;
+    }
+}
+
+static void
+extract_cmp_immediates_mips(elf_t* elf, const program_header_t* segment)
+{
+    bool    known[32]     = {0};
+    int64_t constants[32] = {0};
+
+    for (uint64_t offset = 0; offset + 4 <= segment->file_size; offset += 4) {
+        const uint32_t inst   = byte_arr_to_u64(elf->data + segment->offset + offset, 4, elf->endianess);
+        const uint8_t  opcode = inst >> 26;
+        const uint8_t  rs     = (inst >> 21) & 0x1f;
+        const uint8_t  rt     = (inst >> 16) & 0x1f;
+        const uint8_t  rd     = (inst >> 11) & 0x1f;
+        const int64_t  imm    = (int16_t)(inst & 0xffff);
+
+        // Register zero is always the constant 0.
+        const bool    rs_known = rs == 0 || known[rs];
+        const int64_t rs_value = rs == 0 ? 0 : constants[rs];
+
+        switch (opcode)
+        {
+        // SPECIAL, which writes rd.
+        case 0x00:
+            known[rd] = false;
+            break;
+        // J and JAL. Constants do not survive calls.
+        case 0x02:
+        case 0x03:
+            memset(known, 0, sizeof(known));
+            break;
+        // BEQ, BNE, BEQL and BNEL compare two registers.
+        case 0x04:
+        case 0x05:
+        case 0x14:
+        case 0x15:
+            if (rs != 0 && known[rs]) {
+                add_constant(elf, constants[rs]);
+            }
+            if (rt != 0 && known[rt]) {
+                add_constant(elf, constants[rt]);
+            }
+            break;
+        // ADDIU and DADDIU.
+        case 0x09:
+        case 0x19:
+            known[rt]     = rs_known;
+            constants[rt] = opcode == 0x09 ? (int32_t)(rs_value + imm) : rs_value + imm;
+            break;
+        // SLTI and SLTIU.
+        case 0x0a:
+        case 0x0b:
+            add_constant(elf, imm);
+            known[rt] = false;
+            break;
+        // ORI zero extends its immediate.
+        case 0x0d:
+            known[rt]     = rs_known;
+            constants[rt] = rs_value | (imm & 0xffff);
+            break;
+        // LUI.
+        case 0x0f:
+            known[rt]     = true;
+            constants[rt] = (int32_t)((uint32_t)(imm & 0xffff) << 16);
+            break;
+        // REGIMM branches, stores and cache do not write a register.
+        case 0x01:
+        case 0x28: case 0x29: case 0x2a: case 0x2b: case 0x2c: case 0x2d: case 0x2e: case 0x2f:
+        case 0x3c: case 0x3d: case 0x3e: case 0x3f:
+            break;
+        default:
+            known[rt] = false;
+            break;
+        }
+        known[0] = false;
+    }
+}
+
+// Fill the dictionary of the ELF with strings from its read-only segments
+// and constants compared against by its code.
+static void
+extract_dictionary(elf_t* elf)
+{
+    for (uint64_t i = 0; i < elf->nb_program_headers; i++) {
+        const program_header_t* segment = elf->program_headers[i];
+        if (segment->type != PROGRAM_HEADER_TYPE_LOAD ||
+            segment->offset + segment->file_size > elf->data_length) {
+            continue;
+        }
+        if (!(segment->flags & PROGRAM_HEADER_FLAG_WRITE)) {
+            extract_strings(elf, segment);
+        }
+        if (segment->flags & PROGRAM_HEADER_FLAG_EXEC) {
+            if (elf->machine == ELF_MACHINE_RISCV) {
+                extract_cmp_immediates_riscv(elf, segment);
+            }
+            else if (elf->machine == ELF_MACHINE_MIPS) {
+                extract_cmp_immediates_mips(elf, segment);
+            }
+        }
+    }
+}
+
 static char*
 elf_type_to_str(enum_elf_type_t type)
 {
@@ -199,6 +428,10 @@ elf_print(const elf_t* elf)
     sprintf(program_header_size_str, "%lu", elf->program_header_size);
     elf_print_append(buf, row_length, "| Program header size: ", program_header_size_str);
 
+    char nb_tokens_str[64] = {0};
+    sprintf(nb_tokens_str, "%lu", elf->dictionary->nb_tokens);
+    elf_print_append(buf, row_length, "| Dictionary tokens: ", nb_tokens_str);
+
     strcat(buf, "+");
     for (size_t i = 0; i < row_length - 1; i++) {
         strcat(buf, "-");
@@ -207,6 +440,67 @@ elf_print(const elf_t* elf)
     printf("%s", buf);
 }
 
+// Fields of a section header used to find the symbol table, which are laid out
+// differently in 32 and 64 bit ELFs.
+typedef struct {
+    uint64_t type;
+    uint64_t offset;
+    uint64_t size;
+    uint64_t link;
+} elf_section_t;
+
+static bool
+parse_section(const elf_t* elf, uint64_t idx, elf_section_t* section)
+{
+    const bool     is_64   = elf->bitsize == ENUM_BITSIZE_64;
+    const uint64_t shoff   = byte_arr_to_u64(elf->data + (is_64 ? ELF_HEADER_FIELD_SHOFF_64 : ELF_HEADER_FIELD_SHOFF_32),
+                                             is_64 ? 8 : 4, elf->endianess);
+    const uint64_t entsize = byte_arr_to_u64(elf->data + (is_64 ? ELF_HEADER_FIELD_SHENTSIZE_64 : ELF_HEADER_FIELD_SHENTSIZE_32),
+                                             2, elf->endianess);
+    const uint64_t adr     = shoff + (idx * entsize);
+    if (shoff == 0 || adr + (is_64 ? 64 : 40) > elf->data_length) {
+        return false;
+    }
+    uint8_t* hdr = elf->data + adr;
+    section->type   = byte_arr_to_u64(hdr + 4, 4, elf->endianess);
+    section->offset = byte_arr_to_u64(hdr + (is_64 ? 24 : 16), is_64 ? 8 : 4, elf->endianess);
+    section->size   = byte_arr_to_u64(hdr + (is_64 ? 32 : 20), is_64 ? 8 : 4, elf->endianess);
+    section->link   = byte_arr_to_u64(hdr + (is_64 ? 40 : 24), 4, elf->endianess);
+    return section->offset + section->size <= elf->data_length;
+}
+
+bool
+elf_lookup_symbol(const elf_t* elf, const char* name, uint64_t* value)
+{
+    const bool     is_64    = elf->bitsize == ENUM_BITSIZE_64;
+    const uint64_t sym_size = is_64 ? 24 : 16;
+    const uint64_t nb_sections = byte_arr_to_u64(elf->data + (is_64 ? ELF_HEADER_FIELD_SHNUM_64 : ELF_HEADER_FIELD_SHNUM_32),
+                                                 2, elf->endianess);
+
+    for (uint64_t i = 0; i < nb_sections; i++) {
+        elf_section_t symtab;
+        elf_section_t strtab;
+        if (!parse_section(elf, i, &symtab) || symtab.type != ELF_SECTION_TYPE_SYMTAB ||
+            !parse_section(elf, symtab.link, &strtab)) {
+            continue;
+        }
+        for (uint64_t off = symtab.offset; off + sym_size <= symtab.offset + symtab.size; off += sym_size) {
+            uint8_t*       sym      = elf->data + off;
+            const uint64_t name_off = strtab.offset + byte_arr_to_u64(sym, 4, elf->endianess);
+            const uint64_t shndx    = byte_arr_to_u64(sym + (is_64 ? 6 : 14), 2, elf->endianess);
+            if (shndx == 0 || name_off >= strtab.offset + strtab.size) {
+                continue;
+            }
+            const char* sym_name = (const char*)elf->data + name_off;
+            if (strncmp(sym_name, name, strtab.offset + strtab.size - name_off) == 0) {
+                *value = byte_arr_to_u64(sym + (is_64 ? 8 : 4), is_64 ? 8 : 4, elf->endianess);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
 elf_t*
 elf_create(char* path)
 {
@@ -237,6 +531,7 @@ elf_create(char* path)
 	elf->nb_program_headers    = parse_num_program_headers(elf->data, elf->bitsize, elf->endianess);
 	elf->program_header_offset = parse_program_header_offset(elf->data, elf->bitsize, elf->endianess);
 	elf->program_header_size   = parse_program_header_size(elf->data, elf->bitsize, elf->endianess);
+	elf->machine               = byte_arr_to_u64(elf->data + ELF_HEADER_FIELD_MACHINE, 2, elf->endianess);
     elf->program_headers       = calloc(elf->nb_program_headers, sizeof(program_header_t));
 
     uint64_t program_header_base = elf->program_header_offset;
@@ -245,6 +540,9 @@ elf_create(char* path)
         elf->program_headers[i] = program_header_create(&elf->data[curr_prog_hdr_offset], elf->bitsize, elf->endianess);
     }
 
+    elf->dictionary = dictionary_create();
+    extract_dictionary(elf);
+
     elf_print(elf);
 	return elf;
 }
@@ -256,6 +554,7 @@ elf_destroy(elf_t* elf)
         if (elf->program_headers) {
             free(elf->program_headers);
         }
+        dictionary_destroy(elf->dictionary);
         free(elf);
     }
 }
@@ -1,10 +1,13 @@
 #ifndef ELF_LOADER_H
 #define ELF_LOADER_H
 
+#include <stdbool.h>
 #include <stdint.h>
 
 #include "program_header.h"
 
+#include "../corpus/dictionary.h"
+
 typedef enum {
         ELF_TYPE_NONE   = 0x0000,  // Unknown.
         ELF_TYPE_REL    = 0x0001,  // Relocatable file.
@@ -17,6 +20,11 @@ typedef enum {
         ELF_TYPE_HIPROC = 0xFFFF,
 } enum_elf_type_t;
 
+typedef enum {
+        ELF_MACHINE_MIPS  = 0x0008,
+        ELF_MACHINE_RISCV = 0x00F3,
+} enum_elf_machine_t;
+
 typedef enum {
     ELF_HEADER_FIELD_IDENT        = 0x00,
     ELF_HEADER_FIELD_EICLASS      = 0x04,
@@ -57,11 +65,20 @@ typedef struct{
 	uint8_t* data;
 	uint64_t data_length;
 	uint64_t program_header_size;
+	uint16_t machine;
+	// Strings from the read-only segments and constants which the code
+	// compares against, for the mutator.
+	dictionary_t* dictionary;
 } elf_t;
 
 void
 elf_print(const elf_t* elf);
 
+// Look up the value of the symbol `name` in the symbol table of the ELF.
+// Returns false if it has no symbol table or no defined symbol of that name.
+bool
+elf_lookup_symbol(const elf_t* elf, const char* name, uint64_t* value);
+
 elf_t*
 elf_create(char* path);
 
@@ -6,7 +6,7 @@
 static enum_program_header_type_t
 program_header_parse_type(uint8_t* prog_hdr_bytes, enum_endianess_t endianess)
 {
-    enum_program_header_type_t type = byte_arr_to_u64(prog_hdr_bytes, 4, ENUM_ENDIANESS_MSB);
+    enum_program_header_type_t type = byte_arr_to_u64(prog_hdr_bytes, 4, endianess);
     switch (type)
     {
     case PROGRAM_HEADER_TYPE_NULL:
@@ -19,6 +19,13 @@ typedef enum {
     PROGRAM_HEADER_TYPE_HIPROC  = 0x7FFFFFFF,  // Same as above.
 } enum_program_header_type_t;
 
+// Segment permissions. These have the same values as the MMU permissions.
+typedef enum {
+    PROGRAM_HEADER_FLAG_EXEC  = 0x1,
+    PROGRAM_HEADER_FLAG_WRITE = 0x2,
+    PROGRAM_HEADER_FLAG_READ  = 0x4,
+} enum_program_header_flag_t;
+
 typedef enum {
     PROGRAM_HEADER_FIELD_TYPE      = 0x00,
     PROGRAM_HEADER_FIELD_OFFSET_32 = 0x04,
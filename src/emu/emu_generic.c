@@ -180,6 +180,114 @@ emu_get_pc(const emu_t* self)
     }
 }
 
+uint64_t
+emu_get_reg(const emu_t* self, uint8_t reg)
+{
+    switch (self->arch)
+    {
+        case ENUM_SUPPORTED_ARCHS_RISCV64I_LSB:
+            return self->riscv->get_reg(self->riscv, reg);
+        case ENUM_SUPPORTED_ARCHS_MIPS64_MSB:
+            return self->mips64msb->get_reg(self->mips64msb, reg);
+        default:
+            ginger_log(ERROR, "Unrecognized arch!\n");
+            abort();
+    }
+}
+
+void
+emu_set_reg(emu_t* self, uint8_t reg, uint64_t value)
+{
+    switch (self->arch)
+    {
+        case ENUM_SUPPORTED_ARCHS_RISCV64I_LSB:
+            self->riscv->set_reg(self->riscv, reg, value);
+            break;
+        case ENUM_SUPPORTED_ARCHS_MIPS64_MSB:
+            self->mips64msb->set_reg(self->mips64msb, reg, value);
+            break;
+        default:
+            ginger_log(ERROR, "Unrecognized arch!\n");
+            abort();
+    }
+}
+
+uint8_t
+emu_get_nb_regs(const emu_t* self)
+{
+    switch (self->arch)
+    {
+        case ENUM_SUPPORTED_ARCHS_RISCV64I_LSB:
+            return sizeof(self->riscv->registers) / sizeof(self->riscv->registers[0]);
+        case ENUM_SUPPORTED_ARCHS_MIPS64_MSB:
+            return sizeof(self->mips64msb->registers) / sizeof(self->mips64msb->registers[0]);
+        default:
+            ginger_log(ERROR, "Unrecognized arch!\n");
+            abort();
+    }
+}
+
+// The snapshot bit of the instruction is cleared while it executes, which in
+// copy-on-write mode costs a private copy of the page until the next reset.
+void
+emu_step_over(emu_t* self)
+{
+    mmu_t*         mmu = self->get_mmu(self);
+    const uint64_t pc  = self->get_pc(self);
+
+    switch (self->arch)
+    {
+        case ENUM_SUPPORTED_ARCHS_RISCV64I_LSB:
+            self->riscv->exit_reason = EMU_EXIT_REASON_NO_EXIT;
+            break;
+        case ENUM_SUPPORTED_ARCHS_MIPS64_MSB:
+            self->mips64msb->exit_reason = EMU_EXIT_REASON_NO_EXIT;
+            break;
+        default:
+            ginger_log(ERROR, "Unrecognized arch!\n");
+            abort();
+    }
+    mmu->permissions[pc] &= ~MMU_PERM_SNAPSHOT;
+    self->execute(self);
+    mmu->permissions[pc] |= MMU_PERM_SNAPSHOT;
+}
+
+void
+emu_call(emu_t* self, uint64_t function_adr, uint64_t return_adr)
+{
+    switch (self->arch)
+    {
+        case ENUM_SUPPORTED_ARCHS_RISCV64I_LSB:
+            self->riscv->set_reg(self->riscv, RISC_V_REG_RA, return_adr);
+            self->riscv->set_reg(self->riscv, RISC_V_REG_PC, function_adr);
+            break;
+        case ENUM_SUPPORTED_ARCHS_MIPS64_MSB:
+            // Position independent code expects the address of the function in t9.
+            self->mips64msb->set_reg(self->mips64msb, MIPS64MSB_REG_R31, return_adr);
+            self->mips64msb->set_reg(self->mips64msb, MIPS64MSB_REG_R25, function_adr);
+            self->mips64msb->set_reg(self->mips64msb, MIPS64MSB_REG_PC, function_adr);
+            break;
+        default:
+            ginger_log(ERROR, "Unrecognized arch!\n");
+            abort();
+    }
+}
+
+uint64_t
+emu_get_return_value(const emu_t* self)
+{
+    switch (self->arch)
+    {
+        case ENUM_SUPPORTED_ARCHS_RISCV64I_LSB:
+            return self->riscv->get_reg(self->riscv, RISC_V_REG_A0);
+        case ENUM_SUPPORTED_ARCHS_MIPS64_MSB:
+            return self->mips64msb->get_reg(self->mips64msb, MIPS64MSB_REG_R2);
+        default:
+            ginger_log(ERROR, "Unrecognized arch!\n");
+            abort();
+    }
+}
+
 uint64_t
 emu_get_stack_size(const emu_t* self)
 {
@@ -240,6 +348,21 @@ emu_get_new_coverage(const emu_t* self)
     }
 }
 
+uint64_t
+emu_get_path_hash(const emu_t* self)
+{
+    switch (self->arch)
+    {
+        case ENUM_SUPPORTED_ARCHS_RISCV64I_LSB:
+            return self->riscv->path_hash;
+        case ENUM_SUPPORTED_ARCHS_MIPS64_MSB:
+            return self->mips64msb->path_hash;
+        default:
+            ginger_log(ERROR, "Unrecognized arch!\n");
+            abort();
+    }
+}
+
 corpus_t*
 emu_get_corpus(const emu_t* self)
 {
@@ -256,7 +379,7 @@ emu_get_corpus(const emu_t* self)
 }
 
 emu_t*
-emu_create(enum_supported_archs_t arch, size_t memory_size, corpus_t* corpus)
+emu_create(enum_supported_archs_t arch, size_t memory_size, size_t stack_size, corpus_t* corpus)
 {
     emu_t* emu = calloc(1, sizeof(emu_t));
 
@@ -264,11 +387,11 @@ emu_create(enum_supported_archs_t arch, size_t memory_size, corpus_t* corpus)
     {
         case ENUM_SUPPORTED_ARCHS_RISCV64I_LSB:
         {
-            emu->riscv = riscv_create(memory_size, corpus);
+            emu->riscv = riscv_create(memory_size, stack_size, corpus);
             break;
         }
         case ENUM_SUPPORTED_ARCHS_MIPS64_MSB:
-            emu->mips64msb = mips64msb_create(memory_size, corpus);
+            emu->mips64msb = mips64msb_create(memory_size, stack_size, corpus);
             break;
         default:
             ginger_log(ERROR, "Unrecognized arch!\n");
@@ -287,10 +410,17 @@ emu_create(enum_supported_archs_t arch, size_t memory_size, corpus_t* corpus)
     emu->stack_push       = emu_stack_push;
     emu->get_arch         = emu_get_arch;
     emu->get_pc           = emu_get_pc;
+    emu->get_reg          = emu_get_reg;
+    emu->set_reg          = emu_set_reg;
+    emu->get_nb_regs      = emu_get_nb_regs;
+    emu->step_over        = emu_step_over;
+    emu->call             = emu_call;
+    emu->get_return_value = emu_get_return_value;
     emu->get_stack_size   = emu_get_stack_size;
     emu->get_mmu          = emu_get_mmu;
     emu->get_exit_reason  = emu_get_exit_reason;
     emu->get_new_coverage = emu_get_new_coverage;
+    emu->get_path_hash    = emu_get_path_hash;
     emu->get_corpus       = emu_get_corpus;
 
     return emu;
@@ -14,7 +14,12 @@ static const uint64_t KiB = 1024;
 static const uint64_t MiB = 1024 * 1024;
 static const uint64_t GiB = 1024 * 1024 * 1024;
 
-static const uint64_t EMU_TOTAL_MEM = GiB * 5;
+// Return address given to functions called by the harness mode. It is never
+// mapped, so the function returning to it is told apart from a jump to code.
+#define EMU_RETURN_SENTINEL 0xfffffffffffff000
+
+// Most registers of any backend, counting the pc.
+#define EMU_MAX_NB_REGS 64
 
 typedef struct emu_s emu_t;
 struct emu_s {
@@ -29,10 +34,17 @@ struct emu_s {
     void                       (*stack_push)       (emu_t* self, uint8_t bytes[], size_t nb_bytes); // Pushes a specified amount of bytes onto the stack.
     enum_supported_archs_t     (*get_arch)         (const emu_t* self);
     uint64_t                   (*get_pc)           (const emu_t* self);
+    uint64_t                   (*get_reg)          (const emu_t* self, uint8_t reg); // Registers are numbered like in the backend.
+    void                       (*set_reg)          (emu_t* self, uint8_t reg, uint64_t value);
+    uint8_t                    (*get_nb_regs)      (const emu_t* self); // Registers `get_reg` and `set_reg` take, counting the pc.
+    void                       (*step_over)        (emu_t* self); // Resume from a snapshot stop, executing the instruction at the pc.
+    void                       (*call)             (emu_t* self, uint64_t function_adr, uint64_t return_adr); // Jump to a function which returns to `return_adr`.
+    uint64_t                   (*get_return_value) (const emu_t* self);
     uint64_t                   (*get_stack_size)   (const emu_t* self);
     mmu_t*                     (*get_mmu)          (const emu_t* self);
     enum_emu_exit_reasons_t    (*get_exit_reason)  (const emu_t* self);
     bool                       (*get_new_coverage) (const emu_t* self);
+    uint64_t                   (*get_path_hash)    (const emu_t* self); // Hash of the branches taken since the last reset.
     corpus_t*                  (*get_corpus)       (const emu_t* self);
 
     // Should only be accessed through the member functions.
@@ -47,7 +59,7 @@ struct emu_s {
 };
 
 emu_t*
-emu_create(enum_supported_archs_t arch, size_t memory_size, corpus_t* corpus);
+emu_create(enum_supported_archs_t arch, size_t memory_size, size_t stack_size, corpus_t* corpus);
 
 void
 emu_destroy(emu_t* emu);
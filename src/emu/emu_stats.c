@@ -5,6 +5,7 @@
 
 #include "emu_stats.h"
 
+#include "../main/config.h"
 #include "../utils/logger.h"
 
 // Increment counters.
@@ -28,6 +29,9 @@ emu_stats_inc(emu_stats_t* stats, const enum_emu_counters_t counter)
     case EMU_COUNTERS_EXIT_INVALID_OPCODE:
         ++stats->nb_invalid_opcodes;
         break;
+    case EMU_COUNTERS_EXIT_STACK_OVERFLOW:
+        ++stats->nb_stack_overflows;
+        break;
     case EMU_COUNTERS_EXIT_GRACEFUL:
         ++stats->nb_graceful_exits;
         break;
@@ -62,10 +66,14 @@ emu_stats_report_exit_reason(emu_stats_t* stats, enum_emu_exit_reasons_t exit_re
     case EMU_EXIT_REASON_INVALID_OPCODE:
         emu_stats_inc(stats, EMU_COUNTERS_EXIT_INVALID_OPCODE);
         break;
+    case EMU_EXIT_REASON_STACK_OVERFLOW:
+        emu_stats_inc(stats, EMU_COUNTERS_EXIT_STACK_OVERFLOW);
+        break;
     case EMU_EXIT_REASON_GRACEFUL:
         emu_stats_inc(stats, EMU_COUNTERS_EXIT_GRACEFUL);
         break;
     case EMU_EXIT_REASON_NO_EXIT:
+    case EMU_EXIT_REASON_SNAPSHOT:
         break;
     }
 }
@@ -96,6 +104,10 @@ emu_stats_print(emu_stats_t* stats)
     strcat(stats_buf, tmp_buf);
     memset(tmp_buf, 0, sizeof(tmp_buf));
 
+    sprintf(tmp_buf, " | stack overflows: %lu", stats->nb_stack_overflows);
+    strcat(stats_buf, tmp_buf);
+    memset(tmp_buf, 0, sizeof(tmp_buf));
+
     sprintf(tmp_buf, " | graceful exits: %lu", stats->nb_graceful_exits);
     strcat(stats_buf, tmp_buf);
     memset(tmp_buf, 0, sizeof(tmp_buf));
@@ -118,12 +130,25 @@ emu_stats_print(emu_stats_t* stats)
     strcat(stats_buf, tmp_buf);
     memset(tmp_buf, 0, sizeof(tmp_buf));
 
+    // Average time spent per reset.
+    sprintf(tmp_buf, " | ns / reset: %.0lf", stats->nb_ns_per_reset);
+    strcat(stats_buf, tmp_buf);
+    memset(tmp_buf, 0, sizeof(tmp_buf));
+
     // Total number of inputs in the corpus.
     sprintf(tmp_buf, " | inputs: %lu", stats->nb_inputs);
     strcat(stats_buf, tmp_buf);
     memset(tmp_buf, 0, sizeof(tmp_buf));
 
     ginger_log(INFO, "%s\n", stats_buf);
+
+    if (global_config_get_coverage()) {
+        mutator_stats_print(&stats->mutator);
+        mutator_schedule_print();
+    }
+    if (global_config_get_mmu_stats()) {
+        mmu_stats_print(&stats->mmu);
+    }
 }
 
 emu_stats_t*
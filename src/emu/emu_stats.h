@@ -4,12 +4,16 @@
 #include <pthread.h>
 #include <stdint.h>
 
+#include "../mmu/mmu_stats.h"
+#include "../snap/mutator.h"
+
 typedef enum {
     EMU_COUNTERS_EXIT_REASON_SYSCALL_NOT_SUPPORTED,
     EMU_COUNTERS_EXIT_FSTAT_BAD_FD,
     EMU_COUNTERS_EXIT_SEGFAULT_READ,
     EMU_COUNTERS_EXIT_SEGFAULT_WRITE,
     EMU_COUNTERS_EXIT_INVALID_OPCODE,
+    EMU_COUNTERS_EXIT_STACK_OVERFLOW,
     EMU_COUNTERS_EXIT_GRACEFUL,
     EMU_COUNTERS_EXECUTED_INSTRUCTIONS,
     EMU_COUNTERS_RESETS,
@@ -23,7 +27,9 @@ typedef enum {
     EMU_EXIT_REASON_SEGFAULT_READ,
     EMU_EXIT_REASON_SEGFAULT_WRITE,
     EMU_EXIT_REASON_INVALID_OPCODE,
+    EMU_EXIT_REASON_STACK_OVERFLOW,
     EMU_EXIT_REASON_GRACEFUL,
+    EMU_EXIT_REASON_SNAPSHOT, // Stopped at a snapshot address. Not an exit, execution can be resumed.
 } enum_emu_exit_reasons_t;
 
 typedef struct {
@@ -33,12 +39,21 @@ typedef struct {
     uint64_t nb_segfault_reads;
     uint64_t nb_segfault_writes;
     uint64_t nb_invalid_opcodes;
+    uint64_t nb_stack_overflows;
     uint64_t nb_graceful_exits;
     uint64_t nb_unknown_exit_reasons;
     uint64_t nb_resets;
     uint64_t nb_inputs;
+    uint64_t nb_reset_ns;     // Total time spent resetting emulators.
     double   nb_inst_per_sec;
     double   nb_resets_per_sec;
+    double   nb_ns_per_reset;
+
+    // Only collected with `--mmu-stats`.
+    mmu_stats_t mmu;
+
+    // Mutation operators which generated new coverage.
+    mutator_stats_t mutator;
 
     // Lock for synchronizing updating stats from multiple workers to the main
     // stats structure.
@@ -192,7 +192,6 @@ static void
 mips64msb_build_stack(mips64msb_t* mips, const target_t* target)
 {
     // Create a stack which starts at the curr_alloc_adr of the emulator.
-    // Stack is 1MiB.
     uint8_t alloc_error = 0;
     const uint64_t stack_start = mips->mmu->allocate(mips->mmu, mips->stack_size, &alloc_error);
     if (alloc_error != 0) {
@@ -204,6 +203,10 @@ mips64msb_build_stack(mips64msb_t* mips, const target_t* target)
     mips->mmu->initial_stack_adr_mapped = program_header_delta + mips->stack_size;
     mips->mmu->initial_stack_adr_virt   = stack_start;
 
+    // Keep the bottom of the stack unmapped, so that overflowing it faults
+    // instead of running into the program headers below.
+    mips->mmu->set_permissions(mips->mmu, stack_start, 0, MMU_STACK_GUARD_SIZE);
+
     // Stack grows downwards, so we set the stack pointer to starting address of the
     // stack + the stack size. As variables are allocated on the stack, their size
     // is subtracted from the stack pointer.
@@ -225,6 +228,9 @@ mips64msb_build_stack(mips64msb_t* mips, const target_t* target)
             ginger_log(ERROR, "Failed allocate memory for target program argument!\n");
         }
         guest_arg_addresses[i] = arg_adr;
+        if (i < MMU_MAX_NB_ARGS) {
+            mips->mmu->arg_adrs[mips->mmu->nb_args++] = arg_adr;
+        }
         mips->mmu->write(mips->mmu, arg_adr, (uint8_t*)target->argv[i].string, target->argv[i].length);
 
         // Make arg segment read and writeable.
@@ -233,6 +239,9 @@ mips64msb_build_stack(mips64msb_t* mips, const target_t* target)
         ginger_log(INFO, "arg[%d] \"%s\" written to guest adr: 0x%lx\n", i, target->argv[i].string, arg_adr);
     }
 
+    // The heap starts right after the arguments, and may not shrink below it.
+    mips->mmu->brk_start_adr = mips->mmu->curr_alloc_adr;
+
     ginger_log(INFO, "Building initial stack at guest address: 0x%x\n", mips64msb_get_sp(mips));
 
     // Push the dummy values filled with zero onto the stack as 64 bit values.
@@ -440,8 +449,10 @@ inst_special(mips64msb_t* mips, uint32_t inst)
 /*                           Emulator functions                               */
 /* ========================================================================== */
 
+// The END and SNAPSHOT bits of the first byte are written to `stop`, from the
+// same load as its exec check. Nothing is fetched if one of them is set.
 static uint32_t
-mips64msb_get_next_instruction(mips64msb_t* mips)
+mips64msb_get_next_instruction(mips64msb_t* mips, uint8_t* stop)
 {
     uint8_t instruction_bytes[4] = {0};
     for (int i = 0; i < 4; i++) {
@@ -449,6 +460,12 @@ mips64msb_get_next_instruction(mips64msb_t* mips)
 
         // Check if exec permission is set for this byte.
         const uint8_t current_permission = mips->mmu->permissions[byte_adr];
+        if (i == 0) {
+            *stop = current_permission & (MMU_PERM_END | MMU_PERM_SNAPSHOT);
+            if (*stop) {
+                return 0;
+            }
+        }
         if ((current_permission & MMU_PERM_EXEC) == 0) {
             ginger_log(ERROR, "No exec perm set on address: 0x%x\n", byte_adr);
 
@@ -476,8 +493,15 @@ mips64msb_execute_next_instruction(mips64msb_t* mips)
 {
     mips->registers[MIPS64MSB_REG_R0] = 0;
 
-    const uint32_t instruction = mips64msb_get_next_instruction(mips);
-    const uint8_t  opcode      = inst_get_opcode(instruction);
+    // Reaching an end address ends the fuzzcase before the instruction runs,
+    // and reaching a snapshot address stops the emulator there.
+    uint8_t        stop        = 0;
+    const uint32_t instruction = mips64msb_get_next_instruction(mips, &stop);
+    if (stop) {
+        mips->exit_reason = stop & MMU_PERM_END ? EMU_EXIT_REASON_GRACEFUL : EMU_EXIT_REASON_SNAPSHOT;
+        return;
+    }
+    const uint8_t opcode = inst_get_opcode(instruction);
 
     ginger_log(DEBUG, "=========================\n");
     ginger_log(DEBUG, "PC: 0x%x\n", mips64msb_get_pc(mips));
@@ -501,6 +525,10 @@ mips64msb_execute_next_instruction(mips64msb_t* mips)
         return;
     }
 
+    if (mips->mmu->stats) {
+        mips->mmu->stats->curr_pc = mips64msb_get_pc(mips);
+    }
+
     // Execute the instruction.
     mips->instructions[opcode](mips, instruction);
 }
@@ -508,7 +536,7 @@ mips64msb_execute_next_instruction(mips64msb_t* mips)
 static mips64msb_t*
 mips64msb_fork(const mips64msb_t* mips)
 {
-    mips64msb_t* forked = mips64msb_create(mips->mmu->memory_size, mips->corpus);
+    mips64msb_t* forked = mips64msb_create(mips->mmu->memory_size, mips->stack_size, mips->corpus);
     if (!forked) {
         ginger_log(ERROR, "[%s] Failed to fork mips!\n", __func__);
         abort();
@@ -519,8 +547,8 @@ mips64msb_fork(const mips64msb_t* mips)
     memcpy(forked->mmu->memory,      mips->mmu->memory,      forked->mmu->memory_size);
     memcpy(forked->mmu->permissions, mips->mmu->permissions, forked->mmu->memory_size);
 
-    // Set the current allocation address.
-    forked->mmu->curr_alloc_adr = mips->mmu->curr_alloc_adr;
+    // Set the current allocation address and mapped regions.
+    mmu_copy_allocations(forked->mmu, mips->mmu);
 
     return forked;
 }
@@ -528,22 +556,8 @@ mips64msb_fork(const mips64msb_t* mips)
 static void
 mips64msb_reset(mips64msb_t* dst, const mips64msb_t* src)
 {
-    // Reset the dirty blocks in memory.
-    for (uint64_t i = 0; i < dst->mmu->dirty_state->nb_dirty_blocks; i++) {
-
-        const uint64_t block     = dst->mmu->dirty_state->dirty_blocks[i];
-        const uint64_t block_adr = block * DIRTY_BLOCK_SIZE;
-
-        memcpy(dst->mmu->memory +      block_adr, src->mmu->memory +      block_adr, DIRTY_BLOCK_SIZE);
-        memcpy(dst->mmu->permissions + block_adr, src->mmu->permissions + block_adr, DIRTY_BLOCK_SIZE);
-
-        // Reset the allocation pointer.
-        dst->mmu->curr_alloc_adr = src->mmu->curr_alloc_adr;
-
-        // Clear the dirty bitmap.
-        dst->mmu->dirty_state->dirty_bitmap[block / 64] = 0;
-    }
-    dst->mmu->dirty_state->clear(dst->mmu->dirty_state);
+    // Reset the dirty parts of memory.
+    dst->mmu->reset(dst->mmu, src->mmu);
 
     // Reset register state.
     // TODO: This memcpy almost triples the reset time. Optimize.
@@ -551,6 +565,18 @@ mips64msb_reset(mips64msb_t* dst, const mips64msb_t* src)
 
     dst->exit_reason  = EMU_EXIT_REASON_NO_EXIT;
     dst->new_coverage = false;
+    dst->path_hash    = 0;
+}
+
+// Segfaults in the guard at the bottom of the stack are stack overflows.
+static void
+mips64msb_classify_fault(mips64msb_t* mips)
+{
+    const bool is_segfault = mips->exit_reason == EMU_EXIT_REASON_SEGFAULT_READ ||
+                             mips->exit_reason == EMU_EXIT_REASON_SEGFAULT_WRITE;
+    if (is_segfault && mmu_in_stack_guard(mips->mmu, mips->mmu->fault_adr)) {
+        mips->exit_reason = EMU_EXIT_REASON_STACK_OVERFLOW;
+    }
 }
 
 // Run an emulator until it exits or crashes.
@@ -562,6 +588,8 @@ mips64msb_run(mips64msb_t* mips, emu_stats_t* stats)
         mips64msb_execute_next_instruction(mips);
         emu_stats_inc(stats, EMU_COUNTERS_EXECUTED_INSTRUCTIONS);
     }
+    mips64msb_classify_fault(mips);
+
     // Report why emulator exited.
     emu_stats_report_exit_reason(stats, mips->exit_reason);
     return mips->exit_reason;
@@ -574,8 +602,10 @@ mips64msb_run_until(mips64msb_t* mips, emu_stats_t* stats, const uint64_t break_
         mips64msb_execute_next_instruction(mips);
         emu_stats_inc(stats, EMU_COUNTERS_EXECUTED_INSTRUCTIONS);
     }
+    mips64msb_classify_fault(mips);
+
     // If we exited, crashed or encountered unknown behavior, report it.
-    if (mips->exit_reason == EMU_EXIT_REASON_NO_EXIT) {
+    if (mips->exit_reason != EMU_EXIT_REASON_NO_EXIT) {
         emu_stats_report_exit_reason(stats, mips->exit_reason);
     }
     return mips->exit_reason;
@@ -623,7 +653,7 @@ mips64msb_print_registers(mips64msb_t* mips)
 }
 
 mips64msb_t*
-mips64msb_create(size_t memory_size, corpus_t* corpus)
+mips64msb_create(size_t memory_size, size_t stack_size, corpus_t* corpus)
 {
     mips64msb_t* mips = calloc(1, sizeof(mips64msb_t));
     if (!mips) {
@@ -631,8 +661,7 @@ mips64msb_create(size_t memory_size, corpus_t* corpus)
         return NULL;
     }
 
-    // 1MiB stack.
-    mips->stack_size = 1024 * 1024;
+    mips->stack_size = stack_size;
     mips->mmu = mmu_create(memory_size, mips->stack_size);
 
     if (!mips->mmu) {
@@ -656,6 +685,7 @@ mips64msb_create(size_t memory_size, corpus_t* corpus)
 
     mips->exit_reason  = EMU_EXIT_REASON_NO_EXIT;
     mips->new_coverage = false;
+    mips->path_hash    = 0;
     mips->corpus       = corpus;
 
     mips->instructions[MIPS64MSB_INST_LUI]     = inst_lui;
@@ -56,6 +56,7 @@ struct mips64msb_s {
     uint64_t                stack_size;
     enum_emu_exit_reasons_t exit_reason;
     bool                    new_coverage;
+    uint64_t                path_hash; // Hash of the branches taken by the fuzzcase.
     corpus_t*               corpus; // Shared between all emulators.
 
     // API
@@ -74,7 +75,7 @@ struct mips64msb_s {
 };
 
 mips64msb_t*
-mips64msb_create(size_t memory_size, corpus_t* corpus);
+mips64msb_create(size_t memory_size, size_t stack_size, corpus_t* corpus);
 
 void
 mips64msb_destroy(mips64msb_t* mips);
@@ -10,6 +10,7 @@
 
 #include "riscv.h"
 #include "syscall_riscv.h"
+#include "taint_riscv.h"
 
 #include "../../corpus/coverage.h"
 #include "../../corpus/corpus.h"
@@ -20,7 +21,7 @@
 // Function prototyp needed as both `riscv_create` and `riscv_fork` call
 // eachother.
 riscv_t*
-riscv_create(size_t memory_size, corpus_t* corpus);
+riscv_create(size_t memory_size, size_t stack_size, corpus_t* corpus);
 
 /* ========================================================================== */
 /*                         Instruction meta functions                         */
@@ -296,7 +297,6 @@ static void
 riscv_build_stack(riscv_t* riscv, const target_t* target)
 {
     // Create a stack which starts at the curr_alloc_adr of the emulator.
-    // Stack is 1MiB.
     uint8_t alloc_error = 0;
     const uint64_t stack_start = riscv->mmu->allocate(riscv->mmu, riscv->stack_size, &alloc_error);
     if (alloc_error != 0) {
@@ -307,6 +307,11 @@ riscv_build_stack(riscv_t* riscv, const target_t* target)
     // stack + the stack size. As variables are allocated on the stack, their size
     // is subtracted from the stack pointer.
     riscv_set_sp(riscv, stack_start + riscv->stack_size);
+    riscv->mmu->initial_stack_adr_virt = stack_start;
+
+    // Keep the bottom of the stack unmapped, so that overflowing it faults
+    // instead of running into the program headers below.
+    riscv->mmu->set_permissions(riscv->mmu, stack_start, 0, MMU_STACK_GUARD_SIZE);
 
     ginger_log(INFO, "Stack start: 0x%lx\n", stack_start);
     ginger_log(INFO, "Stack size:  0x%lx\n", riscv->stack_size);
@@ -324,6 +329,9 @@ riscv_build_stack(riscv_t* riscv, const target_t* target)
             ginger_log(ERROR, "Failed allocate memory for target program argument!\n");
         }
         guest_arg_addresses[i] = arg_adr;
+        if (i < MMU_MAX_NB_ARGS) {
+            riscv->mmu->arg_adrs[riscv->mmu->nb_args++] = arg_adr;
+        }
         riscv->mmu->write(riscv->mmu, arg_adr, (uint8_t*)target->argv[i].string, target->argv[i].length);
 
         // Make arg segment read and writeable.
@@ -332,6 +340,9 @@ riscv_build_stack(riscv_t* riscv, const target_t* target)
         ginger_log(INFO, "arg[%d] \"%s\" written to guest adr: 0x%lx\n", i, target->argv[i].string, arg_adr);
     }
 
+    // The heap starts right after the arguments, and may not shrink below it.
+    riscv->mmu->brk_start_adr = riscv->mmu->curr_alloc_adr;
+
     ginger_log(INFO, "Building initial stack at guest address: 0x%x\n", riscv_get_sp(riscv));
 
     // Push the dummy values filled with zero onto the stack as 64 bit values.
@@ -443,7 +454,8 @@ riscv_jal(riscv_t* riscv, const uint32_t instruction)
 
     ginger_log(DEBUG, "Executing\tJAL %s 0x%x\n", riscv_reg_to_str(riscv_get_rd(instruction)), target);
     riscv_set_reg(riscv, riscv_get_rd(instruction), ret);
-    riscv->new_coverage = coverage_on_branch(riscv->corpus->coverage, pc, target);
+    riscv->new_coverage |= coverage_on_branch(riscv->corpus->coverage, pc, target);
+    riscv->path_hash     = coverage_path_hash(riscv->path_hash, pc, target);
     riscv_set_reg(riscv, RISC_V_REG_PC, target);
 
     // TODO: Make use of following if statement.
@@ -475,7 +487,8 @@ riscv_jalr(riscv_t* riscv, const uint32_t instruction)
     // Save ret into register rd.
     riscv_set_reg(riscv, riscv_get_rd(instruction), ret);
 
-    riscv->new_coverage = coverage_on_branch(riscv->corpus->coverage, pc, target);
+    riscv->new_coverage |= coverage_on_branch(riscv->corpus->coverage, pc, target);
+    riscv->path_hash     = coverage_path_hash(riscv->path_hash, pc, target);
 
     // Jump to target address.
     riscv_set_pc(riscv, target);
@@ -1394,7 +1407,8 @@ riscv_beq(riscv_t* riscv, const uint32_t instruction)
     const uint64_t target       = pc + riscv_b_type_get_immediate(instruction);
 
     if (register_rs1 == register_rs2) {
-        riscv->new_coverage = coverage_on_branch(riscv->corpus->coverage, pc, target);
+        riscv->new_coverage |= coverage_on_branch(riscv->corpus->coverage, pc, target);
+        riscv->path_hash     = coverage_path_hash(riscv->path_hash, pc, target);
         riscv_set_pc(riscv, target);
     }
     else {
@@ -1416,7 +1430,8 @@ riscv_bne(riscv_t* riscv, const uint32_t instruction)
                target);
 
     if (register_rs1 != register_rs2) {
-        riscv->new_coverage = coverage_on_branch(riscv->corpus->coverage, pc, target);
+        riscv->new_coverage |= coverage_on_branch(riscv->corpus->coverage, pc, target);
+        riscv->path_hash     = coverage_path_hash(riscv->path_hash, pc, target);
         riscv_set_pc(riscv, target);
     }
     else {
@@ -1439,7 +1454,8 @@ riscv_blt(riscv_t* riscv, const uint32_t instruction)
                target);
 
     if (register_rs1 < register_rs2) {
-        riscv->new_coverage = coverage_on_branch(riscv->corpus->coverage, pc, target);
+        riscv->new_coverage |= coverage_on_branch(riscv->corpus->coverage, pc, target);
+        riscv->path_hash     = coverage_path_hash(riscv->path_hash, pc, target);
         riscv_set_pc(riscv, target);
     }
     else {
@@ -1461,7 +1477,8 @@ riscv_bltu(riscv_t* riscv, const uint32_t instruction)
                target);
 
     if (register_rs1 < register_rs2) {
-        riscv->new_coverage = coverage_on_branch(riscv->corpus->coverage, pc, target);
+        riscv->new_coverage |= coverage_on_branch(riscv->corpus->coverage, pc, target);
+        riscv->path_hash     = coverage_path_hash(riscv->path_hash, pc, target);
         riscv_set_pc(riscv, target);
     }
     else {
@@ -1483,7 +1500,8 @@ riscv_bge(riscv_t* riscv, const uint32_t instruction)
                target);
 
     if (register_rs1 >= register_rs2) {
-        riscv->new_coverage = coverage_on_branch(riscv->corpus->coverage, pc, target);
+        riscv->new_coverage |= coverage_on_branch(riscv->corpus->coverage, pc, target);
+        riscv->path_hash     = coverage_path_hash(riscv->path_hash, pc, target);
         riscv_set_pc(riscv, target);
     }
     else {
@@ -1506,7 +1524,8 @@ riscv_bgeu(riscv_t* riscv, const uint32_t instruction)
                target);
 
     if (register_rs1 >= register_rs2) {
-        riscv->new_coverage = coverage_on_branch(riscv->corpus->coverage, pc, target);
+        riscv->new_coverage |= coverage_on_branch(riscv->corpus->coverage, pc, target);
+        riscv->path_hash     = coverage_path_hash(riscv->path_hash, pc, target);
         riscv_set_pc(riscv, target);
     }
     else {
@@ -1551,12 +1570,20 @@ riscv_execute_branch_instruction(riscv_t* riscv, const uint32_t instruction)
 /*                            Emulator functions                              */
 /* ========================================================================== */
 
+// The END and SNAPSHOT bits of the first byte are written to `stop`, from the
+// same load as its exec check. Nothing is fetched if one of them is set.
 static uint32_t
-riscv_get_next_instruction(const riscv_t* riscv)
+riscv_get_next_instruction(const riscv_t* riscv, uint8_t* stop)
 {
     uint8_t instruction_bytes[4] = {0};
     for (int i = 0; i < 4; i++) {
         const uint8_t current_permission = riscv->mmu->permissions[riscv->registers[RISC_V_REG_PC] + i];
+        if (i == 0) {
+            *stop = current_permission & (MMU_PERM_END | MMU_PERM_SNAPSHOT);
+            if (*stop) {
+                return 0;
+            }
+        }
         if ((current_permission & MMU_PERM_EXEC) == 0) {
             ginger_log(ERROR, "No exec perm set on address: 0x%x\n", riscv->registers[RISC_V_REG_PC] + i);
             abort();
@@ -1590,8 +1617,15 @@ riscv_execute_next_instruction(riscv_t* riscv)
     // riscvlate hard wired zero register.
     riscv->registers[RISC_V_REG_ZERO] = 0;
 
-    const uint32_t instruction = riscv_get_next_instruction(riscv);
-    const uint8_t  opcode      = riscv_get_opcode(instruction);
+    // Reaching an end address ends the fuzzcase before the instruction runs,
+    // and reaching a snapshot address stops the emulator there.
+    uint8_t        stop        = 0;
+    const uint32_t instruction = riscv_get_next_instruction(riscv, &stop);
+    if (stop) {
+        riscv->exit_reason = stop & MMU_PERM_END ? EMU_EXIT_REASON_GRACEFUL : EMU_EXIT_REASON_SNAPSHOT;
+        return;
+    }
+    const uint8_t opcode = riscv_get_opcode(instruction);
 
     ginger_log(DEBUG, "=========================\n");
     ginger_log(DEBUG, "PC: 0x%x\n", riscv_get_pc(riscv));
@@ -1607,6 +1641,13 @@ riscv_execute_next_instruction(riscv_t* riscv)
         return;
     }
 
+    if (riscv->mmu->stats) {
+        riscv->mmu->stats->curr_pc = riscv_get_pc(riscv);
+    }
+    if (riscv->taint) {
+        taint_riscv_propagate(riscv, instruction);
+    }
+
     // Execute the instruction.
     riscv->instructions[opcode](riscv, instruction);
 }
@@ -1616,36 +1657,32 @@ riscv_execute_next_instruction(riscv_t* riscv)
 static void
 riscv_reset(riscv_t* dst_riscv, const riscv_t* src_riscv)
 {
-    // Reset the dirty blocks in memory.
-    for (uint64_t i = 0; i < dst_riscv->mmu->dirty_state->nb_dirty_blocks; i++) {
-
-        const uint64_t block = dst_riscv->mmu->dirty_state->dirty_blocks[i];
-
-        // Starting address of the dirty block in guest memory.
-        const uint64_t block_adr = block * DIRTY_BLOCK_SIZE;
-
-        // Copy the memory and perms corresponding to the dirty block from the source riscv
-        // to the destination riscv.
-        memcpy(dst_riscv->mmu->memory +      block_adr, src_riscv->mmu->memory +      block_adr, DIRTY_BLOCK_SIZE);
-        memcpy(dst_riscv->mmu->permissions + block_adr, src_riscv->mmu->permissions + block_adr, DIRTY_BLOCK_SIZE);
-
-        // Reset the allocation pointer.
-        dst_riscv->mmu->curr_alloc_adr = src_riscv->mmu->curr_alloc_adr;
-
-        // Clear the bitmap entry corresponding to the dirty block.
-        // We could calculate the bit index here and `logicaly and` it to zero, but we
-        // will still have to do a 64 bit write, so might as well skip the bit index
-        // calculation.
-        dst_riscv->mmu->dirty_state->dirty_bitmap[block / 64] = 0;
-    }
-    dst_riscv->mmu->dirty_state->clear(dst_riscv->mmu->dirty_state);
+    // Reset the dirty parts of memory.
+    dst_riscv->mmu->reset(dst_riscv->mmu, src_riscv->mmu);
 
     // Reset register state.
     // TODO: This memcpy almost triples the reset time. Optimize.
     memcpy(dst_riscv->registers, src_riscv->registers, sizeof(dst_riscv->registers));
 
-    dst_riscv->exit_reason = EMU_EXIT_REASON_NO_EXIT;
+    // The fuzzcase is injected after the reset, so no register holds a label.
+    if (dst_riscv->taint) {
+        memset(dst_riscv->taint, 0, sizeof(*dst_riscv->taint));
+    }
+
+    dst_riscv->exit_reason  = EMU_EXIT_REASON_NO_EXIT;
     dst_riscv->new_coverage = false;
+    dst_riscv->path_hash    = 0;
+}
+
+// Segfaults in the guard at the bottom of the stack are stack overflows.
+static void
+riscv_classify_fault(riscv_t* riscv)
+{
+    const bool is_segfault = riscv->exit_reason == EMU_EXIT_REASON_SEGFAULT_READ ||
+                             riscv->exit_reason == EMU_EXIT_REASON_SEGFAULT_WRITE;
+    if (is_segfault && mmu_in_stack_guard(riscv->mmu, riscv->mmu->fault_adr)) {
+        riscv->exit_reason = EMU_EXIT_REASON_STACK_OVERFLOW;
+    }
 }
 
 // Run an emulator until it exits or crashes.
@@ -1657,6 +1694,8 @@ riscv_run(riscv_t* riscv, emu_stats_t* stats)
         riscv_execute_next_instruction(riscv);
         emu_stats_inc(stats, EMU_COUNTERS_EXECUTED_INSTRUCTIONS);
     }
+    riscv_classify_fault(riscv);
+
     // Report why emulator exited.
     emu_stats_report_exit_reason(stats, riscv->exit_reason);
     return riscv->exit_reason;
@@ -1669,8 +1708,10 @@ riscv_run_until(riscv_t* riscv, emu_stats_t* stats, const uint64_t break_adr)
         riscv_execute_next_instruction(riscv);
         emu_stats_inc(stats, EMU_COUNTERS_EXECUTED_INSTRUCTIONS);
     }
+    riscv_classify_fault(riscv);
+
     // If we exited, crashed or encountered unknown behavior, report it.
-    if (riscv->exit_reason == EMU_EXIT_REASON_NO_EXIT) {
+    if (riscv->exit_reason != EMU_EXIT_REASON_NO_EXIT) {
         emu_stats_report_exit_reason(stats, riscv->exit_reason);
     }
     return riscv->exit_reason;
@@ -1680,7 +1721,7 @@ riscv_run_until(riscv_t* riscv, emu_stats_t* stats, const uint64_t break_adr)
 static riscv_t*
 riscv_fork(const riscv_t* riscv)
 {
-    riscv_t* forked = riscv_create(riscv->mmu->memory_size, riscv->corpus);
+    riscv_t* forked = riscv_create(riscv->mmu->memory_size, riscv->stack_size, riscv->corpus);
     if (!forked) {
         ginger_log(ERROR, "[%s] Failed to fork riscv!\n", __func__);
         abort();
@@ -1691,8 +1732,8 @@ riscv_fork(const riscv_t* riscv)
     memcpy(forked->mmu->memory,      riscv->mmu->memory,      forked->mmu->memory_size);
     memcpy(forked->mmu->permissions, riscv->mmu->permissions, forked->mmu->memory_size);
 
-    // Set the current allocation address.
-    forked->mmu->curr_alloc_adr = riscv->mmu->curr_alloc_adr;
+    // Set the current allocation address and mapped regions.
+    mmu_copy_allocations(forked->mmu, riscv->mmu);
 
     return forked;
 }
@@ -1704,12 +1745,13 @@ riscv_destroy(riscv_t* riscv)
         if (riscv->mmu) {
             mmu_destroy(riscv->mmu);
         }
+        free(riscv->taint);
         free(riscv);
     }
 }
 
 riscv_t*
-riscv_create(size_t memory_size, corpus_t* corpus)
+riscv_create(size_t memory_size, size_t stack_size, corpus_t* corpus)
 {
     riscv_t* riscv = calloc(1, sizeof(riscv_t));
     if (!riscv) {
@@ -1717,13 +1759,21 @@ riscv_create(size_t memory_size, corpus_t* corpus)
         return NULL;
     }
 
-    riscv->stack_size = 1024 * 1024; // 1MiB stack.
+    riscv->stack_size = stack_size;
     riscv->mmu = mmu_create(memory_size, riscv->stack_size);
     if (!riscv->mmu) {
         ginger_log(ERROR, "[%s]Could not create mmu!\n", __func__);
         abort();
     }
 
+    if (riscv->mmu->taint) {
+        riscv->taint = calloc(1, sizeof(taint_riscv_t));
+        if (!riscv->taint) {
+            ginger_log(ERROR, "[%s]Could not create taint state!\n", __func__);
+            abort();
+        }
+    }
+
     // API.
     riscv->load_elf    = riscv_load_elf;
     riscv->build_stack = riscv_build_stack;
@@ -1755,6 +1805,7 @@ riscv_create(size_t memory_size, corpus_t* corpus)
 
     riscv->exit_reason  = EMU_EXIT_REASON_NO_EXIT;
     riscv->new_coverage = false;
+    riscv->path_hash    = 0;
     riscv->corpus       = corpus;
 
     return riscv;
@@ -1,6 +1,7 @@
 #ifndef EMU_RISCV_H
 #define EMU_RISCV_H
 
+#include "taint_riscv.h"
 #include "../emu_stats.h"
 #include "../../corpus/corpus.h"
 #include "../../mmu/mmu.h"
@@ -72,7 +73,9 @@ struct riscv_s {
     uint64_t                stack_size;
     enum_emu_exit_reasons_t exit_reason;
     bool                    new_coverage;
+    uint64_t                path_hash; // Hash of the branches taken by the fuzzcase.
     corpus_t*               corpus; // Shared between all emulators.
+    taint_riscv_t*          taint;  // NULL unless taint tracking is enabled.
 
     void                       (*load_elf)   (riscv_t* self, const target_t* target);
     void                       (*build_stack)(riscv_t* self, const target_t* target);
@@ -89,7 +92,7 @@ struct riscv_s {
 };
 
 riscv_t*
-riscv_create(size_t memory_size, corpus_t* corpus);
+riscv_create(size_t memory_size, size_t stack_size, corpus_t* corpus);
 
 void
 riscv_destroy(riscv_t* riscv);
@@ -1,8 +1,10 @@
+#include <errno.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 
 #include "riscv.h"
@@ -34,6 +36,34 @@ struct kernel_stat
     int __glibc_reserved[2];
 };
 
+// Translate mmap and mprotect protection flags into MMU permissions. Like on
+// Linux, writeable memory is readable as well.
+static uint8_t
+prot_to_perms(const uint64_t prot)
+{
+    uint8_t perms = 0;
+    if (prot & PROT_READ) {
+        perms |= MMU_PERM_READ;
+    }
+    if (prot & PROT_WRITE) {
+        perms |= MMU_PERM_READ | MMU_PERM_WRITE;
+    }
+    if (prot & PROT_EXEC) {
+        perms |= MMU_PERM_EXEC;
+    }
+    return perms;
+}
+
+// Syscalls return negated error numbers in a0.
+static uint64_t
+map_error_to_errno(const uint8_t error)
+{
+    if (error == MMU_MAP_ERROR_NO_MEM) {
+        return -(uint64_t)ENOMEM;
+    }
+    return -(uint64_t)EINVAL;
+}
+
 void
 handle_syscall(riscv_t* riscv, const uint64_t num)
 {
@@ -162,7 +192,7 @@ handle_syscall(riscv_t* riscv, const uint64_t num)
         riscv->exit_reason = EMU_EXIT_REASON_GRACEFUL;
         break;
 
-    // brk. Allocate/deallocate heap.
+    // brk. Allocate/deallocate heap. On failure the current break is returned.
     case 214:
         {
             const uint64_t brk_val = riscv->get_reg(riscv, RISC_V_REG_A0);
@@ -173,28 +203,73 @@ handle_syscall(riscv_t* riscv, const uint64_t num)
                 return;
             }
 
-            // How much memory to allocate?
-            const int64_t new_alloc_size = brk_val - riscv->mmu->curr_alloc_adr;
-
-            // TODO: Support freeing memory.
-            if (new_alloc_size < 0) {
-                ginger_log(ERROR, "brk. We do currently not support freeing memory!\n");
-                exit(1);
+            if (brk_val < riscv->mmu->curr_alloc_adr) {
+                if (riscv->mmu->shrink(riscv->mmu, brk_val) != MMU_MAP_NO_ERROR) {
+                    ginger_log(DEBUG, "brk. Can not shrink the heap below its start!\n");
+                }
+                riscv->set_reg(riscv, RISC_V_REG_A0, riscv->mmu->curr_alloc_adr);
+                return;
             }
 
-            if (riscv->mmu->curr_alloc_adr + new_alloc_size > riscv->mmu->memory_size) {
-                ginger_log(ERROR, "brk. New allocation would run the emulator out of total memory!\n");
-                exit(1);
-            }
+            // How much memory to allocate?
+            const uint64_t new_alloc_size = brk_val - riscv->mmu->curr_alloc_adr;
 
             uint8_t alloc_error = 0;
-            const uint64_t heap_end = riscv->mmu->allocate(riscv->mmu, new_alloc_size, &alloc_error) + new_alloc_size;
+            const uint64_t heap_start = riscv->mmu->allocate(riscv->mmu, new_alloc_size, &alloc_error);
             if (alloc_error != 0) {
-                ginger_log(ERROR, "[%s] Failed to allocate memory on the heap!\n", __func__);
+                ginger_log(DEBUG, "[%s] Failed to allocate memory on the heap!\n", __func__);
+                riscv->set_reg(riscv, RISC_V_REG_A0, riscv->mmu->curr_alloc_adr);
+                return;
             }
 
             // Return the new brk address.
-            riscv->set_reg(riscv, RISC_V_REG_A0, heap_end);
+            riscv->set_reg(riscv, RISC_V_REG_A0, heap_start + new_alloc_size);
+        }
+        break;
+
+    // munmap.
+    case 215:
+        {
+            const uint64_t adr = riscv->get_reg(riscv, RISC_V_REG_A0);
+            const uint64_t len = riscv->get_reg(riscv, RISC_V_REG_A1);
+            ginger_log(DEBUG, "munmap 0x%lx, 0x%lx bytes\n", adr, len);
+
+            const uint8_t error = riscv->mmu->unmap(riscv->mmu, adr, len);
+            riscv->set_reg(riscv, RISC_V_REG_A0, error == MMU_MAP_NO_ERROR ? 0 : map_error_to_errno(error));
+        }
+        break;
+
+    // mmap. Only private anonymous mappings are supported, and the address is
+    // never more than a hint.
+    case 222:
+        {
+            const uint64_t len   = riscv->get_reg(riscv, RISC_V_REG_A1);
+            const uint64_t prot  = riscv->get_reg(riscv, RISC_V_REG_A2);
+            const uint64_t flags = riscv->get_reg(riscv, RISC_V_REG_A3);
+            ginger_log(DEBUG, "mmap 0x%lx bytes, prot 0x%lx, flags 0x%lx\n", len, prot, flags);
+
+            if ((flags & MAP_ANONYMOUS) == 0 || (flags & MAP_FIXED) != 0 || (flags & MAP_SHARED) != 0) {
+                ginger_log(DEBUG, "mmap. Only private anonymous mappings are supported!\n");
+                riscv->exit_reason = EMU_EXIT_REASON_SYSCALL_NOT_SUPPORTED;
+                return;
+            }
+
+            uint8_t        error = 0;
+            const uint64_t adr   = riscv->mmu->map(riscv->mmu, len, prot_to_perms(prot), &error);
+            riscv->set_reg(riscv, RISC_V_REG_A0, error == MMU_MAP_NO_ERROR ? adr : map_error_to_errno(error));
+        }
+        break;
+
+    // mprotect. Only memory mapped with mmap can be protected.
+    case 226:
+        {
+            const uint64_t adr  = riscv->get_reg(riscv, RISC_V_REG_A0);
+            const uint64_t len  = riscv->get_reg(riscv, RISC_V_REG_A1);
+            const uint64_t prot = riscv->get_reg(riscv, RISC_V_REG_A2);
+            ginger_log(DEBUG, "mprotect 0x%lx, 0x%lx bytes, prot 0x%lx\n", adr, len, prot);
+
+            const uint8_t error = riscv->mmu->protect(riscv->mmu, adr, len, prot_to_perms(prot));
+            riscv->set_reg(riscv, RISC_V_REG_A0, error == MMU_MAP_NO_ERROR ? 0 : map_error_to_errno(error));
         }
         break;
 
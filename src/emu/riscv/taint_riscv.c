@@ -0,0 +1,242 @@
+/**
+ * Taint propagation for rv64i.
+ *
+ * Propagation is byte wise where values are combined byte wise (add, logical
+ * operations and moves) and conservative otherwise. Shifts and comparisons
+ * spread the first label found in their operands over the whole result, as any
+ * input byte may end up anywhere in it. A carry into a neighbouring byte is not
+ * tracked.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "taint_riscv.h"
+#include "riscv.h"
+
+#include "../../mmu/mmu.h"
+
+static uint32_t
+taint_riscv_get_rd(const uint32_t instruction)
+{
+    return (instruction >> 7) & 0b11111;
+}
+
+static uint32_t
+taint_riscv_get_rs1(const uint32_t instruction)
+{
+    return (instruction >> 15) & 0b11111;
+}
+
+static uint32_t
+taint_riscv_get_rs2(const uint32_t instruction)
+{
+    return (instruction >> 20) & 0b11111;
+}
+
+static uint32_t
+taint_riscv_get_funct3(const uint32_t instruction)
+{
+    return (instruction >> 12) & 0b111;
+}
+
+static int32_t
+taint_riscv_i_type_get_immediate(const uint32_t instruction)
+{
+    return (int32_t)instruction >> 20;
+}
+
+static int32_t
+taint_riscv_s_type_get_immediate(const uint32_t instruction)
+{
+    const uint32_t immediate40  = (instruction >> 7)  & 0b11111;
+    const uint32_t immediate115 = (instruction >> 25) & 0b1111111;
+    return ((int32_t)((immediate115 << 5) | immediate40) << 20) >> 20;
+}
+
+// Wrap-safe, wild pointers near 2^64 would wrap `adr + nb_bytes` past the check.
+static bool
+taint_riscv_in_shadow(const taint_t* taint, uint64_t adr, uint64_t nb_bytes)
+{
+    return nb_bytes <= taint->memory_size && adr <= taint->memory_size - nb_bytes;
+}
+
+// First label found in the low `nb_bytes` of a register, or 0.
+static taint_label_t
+taint_riscv_first_label(const taint_label_t reg[8], int nb_bytes)
+{
+    for (int i = 0; i < nb_bytes; i++) {
+        if (reg[i] != 0) {
+            return reg[i];
+        }
+    }
+    return 0;
+}
+
+static void
+taint_riscv_record_reg(taint_t* taint, const taint_label_t reg[8])
+{
+    for (int i = 0; i < 8; i++) {
+        taint_record_cmp(taint, reg[i]);
+    }
+}
+
+// rd = rs1 op rs2 for operations which combine values byte by byte. Writes to
+// a temporary first, since rd may be one of the sources.
+static void
+taint_riscv_merge(taint_label_t rd[8], const taint_label_t rs1[8], const taint_label_t rs2[8], int nb_bytes)
+{
+    taint_label_t result[8] = {0};
+    for (int i = 0; i < nb_bytes; i++) {
+        result[i] = rs1[i] != 0 ? rs1[i] : rs2[i];
+    }
+    // 32 bit results are sign extended from their top byte.
+    for (int i = nb_bytes; i < 8; i++) {
+        result[i] = result[nb_bytes - 1];
+    }
+    memcpy(rd, result, sizeof(result));
+}
+
+// Give every byte of rd the same label.
+static void
+taint_riscv_spread(taint_label_t rd[8], taint_label_t label)
+{
+    for (int i = 0; i < 8; i++) {
+        rd[i] = label;
+    }
+}
+
+void
+taint_riscv_propagate(riscv_t* riscv, uint32_t instruction)
+{
+    static const taint_label_t clean[8] = {0};
+
+    taint_t*       taint  = riscv->mmu->taint;
+    taint_label_t (*regs)[8] = riscv->taint->regs;
+    const uint8_t  opcode = instruction & 0b1111111;
+    const uint32_t funct3 = taint_riscv_get_funct3(instruction);
+    taint_label_t* rd     = regs[taint_riscv_get_rd(instruction)];
+    taint_label_t* rs1    = regs[taint_riscv_get_rs1(instruction)];
+    taint_label_t* rs2    = regs[taint_riscv_get_rs2(instruction)];
+
+    switch (opcode) {
+        case ENUM_RISCV_LUI:
+        case ENUM_RISCV_AUIPC:
+        case ENUM_RISCV_JAL:
+        case ENUM_RISCV_JALR:
+            memset(rd, 0, sizeof(regs[0]));
+            break;
+
+        case ENUM_RISCV_LOAD:
+        {
+            const uint64_t adr      = riscv->registers[taint_riscv_get_rs1(instruction)] +
+                                      taint_riscv_i_type_get_immediate(instruction);
+            const int      nb_bytes = 1 << (funct3 & 0b11);
+            const bool     is_signed = funct3 < 4;
+            if (!taint_riscv_in_shadow(taint, adr, nb_bytes)) {
+                break; // Faults anyway.
+            }
+            taint_label_t result[8] = {0};
+            memcpy(result, taint->shadow + adr, nb_bytes * sizeof(taint_label_t));
+            for (int i = nb_bytes; i < 8 && is_signed; i++) {
+                result[i] = result[nb_bytes - 1];
+            }
+            memcpy(rd, result, sizeof(result));
+            break;
+        }
+
+        case ENUM_RISCV_STORE:
+        {
+            const uint64_t adr      = riscv->registers[taint_riscv_get_rs1(instruction)] +
+                                      taint_riscv_s_type_get_immediate(instruction);
+            const int      nb_bytes = 1 << (funct3 & 0b11);
+            if (!taint_riscv_in_shadow(taint, adr, nb_bytes)) {
+                break; // Faults anyway.
+            }
+
+            // A labeled shadow byte is always in a dirty block, as labels are
+            // only ever stored here, so clearing labels needs no bookkeeping.
+            // New labels have to dirty the block, in case the store itself
+            // faults before marking it.
+            memcpy(taint->shadow + adr, rs2, nb_bytes * sizeof(taint_label_t));
+            if (taint_riscv_first_label(rs2, nb_bytes) != 0) {
+                riscv->mmu->dirty_state->make_dirty(riscv->mmu->dirty_state, adr / DIRTY_BLOCK_SIZE);
+                riscv->mmu->dirty_state->make_dirty(riscv->mmu->dirty_state, (adr + nb_bytes - 1) / DIRTY_BLOCK_SIZE);
+            }
+            break;
+        }
+
+        case ENUM_RISCV_BRANCH:
+            taint_riscv_record_reg(taint, rs1);
+            taint_riscv_record_reg(taint, rs2);
+            break;
+
+        case ENUM_RISCV_ARITHMETIC_I_TYPE:
+            switch (funct3) {
+                case 2: // SLTI
+                case 3: // SLTIU
+                    taint_riscv_record_reg(taint, rs1);
+                    taint_riscv_spread(rd, taint_riscv_first_label(rs1, 8));
+                    break;
+                case 1: // SLLI
+                case 5: // SRLI, SRAI
+                    taint_riscv_spread(rd, taint_riscv_first_label(rs1, 8));
+                    break;
+                default: // ADDI, XORI, ORI, ANDI
+                    taint_riscv_merge(rd, rs1, clean, 8);
+                    break;
+            }
+            break;
+
+        case ENUM_RISCV_ARITHMETIC_R_TYPE:
+            switch (funct3) {
+                case 2: // SLT
+                case 3: // SLTU
+                    taint_riscv_record_reg(taint, rs1);
+                    taint_riscv_record_reg(taint, rs2);
+                    // Fall through.
+                case 1: // SLL
+                case 5: // SRL, SRA
+                {
+                    const taint_label_t label = taint_riscv_first_label(rs1, 8);
+                    taint_riscv_spread(rd, label != 0 ? label : taint_riscv_first_label(rs2, 8));
+                    break;
+                }
+                default: // ADD, SUB, XOR, OR, AND
+                    taint_riscv_merge(rd, rs1, rs2, 8);
+                    break;
+            }
+            break;
+
+        case ENUM_RISCV_ARITHMETIC_64_REGISTER_IMMEDIATE:
+            if (funct3 == 0) { // ADDIW
+                taint_riscv_merge(rd, rs1, clean, 4);
+            }
+            else { // SLLIW, SRLIW, SRAIW
+                taint_riscv_spread(rd, taint_riscv_first_label(rs1, 4));
+            }
+            break;
+
+        case ENUM_RISCV_ARITHMETIC_64_REGISTER_REGISTER:
+            if (funct3 == 0) { // ADDW, SUBW
+                taint_riscv_merge(rd, rs1, rs2, 4);
+            }
+            else { // SLLW, SRLW, SRAW
+                const taint_label_t label = taint_riscv_first_label(rs1, 4);
+                taint_riscv_spread(rd, label != 0 ? label : taint_riscv_first_label(rs2, 8));
+            }
+            break;
+
+        case ENUM_RISCV_ENV:
+            // Syscall return values do not depend on the fuzzcase.
+            memset(regs[RISC_V_REG_A0], 0, sizeof(regs[0]));
+            break;
+
+        default:
+            break;
+    }
+
+    // The zero register can not hold a label.
+    memset(regs[RISC_V_REG_ZERO], 0, sizeof(regs[0]));
+}
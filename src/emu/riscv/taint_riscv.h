@@ -0,0 +1,22 @@
+#ifndef TAINT_RISCV_H
+#define TAINT_RISCV_H
+
+#include <stdint.h>
+
+#include "../../mmu/taint.h"
+
+typedef struct riscv_s riscv_t;
+
+// Labels of the bytes of every register. Register bytes are numbered from
+// least significant.
+typedef struct {
+    taint_label_t regs[33][8];
+} taint_riscv_t;
+
+// Propagate labels for an instruction which is about to be executed, and
+// record the labels of compared operands. Has to run before the instruction,
+// as it may overwrite its own source registers.
+void
+taint_riscv_propagate(riscv_t* riscv, uint32_t instruction);
+
+#endif
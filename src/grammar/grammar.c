@@ -0,0 +1,597 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "grammar.h"
+
+#include "../utils/logger.h"
+
+#define GRAMMAR_INFINITE_DEPTH UINT32_MAX
+
+// Growable array of tree nodes, used while building trees.
+typedef struct {
+    tree_node_t* nodes;
+    size_t       nb_nodes;
+    size_t       capacity;
+} node_buf_t;
+
+static void
+node_buf_push(node_buf_t* buf, tree_node_t node)
+{
+    if (buf->nb_nodes == buf->capacity) {
+        buf->capacity = buf->capacity ? buf->capacity * 2 : 64;
+        buf->nodes    = realloc(buf->nodes, buf->capacity * sizeof(tree_node_t));
+        if (!buf->nodes) {
+            ginger_log(ERROR, "[%s] Could not grow tree!\n", __func__);
+            abort();
+        }
+    }
+    buf->nodes[buf->nb_nodes++] = node;
+}
+
+// Parsing.
+
+static size_t
+intern_rule(grammar_t* grammar, const char* name, size_t length)
+{
+    for (size_t i = 0; i < grammar->nb_rules; i++) {
+        if (strlen(grammar->rules[i].name) == length && strncmp(grammar->rules[i].name, name, length) == 0) {
+            return i;
+        }
+    }
+    grammar->rules = realloc(grammar->rules, (grammar->nb_rules + 1) * sizeof(grammar_rule_t));
+    grammar_rule_t* rule = &grammar->rules[grammar->nb_rules];
+    memset(rule, 0, sizeof(grammar_rule_t));
+    rule->name = strndup(name, length);
+    return grammar->nb_rules++;
+}
+
+static size_t
+intern_terminal(grammar_t* grammar, const uint8_t* data, size_t length)
+{
+    for (size_t i = 0; i < grammar->nb_terminals; i++) {
+        const grammar_terminal_t* terminal = &grammar->terminals[i];
+        if (terminal->length == length && memcmp(terminal->data, data, length) == 0) {
+            return i;
+        }
+    }
+    grammar->terminals = realloc(grammar->terminals, (grammar->nb_terminals + 1) * sizeof(grammar_terminal_t));
+    grammar_terminal_t* terminal = &grammar->terminals[grammar->nb_terminals];
+    terminal->data   = malloc(length ? length : 1);
+    terminal->length = length;
+    memcpy(terminal->data, data, length);
+    return grammar->nb_terminals++;
+}
+
+static int
+hex_digit(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+// Parse the quoted terminal at `*c`, leaving `*c` after the closing quote.
+// Returns the index of the terminal, or -1 if it is malformed.
+static int64_t
+parse_terminal(grammar_t* grammar, const char** c)
+{
+    size_t   length   = 0;
+    size_t   capacity = 16;
+    uint8_t* data     = malloc(capacity);
+
+    (*c)++;
+    while (**c != '"') {
+        if (**c == '\0' || **c == '\n') {
+            free(data);
+            return -1;
+        }
+        if (length == capacity) {
+            capacity *= 2;
+            data = realloc(data, capacity);
+        }
+        if (**c != '\\') {
+            data[length++] = *(*c)++;
+            continue;
+        }
+        (*c)++;
+        switch (**c)
+        {
+        case '\\':
+        case '"':
+            data[length++] = **c;
+            (*c)++;
+            break;
+        case 'n':
+            data[length++] = '\n';
+            (*c)++;
+            break;
+        case 'r':
+            data[length++] = '\r';
+            (*c)++;
+            break;
+        case 't':
+            data[length++] = '\t';
+            (*c)++;
+            break;
+        case 'x':
+            if (hex_digit((*c)[1]) < 0 || hex_digit((*c)[2]) < 0) {
+                free(data);
+                return -1;
+            }
+            data[length++] = (hex_digit((*c)[1]) << 4) | hex_digit((*c)[2]);
+            *c += 3;
+            break;
+        default:
+            free(data);
+            return -1;
+        }
+    }
+    (*c)++;
+
+    const size_t index = intern_terminal(grammar, data, length);
+    free(data);
+    return index;
+}
+
+static void
+alt_push(grammar_alt_t* alt, int32_t symbol)
+{
+    alt->symbols = realloc(alt->symbols, (alt->nb_symbols + 1) * sizeof(int32_t));
+    alt->symbols[alt->nb_symbols++] = symbol;
+    if (symbol >= 0) {
+        alt->nb_nonterminals++;
+    }
+}
+
+static grammar_alt_t*
+rule_new_alt(grammar_t* grammar, size_t rule_idx)
+{
+    grammar_rule_t* rule = &grammar->rules[rule_idx];
+    rule->alts = realloc(rule->alts, (rule->nb_alts + 1) * sizeof(grammar_alt_t));
+    grammar_alt_t* alt = &rule->alts[rule->nb_alts++];
+    memset(alt, 0, sizeof(grammar_alt_t));
+    return alt;
+}
+
+// Parse alternatives separated by `|` until the end of the line, adding them
+// to the rule. `first` tells whether the line starts with an alternative
+// rather than with a `|`. Returns false if the line is malformed.
+static bool
+parse_alts(grammar_t* grammar, size_t rule_idx, const char* c, bool first)
+{
+    grammar_alt_t* alt = first ? rule_new_alt(grammar, rule_idx) : NULL;
+
+    for (;;) {
+        while (*c == ' ' || *c == '\t' || *c == '\r') {
+            c++;
+        }
+        if (*c == '\0' || *c == '\n') {
+            break;
+        }
+        if (*c == '|') {
+            if (alt && alt->nb_symbols == 0) {
+                return false;
+            }
+            // `rule_new_alt` may move the alternatives, so do not keep
+            // pointers to them across calls.
+            alt = rule_new_alt(grammar, rule_idx);
+            c++;
+        }
+        else if (*c == '<') {
+            const char* end = strchr(c, '>');
+            if (!alt || !end || end == c + 1) {
+                return false;
+            }
+            const size_t nonterminal = intern_rule(grammar, c + 1, end - c - 1);
+            // Interning may move the rules.
+            alt = &grammar->rules[rule_idx].alts[grammar->rules[rule_idx].nb_alts - 1];
+            alt_push(alt, nonterminal);
+            c = end + 1;
+        }
+        else if (*c == '"') {
+            if (!alt) {
+                return false;
+            }
+            const int64_t terminal = parse_terminal(grammar, &c);
+            if (terminal < 0) {
+                return false;
+            }
+            alt_push(alt, -(int32_t)terminal - 1);
+        }
+        else {
+            return false;
+        }
+    }
+    return alt && alt->nb_symbols > 0;
+}
+
+// Compute the depth of the shallowest tree of every rule and alternative.
+// Returns false if a rule can not terminate.
+static bool
+compute_min_depths(grammar_t* grammar)
+{
+    for (size_t i = 0; i < grammar->nb_rules; i++) {
+        grammar->rules[i].min_depth = GRAMMAR_INFINITE_DEPTH;
+        for (size_t j = 0; j < grammar->rules[i].nb_alts; j++) {
+            grammar->rules[i].alts[j].min_depth = GRAMMAR_INFINITE_DEPTH;
+        }
+    }
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t i = 0; i < grammar->nb_rules; i++) {
+            grammar_rule_t* rule = &grammar->rules[i];
+            for (size_t j = 0; j < rule->nb_alts; j++) {
+                grammar_alt_t* alt   = &rule->alts[j];
+                uint32_t       depth = 1;
+                for (size_t k = 0; k < alt->nb_symbols && depth != GRAMMAR_INFINITE_DEPTH; k++) {
+                    if (alt->symbols[k] < 0) {
+                        continue;
+                    }
+                    const uint32_t child = grammar->rules[alt->symbols[k]].min_depth;
+                    depth = child == GRAMMAR_INFINITE_DEPTH ? child : (child + 1 > depth ? child + 1 : depth);
+                }
+                if (depth < alt->min_depth) {
+                    alt->min_depth = depth;
+                    changed = true;
+                }
+                if (depth < rule->min_depth) {
+                    rule->min_depth = depth;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    for (size_t i = 0; i < grammar->nb_rules; i++) {
+        if (grammar->rules[i].min_depth == GRAMMAR_INFINITE_DEPTH) {
+            ginger_log(ERROR, "Grammar nonterminal <%s> never terminates\n", grammar->rules[i].name);
+            return false;
+        }
+    }
+    return true;
+}
+
+grammar_t*
+grammar_load(const char* path)
+{
+    FILE* fp = fopen(path, "r");
+    if (!fp) {
+        ginger_log(ERROR, "Could not open grammar file %s\n", path);
+        return NULL;
+    }
+
+    grammar_t* grammar  = calloc(1, sizeof(grammar_t));
+    bool       ok       = true;
+    char*      line     = NULL;
+    size_t     line_len = 0;
+    size_t     line_nb  = 0;
+    int64_t    curr     = -1;  // Rule which `|` lines add to.
+    while (ok && getline(&line, &line_len, fp) != -1) {
+        line_nb++;
+
+        const char* c = line;
+        while (isspace((unsigned char)*c)) {
+            c++;
+        }
+        if (*c == '\0' || *c == '#') {
+            continue;
+        }
+
+        if (*c == '|') {
+            ok = curr >= 0 && parse_alts(grammar, curr, c, false);
+        }
+        else if (*c == '<') {
+            const char* end    = strchr(c, '>');
+            const char* define = end ? strstr(end, "::=") : NULL;
+            ok = end && end != c + 1 && define;
+            for (const char* s = end ? end + 1 : c; ok && s < define; s++) {
+                ok = isspace((unsigned char)*s);
+            }
+            if (ok) {
+                curr = intern_rule(grammar, c + 1, end - c - 1);
+                if (grammar->rules[curr].nb_alts > 0) {
+                    ginger_log(ERROR, "Grammar nonterminal <%s> is defined twice\n", grammar->rules[curr].name);
+                    ok = false;
+                    break;
+                }
+                ok = parse_alts(grammar, curr, define + 3, true);
+            }
+        }
+        else {
+            ok = false;
+        }
+        if (!ok) {
+            ginger_log(ERROR, "Malformed line %lu of grammar file %s\n", line_nb, path);
+        }
+    }
+    free(line);
+    fclose(fp);
+
+    if (ok && grammar->nb_rules == 0) {
+        ginger_log(ERROR, "Grammar file %s has no rules\n", path);
+        ok = false;
+    }
+    if (ok && (grammar->nb_rules > UINT16_MAX)) {
+        ginger_log(ERROR, "Grammar file %s has too many rules\n", path);
+        ok = false;
+    }
+    for (size_t i = 0; ok && i < grammar->nb_rules; i++) {
+        if (grammar->rules[i].nb_alts == 0) {
+            ginger_log(ERROR, "Grammar nonterminal <%s> is never defined\n", grammar->rules[i].name);
+            ok = false;
+        }
+        else if (grammar->rules[i].nb_alts > UINT16_MAX) {
+            ginger_log(ERROR, "Grammar nonterminal <%s> has too many alternatives\n", grammar->rules[i].name);
+            ok = false;
+        }
+    }
+    if (ok) {
+        ok = compute_min_depths(grammar);
+    }
+    if (!ok) {
+        grammar_destroy(grammar);
+        return NULL;
+    }
+    return grammar;
+}
+
+void
+grammar_destroy(grammar_t* grammar)
+{
+    if (!grammar) {
+        return;
+    }
+    for (size_t i = 0; i < grammar->nb_rules; i++) {
+        for (size_t j = 0; j < grammar->rules[i].nb_alts; j++) {
+            free(grammar->rules[i].alts[j].symbols);
+        }
+        free(grammar->rules[i].alts);
+        free(grammar->rules[i].name);
+    }
+    for (size_t i = 0; i < grammar->nb_terminals; i++) {
+        free(grammar->terminals[i].data);
+    }
+    free(grammar->rules);
+    free(grammar->terminals);
+    free(grammar);
+}
+
+// Trees.
+
+// Append a random subtree of `rule` to `buf`. Past the max depth, or once the
+// tree is full, the alternatives closest to terminating are picked.
+static void
+generate(const grammar_t* grammar, prng_t* prng, size_t rule_idx, uint32_t depth, node_buf_t* buf)
+{
+    const grammar_rule_t* rule = &grammar->rules[rule_idx];
+
+    size_t alt_idx = prng_below(prng, rule->nb_alts);
+    if (depth >= GRAMMAR_MAX_DEPTH || buf->nb_nodes >= GRAMMAR_MAX_NB_NODES) {
+        for (size_t i = 0; i < rule->nb_alts; i++) {
+            if (rule->alts[i].min_depth < rule->alts[alt_idx].min_depth) {
+                alt_idx = i;
+            }
+        }
+    }
+
+    const size_t node_idx = buf->nb_nodes;
+    node_buf_push(buf, (tree_node_t){ .rule = rule_idx, .alt = alt_idx, .size = 0 });
+
+    const grammar_alt_t* alt = &rule->alts[alt_idx];
+    for (size_t i = 0; i < alt->nb_symbols; i++) {
+        if (alt->symbols[i] >= 0) {
+            generate(grammar, prng, alt->symbols[i], depth + 1, buf);
+        }
+    }
+    buf->nodes[node_idx].size = buf->nb_nodes - node_idx;
+}
+
+tree_t*
+tree_generate(const grammar_t* grammar, prng_t* prng)
+{
+    node_buf_t buf = {0};
+    generate(grammar, prng, 0, 0, &buf);
+
+    tree_t* tree   = calloc(1, sizeof(tree_t));
+    tree->nodes    = buf.nodes;
+    tree->nb_nodes = buf.nb_nodes;
+    return tree;
+}
+
+tree_t*
+tree_copy(const tree_t* tree)
+{
+    tree_t* copy   = calloc(1, sizeof(tree_t));
+    copy->nodes    = malloc(tree->nb_nodes * sizeof(tree_node_t));
+    copy->nb_nodes = tree->nb_nodes;
+    memcpy(copy->nodes, tree->nodes, tree->nb_nodes * sizeof(tree_node_t));
+    return copy;
+}
+
+void
+tree_destroy(tree_t* tree)
+{
+    if (tree) {
+        free(tree->nodes);
+        free(tree);
+    }
+}
+
+// Serialize the subtree at `node_idx`. Returns the index of the node after it.
+static size_t
+serialize(const grammar_t* grammar, const tree_t* tree, size_t node_idx, uint8_t* buf, size_t capacity, size_t* length)
+{
+    const tree_node_t*   node  = &tree->nodes[node_idx];
+    const grammar_alt_t* alt   = &grammar->rules[node->rule].alts[node->alt];
+    size_t               child = node_idx + 1;
+
+    for (size_t i = 0; i < alt->nb_symbols; i++) {
+        if (alt->symbols[i] >= 0) {
+            child = serialize(grammar, tree, child, buf, capacity, length);
+            continue;
+        }
+        const grammar_terminal_t* terminal = &grammar->terminals[-alt->symbols[i] - 1];
+        const size_t n = terminal->length < capacity - *length ? terminal->length : capacity - *length;
+        memcpy(buf + *length, terminal->data, n);
+        *length += n;
+    }
+    return child;
+}
+
+size_t
+tree_serialize(const grammar_t* grammar, const tree_t* tree, uint8_t* buf, size_t capacity)
+{
+    size_t length = 0;
+    serialize(grammar, tree, 0, buf, capacity, &length);
+    return length;
+}
+
+// Recompute the sizes of the subtree at `node_idx` of `nodes`. Returns the
+// index of the node after it.
+static size_t
+fix_sizes(const grammar_t* grammar, tree_node_t* nodes, size_t node_idx)
+{
+    const grammar_alt_t* alt   = &grammar->rules[nodes[node_idx].rule].alts[nodes[node_idx].alt];
+    size_t               child = node_idx + 1;
+
+    for (size_t i = 0; i < alt->nb_nonterminals; i++) {
+        child = fix_sizes(grammar, nodes, child);
+    }
+    nodes[node_idx].size = child - node_idx;
+    return child;
+}
+
+// Replace the subtree at `node_idx` with the `nb_nodes` nodes of `subtree`,
+// whose sizes have to be right. Returns false if the tree would grow too
+// large.
+static bool
+replace_subtree(tree_t* tree, size_t node_idx, const tree_node_t* subtree, size_t nb_nodes)
+{
+    const size_t  old_size = tree->nodes[node_idx].size;
+    const int64_t delta    = (int64_t)nb_nodes - (int64_t)old_size;
+    const size_t  new_nb   = tree->nb_nodes + delta;
+    if (new_nb > GRAMMAR_MAX_NB_NODES) {
+        return false;
+    }
+
+    // The ancestors of the node are the nodes before it whose subtrees
+    // reach past it.
+    for (size_t i = 0; i < node_idx; i++) {
+        if (i + tree->nodes[i].size > node_idx) {
+            tree->nodes[i].size += delta;
+        }
+    }
+
+    if (delta > 0) {
+        tree->nodes = realloc(tree->nodes, new_nb * sizeof(tree_node_t));
+    }
+    memmove(tree->nodes + node_idx + nb_nodes, tree->nodes + node_idx + old_size,
+            (tree->nb_nodes - node_idx - old_size) * sizeof(tree_node_t));
+    memcpy(tree->nodes + node_idx, subtree, nb_nodes * sizeof(tree_node_t));
+    tree->nb_nodes = new_nb;
+    return true;
+}
+
+bool
+tree_mutate_replace(const grammar_t* grammar, tree_t* tree, prng_t* prng)
+{
+    const size_t node_idx = prng_below(prng, tree->nb_nodes);
+
+    node_buf_t buf = {0};
+    generate(grammar, prng, tree->nodes[node_idx].rule, 0, &buf);
+    const bool ok = replace_subtree(tree, node_idx, buf.nodes, buf.nb_nodes);
+    free(buf.nodes);
+    return ok;
+}
+
+bool
+tree_mutate_recurse(const grammar_t* grammar, tree_t* tree, prng_t* prng)
+{
+    // Look for a node with a descendant of the same nonterminal, starting
+    // from a few random nodes.
+    for (int attempt = 0; attempt < 16; attempt++) {
+        const size_t outer = prng_below(prng, tree->nb_nodes);
+        const size_t end   = outer + tree->nodes[outer].size;
+
+        size_t nb_inner = 0;
+        for (size_t i = outer + 1; i < end; i++) {
+            nb_inner += tree->nodes[i].rule == tree->nodes[outer].rule;
+        }
+        if (nb_inner == 0) {
+            continue;
+        }
+        size_t pick  = prng_below(prng, nb_inner);
+        size_t inner = outer + 1;
+        for (;; inner++) {
+            if (tree->nodes[inner].rule == tree->nodes[outer].rule && pick-- == 0) {
+                break;
+            }
+        }
+
+        // The subtree is A B C, where B is the inner subtree. Nesting it n
+        // more times gives A^(n+1) B C^(n+1) in preorder.
+        const size_t inner_end  = inner + tree->nodes[inner].size;
+        const size_t len_a      = inner - outer;
+        const size_t len_b      = inner_end - inner;
+        const size_t len_c      = end - inner_end;
+        const size_t nb_repeats = 2 + prng_below(prng, 4);
+        const size_t nb_nodes   = (len_a + len_c) * nb_repeats + len_b;
+        if (tree->nb_nodes - (end - outer) + nb_nodes > GRAMMAR_MAX_NB_NODES) {
+            continue;
+        }
+
+        tree_node_t* nodes = malloc(nb_nodes * sizeof(tree_node_t));
+        tree_node_t* out   = nodes;
+        for (size_t i = 0; i < nb_repeats; i++, out += len_a) {
+            memcpy(out, tree->nodes + outer, len_a * sizeof(tree_node_t));
+        }
+        memcpy(out, tree->nodes + inner, len_b * sizeof(tree_node_t));
+        out += len_b;
+        for (size_t i = 0; i < nb_repeats; i++, out += len_c) {
+            memcpy(out, tree->nodes + inner_end, len_c * sizeof(tree_node_t));
+        }
+        fix_sizes(grammar, nodes, 0);
+
+        const bool ok = replace_subtree(tree, outer, nodes, nb_nodes);
+        free(nodes);
+        return ok;
+    }
+    return false;
+}
+
+bool
+tree_mutate_splice(tree_t* tree, const tree_t* other, prng_t* prng)
+{
+    for (int attempt = 0; attempt < 8; attempt++) {
+        const size_t node_idx = prng_below(prng, tree->nb_nodes);
+        const uint16_t rule   = tree->nodes[node_idx].rule;
+
+        size_t nb_matches = 0;
+        for (size_t i = 0; i < other->nb_nodes; i++) {
+            nb_matches += other->nodes[i].rule == rule;
+        }
+        if (nb_matches == 0) {
+            continue;
+        }
+        size_t pick = prng_below(prng, nb_matches);
+        size_t src  = 0;
+        for (;; src++) {
+            if (other->nodes[src].rule == rule && pick-- == 0) {
+                break;
+            }
+        }
+        return replace_subtree(tree, node_idx, other->nodes + src, other->nodes[src].size);
+    }
+    return false;
+}
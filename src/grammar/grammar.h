@@ -0,0 +1,116 @@
+/**
+ * Context-free grammars and derivation trees.
+ *
+ * A grammar is read from a BNF file, where every rule defines a nonterminal
+ * as one or more alternatives, separated by `|`. An alternative is a sequence
+ * of nonterminals, written `<name>`, and double quoted terminals, which take
+ * the `\\`, `\"`, `\n`, `\r`, `\t` and `\xNN` escapes. A line starting with
+ * `|` adds alternatives to the rule above it, and `#` starts a comment line.
+ * The first rule defines the start symbol.
+ *
+ *     <start> ::= <expr> "\n"
+ *     <expr>  ::= <num> | <expr> "+" <num>
+ *               | "(" <expr> ")"
+ *     <num>   ::= "0" | "1" | "42"
+ *
+ * A derivation tree is stored as its nodes in preorder. Every node names a
+ * nonterminal and the alternative it was expanded with, and the alternative
+ * determines how many children follow. This makes copying a tree a memcpy,
+ * and replacing a subtree a splice of the node array.
+ */
+
+#ifndef GRAMMAR_H
+#define GRAMMAR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../utils/prng.h"
+
+// Largest number of nodes in a derivation tree. Generation picks the shortest
+// alternatives once a tree reaches it.
+#define GRAMMAR_MAX_NB_NODES 4096
+
+// Depth after which generation only picks the alternatives closest to
+// terminating.
+#define GRAMMAR_MAX_DEPTH 24
+
+typedef struct {
+    // Symbols of the alternative. Nonterminals are their index, terminals are
+    // -(index + 1).
+    int32_t* symbols;
+    size_t   nb_symbols;
+    size_t   nb_nonterminals;  // Number of children of a node expanded with the alternative.
+    uint32_t min_depth;        // Depth of the shallowest tree starting with the alternative.
+} grammar_alt_t;
+
+typedef struct {
+    char*          name;
+    grammar_alt_t* alts;
+    size_t         nb_alts;
+    uint32_t       min_depth;  // Depth of the shallowest tree of the nonterminal.
+} grammar_rule_t;
+
+typedef struct {
+    uint8_t* data;
+    size_t   length;
+} grammar_terminal_t;
+
+typedef struct {
+    grammar_rule_t*     rules;      // Indexed by nonterminal. Rule 0 is the start symbol.
+    size_t              nb_rules;
+    grammar_terminal_t* terminals;
+    size_t              nb_terminals;
+} grammar_t;
+
+typedef struct {
+    uint16_t rule;
+    uint16_t alt;
+    uint32_t size;  // Number of nodes in the subtree rooted at this node.
+} tree_node_t;
+
+typedef struct tree {
+    tree_node_t* nodes;
+    size_t       nb_nodes;
+} tree_t;
+
+// Read a grammar from a BNF file. Returns NULL, after logging why, if the file
+// can not be read, is malformed, or has a nonterminal which never terminates.
+grammar_t*
+grammar_load(const char* path);
+
+void
+grammar_destroy(grammar_t* grammar);
+
+// Generate a random tree from the start symbol.
+tree_t*
+tree_generate(const grammar_t* grammar, prng_t* prng);
+
+tree_t*
+tree_copy(const tree_t* tree);
+
+void
+tree_destroy(tree_t* tree);
+
+// Write the terminals of the tree to `buf`, up to `capacity` bytes. Returns
+// the number of bytes written.
+size_t
+tree_serialize(const grammar_t* grammar, const tree_t* tree, uint8_t* buf, size_t capacity);
+
+// Replace a random subtree with a freshly generated one.
+bool
+tree_mutate_replace(const grammar_t* grammar, tree_t* tree, prng_t* prng);
+
+// Find a subtree which contains a subtree of the same nonterminal, and repeat
+// the part between them a few times, like turning `(x)` into `(((x)))`.
+// Returns false if the tree has no such recursion.
+bool
+tree_mutate_recurse(const grammar_t* grammar, tree_t* tree, prng_t* prng);
+
+// Replace a random subtree with a subtree of the same nonterminal from
+// `other`. Returns false if `other` has no subtree of that nonterminal.
+bool
+tree_mutate_splice(tree_t* tree, const tree_t* other, prng_t* prng);
+
+#endif
@@ -1,3 +1,4 @@
+#include <stdlib.h>
 #include <string.h>
 
 #include "config.h"
@@ -66,6 +67,194 @@ global_config_set_arch(char* arch)
     }
 }
 
+void
+global_config_set_reset_mode(char* reset_mode)
+{
+    if (strcmp(reset_mode, "dirty") == 0) {
+        global_config.reset_mode = ENUM_RESET_MODE_DIRTY_BLOCKS;
+    }
+    else if (strcmp(reset_mode, "cow") == 0) {
+        global_config.reset_mode = ENUM_RESET_MODE_COW;
+    }
+    else {
+        global_config.reset_mode = ENUM_RESET_MODE_INVALID;
+    }
+}
+
+void
+global_config_set_inject_mode(char* inject_mode)
+{
+    if (strcmp(inject_mode, "copy") == 0) {
+        global_config.inject_mode = ENUM_INJECT_MODE_COPY;
+    }
+    else if (strcmp(inject_mode, "in-place") == 0) {
+        global_config.inject_mode = ENUM_INJECT_MODE_IN_PLACE;
+    }
+    else {
+        global_config.inject_mode = ENUM_INJECT_MODE_INVALID;
+    }
+}
+
+void
+global_config_set_huge_pages(char* huge_pages)
+{
+    if (strcmp(huge_pages, "none") == 0) {
+        global_config.huge_pages = ENUM_HUGE_PAGES_NONE;
+    }
+    else if (strcmp(huge_pages, "thp") == 0) {
+        global_config.huge_pages = ENUM_HUGE_PAGES_THP;
+    }
+    else if (strcmp(huge_pages, "hugetlb") == 0) {
+        global_config.huge_pages = ENUM_HUGE_PAGES_HUGETLB;
+    }
+    else {
+        global_config.huge_pages = ENUM_HUGE_PAGES_INVALID;
+    }
+}
+
+void
+global_config_set_taint(bool taint)
+{
+    global_config.taint = taint;
+}
+
+void
+global_config_set_mmu_stats(bool mmu_stats)
+{
+    global_config.mmu_stats = mmu_stats;
+}
+
+// Parse a size like `4096`, `64K`, `16M` or `2G`. Returns 0 if invalid.
+static uint64_t
+parse_size(const char* size)
+{
+    char*          end   = NULL;
+    const uint64_t value = strtoull(size, &end, 0);
+    if (end == size) {
+        return 0;
+    }
+
+    uint64_t shift = 0;
+    switch (*end) {
+        case '\0':
+            return value;
+        case 'k':
+        case 'K':
+            shift = 10;
+            break;
+        case 'm':
+        case 'M':
+            shift = 20;
+            break;
+        case 'g':
+        case 'G':
+            shift = 30;
+            break;
+        default:
+            return 0;
+    }
+    if (end[1] != '\0' || value > (UINT64_MAX >> shift)) {
+        return 0;
+    }
+    return value << shift;
+}
+
+void
+global_config_set_memory_size(const char* memory_size)
+{
+    global_config.memory_size = parse_size(memory_size);
+}
+
+void
+global_config_set_stack_size(const char* stack_size)
+{
+    global_config.stack_size = parse_size(stack_size);
+}
+
+void
+global_config_set_memory_size_bytes(uint64_t memory_size)
+{
+    global_config.memory_size = memory_size;
+}
+
+void
+global_config_set_stack_size_bytes(uint64_t stack_size)
+{
+    global_config.stack_size = stack_size;
+}
+
+void
+global_config_set_auto_size(bool auto_size)
+{
+    global_config.auto_size = auto_size;
+}
+
+void
+global_config_set_seed(uint64_t seed)
+{
+    global_config.seed = seed;
+}
+
+void
+global_config_set_dictionary(char* dictionary)
+{
+    global_config.dictionary = dictionary;
+}
+
+void
+global_config_set_mutator(char* mutator)
+{
+    global_config.mutator = mutator;
+}
+
+void
+global_config_set_grammar(char* grammar)
+{
+    global_config.grammar = grammar;
+}
+
+void
+global_config_set_function(char* function)
+{
+    global_config.function = function;
+}
+
+void
+global_config_set_end_adrs(char* end_adrs)
+{
+    global_config.end_adrs = end_adrs;
+}
+
+void
+global_config_set_nested_adrs(char* nested_adrs)
+{
+    global_config.nested_adrs = nested_adrs;
+}
+
+void
+global_config_set_snapshot(char* snapshot)
+{
+    global_config.snapshot = snapshot;
+}
+
+void
+global_config_set_script(char* script)
+{
+    global_config.script = script;
+}
+
+void
+global_config_set_commands(char* commands)
+{
+    global_config.commands = commands;
+}
+
+void
+global_config_set_headless(bool headless)
+{
+    global_config.headless = headless;
+}
+
 bool
 global_config_get_verbosity(void)
 {
@@ -119,3 +308,117 @@ global_config_get_arch(void)
 {
     return global_config.arch;
 }
+
+enum_reset_mode_t
+global_config_get_reset_mode(void)
+{
+    return global_config.reset_mode;
+}
+
+enum_inject_mode_t
+global_config_get_inject_mode(void)
+{
+    return global_config.inject_mode;
+}
+
+enum_huge_pages_t
+global_config_get_huge_pages(void)
+{
+    return global_config.huge_pages;
+}
+
+bool
+global_config_get_taint(void)
+{
+    return global_config.taint;
+}
+
+bool
+global_config_get_mmu_stats(void)
+{
+    return global_config.mmu_stats;
+}
+
+uint64_t
+global_config_get_memory_size(void)
+{
+    return global_config.memory_size;
+}
+
+uint64_t
+global_config_get_stack_size(void)
+{
+    return global_config.stack_size;
+}
+
+bool
+global_config_get_auto_size(void)
+{
+    return global_config.auto_size;
+}
+
+uint64_t
+global_config_get_seed(void)
+{
+    return global_config.seed;
+}
+
+char*
+global_config_get_dictionary(void)
+{
+    return global_config.dictionary;
+}
+
+char*
+global_config_get_mutator(void)
+{
+    return global_config.mutator;
+}
+
+char*
+global_config_get_grammar(void)
+{
+    return global_config.grammar;
+}
+
+char*
+global_config_get_function(void)
+{
+    return global_config.function;
+}
+
+char*
+global_config_get_end_adrs(void)
+{
+    return global_config.end_adrs;
+}
+
+char*
+global_config_get_nested_adrs(void)
+{
+    return global_config.nested_adrs;
+}
+
+char*
+global_config_get_snapshot(void)
+{
+    return global_config.snapshot;
+}
+
+char*
+global_config_get_script(void)
+{
+    return global_config.script;
+}
+
+char*
+global_config_get_commands(void)
+{
+    return global_config.commands;
+}
+
+bool
+global_config_get_headless(void)
+{
+    return global_config.headless;
+}
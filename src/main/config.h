@@ -11,16 +11,54 @@ typedef enum {
     ENUM_SUPPORTED_ARCHS_MIPS64_MSB,
 } enum_supported_archs_t;
 
+typedef enum {
+    ENUM_RESET_MODE_INVALID,
+    ENUM_RESET_MODE_DIRTY_BLOCKS, // Copy every dirtied block back from the snapshot.
+    ENUM_RESET_MODE_COW,          // Drop copy-on-write pages of a private mapping of the snapshot.
+} enum_reset_mode_t;
+
+typedef enum {
+    ENUM_INJECT_MODE_INVALID,
+    ENUM_INJECT_MODE_COPY,        // Mutate a host copy of the input and write it to guest memory.
+    ENUM_INJECT_MODE_IN_PLACE,    // Mutate the input in guest memory.
+} enum_inject_mode_t;
+
+typedef enum {
+    ENUM_HUGE_PAGES_INVALID,
+    ENUM_HUGE_PAGES_NONE,    // Regular 4KiB pages.
+    ENUM_HUGE_PAGES_THP,     // Transparent huge pages, requested with madvise.
+    ENUM_HUGE_PAGES_HUGETLB, // Explicit 2MiB pages from the hugetlb pool.
+} enum_huge_pages_t;
+
 typedef struct {
     bool                   verbosity;
     bool                   coverage;
     uint64_t               nb_cpus;
     char*                  progress_dir;
     char*                  crashes_dir;
-    char*                  inputs_dir; // Inputs generated by mutation based fuzing.
-    char*                  corpus_dir; // Initial inputs provided by the user.
+    char*                  inputs_dir;  // Inputs generated by mutation based fuzing.
+    char*                  corpus_dir;  // Initial inputs provided by the user.
     char*                  target;
     enum_supported_archs_t arch;
+    enum_reset_mode_t      reset_mode;
+    enum_inject_mode_t     inject_mode;
+    enum_huge_pages_t      huge_pages;
+    bool                   taint;       // Track which fuzzcase bytes reach comparisons.
+    bool                   mmu_stats;   // Collect memory access statistics.
+    uint64_t               memory_size; // Bytes of guest memory per emulator.
+    uint64_t               stack_size;  // Bytes of guest stack.
+    bool                   auto_size;   // Size worker memory from runs of the corpus.
+    uint64_t               seed;        // Master seed of the worker random number generators.
+    char*                  dictionary;  // Dictionary file, merged with the tokens from the target.
+    char*                  mutator;     // Custom mutator shared object.
+    char*                  grammar;     // BNF grammar to generate fuzzcases from.
+    char*                  function;    // Symbol or address of the function called by the harness mode.
+    char*                  end_adrs;    // Comma separated symbols or addresses which end the fuzzcases.
+    char*                  nested_adrs; // Comma separated symbols or addresses to take nested snapshots at.
+    char*                  snapshot;    // Snapshot file to fuzz from, instead of running the debug CLI.
+    char*                  script;      // File of debug CLI commands to run before prompting.
+    char*                  commands;    // `;` separated debug CLI commands to run before prompting.
+    bool                   headless;    // Never prompt, fuzz once the script and commands are done.
 } global_config_t;
 
 void
@@ -50,6 +88,73 @@ global_config_set_target(char* target);
 void
 global_config_set_arch(char* arch);
 
+void
+global_config_set_reset_mode(char* reset_mode);
+
+void
+global_config_set_inject_mode(char* inject_mode);
+
+void
+global_config_set_huge_pages(char* huge_pages);
+
+void
+global_config_set_taint(bool taint);
+
+void
+global_config_set_mmu_stats(bool mmu_stats);
+
+// Sizes are given in bytes, with an optional `K`, `M` or `G` suffix. Invalid
+// sizes are stored as 0.
+void
+global_config_set_memory_size(const char* memory_size);
+
+void
+global_config_set_stack_size(const char* stack_size);
+
+// Used by automatic sizing, after the configured size has been used for the
+// snapshot, and by snapshot files, which bring their own sizes.
+void
+global_config_set_memory_size_bytes(uint64_t memory_size);
+
+void
+global_config_set_stack_size_bytes(uint64_t stack_size);
+
+void
+global_config_set_auto_size(bool auto_size);
+
+void
+global_config_set_seed(uint64_t seed);
+
+void
+global_config_set_dictionary(char* dictionary);
+
+void
+global_config_set_mutator(char* mutator);
+
+void
+global_config_set_grammar(char* grammar);
+
+void
+global_config_set_function(char* function);
+
+void
+global_config_set_end_adrs(char* end_adrs);
+
+void
+global_config_set_nested_adrs(char* nested_adrs);
+
+void
+global_config_set_snapshot(char* snapshot);
+
+void
+global_config_set_script(char* script);
+
+void
+global_config_set_commands(char* commands);
+
+void
+global_config_set_headless(bool headless);
+
 bool
 global_config_get_verbosity(void);
 
@@ -77,4 +182,61 @@ global_config_get_target(void);
 enum_supported_archs_t
 global_config_get_arch(void);
 
+enum_reset_mode_t
+global_config_get_reset_mode(void);
+
+enum_inject_mode_t
+global_config_get_inject_mode(void);
+
+enum_huge_pages_t
+global_config_get_huge_pages(void);
+
+bool
+global_config_get_taint(void);
+
+bool
+global_config_get_mmu_stats(void);
+
+uint64_t
+global_config_get_memory_size(void);
+
+uint64_t
+global_config_get_stack_size(void);
+
+bool
+global_config_get_auto_size(void);
+
+uint64_t
+global_config_get_seed(void);
+
+char*
+global_config_get_dictionary(void);
+
+char*
+global_config_get_mutator(void);
+
+char*
+global_config_get_grammar(void);
+
+char*
+global_config_get_function(void);
+
+char*
+global_config_get_end_adrs(void);
+
+char*
+global_config_get_nested_adrs(void);
+
+char*
+global_config_get_snapshot(void);
+
+char*
+global_config_get_script(void);
+
+char*
+global_config_get_commands(void);
+
+bool
+global_config_get_headless(void);
+
 #endif
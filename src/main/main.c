@@ -18,6 +18,7 @@
 #include "../emu/emu_generic.h"
 #include "../emu/emu_stats.h"
 #include "../snap/snapshot_engine.h"
+#include "../snap/snapshot_file.h"
 #include "../debug_cli/debug_cli.h"
 #include "../utils/cli.h"
 #include "../utils/dir.h"
@@ -42,9 +43,64 @@ static const char usage_string[] = ""
 "                     stored. Defaults to `./progress`.\n"
 " -v, --verbose       Print stdout from emulators to stdout.\n"
 " -n, --no-coverage   No coverage. Do not track coverage.\n"
+" -r, --reset         How emulators are reset to the snapshot after each fuzzcase, `dirty`\n"
+"                     or `cow`. Defaults to `dirty`.\n"
+" -I, --inject        How fuzzcases are put into guest memory, `copy` or `in-place`.\n"
+"                     Defaults to `copy`.\n"
+" -H, --huge-pages    Kind of pages backing guest memory, `none`, `thp` or `hugetlb`.\n"
+"                     Defaults to `thp`.\n"
+" -M, --memory        Bytes of guest memory per emulator, with an optional K, M or G\n"
+"                     suffix. Defaults to `5G`.\n"
+" -S, --stack         Bytes of guest stack, with an optional K, M or G suffix. Defaults\n"
+"                     to `1M`.\n"
+" -A, --auto-size     Run the corpus once after the snapshot is taken, and shrink the\n"
+"                     memory of the workers to what it used, with a margin.\n"
+" -s, --seed          Master seed of the random number generators of the workers. Runs\n"
+"                     with the same seed, snapshot, corpus and one job are identical.\n"
+"                     Defaults to a seed based on the time, which is logged at startup.\n"
+" -D, --dict          Dictionary file with tokens for the mutator, in the AFL format.\n"
+"                     Merged with strings and constants extracted from the target.\n"
+" -P, --mutator       Shared object with a custom mutator. See `src/snap/mutator_plugin_api.h`.\n"
+" -g, --grammar       BNF grammar file. Fuzzcases are generated from it and mutated as\n"
+"                     derivation trees. See `src/grammar/grammar.h` for the format.\n"
+" -F, --function      Harness mode. Every fuzzcase calls the function, given by symbol name\n"
+"                     or hex address, from the snapshot and ends when it returns.\n"
+" -E, --end           Comma separated symbols or hex addresses which end the fuzzcases\n"
+"                     gracefully when reached, e.g. to skip cleanup code. More can be\n"
+"                     added with the `end` command.\n"
+" -N, --nested        Comma separated symbols or hex addresses where workers take nested\n"
+"                     snapshots, when a fuzzcase reaches one along a new path, and fuzz\n"
+"                     from the one with the best recent yield.\n"
+" -L, --snapshot      Snapshot file saved with the `save` command to fuzz from, instead of\n"
+"                     running the target up to the snapshot in the debug CLI. Sets the\n"
+"                     memory and stack sizes to the ones it was saved with.\n"
+" -x, --script        File of debug CLI commands, one per line, to run before prompting.\n"
+"                     Lines starting with `#` are comments.\n"
+" -C, --commands      Debug CLI commands separated by `;`, run after the script.\n"
+" -X, --headless      Never prompt. Fuzzing starts once the script and the commands are\n"
+"                     done, and gingersnap exits with 1 if one of them fails, or if they\n"
+"                     did not set a snapshot and an injection slot.\n"
+" -m, --mmu-stats     Collect and print memory access statistics. Dirty blocks and the\n"
+"                     pcs dirtying them are only counted in the `dirty` reset mode.\n"
+" -T, --taint         Track which fuzzcase bytes reach comparisons, and focus mutations on\n"
+"                     them. rv64i and the `dirty` reset mode only.\n"
 " -h, --help          Print this help text.\n\n"
 "Supported architectures:\n"
 " - rv64i [RISC V 64 bit]\n\n"
+"Reset modes:\n"
+" - dirty [Copy back the 64 byte blocks written to by the fuzzcase]\n"
+" - cow   [Map the snapshot copy-on-write and drop the pages written to, using\n"
+"          /proc/self/pagemap]\n\n"
+"Injection modes:\n"
+" - copy     [Mutate a copy of the input, and write it to the fuzz buffer]\n"
+" - in-place [Write the input to the fuzz buffer and mutate it there. The input\n"
+"             is only rebuilt, by replaying its mutations, if it is kept. Not\n"
+"             with --grammar or --mutator]\n\n"
+"Huge pages:\n"
+" - none    [Regular 4KiB pages]\n"
+" - thp     [Transparent huge pages, requested with madvise]\n"
+" - hugetlb [2MiB pages from the hugetlb pool, falling back to thp if the pool\n"
+"            cannot back all of guest memory. See /proc/sys/vm/nr_hugepages]\n\n"
 "Available pre-fuzzing commands:\n"
 " xmem       Examine emulator memory.\n"
 " smem       Search for sequence of bytes in guest memory.\n"
@@ -52,12 +108,18 @@ static const char usage_string[] = ""
 " ir         Show emulator registers.\n"
 " break      Set breakpoint.\n"
 " watch      Set register watchpoint.\n"
+" mwatch     Set memory watchpoint.\n"
 " sbreak     Show all breakpoints.\n"
 " swatch     Show all watchpoints.\n"
 " continue   Run emulator until breakpoint or program exit.\n"
 " snapshot   Take a snapshot.\n"
+" autosnap   Snapshot before the first read of the buffer to fuzz.\n"
 " adr        Set the address in guest memory where fuzzed input will be injected.\n"
 " length     Set the fuzzer injection input length.\n"
+" inject     Add a slot or a sink to the injection layout.\n"
+" end        Add an address which ends the fuzzcases.\n"
+" save       Save the snapshot and the layout to a file.\n"
+" load       Load a snapshot and its layout from a file.\n"
 " go         Try to start the fuzzer.\n"
 " options    Show values of the adjustable options.\n"
 " help       Displays help text of a command.\n"
@@ -82,14 +144,13 @@ extern global_config_t global_config;
 
 // Used as argument to the threads running the emulators.
 typedef struct {
-    pthread_t       thread_id;    // ID returned by pthread_create().
-    uint64_t        thread_num;   // Application-defined thread number.
-    const target_t* target;       // The target executable.
-    emu_stats_t*    shared_stats; // Collected statistics, reported by the worker threads.
-    corpus_t*       corpus;       // Data which the fuzz inputs are based on. Shared between threads.
-    uint64_t        fuzz_buf_adr;
-    uint64_t        fuzz_buf_size;
-    const emu_t*    clean_snapshot;
+    pthread_t              thread_id;    // ID returned by pthread_create().
+    uint64_t               thread_num;   // Application-defined thread number.
+    const target_t*        target;       // The target executable.
+    emu_stats_t*           shared_stats; // Collected statistics, reported by the worker threads.
+    corpus_t*              corpus;       // Data which the fuzz inputs are based on. Shared between threads.
+    const inject_layout_t* layout;       // Where fuzzcases are injected.
+    const emu_t*           clean_snapshot;
 } thread_info_t;
 
 static char*
@@ -106,6 +167,50 @@ arch_to_str(enum_supported_archs_t arch)
     }
 }
 
+static char*
+reset_mode_to_str(enum_reset_mode_t reset_mode)
+{
+    switch (reset_mode)
+    {
+        case ENUM_RESET_MODE_DIRTY_BLOCKS:
+            return "Dirty blocks";
+        case ENUM_RESET_MODE_COW:
+            return "Copy-on-write";
+        default:
+            return "Unrecognized";
+    }
+}
+
+static char*
+inject_mode_to_str(enum_inject_mode_t inject_mode)
+{
+    switch (inject_mode)
+    {
+        case ENUM_INJECT_MODE_COPY:
+            return "Copy";
+        case ENUM_INJECT_MODE_IN_PLACE:
+            return "In place";
+        default:
+            return "Unrecognized";
+    }
+}
+
+static char*
+huge_pages_to_str(enum_huge_pages_t huge_pages)
+{
+    switch (huge_pages)
+    {
+        case ENUM_HUGE_PAGES_NONE:
+            return "None";
+        case ENUM_HUGE_PAGES_THP:
+            return "Transparent";
+        case ENUM_HUGE_PAGES_HUGETLB:
+            return "Hugetlb";
+        default:
+            return "Unrecognized";
+    }
+}
+
 static void
 usage_string_print(void)
 {
@@ -123,8 +228,6 @@ worker_run(void* arg)
     // Thread arguments.
     thread_info_t*  t_info         = arg;
     const target_t* target         = t_info->target;
-    const uint64_t  fuzz_buf_adr   = t_info->fuzz_buf_adr;
-    const uint64_t  fuzz_buf_size  = t_info->fuzz_buf_size;
     corpus_t*       corpus         = t_info->corpus;
     const emu_t*    clean_snapshot = t_info->clean_snapshot;
     emu_stats_t*    shared_stats   = t_info->shared_stats;
@@ -132,22 +235,25 @@ worker_run(void* arg)
     // Create the thread local snapshot engine.
     snapshot_engine_t* engine = snapshot_engine_create(global_config_get_arch(),
                                 corpus,
-                                fuzz_buf_adr,
-                                fuzz_buf_size,
+                                t_info->layout,
                                 target,
                                 clean_snapshot,
-                                global_config_get_crashes_dir());
+                                global_config_get_crashes_dir(),
+                                t_info->thread_num);
+
+    // Report whether we got the huge pages we asked for. The engine has synced
+    // its memory with the snapshot, so the used part of it is populated.
+    const mmu_t* mmu = engine->emu->get_mmu(engine->emu);
+    ginger_log(INFO, "Worker %lu guest memory pages: %s, %lu MiB in huge pages\n",
+               t_info->thread_num, huge_pages_to_str(mmu->huge_pages), mmu_huge_page_bytes(mmu) / (1024 * 1024));
 
     // A timestamp which is used for comparison.
     struct timespec checkpoint;
     clock_gettime(CLOCK_MONOTONIC, &checkpoint);
 
     for (;;) {
-        // Run one fuzzcase.
-        engine->fuzz(engine);
-
-        // If we crashed, write input to disk.
-        enum_emu_exit_reasons_t exit_reason = engine->emu->get_exit_reason(engine->emu);
+        // Run one fuzzcase. If we crashed, write input to disk.
+        const enum_emu_exit_reasons_t exit_reason = engine->fuzz(engine);
         if (exit_reason != EMU_EXIT_REASON_GRACEFUL) {
             if (exit_reason == EMU_EXIT_REASON_SYSCALL_NOT_SUPPORTED) {
                 ginger_log(ERROR, "Unsupported syscall!\n");
@@ -158,17 +264,19 @@ worker_run(void* arg)
 
         // If the fuzz case generated new code coverage, save it to the corpus.
         if (engine->emu->get_new_coverage(engine->emu)) {
-            corpus_add_input(engine->emu->get_corpus(engine->emu), engine->curr_input);
+            engine->write_input(engine);
+            uint64_t corpus_idx = 0;
+            if (engine->promote_input(engine, &corpus_idx)) {
+                mutator_det_enqueue(engine->mutator, corpus_idx, engine->emu->get_path_hash(engine->emu));
+            }
             emu_stats_inc(engine->stats, EMU_COUNTERS_INPUTS);
         }
-        // We do not care for inputs which did not generate new coverage, so we
-        // can free it.
-        else {
-            corpus_input_destroy(engine->curr_input);
-        }
 
-        // Restore the emulator to its initial state.
-        engine->emu->reset(engine->emu, engine->clean_snapshot);
+        // Restore the emulator to its initial state, timing how long it takes
+        // so that the reset modes can be compared.
+        struct timespec reset_start;
+        clock_gettime(CLOCK_MONOTONIC, &reset_start);
+        engine->reset(engine);
 
         // Increment the counter counting emulator resets.
         emu_stats_inc(engine->stats, EMU_COUNTERS_RESETS);
@@ -176,6 +284,8 @@ worker_run(void* arg)
         // Update the main stats with data from the thread local stats if the time is right.
         struct timespec current;
         clock_gettime(CLOCK_MONOTONIC, &current);
+        engine->stats->nb_reset_ns += ((current.tv_sec - reset_start.tv_sec) * 1e9) +
+                                       (current.tv_nsec - reset_start.tv_nsec);
         const time_t   elapsed_s = current.tv_sec - checkpoint.tv_sec;
         const uint64_t elapsed_ns = (elapsed_s * 1e9) + (current.tv_nsec - checkpoint.tv_nsec);
 
@@ -191,6 +301,10 @@ worker_run(void* arg)
             shared_stats->nb_segfault_reads        += engine->stats->nb_segfault_reads;
             shared_stats->nb_segfault_writes       += engine->stats->nb_segfault_writes;
             shared_stats->nb_invalid_opcodes       += engine->stats->nb_invalid_opcodes;
+            shared_stats->nb_stack_overflows       += engine->stats->nb_stack_overflows;
+            shared_stats->nb_reset_ns              += engine->stats->nb_reset_ns;
+            mmu_stats_merge(&shared_stats->mmu, &engine->stats->mmu);
+            mutator_stats_merge(&shared_stats->mutator, &engine->stats->mutator);
             pthread_mutex_unlock(&shared_stats->lock);
             // Reset the timer checkpoint.
             clock_gettime(CLOCK_MONOTONIC, &checkpoint);
@@ -213,12 +327,31 @@ handle_cli_args(int argc, char** argv)
         {"progress",     required_argument, NULL, 'p'},
         {"verbose",      no_argument,       NULL, 'v'},
         {"no-coverage",  no_argument,       NULL, 'n'},
+        {"reset",        required_argument, NULL, 'r'},
+        {"inject",       required_argument, NULL, 'I'},
+        {"huge-pages",   required_argument, NULL, 'H'},
+        {"memory",       required_argument, NULL, 'M'},
+        {"stack",        required_argument, NULL, 'S'},
+        {"auto-size",    no_argument,       NULL, 'A'},
+        {"seed",         required_argument, NULL, 's'},
+        {"dict",         required_argument, NULL, 'D'},
+        {"mutator",      required_argument, NULL, 'P'},
+        {"grammar",      required_argument, NULL, 'g'},
+        {"function",     required_argument, NULL, 'F'},
+        {"end",          required_argument, NULL, 'E'},
+        {"nested",       required_argument, NULL, 'N'},
+        {"snapshot",     required_argument, NULL, 'L'},
+        {"script",       required_argument, NULL, 'x'},
+        {"commands",     required_argument, NULL, 'C'},
+        {"headless",     no_argument,       NULL, 'X'},
+        {"mmu-stats",    no_argument,       NULL, 'm'},
+        {"taint",        no_argument,       NULL, 'T'},
         {"help",         no_argument,       NULL, 'h'},
         {NULL, 0, NULL, 0}
     };
 
     int ch = -1;
-    while ((ch = getopt_long(argc, argv, "t:c:j:p:a:vnh", long_options, NULL)) != -1) {
+    while ((ch = getopt_long(argc, argv, "t:c:j:p:a:r:I:H:M:S:s:D:P:g:F:E:N:L:x:C:vnAmXTh", long_options, NULL)) != -1) {
         switch (ch)
         {
         case 't':
@@ -242,6 +375,63 @@ handle_cli_args(int argc, char** argv)
         case 'n':
             global_config_set_coverage(false);
             break;
+        case 'r':
+            global_config_set_reset_mode(optarg);
+            break;
+        case 'I':
+            global_config_set_inject_mode(optarg);
+            break;
+        case 'H':
+            global_config_set_huge_pages(optarg);
+            break;
+        case 'M':
+            global_config_set_memory_size(optarg);
+            break;
+        case 'S':
+            global_config_set_stack_size(optarg);
+            break;
+        case 'A':
+            global_config_set_auto_size(true);
+            break;
+        case 's':
+            global_config_set_seed(strtoull(optarg, NULL, 0));
+            break;
+        case 'D':
+            global_config_set_dictionary(optarg);
+            break;
+        case 'P':
+            global_config_set_mutator(optarg);
+            break;
+        case 'g':
+            global_config_set_grammar(optarg);
+            break;
+        case 'F':
+            global_config_set_function(optarg);
+            break;
+        case 'E':
+            global_config_set_end_adrs(optarg);
+            break;
+        case 'N':
+            global_config_set_nested_adrs(optarg);
+            break;
+        case 'L':
+            global_config_set_snapshot(optarg);
+            break;
+        case 'x':
+            global_config_set_script(optarg);
+            break;
+        case 'C':
+            global_config_set_commands(optarg);
+            break;
+        case 'X':
+            global_config_set_headless(true);
+            break;
+        case 'm':
+            global_config_set_mmu_stats(true);
+            break;
+        case 'T':
+            global_config_set_taint(true);
+            break;
         case 'h':
             usage_string_print();
             exit(0);
@@ -262,6 +452,77 @@ handle_cli_args(int argc, char** argv)
         ginger_log(ERROR, "Invalid or missing required argument [-a, --arch]\n");
         ok = false;
     }
+    if (global_config_get_reset_mode() == ENUM_RESET_MODE_INVALID) {
+        ginger_log(ERROR, "Invalid argument [-r, --reset]\n");
+        ok = false;
+    }
+    if (global_config_get_inject_mode() == ENUM_INJECT_MODE_INVALID) {
+        ginger_log(ERROR, "Invalid argument [-I, --inject]\n");
+        ok = false;
+    }
+    // In-place fuzzcases are rebuilt by replaying their mutations, which
+    // custom mutators and grammar trees can not be relied on for.
+    if (global_config_get_inject_mode() == ENUM_INJECT_MODE_IN_PLACE &&
+        (global_config_get_mutator() || global_config_get_grammar())) {
+        ginger_log(ERROR, "[-I, --inject] `in-place` can not be combined with --mutator or --grammar\n");
+        ok = false;
+    }
+    // A harness resets the call to the function for every fuzzcase, which
+    // nested snapshots taken inside of it would skip.
+    if (global_config_get_nested_adrs() && global_config_get_function()) {
+        ginger_log(ERROR, "[-N, --nested] can not be combined with --function\n");
+        ok = false;
+    }
+    // The debug CLI is skipped when loading a snapshot file, and a headless
+    // run has nothing else to take the snapshot with.
+    if (global_config_get_snapshot() && (global_config_get_script() || global_config_get_commands())) {
+        ginger_log(ERROR, "[-x, --script] and [-C, --commands] can not be combined with --snapshot\n");
+        ok = false;
+    }
+    if (global_config_get_headless() && !global_config_get_script() && !global_config_get_commands() &&
+        !global_config_get_snapshot()) {
+        ginger_log(ERROR, "[-X, --headless] needs --script, --commands or --snapshot\n");
+        ok = false;
+    }
+    if (global_config_get_huge_pages() == ENUM_HUGE_PAGES_INVALID) {
+        ginger_log(ERROR, "Invalid argument [-H, --huge-pages]\n");
+        ok = false;
+    }
+    if (global_config_get_memory_size() == 0 || global_config_get_memory_size() % MMU_PAGE_SIZE != 0) {
+        ginger_log(ERROR, "Invalid argument [-M, --memory], has to be a multiple of the page size\n");
+        ok = false;
+    }
+    if (global_config_get_stack_size() <= MMU_STACK_GUARD_SIZE || global_config_get_stack_size() % 16 != 0) {
+        ginger_log(ERROR, "Invalid argument [-S, --stack], has to be 16 byte aligned and larger than the guard page\n");
+        ok = false;
+    }
+    else if (global_config_get_stack_size() >= global_config_get_memory_size()) {
+        ginger_log(ERROR, "The stack [-S, --stack] has to be smaller than the memory [-M, --memory]\n");
+        ok = false;
+    }
+    // Taint propagation is only implemented for RISC V, and the shadow memory
+    // is reset along with the dirty blocks.
+    if (global_config_get_taint()) {
+        if (global_config_get_arch() != ENUM_SUPPORTED_ARCHS_RISCV64I_LSB) {
+            ginger_log(ERROR, "[-T, --taint] requires the rv64i architecture\n");
+            ok = false;
+        }
+        if (global_config_get_reset_mode() != ENUM_RESET_MODE_DIRTY_BLOCKS) {
+            ginger_log(ERROR, "[-T, --taint] requires the `dirty` reset mode\n");
+            ok = false;
+        }
+    }
+
+    // Fail early rather than in every worker if the custom mutator can not be
+    // loaded.
+    if (global_config_get_mutator()) {
+        mutator_plugin_t* plugin = mutator_plugin_open(global_config_get_mutator());
+        if (!plugin) {
+            ginger_log(ERROR, "Invalid argument [-P, --mutator]\n");
+            ok = false;
+        }
+        mutator_plugin_close(plugin);
+    }
 
     if (!ok) {
         exit(1);
@@ -274,6 +535,25 @@ handle_cli_args(int argc, char** argv)
     ginger_log(INFO, "Target:       %s\n",  global_config_get_target());
     ginger_log(INFO, "Progress dir: %s\n",  global_config_get_progress_dir());
     ginger_log(INFO, "Arch:         %s\n",  arch_to_str(global_config_get_arch()));
+    ginger_log(INFO, "Reset mode:   %s\n",  reset_mode_to_str(global_config_get_reset_mode()));
+    ginger_log(INFO, "Inject mode:  %s\n",  inject_mode_to_str(global_config_get_inject_mode()));
+    ginger_log(INFO, "Huge pages:   %s\n",  huge_pages_to_str(global_config_get_huge_pages()));
+    ginger_log(INFO, "Memory size:  0x%lx\n", global_config_get_memory_size());
+    ginger_log(INFO, "Stack size:   0x%lx\n", global_config_get_stack_size());
+    ginger_log(INFO, "Auto size:    %s\n",  global_config_get_auto_size() ? "true" : "false");
+    ginger_log(INFO, "Seed:         0x%lx\n", global_config_get_seed());
+    ginger_log(INFO, "Dictionary:   %s\n",  global_config_get_dictionary() ? global_config_get_dictionary() : "none");
+    ginger_log(INFO, "Mutator:      %s\n",  global_config_get_mutator() ? global_config_get_mutator() : "built-in");
+    ginger_log(INFO, "Grammar:      %s\n",  global_config_get_grammar() ? global_config_get_grammar() : "none");
+    ginger_log(INFO, "Function:     %s\n",  global_config_get_function() ? global_config_get_function() : "none");
+    ginger_log(INFO, "End adrs:     %s\n",  global_config_get_end_adrs() ? global_config_get_end_adrs() : "none");
+    ginger_log(INFO, "Nested adrs:  %s\n",  global_config_get_nested_adrs() ? global_config_get_nested_adrs() : "none");
+    ginger_log(INFO, "Snapshot:     %s\n",  global_config_get_snapshot() ? global_config_get_snapshot() : "none");
+    ginger_log(INFO, "Script:       %s\n",  global_config_get_script() ? global_config_get_script() : "none");
+    ginger_log(INFO, "Commands:     %s\n",  global_config_get_commands() ? global_config_get_commands() : "none");
+    ginger_log(INFO, "Headless:     %s\n",  global_config_get_headless() ? "true" : "false");
+    ginger_log(INFO, "Taint:        %s\n",  global_config_get_taint() ? "true" : "false");
+    ginger_log(INFO, "MMU stats:    %s\n",  global_config_get_mmu_stats() ? "true" : "false");
 }
 
 static uint8_t
@@ -303,6 +583,146 @@ init_default_config(void)
     global_config_set_coverage(true);
     global_config_set_nb_cpus(nb_active_cpus());
     global_config_set_progress_dir("./progress");
+    global_config_set_reset_mode("dirty");
+    global_config_set_inject_mode("copy");
+    global_config_set_huge_pages("thp");
+    global_config_set_memory_size("5G");
+    global_config_set_stack_size("1M");
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    global_config_set_seed(((uint64_t)now.tv_sec << 32) ^ now.tv_nsec ^ getpid());
+}
+
+// Run every corpus input once from the snapshot, and shrink the memory of the
+// workers to what the runs used, with a margin. Only the heap and the mmap
+// regions can be resized, as the stack is part of the snapshot. The stack
+// depth is reported so that the stack size can be tuned for the next session.
+static void
+auto_size_memory(const target_t* target, corpus_t* corpus, const debug_cli_result_t* cli_result)
+{
+    const emu_t* snapshot     = cli_result->snapshot;
+    const mmu_t* snapshot_mmu = snapshot->get_mmu(snapshot);
+    if (snapshot_mmu->mmap_floor_adr != snapshot_mmu->memory_size) {
+        ginger_log(WARNING, "The snapshot has mapped memory at its top, keeping the configured memory size\n");
+        return;
+    }
+
+    // The snapshot has not been exported yet, so the engine uses dirty block
+    // resets, which also tell us how deep the stack got.
+    snapshot_engine_t* engine = snapshot_engine_create(global_config_get_arch(),
+                                corpus,
+                                &cli_result->layout,
+                                target,
+                                snapshot,
+                                global_config_get_crashes_dir(),
+                                0);
+    mmu_t* mmu = engine->emu->get_mmu(engine->emu);
+
+    const uint64_t stack_size = global_config_get_stack_size();
+    const uint64_t stack_top  = mmu->initial_stack_adr_virt + stack_size;
+    uint64_t       heap_peak  = mmu->curr_alloc_adr;
+    uint64_t       mmap_peak  = 0;
+    uint64_t       stack_low  = stack_top;
+
+    const uint64_t nb_inputs = corpus_nb_inputs(corpus);
+    for (uint64_t i = 0; i < nb_inputs; i++) {
+        const input_t* input = corpus_get_input(corpus, i);
+        const uint64_t len   = input->length < engine->fuzz_buf_size ? input->length : engine->fuzz_buf_size;
+        if (len == 0) {
+            continue;
+        }
+        engine->inject(engine, input->data, len);
+        engine->run(engine);
+
+        if (mmu->curr_alloc_adr > heap_peak) {
+            heap_peak = mmu->curr_alloc_adr;
+        }
+        if (mmu->memory_size - mmu->mmap_floor_adr > mmap_peak) {
+            mmap_peak = mmu->memory_size - mmu->mmap_floor_adr;
+        }
+
+        // The stack grows downwards, so its lowest dirty block is as deep as
+        // it got during the run.
+        const dirty_state_t* dirty_state = mmu->dirty_state;
+        for (uint64_t j = 0; j < dirty_state->nb_dirty_blocks; j++) {
+            const uint64_t block_adr = dirty_state->dirty_blocks[j] * DIRTY_BLOCK_SIZE;
+            if (block_adr >= mmu->initial_stack_adr_virt && block_adr < stack_low) {
+                stack_low = block_adr;
+            }
+        }
+
+        engine->emu->reset(engine->emu, snapshot);
+    }
+    snapshot_engine_destroy(engine);
+
+    // Mutated inputs will want more than the seeds did, so double it.
+    uint64_t memory_size = (heap_peak + mmap_peak) * 2;
+    memory_size = (memory_size + (2 * MiB) - 1) & ~((2 * MiB) - 1);
+    if (memory_size < global_config_get_memory_size()) {
+        global_config_set_memory_size_bytes(memory_size);
+    }
+
+    ginger_log(INFO, "Auto size: heap peak 0x%lx, mapped peak 0x%lx, stack depth 0x%lx of 0x%lx\n",
+               heap_peak, mmap_peak, stack_top - stack_low, stack_size);
+    ginger_log(INFO, "Auto size: worker memory size 0x%lx\n", global_config_get_memory_size());
+    if ((stack_top - stack_low) > (stack_size / 4) * 3) {
+        ginger_log(WARNING, "The corpus used most of the stack, consider a larger [-S, --stack]\n");
+    }
+}
+
+// Address of a location given as a symbol of the target or as a hex address.
+static bool
+resolve_adr(const target_t* target, const char* location, uint64_t* adr)
+{
+    if (elf_lookup_symbol(target->elf, location, adr)) {
+        return true;
+    }
+
+    char* end = NULL;
+    *adr = strtoull(location, &end, 16);
+    return end != location && *end == '\0';
+}
+
+// Set `bit` on the instructions at the comma separated `locations`.
+static bool
+mark_instructions(const target_t* target, mmu_t* mmu, char* locations, uint8_t bit, const char* arg_name)
+{
+    token_str_t* tokens = token_str_tokenize(locations, ",");
+    for (int i = 0; i < tokens->nb_tokens; i++) {
+        uint64_t adr = 0;
+        if (!resolve_adr(target, tokens->tokens[i], &adr) || !mmu_mark_instruction(mmu, adr, bit)) {
+            ginger_log(ERROR, "Invalid argument [%s] %s\n", arg_name, tokens->tokens[i]);
+            token_str_destroy(tokens);
+            return false;
+        }
+    }
+    token_str_destroy(tokens);
+    return true;
+}
+
+// Set the end bit on the addresses given with `--end` and `end`, and the
+// snapshot bit on the ones given with `--nested`.
+static bool
+set_stop_adrs(const target_t* target, const debug_cli_result_t* cli_result)
+{
+    mmu_t* mmu = cli_result->snapshot->get_mmu(cli_result->snapshot);
+
+    if (global_config_get_end_adrs() &&
+        !mark_instructions(target, mmu, global_config_get_end_adrs(), MMU_PERM_END, "-E, --end")) {
+        return false;
+    }
+    if (global_config_get_nested_adrs() &&
+        !mark_instructions(target, mmu, global_config_get_nested_adrs(), MMU_PERM_SNAPSHOT, "-N, --nested")) {
+        return false;
+    }
+    for (size_t i = 0; i < cli_result->nb_end_adrs; i++) {
+        if (!mmu_mark_instruction(mmu, cli_result->end_adrs[i], MMU_PERM_END)) {
+            ginger_log(ERROR, "Could not set end address 0x%lx!\n", cli_result->end_adrs[i]);
+            return false;
+        }
+    }
+    return true;
 }
 
 static bool
@@ -364,8 +784,6 @@ main(int argc, char** argv)
     // Provided cli args overwrites the default config.
     handle_cli_args(argc, argv);
 
-    srand(time(NULL));
-
     if (!output_dirs_create()) {
         ginger_log(ERROR, "Failed to create output dirs!\n");
         exit(1);
@@ -384,35 +802,178 @@ main(int argc, char** argv)
     // Multiple emus can use the same target since it is only read from and never written to.
     const target_t* target = target_create(target_tokens->nb_tokens, target_argv);
 
+    // Merge the user supplied tokens with the ones extracted from the target.
+    if (global_config_get_dictionary()) {
+        if (!dictionary_load_file(target->elf->dictionary, global_config_get_dictionary())) {
+            ginger_log(ERROR, "Failed to load dictionary file %s\n", global_config_get_dictionary());
+            exit(1);
+        }
+    }
+    ginger_log(INFO, "Dictionary tokens: %lu\n", target->elf->dictionary->nb_tokens);
+
+    uint64_t function_adr = 0;
+    if (global_config_get_function()) {
+        if (!resolve_adr(target, global_config_get_function(), &function_adr)) {
+            ginger_log(ERROR, "Invalid argument [-F, --function]\n");
+            exit(1);
+        }
+        ginger_log(INFO, "Function adr: 0x%lx\n", function_adr);
+    }
+
     // Create an initial emulator, for taking the initial snapshot. This emulator will not be
     // used to fuzz, but the snapshotted state will be passed to the worker emulators as the
     // pre-fuzzed state which they will be reset to after a fuzz case is ran.
     corpus_t* shared_corpus = corpus_create(global_config_get_corpus_dir());
+    if (global_config_get_grammar()) {
+        shared_corpus->grammar = grammar_load(global_config_get_grammar());
+        if (!shared_corpus->grammar) {
+            ginger_log(ERROR, "Invalid argument [-g, --grammar]\n");
+            exit(1);
+        }
+    }
 
-    emu_t* initial_emu = emu_create(global_config_get_arch(), EMU_TOTAL_MEM, shared_corpus);
+    // A snapshot file brings the memory and stack sizes it was saved with,
+    // which the initial emulator and the workers have to share.
+    snapshot_file_t* snapshot_file = NULL;
+    if (global_config_get_snapshot()) {
+        snapshot_file = snapshot_file_open(global_config_get_snapshot());
+        if (!snapshot_file) {
+            exit(1);
+        }
+        if (snapshot_file->arch != global_config_get_arch()) {
+            ginger_log(ERROR, "[-L, --snapshot] was saved for %s!\n", arch_to_str(snapshot_file->arch));
+            exit(1);
+        }
+        global_config_set_memory_size_bytes(snapshot_file->memory_size);
+        global_config_set_stack_size_bytes(snapshot_file->stack_size);
+        ginger_log(INFO, "Snapshot memory size: 0x%lx, stack size: 0x%lx\n",
+                   snapshot_file->memory_size, snapshot_file->stack_size);
+    }
+
+    emu_t* initial_emu = emu_create(global_config_get_arch(), global_config_get_memory_size(),
+                                    global_config_get_stack_size(), shared_corpus);
+
+    debug_cli_result_t* cli_result = NULL;
+    if (snapshot_file) {
+        // The file has the elf, the stack and everything the debug CLI would
+        // have set.
+        cli_result = calloc(1, sizeof(debug_cli_result_t));
+        if (!cli_result ||
+            !snapshot_file_load(snapshot_file, initial_emu, &cli_result->layout,
+                                cli_result->end_adrs, &cli_result->nb_end_adrs)) {
+            ginger_log(ERROR, "Failed to load [-L, --snapshot] %s\n", global_config_get_snapshot());
+            exit(1);
+        }
+        snapshot_file_close(snapshot_file);
+        cli_result->snapshot     = initial_emu;
+        cli_result->snapshot_set = true;
+        ginger_log(INFO, "Loaded snapshot at PC 0x%lx\n", initial_emu->get_pc(initial_emu));
+    }
+    else {
+        initial_emu->load_elf(initial_emu, target);
+        initial_emu->build_stack(initial_emu, target);
+
+        // Create a debugging CLI using the initial emulator.
+        cli_t* debug_cli = debug_cli_create();
+
+        // Run the script and the commands first, stopping at the first one
+        // which fails, or at `go`.
+        if (global_config_get_script()) {
+            cli_result = debug_cli_run_script(initial_emu, debug_cli, global_config_get_script());
+            if (!cli_result) {
+                exit(1);
+            }
+        }
+        if (global_config_get_commands() && !(cli_result && cli_result->go)) {
+            cli_result = debug_cli_run_commands(initial_emu, debug_cli, global_config_get_commands());
+            if (!cli_result) {
+                exit(1);
+            }
+        }
+        if (cli_result) {
+            printf("\n");
+        }
+
+        // Headless runs treat the end of the commands as `go`, and have no one
+        // to ask for what is missing.
+        if (global_config_get_headless()) {
+            if (!cli_result->snapshot_set || cli_result->layout.nb_slots == 0) {
+                ginger_log(ERROR, "[-X, --headless] The commands did not set a snapshot and an injection slot "
+                           "(snapshot set: %u, injection slots set: %lu)\n",
+                           cli_result->snapshot_set, cli_result->layout.nb_slots);
+                exit(1);
+            }
+        }
+        else {
+            // Run the CLI. If we get a snapshot from it, use it, otherwise exit the program. The snapshot
+            // is simply a pointer to the `initial_emu`.
+            if (!cli_result || !cli_result->go) {
+                cli_result = debug_cli_run(initial_emu, debug_cli);
+            }
+            while (!cli_result->snapshot_set || cli_result->layout.nb_slots == 0) {
+
+                printf("\nAll mandatory options not set\n"      \
+                       "Snapshot set:                     %u\n" \
+                       "Injection slots set:              %lu\n" \
+                       "Set a slot with `adr` and `length`, or with `inject`.\n",
+                       cli_result->snapshot_set,
+                       cli_result->layout.nb_slots);
+                cli_result = debug_cli_run(initial_emu, debug_cli);
+            }
+        }
+    }
+
+    // Fuzzcases mutated in place go to a single buffer as they are.
+    if (global_config_get_inject_mode() == ENUM_INJECT_MODE_IN_PLACE && !inject_layout_is_raw(&cli_result->layout)) {
+        ginger_log(ERROR, "[-I, --inject] `in-place` needs a single memory slot to inject to!\n");
+        exit(1);
+    }
+
+    // In harness mode every fuzzcase starts with the call to the function,
+    // which returns to the sentinel. Its arguments are set by the sinks.
+    if (global_config_get_function()) {
+        cli_result->snapshot->call(cli_result->snapshot, function_adr, EMU_RETURN_SENTINEL);
+    }
+
+    // Nested snapshots are taken at the same program counter with different
+    // state, so registers can not be injected to.
+    if (global_config_get_nested_adrs()) {
+        bool uses_regs = false;
+        for (size_t i = 0; i < cli_result->layout.nb_slots; i++) {
+            uses_regs |= cli_result->layout.slots[i].kind == INJECT_SLOT_REG;
+        }
+        for (size_t i = 0; i < cli_result->layout.nb_sinks; i++) {
+            uses_regs |= cli_result->layout.sinks[i].to_reg;
+        }
+        if (uses_regs) {
+            ginger_log(ERROR, "[-N, --nested] can not be combined with register slots or sinks!\n");
+            exit(1);
+        }
+    }
 
-    initial_emu->load_elf(initial_emu, target);
-    initial_emu->build_stack(initial_emu, target);
+    // End and snapshot addresses are set now, so that they do not stop the
+    // debug CLI.
+    if (!set_stop_adrs(target, cli_result)) {
+        exit(1);
+    }
 
-    // Create a debugging CLI using the initial emulator.
-    cli_t* debug_cli = debug_cli_create();
+    // Memory watchpoints are only for the debug CLI, the workers should not
+    // pay for them.
+    mmu_clear_watchpoints(cli_result->snapshot->get_mmu(cli_result->snapshot));
 
-    // Run the CLI. If we get a snapshot from it, use it, otherwise exit the program. The snapshot
-    // is simply a pointer to the `initial_emu`.
-    debug_cli_result_t* cli_result = debug_cli_run(initial_emu, debug_cli);
-    while (!cli_result->snapshot_set     ||
-           !cli_result->fuzz_buf_adr_set ||
-           !cli_result->fuzz_buf_size_set) {
+    if (global_config_get_auto_size()) {
+        auto_size_memory(target, shared_corpus, cli_result);
+    }
 
-        printf("\nAll mandatory options not set\n"      \
-               "Snapshot set:                     %u\n" \
-               "Fuzzing buffer start address set: %u\n" \
-               "Fuzzing buffer size set:          %u\n",
-               cli_result->snapshot_set,
-               cli_result->fuzz_buf_adr_set,
-               cli_result->fuzz_buf_size_set);
-        cli_result = debug_cli_run(initial_emu, debug_cli);
+    // In copy-on-write mode the workers map the snapshot memory instead of
+    // copying it, so it has to be placed in a memfd first.
+    if (global_config_get_reset_mode() == ENUM_RESET_MODE_COW) {
+        if (!mmu_cow_export(cli_result->snapshot->get_mmu(cli_result->snapshot))) {
+            ginger_log(ERROR, "Failed to export the snapshot for copy-on-write resets!\n");
+            exit(1);
+        }
     }
+
     // Can be used for all threads.
     pthread_attr_t thread_attr = {0};
     pthread_attr_init(&thread_attr);
@@ -445,8 +1006,7 @@ main(int argc, char** argv)
         t_info[i].shared_stats   = shared_stats;
         t_info[i].corpus         = shared_corpus;
         t_info[i].clean_snapshot = cli_result->snapshot;
-        t_info[i].fuzz_buf_adr   = cli_result->fuzz_buf_adr;
-        t_info[i].fuzz_buf_size  = cli_result->fuzz_buf_size;
+        t_info[i].layout         = &cli_result->layout;
 
         ok = pthread_create(&t_info[i].thread_id, &thread_attr, &worker_run, &t_info[i]);
         if (ok != 0) {
@@ -477,6 +1037,7 @@ main(int argc, char** argv)
     clock_gettime(CLOCK_MONOTONIC, &checkpoint);
     uint64_t prev_nb_exec_inst = 0;
     uint64_t prev_nb_resets    = 0;
+    uint64_t prev_nb_reset_ns  = 0;
     for (;;) {
         clock_gettime(CLOCK_MONOTONIC, &current);
         const uint64_t elapsed_s  = current.tv_sec - checkpoint.tv_sec;
@@ -494,9 +1055,15 @@ main(int argc, char** argv)
             const uint64_t nb_resets_this_round = shared_stats->nb_resets - prev_nb_resets;
             shared_stats->nb_resets_per_sec = nb_resets_this_round / (elapsed_ns / 1e9);
 
+            // Calculate the average time spent per emulator reset this round.
+            const uint64_t nb_reset_ns_this_round = shared_stats->nb_reset_ns - prev_nb_reset_ns;
+            if (nb_resets_this_round > 0) {
+                shared_stats->nb_ns_per_reset = (double)nb_reset_ns_this_round / nb_resets_this_round;
+            }
+
             // Get the number of total inputs currently in the corpus.
             emu_stats_print(shared_stats);
-            shared_stats->nb_inputs = shared_corpus->inputs->length;
+            shared_stats->nb_inputs = corpus_nb_inputs(shared_corpus);
 
             // Reset the timer checkpoint.
             clock_gettime(CLOCK_MONOTONIC, &checkpoint);
@@ -504,8 +1071,10 @@ main(int argc, char** argv)
             // Prepare for next loop iteration.
             shared_stats->nb_inst_per_sec   = 0;
             shared_stats->nb_resets_per_sec = 0;
+            shared_stats->nb_ns_per_reset   = 0;
             prev_nb_exec_inst               = shared_stats->nb_executed_instructions;
             prev_nb_resets                  = shared_stats->nb_resets;
+            prev_nb_reset_ns                = shared_stats->nb_reset_ns;
         }
         else {
             // This might be suboptimal if the main thread is running on the
@@ -1,8 +1,18 @@
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
 
 #include "adr_map.h"
 #include "mmu.h"
@@ -12,6 +22,27 @@
 #include "../utils/print_utils.h"
 #include "../utils/vector.h"
 
+#define MMU_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+// From <linux/mman.h>, which clashes with <sys/mman.h> on older libcs.
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << 26)
+#endif
+
+// Number of `/proc/self/pagemap` entries read per syscall on copy-on-write
+// resets.
+#define MMU_PAGEMAP_BATCH 512
+
+// Accesses up to this size, which covers all loads and stores done by
+// instructions, check permissions one byte at a time. Larger ones use the
+// vectorized kernels below.
+#define MMU_SIMD_MIN_SIZE 16
+
+// Flags of a `/proc/self/pagemap` entry.
+static const uint64_t PAGEMAP_FILE_OR_SHARED = (uint64_t)1 << 61;
+static const uint64_t PAGEMAP_SWAPPED        = (uint64_t)1 << 62;
+static const uint64_t PAGEMAP_PRESENT        = (uint64_t)1 << 63;
+
 // Get the address in MMU memory buffer for a virtual address.
 static uint64_t
 mmu_virt_to_mapped(mmu_t* mmu, uint64_t virt_adr)
@@ -136,7 +167,7 @@ dirty_state_make_dirty(dirty_state_t* state, size_t block)
         state->nb_dirty_blocks++;
 
         // Mark block as dirty.
-        state->dirty_bitmap[index] |= 1 << bit;
+        state->dirty_bitmap[index] |= shift_bit << bit;
     }
 
     return;
@@ -149,6 +180,166 @@ dirty_state_clear(dirty_state_t* state)
     state->nb_dirty_blocks = 0;
 }
 
+#if defined(__x86_64__)
+// Set once by `mmu_create`. SSE2 is always available on x86_64.
+static bool mmu_cpu_has_avx2 = false;
+
+// The vectorized kernels below process whole vectors only and return the
+// number of bytes they handled. The permission checks stop at the first vector
+// which has a byte without the required bits, leaving it to the scalar tail to
+// find the exact byte.
+
+__attribute__((target("avx2")))
+static size_t
+mmu_perms_check_avx2(const uint8_t* perms, size_t size, uint8_t required, uint8_t* seen)
+{
+    const __m256i req = _mm256_set1_epi8(required);
+    __m256i       acc = _mm256_setzero_si256();
+    size_t        i   = 0;
+
+    for (; i + 32 <= size; i += 32) {
+        const __m256i p  = _mm256_loadu_si256((const __m256i*)(perms + i));
+        const __m256i ok = _mm256_cmpeq_epi8(_mm256_and_si256(p, req), req);
+        if ((uint32_t)_mm256_movemask_epi8(ok) != 0xffffffff) {
+            break;
+        }
+        acc = _mm256_or_si256(acc, p);
+    }
+
+    // Fold the accumulated bits of all bytes into one byte.
+    __m128i acc128 = _mm_or_si128(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    acc128 = _mm_or_si128(acc128, _mm_srli_si128(acc128, 8));
+    acc128 = _mm_or_si128(acc128, _mm_srli_si128(acc128, 4));
+    acc128 = _mm_or_si128(acc128, _mm_srli_si128(acc128, 2));
+    acc128 = _mm_or_si128(acc128, _mm_srli_si128(acc128, 1));
+    *seen |= (uint8_t)_mm_cvtsi128_si32(acc128);
+    return i;
+}
+
+static size_t
+mmu_perms_check_sse2(const uint8_t* perms, size_t size, uint8_t required, uint8_t* seen)
+{
+    const __m128i req = _mm_set1_epi8(required);
+    __m128i       acc = _mm_setzero_si128();
+    size_t        i   = 0;
+
+    for (; i + 16 <= size; i += 16) {
+        const __m128i p  = _mm_loadu_si128((const __m128i*)(perms + i));
+        const __m128i ok = _mm_cmpeq_epi8(_mm_and_si128(p, req), req);
+        if (_mm_movemask_epi8(ok) != 0xffff) {
+            break;
+        }
+        acc = _mm_or_si128(acc, p);
+    }
+
+    acc = _mm_or_si128(acc, _mm_srli_si128(acc, 8));
+    acc = _mm_or_si128(acc, _mm_srli_si128(acc, 4));
+    acc = _mm_or_si128(acc, _mm_srli_si128(acc, 2));
+    acc = _mm_or_si128(acc, _mm_srli_si128(acc, 1));
+    *seen |= (uint8_t)_mm_cvtsi128_si32(acc);
+    return i;
+}
+
+__attribute__((target("avx2")))
+static size_t
+mmu_perms_raw_to_read_avx2(uint8_t* perms, size_t size)
+{
+    const __m256i keep = _mm256_set1_epi8((uint8_t)~MMU_PERM_RAW);
+    const __m256i read = _mm256_set1_epi8(MMU_PERM_READ);
+    size_t        i    = 0;
+
+    for (; i + 32 <= size; i += 32) {
+        const __m256i p = _mm256_loadu_si256((const __m256i*)(perms + i));
+        _mm256_storeu_si256((__m256i*)(perms + i), _mm256_or_si256(_mm256_and_si256(p, keep), read));
+    }
+    return i;
+}
+
+static size_t
+mmu_perms_raw_to_read_sse2(uint8_t* perms, size_t size)
+{
+    const __m128i keep = _mm_set1_epi8((uint8_t)~MMU_PERM_RAW);
+    const __m128i read = _mm_set1_epi8(MMU_PERM_READ);
+    size_t        i    = 0;
+
+    for (; i + 16 <= size; i += 16) {
+        const __m128i p = _mm_loadu_si128((const __m128i*)(perms + i));
+        _mm_storeu_si128((__m128i*)(perms + i), _mm_or_si128(_mm_and_si128(p, keep), read));
+    }
+    return i;
+}
+#endif
+
+// Check that every byte in `perms[0..size]` has all bits in `required` set.
+// Returns the index of the first byte which does not, or `size` if all of them
+// do. The bits of all checked bytes are or:ed into `seen`.
+static size_t
+mmu_perms_check(const uint8_t* perms, size_t size, uint8_t required, uint8_t* seen)
+{
+    size_t i = 0;
+
+#if defined(__x86_64__)
+    if (size >= MMU_SIMD_MIN_SIZE) {
+        if (mmu_cpu_has_avx2) {
+            i = mmu_perms_check_avx2(perms, size, required, seen);
+        }
+        else {
+            i = mmu_perms_check_sse2(perms, size, required, seen);
+        }
+    }
+#endif
+
+    // Scalar tail, or the first vector which failed the check.
+    for (; i < size; i++) {
+        if ((perms[i] & required) != required) {
+            return i;
+        }
+        *seen |= perms[i];
+    }
+    return size;
+}
+
+// Clear the RAW bit and set the READ bit of every byte in `perms[0..size]`.
+static void
+mmu_perms_raw_to_read(uint8_t* perms, size_t size)
+{
+    size_t i = 0;
+
+#if defined(__x86_64__)
+    if (size >= MMU_SIMD_MIN_SIZE) {
+        if (mmu_cpu_has_avx2) {
+            i = mmu_perms_raw_to_read_avx2(perms, size);
+        }
+        else {
+            i = mmu_perms_raw_to_read_sse2(perms, size);
+        }
+    }
+#endif
+
+    // Scalar tail.
+    for (; i < size; i++) {
+        perms[i] = (perms[i] & ~MMU_PERM_RAW) | MMU_PERM_READ;
+    }
+}
+
+void
+mmu_mark_dirty(mmu_t* mmu, size_t adr, size_t size)
+{
+    // In copy-on-write mode the kernel keeps track of this for us.
+    if (mmu->reset_mode != ENUM_RESET_MODE_DIRTY_BLOCKS || size == 0) {
+        return;
+    }
+    const uint64_t nb_dirty    = mmu->dirty_state->nb_dirty_blocks;
+    const size_t   start_block = adr / DIRTY_BLOCK_SIZE;
+    const size_t   end_block   = (adr + size - 1) / DIRTY_BLOCK_SIZE;
+    for (size_t i = start_block; i <= end_block; i++) {
+        mmu->dirty_state->make_dirty(mmu->dirty_state, i);
+    }
+    if (mmu->stats) {
+        mmu_stats_record_dirty(mmu->stats, mmu->dirty_state->nb_dirty_blocks - nb_dirty);
+    }
+}
+
 // mmu:        The mmu.
 // start_adr:  Offset in the emulators memory to the address where permissions will be set.
 // permission: uint8_t representation of the permission to write.
@@ -156,7 +347,7 @@ dirty_state_clear(dirty_state_t* state)
 static void
 mmu_set_permissions(mmu_t* mmu, size_t start_adr, uint8_t permission, size_t size)
 {
-    if (start_adr + size >= mmu->memory_size) {
+    if (start_adr + size > mmu->memory_size) {
         ginger_log(ERROR, "[%s] Address is to high!\n", __func__);
         return;
     }
@@ -164,6 +355,26 @@ mmu_set_permissions(mmu_t* mmu, size_t start_adr, uint8_t permission, size_t siz
     // Set the provided address to the specified permission
     // TODO: Remove this cast to unsigned char*
     memset((unsigned char*)mmu->permissions + start_adr, permission, size);
+
+    // Permissions are reset along with memory, so changing them dirties the
+    // blocks just like a write does.
+    mmu_mark_dirty(mmu, start_adr, size);
+}
+
+// Which part of guest memory an address is in, for the access statistics.
+static enum_mmu_stats_region_t
+mmu_stats_region_of(const mmu_t* mmu, uint64_t adr)
+{
+    if (adr >= mmu->mmap_floor_adr) {
+        return MMU_STATS_REGION_MMAP;
+    }
+    if (adr >= mmu->brk_start_adr) {
+        return MMU_STATS_REGION_HEAP;
+    }
+    if (adr >= mmu->initial_stack_adr_virt) {
+        return MMU_STATS_REGION_STACK;
+    }
+    return MMU_STATS_REGION_ELF;
 }
 
 // Allocate memory for emulator. Returns the virtual guest address of the allocated memory.
@@ -174,14 +385,14 @@ mmu_allocate(mmu_t* mmu, size_t size, uint8_t* error)
     size_t aligned_size = (size + 0xf) & ~0xf;
 
     // Guest memory is already full.
-    if (mmu->curr_alloc_adr >= mmu->memory_size) {
+    if (mmu->curr_alloc_adr >= mmu->mmap_floor_adr) {
         ginger_log(ERROR, "[%s] Error! Emulator memory already full!\n", __func__);
         *error = MMU_ALLOC_ERROR_MEM_FULL;
         return 0;
     }
 
     // Check if new allocation runs the emulator out of memory.
-    if (mmu->curr_alloc_adr + aligned_size >= mmu->memory_size) {
+    if (mmu->curr_alloc_adr + aligned_size >= mmu->mmap_floor_adr) {
         ginger_log(ERROR, "[%s] Emulator is out of memory!\n", __func__);
         *error = MMU_ALLOC_ERROR_WOULD_OVERRUN;
         return 0;
@@ -201,61 +412,299 @@ mmu_allocate(mmu_t* mmu, size_t size, uint8_t* error)
     return base;
 }
 
+static uint8_t
+mmu_shrink(mmu_t* mmu, size_t adr)
+{
+    if (adr < mmu->brk_start_adr || adr > mmu->curr_alloc_adr) {
+        return MMU_MAP_ERROR_INVALID;
+    }
+    mmu->set_permissions(mmu, adr, 0, mmu->curr_alloc_adr - adr);
+    mmu->curr_alloc_adr = adr;
+    return MMU_MAP_NO_ERROR;
+}
+
+static size_t
+mmu_page_align_up(size_t size)
+{
+    return (size + MMU_PAGE_SIZE - 1) & ~(size_t)(MMU_PAGE_SIZE - 1);
+}
+
+// Find room for `size` bytes among the mmap regions. Below the lowest address
+// handed out so far if possible, otherwise in the first large enough hole.
+// Returns 0 if there is no room.
+static size_t
+mmu_map_find_free(const mmu_t* mmu, size_t size)
+{
+    if (mmu->mmap_floor_adr >= size && mmu->mmap_floor_adr - size >= mmu->curr_alloc_adr) {
+        return mmu->mmap_floor_adr - size;
+    }
+
+    size_t hole_start = mmu->mmap_floor_adr;
+    for (size_t i = 0; i < mmu->nb_mmap_regions; i++) {
+        const mmu_region_t* region = &mmu->mmap_regions[i];
+        if (region->adr - hole_start >= size) {
+            return hole_start;
+        }
+        hole_start = region->adr + region->size;
+    }
+    if (mmu->memory_size - hole_start >= size) {
+        return hole_start;
+    }
+    return 0;
+}
+
+static size_t
+mmu_map(mmu_t* mmu, size_t size, uint8_t permission, uint8_t* error)
+{
+    size = mmu_page_align_up(size);
+    if (size == 0) {
+        *error = MMU_MAP_ERROR_INVALID;
+        return 0;
+    }
+    if (mmu->nb_mmap_regions == MMU_MAX_NB_MMAP_REGIONS) {
+        ginger_log(DEBUG, "[%s] Out of mmap regions!\n", __func__);
+        *error = MMU_MAP_ERROR_NO_MEM;
+        return 0;
+    }
+
+    const size_t adr = mmu_map_find_free(mmu, size);
+    if (adr == 0) {
+        ginger_log(DEBUG, "[%s] No room for a mapping of 0x%lx bytes!\n", __func__, size);
+        *error = MMU_MAP_ERROR_NO_MEM;
+        return 0;
+    }
+    if (adr < mmu->mmap_floor_adr) {
+        mmu->mmap_floor_adr = adr;
+    }
+
+    // Keep the regions sorted.
+    size_t i = 0;
+    while (i < mmu->nb_mmap_regions && mmu->mmap_regions[i].adr < adr) {
+        i++;
+    }
+    memmove(&mmu->mmap_regions[i + 1], &mmu->mmap_regions[i], (mmu->nb_mmap_regions - i) * sizeof(mmu_region_t));
+    mmu->mmap_regions[i] = (mmu_region_t){ .adr = adr, .size = size };
+    mmu->nb_mmap_regions++;
+
+    // The memory may have been mapped and written to before during this run.
+    memset(mmu->memory + adr, 0, size);
+    if (mmu->taint) {
+        taint_clear(mmu->taint, adr, size);
+    }
+    mmu->set_permissions(mmu, adr, permission, size);
+
+    *error = MMU_MAP_NO_ERROR;
+    return adr;
+}
+
+static uint8_t
+mmu_unmap(mmu_t* mmu, size_t adr, size_t size)
+{
+    size = mmu_page_align_up(size);
+    const size_t end = adr + size;
+    if (adr % MMU_PAGE_SIZE != 0 || size == 0 || adr < mmu->mmap_floor_adr || end > mmu->memory_size) {
+        return MMU_MAP_ERROR_INVALID;
+    }
+
+    mmu_region_t* regions = mmu->mmap_regions;
+    for (size_t i = 0; i < mmu->nb_mmap_regions;) {
+        const size_t region_end = regions[i].adr + regions[i].size;
+        if (region_end <= adr || regions[i].adr >= end) {
+            i++;
+            continue;
+        }
+
+        const bool keep_below = regions[i].adr < adr;
+        const bool keep_above = region_end > end;
+        if (keep_below && keep_above) {
+            // Punching a hole in a single region, which is then the only one
+            // touched, so nothing has changed yet if we bail out here.
+            if (mmu->nb_mmap_regions == MMU_MAX_NB_MMAP_REGIONS) {
+                return MMU_MAP_ERROR_NO_MEM;
+            }
+            memmove(&regions[i + 2], &regions[i + 1], (mmu->nb_mmap_regions - i - 1) * sizeof(mmu_region_t));
+            regions[i].size  = adr - regions[i].adr;
+            regions[i + 1]   = (mmu_region_t){ .adr = end, .size = region_end - end };
+            mmu->nb_mmap_regions++;
+            i += 2;
+        }
+        else if (keep_below) {
+            regions[i].size = adr - regions[i].adr;
+            i++;
+        }
+        else if (keep_above) {
+            regions[i].size = region_end - end;
+            regions[i].adr  = end;
+            i++;
+        }
+        else {
+            memmove(&regions[i], &regions[i + 1], (mmu->nb_mmap_regions - i - 1) * sizeof(mmu_region_t));
+            mmu->nb_mmap_regions--;
+        }
+    }
+
+    // Any later access is a use after unmap.
+    mmu->set_permissions(mmu, adr, 0, size);
+    return MMU_MAP_NO_ERROR;
+}
+
+static uint8_t
+mmu_protect(mmu_t* mmu, size_t adr, size_t size, uint8_t permission)
+{
+    size = mmu_page_align_up(size);
+    const size_t end = adr + size;
+    if (adr % MMU_PAGE_SIZE != 0) {
+        return MMU_MAP_ERROR_INVALID;
+    }
+
+    // The whole range has to be mapped.
+    size_t covered = adr;
+    for (size_t i = 0; i < mmu->nb_mmap_regions && covered < end; i++) {
+        const mmu_region_t* region = &mmu->mmap_regions[i];
+        if (region->adr <= covered && covered < region->adr + region->size) {
+            covered = region->adr + region->size;
+        }
+    }
+    if (covered < end) {
+        return MMU_MAP_ERROR_NO_MEM;
+    }
+
+    mmu->set_permissions(mmu, adr, permission, size);
+    return MMU_MAP_NO_ERROR;
+}
+
+void
+mmu_copy_allocations(mmu_t* dst, const mmu_t* src)
+{
+    const size_t src_top = src->memory_size & ~(size_t)(MMU_PAGE_SIZE - 1);
+    const size_t dst_top = dst->memory_size & ~(size_t)(MMU_PAGE_SIZE - 1);
+
+    dst->curr_alloc_adr  = src->curr_alloc_adr;
+    dst->brk_start_adr   = src->brk_start_adr;
+    dst->nb_args         = src->nb_args;
+    memcpy(dst->arg_adrs, src->arg_adrs, sizeof(dst->arg_adrs));
+
+    // Workers may have less memory than the snapshot, which is fine as long
+    // as the snapshot has never mapped anything at its top.
+    dst->mmap_floor_adr  = src->mmap_floor_adr == src_top ? dst_top : src->mmap_floor_adr;
+    dst->nb_mmap_regions = src->nb_mmap_regions;
+    memcpy(dst->mmap_regions, src->mmap_regions, src->nb_mmap_regions * sizeof(mmu_region_t));
+}
+
+// Record an access to watched memory, before it is carried out.
+static void
+mmu_watch_record(mmu_t* mmu, uint64_t adr, uint64_t size, bool is_write)
+{
+    mmu_watch_hit_t* hit = &mmu->watch_hit;
+    hit->hit      = true;
+    hit->is_write = is_write;
+    hit->adr      = adr;
+    hit->size     = size;
+    memset(hit->old_value, 0, sizeof(hit->old_value));
+    memset(hit->new_value, 0, sizeof(hit->new_value));
+    memcpy(hit->old_value, mmu->memory + adr, size < MMU_WATCH_VALUE_SIZE ? size : MMU_WATCH_VALUE_SIZE);
+}
+
+bool
+mmu_in_stack_guard(const mmu_t* mmu, uint64_t adr)
+{
+    return adr >= mmu->initial_stack_adr_virt && adr < mmu->initial_stack_adr_virt + MMU_STACK_GUARD_SIZE;
+}
+
+void
+mmu_clear_watchpoints(mmu_t* mmu)
+{
+    const uint8_t keep = ~(MMU_PERM_WATCH_WRITE | MMU_PERM_WATCH_READ);
+    const size_t  used = mmu->curr_alloc_adr < mmu->memory_size ? mmu->curr_alloc_adr : mmu->memory_size;
+    for (size_t i = 0; i < used; i++) {
+        mmu->permissions[i] &= keep;
+    }
+    for (size_t i = mmu->mmap_floor_adr; i < mmu->memory_size; i++) {
+        mmu->permissions[i] &= keep;
+    }
+    mmu->watch_hit.hit = false;
+}
+
+bool
+mmu_mark_instruction(mmu_t* mmu, uint64_t adr, uint8_t bit)
+{
+    if (adr >= mmu->memory_size || (mmu->permissions[adr] & MMU_PERM_EXEC) == 0) {
+        return false;
+    }
+    mmu->permissions[adr] |= bit;
+    return true;
+}
+
+void
+mmu_save_allocations(const mmu_t* mmu, mmu_allocations_t* allocations)
+{
+    allocations->curr_alloc_adr  = mmu->curr_alloc_adr;
+    allocations->brk_start_adr   = mmu->brk_start_adr;
+    allocations->mmap_floor_adr  = mmu->mmap_floor_adr;
+    allocations->nb_mmap_regions = mmu->nb_mmap_regions;
+    memcpy(allocations->mmap_regions, mmu->mmap_regions, mmu->nb_mmap_regions * sizeof(mmu_region_t));
+}
+
+void
+mmu_restore_allocations(mmu_t* mmu, const mmu_allocations_t* allocations)
+{
+    mmu->curr_alloc_adr  = allocations->curr_alloc_adr;
+    mmu->brk_start_adr   = allocations->brk_start_adr;
+    mmu->mmap_floor_adr  = allocations->mmap_floor_adr;
+    mmu->nb_mmap_regions = allocations->nb_mmap_regions;
+    memcpy(mmu->mmap_regions, allocations->mmap_regions, allocations->nb_mmap_regions * sizeof(mmu_region_t));
+}
+
 // TODO: Should we check for write outside of allocated memory?
 static uint8_t
 mmu_write(mmu_t* mmu, size_t dst_adr, const uint8_t* src_buffer, size_t size)
 {
     if (dst_adr + size > mmu->memory_size) {
         ginger_log(WARNING, "[%s] Write outside of total emulator memory!\n", __func__);
+        mmu->fault_adr = dst_adr;
         return MMU_WRITE_ERROR_ADR_OUT_OF_RANGE;
     }
 
     // Check permission of memory we are about to write to. If any of the addresses has the MMU_PERM_READ_AFTER_WRITE bit
     // set, we will remove it from all of them. If none of the addresses has it set, we will skip it.
     //
-    // If any of the addresses we are about to write to is not writeable, return NULL.
-    bool has_read_after_write = false;
-    for (int i = 0; i < size; i++) {
-
-        // Offset to the dst address from start of emulator memory.
-        const size_t curr_adr = dst_adr + i;
-        const uint8_t curr_perm = mmu->permissions[curr_adr];
-
-        // If the RAW bit is set
-        if ((curr_perm & MMU_PERM_RAW) !=0) {
-            has_read_after_write = true;
-        }
+    // If any of the addresses we are about to write to is not writeable, return an error.
+    uint8_t      seen_perms = 0;
+    const size_t no_perm    = mmu_perms_check(mmu->permissions + dst_adr, size, MMU_PERM_WRITE, &seen_perms);
+    if (no_perm != size) {
+        const size_t curr_adr = dst_adr + no_perm;
+        ginger_log(ERROR, "[%s] Address 0x%lx not writeable. Has perm ", __func__, curr_adr);
+        print_permissions(mmu->permissions[curr_adr]);
+        printf("\n");
+        mmu->fault_adr = curr_adr;
+        return MMU_WRITE_ERROR_NO_PERM;
+    }
+    const bool has_read_after_write = (seen_perms & MMU_PERM_RAW) != 0;
 
-        // If write permission is not set
-        if ((curr_perm & MMU_PERM_WRITE) == 0) {
-            ginger_log(ERROR, "[%s] Address 0x%lx not writeable. Has perm ", __func__, curr_adr);
-            print_permissions(curr_perm);
-            printf("\n");
-            return MMU_WRITE_ERROR_NO_PERM;
-        }
+    // Only writes touching watched memory take the slow path.
+    const bool is_watched = (seen_perms & MMU_PERM_WATCH_WRITE) != 0;
+    if (is_watched) {
+        mmu_watch_record(mmu, dst_adr, size, true);
     }
 
     // Write the data
     ginger_log(DEBUG, "[%s] Writing 0x%lx bytes to address 0x%lx\n", __func__, size, dst_adr);
     memcpy(mmu->memory + dst_adr, src_buffer, size);
+    if (is_watched) {
+        memcpy(mmu->watch_hit.new_value, mmu->memory + dst_adr, size < MMU_WATCH_VALUE_SIZE ? size : MMU_WATCH_VALUE_SIZE);
+    }
 
-    // Mark blocks corresponding to addresses written to as dirty
-    size_t start_block = dst_adr / DIRTY_BLOCK_SIZE;
-    size_t end_block   = (dst_adr + size) / DIRTY_BLOCK_SIZE;
-    for (size_t i = start_block; i <= end_block; i++) {
-        mmu->dirty_state->make_dirty(mmu->dirty_state, i);
+    // Mark blocks corresponding to addresses written to as dirty.
+    mmu_mark_dirty(mmu, dst_adr, size);
+    if (mmu->stats) {
+        mmu->stats->nb_bytes_written[mmu_stats_region_of(mmu, dst_adr)] += size;
     }
 
     // Set permission of all memory written to readable.
     if (has_read_after_write) {
-        for (int i = 0; i < size; i++) {
-            // Remove the RAW bit TODO: Find out if this really is needed, we
-            // might gain performance by removing it
-            *(mmu->permissions + dst_adr + i) &= ~MMU_PERM_RAW;
-
-            // Set permission of written memory to readable.
-            *(mmu->permissions + dst_adr + i) |= MMU_PERM_READ;
-        }
+        // Remove the RAW bit TODO: Find out if this really is needed, we
+        // might gain performance by removing it
+        mmu_perms_raw_to_read(mmu->permissions + dst_adr, size);
     }
     return MMU_WRITE_NO_ERROR;
 }
@@ -270,42 +719,173 @@ mmu_read(mmu_t* mmu, uint8_t* dst_buffer, const uint64_t src_adr, size_t size)
     // allows us to see where the execution goes even after an invalid read.
     if (src_adr + size > mmu->memory_size) {
         ginger_log(WARNING, "Address 0x%lx is outside of emulator total memory!\n", src_adr + size);
+        mmu->fault_adr = src_adr;
         return MMU_READ_ERROR_ADR_OUT_OF_RANGE;
     }
 
     // If permission denied
-    for (int i = 0; i < size; i++) {
-        if ((*(mmu->permissions + src_adr + i) & MMU_PERM_READ) == 0) {
-            ginger_log(DEBUG, "Illegal read at address: 0x%lx\n", src_adr + i);
-            return MMU_READ_ERROR_NO_PERM;
-        }
+    uint8_t      seen_perms = 0;
+    const size_t no_perm    = mmu_perms_check(mmu->permissions + src_adr, size, MMU_PERM_READ, &seen_perms);
+    if (no_perm != size) {
+        ginger_log(DEBUG, "Illegal read at address: 0x%lx\n", src_adr + no_perm);
+        mmu->fault_adr = src_adr + no_perm;
+        return MMU_READ_ERROR_NO_PERM;
+    }
+    if ((seen_perms & MMU_PERM_WATCH_READ) != 0) {
+        mmu_watch_record(mmu, src_adr, size, false);
+        memcpy(mmu->watch_hit.new_value, mmu->watch_hit.old_value, MMU_WATCH_VALUE_SIZE);
+    }
+    if (mmu->stats) {
+        mmu->stats->nb_bytes_read[mmu_stats_region_of(mmu, src_adr)] += size;
     }
     memcpy(dst_buffer, mmu->memory + src_adr, size);
     return MMU_READ_NO_ERROR;
 }
 
-// Search for specified value in guest memory. The size of the value is
-// specififed by `size_letter`. Valid size letters are b(byte), h(halfword),
-// w(word) or g(giant). If matching values are found, store their guest memory
-// addresses in a vector and return it. Otherwise, return NULL.
-static vector_t*
-mmu_search(mmu_t* mmu, const uint64_t needle, const char size_letter)
+// Searches smaller than this are not worth spreading over threads.
+#define MMU_SEARCH_MIN_SIZE_PER_THREAD (16 * 1024 * 1024)
+
+// Max number of threads a single search is split across.
+#define MMU_SEARCH_MAX_NB_THREADS 16
+
+typedef struct {
+    const mmu_t*   mmu;
+    const uint8_t* needle;
+    size_t         needle_len;
+    size_t         alignment;
+    uint8_t        perms;
+    size_t         start;       // First address where a hit may start.
+    size_t         end;         // Hits start below this address.
+    size_t         scan_end;    // Bytes of hits starting below `end` end below this address.
+    vector_t*      hits;
+} mmu_search_job_t;
+
+// A hit only counts if all of its bytes are mapped and, if a permission filter
+// is given, has all of the permission bits in it.
+static bool
+mmu_search_perms_match(const mmu_t* mmu, size_t adr, size_t len, uint8_t perms)
 {
-    uint8_t data_size = 0;
-    vector_t* hits    = vector_create(sizeof(size_t));
+    for (size_t i = 0; i < len; i++) {
+        const uint8_t curr_perm = mmu->permissions[adr + i];
+        if (curr_perm == 0 || (curr_perm & perms) != perms) {
+            return false;
+        }
+    }
+    return true;
+}
 
-    if (size_letter == 'b')      data_size = BYTE_SIZE;
-    else if (size_letter == 'h') data_size = HALFWORD_SIZE;
-    else if (size_letter == 'w') data_size = WORD_SIZE;
-    else if (size_letter == 'g') data_size = GIANT_SIZE;
-    else { ginger_log(ERROR, "Invalid size letter!\n"); return false; }
+static void*
+mmu_search_job_run(void* arg)
+{
+    mmu_search_job_t* job    = arg;
+    const uint8_t*    memory = job->mmu->memory;
+    size_t            adr    = job->start;
+
+    while (adr < job->end) {
+        // memmem finds candidates with vectorized scanning of the first byte.
+        const uint8_t* hit = memmem(memory + adr, job->scan_end - adr, job->needle, job->needle_len);
+        if (!hit) {
+            break;
+        }
+
+        const size_t hit_adr = hit - memory;
+        if (hit_adr >= job->end) {
+            break;
+        }
+        if (hit_adr % job->alignment == 0 &&
+            mmu_search_perms_match(job->mmu, hit_adr, job->needle_len, job->perms))
+        {
+            vector_append(job->hits, (void*)&hit_adr);
+        }
+        adr = hit_adr + 1;
+    }
+    return NULL;
+}
+
+// Search [range_start, range_end) of guest memory, appending the hits to
+// `hits` in ascending order. Large ranges are split across threads.
+static void
+mmu_search_range(mmu_t* mmu, const uint8_t* needle, size_t needle_len, size_t alignment, uint8_t perms,
+                 size_t range_start, size_t range_end, vector_t* hits)
+{
+    if (range_end - range_start < needle_len) {
+        return;
+    }
+    const size_t nb_starts = range_end - range_start - needle_len + 1;
+
+    size_t nb_threads = nb_starts / MMU_SEARCH_MIN_SIZE_PER_THREAD;
+    if (nb_threads > global_config_get_nb_cpus()) {
+        nb_threads = global_config_get_nb_cpus();
+    }
+    if (nb_threads > MMU_SEARCH_MAX_NB_THREADS) {
+        nb_threads = MMU_SEARCH_MAX_NB_THREADS;
+    }
+    if (nb_threads == 0) {
+        nb_threads = 1;
+    }
 
-    for (size_t i = 0; i < mmu->memory_size; i += data_size) {
-        uint64_t curr_value = byte_arr_to_u64(&mmu->memory[i], data_size, ENUM_ENDIANESS_LSB);
-        if (curr_value == needle) {
-            vector_append(hits, &i);
+    mmu_search_job_t jobs[MMU_SEARCH_MAX_NB_THREADS];
+    pthread_t        threads[MMU_SEARCH_MAX_NB_THREADS];
+    const size_t     chunk_size = (nb_starts + nb_threads - 1) / nb_threads;
+    for (size_t i = 0; i < nb_threads; i++) {
+        const size_t start = range_start + i * chunk_size;
+        const size_t end   = start + chunk_size < range_start + nb_starts ? start + chunk_size : range_start + nb_starts;
+        jobs[i] = (mmu_search_job_t){
+            .mmu        = mmu,
+            .needle     = needle,
+            .needle_len = needle_len,
+            .alignment  = alignment,
+            .perms      = perms,
+            .start      = start,
+            .end        = end,
+            .scan_end   = end + needle_len - 1,
+            .hits       = vector_create(sizeof(size_t)),
+        };
+    }
+
+    // Run the first chunk on the calling thread.
+    size_t nb_spawned = 1;
+    for (; nb_spawned < nb_threads; nb_spawned++) {
+        if (pthread_create(&threads[nb_spawned], NULL, mmu_search_job_run, &jobs[nb_spawned]) != 0) {
+            break;
         }
     }
+    mmu_search_job_run(&jobs[0]);
+    for (size_t i = nb_spawned; i < nb_threads; i++) {
+        mmu_search_job_run(&jobs[i]);
+    }
+    for (size_t i = 1; i < nb_spawned; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    // The chunks are in ascending order, so are the hits after concatenating.
+    for (size_t i = 0; i < nb_threads; i++) {
+        for (size_t j = 0; j < vector_length(jobs[i].hits); j++) {
+            vector_append(hits, vector_get(jobs[i].hits, j));
+        }
+        vector_destroy(jobs[i].hits);
+    }
+}
+
+// Search for a sequence of bytes in the allocated and mapped parts of guest
+// memory. Only hits starting at a multiple of `alignment`, with all bytes
+// mapped and with all bits of `perms` set, are returned. If matching values
+// are found, store their guest memory addresses in a vector and return it, in
+// ascending order. Otherwise, return NULL.
+static vector_t*
+mmu_search(mmu_t* mmu, const uint8_t* needle, size_t needle_len, size_t alignment, uint8_t perms)
+{
+    if (needle_len == 0 || alignment == 0) {
+        ginger_log(ERROR, "[%s] Invalid needle length or alignment!\n", __func__);
+        return NULL;
+    }
+
+    // Everything between the allocation pointer and the mmap regions is
+    // unmapped.
+    const size_t used = mmu->curr_alloc_adr < mmu->memory_size ? mmu->curr_alloc_adr : mmu->memory_size;
+    vector_t*    hits = vector_create(sizeof(size_t));
+    mmu_search_range(mmu, needle, needle_len, alignment, perms, 0, used, hits);
+    mmu_search_range(mmu, needle, needle_len, alignment, perms, mmu->mmap_floor_adr, mmu->memory_size, hits);
 
     if (vector_length(hits) > 0) {
         return hits;
@@ -315,6 +895,360 @@ mmu_search(mmu_t* mmu, const uint64_t needle, const char size_letter)
     }
 }
 
+// Number of bytes from address 0 which may have been touched in either of the
+// MMUs, rounded up to whole pages.
+static size_t
+mmu_used_size(const mmu_t* mmu, const mmu_t* other)
+{
+    size_t used = mmu->curr_alloc_adr;
+    if (other->curr_alloc_adr > used) {
+        used = other->curr_alloc_adr;
+    }
+    used = (used + MMU_PAGE_SIZE - 1) & ~(size_t)(MMU_PAGE_SIZE - 1);
+    if (used > mmu->memory_size) {
+        used = mmu->memory_size;
+    }
+    return used;
+}
+
+// Lowest address of the mmap regions of either of the MMUs. Always page
+// aligned.
+static size_t
+mmu_mmap_floor(const mmu_t* mmu, const mmu_t* other)
+{
+    return mmu->mmap_floor_adr < other->mmap_floor_adr ? mmu->mmap_floor_adr : other->mmap_floor_adr;
+}
+
+// Forget all dirty blocks without restoring them.
+static void
+mmu_clear_dirty_blocks(mmu_t* mmu)
+{
+    dirty_state_t* state = mmu->dirty_state;
+    for (uint64_t i = 0; i < state->nb_dirty_blocks; i++) {
+        state->dirty_bitmap[state->dirty_blocks[i] / 64] = 0;
+    }
+    state->clear(state);
+}
+
+// Drop all pages in `base[0..size]` which have been copied on write, making
+// them read as the contents of the backing memfd again.
+static void
+mmu_cow_drop_dirty_pages(mmu_t* mmu, uint8_t* base, size_t size)
+{
+    uint64_t     entries[MMU_PAGEMAP_BATCH];
+    const size_t nb_pages  = size / MMU_PAGE_SIZE;
+    const size_t base_page = (uintptr_t)base / MMU_PAGE_SIZE;
+    size_t       run_start = 0;
+    size_t       run_len   = 0;
+
+    for (size_t first = 0; first < nb_pages; first += MMU_PAGEMAP_BATCH) {
+        size_t nb_entries = nb_pages - first;
+        if (nb_entries > MMU_PAGEMAP_BATCH) {
+            nb_entries = MMU_PAGEMAP_BATCH;
+        }
+
+        const ssize_t nb_read = pread(mmu->pagemap_fd, entries, nb_entries * sizeof(entries[0]),
+                                      (base_page + first) * sizeof(entries[0]));
+        if (nb_read != nb_entries * sizeof(entries[0])) {
+            ginger_log(ERROR, "[%s] Failed to read /proc/self/pagemap!\n", __func__);
+            abort();
+        }
+
+        for (size_t i = 0; i < nb_entries; i++) {
+            // A page which is populated but no longer backed by the memfd has
+            // been copied on write.
+            const bool populated = (entries[i] & (PAGEMAP_PRESENT | PAGEMAP_SWAPPED)) != 0;
+            const bool dirty     = populated && (entries[i] & PAGEMAP_FILE_OR_SHARED) == 0;
+
+            if (dirty) {
+                if (run_len == 0) {
+                    run_start = first + i;
+                }
+                run_len++;
+            }
+            else if (run_len > 0) {
+                madvise(base + (run_start * MMU_PAGE_SIZE), run_len * MMU_PAGE_SIZE, MADV_DONTNEED);
+                run_len = 0;
+            }
+        }
+    }
+    if (run_len > 0) {
+        madvise(base + (run_start * MMU_PAGE_SIZE), run_len * MMU_PAGE_SIZE, MADV_DONTNEED);
+    }
+}
+
+static void
+mmu_reset(mmu_t* dst, const mmu_t* src)
+{
+    if (dst->reset_mode == ENUM_RESET_MODE_COW) {
+        const size_t used  = mmu_used_size(dst, src);
+        const size_t floor = mmu_mmap_floor(dst, src);
+        mmu_cow_drop_dirty_pages(dst, dst->memory,      used);
+        mmu_cow_drop_dirty_pages(dst, dst->permissions, used);
+        mmu_cow_drop_dirty_pages(dst, dst->memory +      floor, dst->memory_size - floor);
+        mmu_cow_drop_dirty_pages(dst, dst->permissions + floor, dst->memory_size - floor);
+    }
+    else {
+        dirty_state_t* state = dst->dirty_state;
+        if (dst->stats) {
+            mmu_stats_record_reset(dst->stats, state->nb_dirty_blocks);
+        }
+        for (uint64_t i = 0; i < state->nb_dirty_blocks; i++) {
+
+            const uint64_t block = state->dirty_blocks[i];
+
+            // Starting address of the dirty block in guest memory.
+            const uint64_t block_adr = block * DIRTY_BLOCK_SIZE;
+
+            // Copy the memory and perms corresponding to the dirty block from
+            // the source to the destination.
+            memcpy(dst->memory +      block_adr, src->memory +      block_adr, DIRTY_BLOCK_SIZE);
+            memcpy(dst->permissions + block_adr, src->permissions + block_adr, DIRTY_BLOCK_SIZE);
+
+            // The snapshot is never tainted, so the shadow of a dirty block
+            // can simply be cleared.
+            if (dst->taint) {
+                taint_clear(dst->taint, block_adr, DIRTY_BLOCK_SIZE);
+            }
+
+            // Clear the bitmap entry corresponding to the dirty block.
+            // We could calculate the bit index here and `logicaly and` it to
+            // zero, but we will still have to do a 64 bit write, so might as
+            // well skip the bit index calculation.
+            state->dirty_bitmap[block / 64] = 0;
+        }
+        state->clear(state);
+    }
+
+    // Reset the allocation pointer and the mmap regions.
+    mmu_copy_allocations(dst, src);
+
+    if (dst->taint) {
+        taint_clear_cmps(dst->taint);
+    }
+}
+
+static void
+mmu_sync(mmu_t* dst, const mmu_t* src)
+{
+    const size_t used  = mmu_used_size(dst, src);
+    const size_t floor = mmu_mmap_floor(dst, src);
+    memcpy(dst->memory,      src->memory,      used);
+    memcpy(dst->permissions, src->permissions, used);
+    memcpy(dst->memory +      floor, src->memory +      floor, dst->memory_size - floor);
+    memcpy(dst->permissions + floor, src->permissions + floor, dst->memory_size - floor);
+    mmu_copy_allocations(dst, src);
+
+    // Everything is in sync now, so nothing needs to be reset yet.
+    mmu_clear_dirty_blocks(dst);
+}
+
+// Write `size` bytes from `buf` to the file at `offset`.
+static bool
+mmu_pwrite_all(int fd, const uint8_t* buf, size_t size, off_t offset)
+{
+    while (size > 0) {
+        const ssize_t nb_written = pwrite(fd, buf, size, offset);
+        if (nb_written <= 0) {
+            return false;
+        }
+        buf    += nb_written;
+        offset += nb_written;
+        size   -= nb_written;
+    }
+    return true;
+}
+
+bool
+mmu_cow_export(mmu_t* snapshot)
+{
+    if (snapshot->memory_size % MMU_PAGE_SIZE != 0) {
+        ginger_log(ERROR, "[%s] Memory size 0x%lx is not page aligned!\n", __func__, snapshot->memory_size);
+        return false;
+    }
+
+    const int fd = memfd_create("gingersnap-snapshot", MFD_CLOEXEC);
+    if (fd == -1) {
+        ginger_log(ERROR, "[%s] Failed to create memfd!\n", __func__);
+        return false;
+    }
+
+    // Memory at offset 0, permissions right after it. Everything between the
+    // used part of the snapshot and its mmap regions is zero, so the file can
+    // stay sparse there.
+    const size_t used      = mmu_used_size(snapshot, snapshot);
+    const size_t floor     = snapshot->mmap_floor_adr;
+    const size_t top_size  = snapshot->memory_size - floor;
+    if (ftruncate(fd, snapshot->memory_size * 2) != 0                                          ||
+        !mmu_pwrite_all(fd, snapshot->memory,      used, 0)                                    ||
+        !mmu_pwrite_all(fd, snapshot->permissions, used, snapshot->memory_size)                ||
+        !mmu_pwrite_all(fd, snapshot->memory +      floor, top_size, floor)                    ||
+        !mmu_pwrite_all(fd, snapshot->permissions + floor, top_size, snapshot->memory_size + floor))
+    {
+        ginger_log(ERROR, "[%s] Failed to write snapshot to memfd!\n", __func__);
+        close(fd);
+        return false;
+    }
+
+    snapshot->cow_fd = fd;
+    ginger_log(INFO, "Exported 0x%lx bytes of snapshot memory for copy-on-write resets\n", used);
+    return true;
+}
+
+// Map a zeroed buffer of `size` bytes rounded up to a whole huge page, backed
+// by the kind of pages requested in `huge_pages` if possible. Returns the kind
+// of pages actually used in `obtained`.
+static uint8_t*
+mmu_map_buffer(size_t size, enum_huge_pages_t huge_pages, enum_huge_pages_t* obtained)
+{
+    const int    prot      = PROT_READ | PROT_WRITE;
+    const int    flags     = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE;
+    const size_t huge_size = (size + MMU_HUGE_PAGE_SIZE - 1) & ~(size_t)(MMU_HUGE_PAGE_SIZE - 1);
+
+    if (huge_pages == ENUM_HUGE_PAGES_HUGETLB) {
+        // No MAP_NORESERVE here. The pages have to be reserved up front, so
+        // that an empty pool fails the mmap rather than raising SIGBUS on
+        // first touch.
+        uint8_t* buf = mmap(NULL, huge_size, prot, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_HUGE_2MB, -1, 0);
+        if (buf != MAP_FAILED) {
+            *obtained = ENUM_HUGE_PAGES_HUGETLB;
+            return buf;
+        }
+        huge_pages = ENUM_HUGE_PAGES_THP;
+    }
+
+    if (huge_pages == ENUM_HUGE_PAGES_THP) {
+        // Over-allocate to be able to align the buffer on a huge page boundary,
+        // and unmap the slack on both sides.
+        uint8_t* raw = mmap(NULL, huge_size + MMU_HUGE_PAGE_SIZE, prot, flags, -1, 0);
+        if (raw == MAP_FAILED) {
+            return NULL;
+        }
+        uint8_t* buf = (uint8_t*)(((uintptr_t)raw + MMU_HUGE_PAGE_SIZE - 1) & ~(uintptr_t)(MMU_HUGE_PAGE_SIZE - 1));
+        if (buf != raw) {
+            munmap(raw, buf - raw);
+        }
+        munmap(buf + huge_size, (raw + huge_size + MMU_HUGE_PAGE_SIZE) - (buf + huge_size));
+
+        *obtained = madvise(buf, huge_size, MADV_HUGEPAGE) == 0 ? ENUM_HUGE_PAGES_THP : ENUM_HUGE_PAGES_NONE;
+        return buf;
+    }
+
+    uint8_t* buf = mmap(NULL, huge_size, prot, flags, -1, 0);
+    if (buf == MAP_FAILED) {
+        return NULL;
+    }
+
+    // Transparent huge pages may still be used if they are enabled system
+    // wide, so opt out explicitly.
+    madvise(buf, huge_size, MADV_NOHUGEPAGE);
+    *obtained = ENUM_HUGE_PAGES_NONE;
+    return buf;
+}
+
+// Free the memory and permission buffers of an MMU.
+static void
+mmu_release_buffers(mmu_t* mmu)
+{
+    if (mmu->memory) {
+        munmap(mmu->memory, mmu->mapped_size);
+    }
+    if (mmu->permissions) {
+        munmap(mmu->permissions, mmu->mapped_size);
+    }
+    mmu->memory      = NULL;
+    mmu->permissions = NULL;
+}
+
+bool
+mmu_cow_attach(mmu_t* mmu, const mmu_t* snapshot)
+{
+    if (snapshot->cow_fd == -1) {
+        ginger_log(ERROR, "[%s] Snapshot has not been exported!\n", __func__);
+        return false;
+    }
+    if (mmu->memory_size > snapshot->memory_size) {
+        ginger_log(ERROR, "[%s] MMU is larger than the snapshot!\n", __func__);
+        return false;
+    }
+
+    const int prot  = PROT_READ | PROT_WRITE;
+    const int flags = MAP_PRIVATE | MAP_NORESERVE;
+    uint8_t* memory = mmap(NULL, mmu->memory_size, prot, flags, snapshot->cow_fd, 0);
+    uint8_t* perms  = mmap(NULL, mmu->memory_size, prot, flags, snapshot->cow_fd, snapshot->memory_size);
+    if (memory == MAP_FAILED || perms == MAP_FAILED) {
+        ginger_log(ERROR, "[%s] Failed to map snapshot!\n", __func__);
+        return false;
+    }
+
+    const int pagemap_fd = open("/proc/self/pagemap", O_RDONLY | O_CLOEXEC);
+    if (pagemap_fd == -1) {
+        ginger_log(ERROR, "[%s] Failed to open /proc/self/pagemap!\n", __func__);
+        munmap(memory, mmu->memory_size);
+        munmap(perms,  mmu->memory_size);
+        return false;
+    }
+
+    mmu_release_buffers(mmu);
+    mmu->memory         = memory;
+    mmu->permissions    = perms;
+    mmu->mapped_size    = mmu->memory_size;
+    mmu->huge_pages     = ENUM_HUGE_PAGES_NONE;
+    mmu->cow_fd         = snapshot->cow_fd;
+    mmu->pagemap_fd     = pagemap_fd;
+    mmu->reset_mode     = ENUM_RESET_MODE_COW;
+    mmu_copy_allocations(mmu, snapshot);
+    mmu_clear_dirty_blocks(mmu);
+    return true;
+}
+
+// Sum the `AnonHugePages` and `Private_Hugetlb` fields of the smaps entry of
+// the mapping starting at `buf`.
+static size_t
+mmu_huge_page_bytes_of(FILE* fp, const uint8_t* buf)
+{
+    char   line[256];
+    size_t nb_kb    = 0;
+    bool   in_entry = false;
+
+    rewind(fp);
+    while (fgets(line, sizeof(line), fp)) {
+        uintptr_t start = 0;
+        uintptr_t end   = 0;
+
+        // Every mapping starts with a `start-end perms ...` line.
+        if (sscanf(line, "%lx-%lx ", &start, &end) == 2) {
+            if (in_entry) {
+                break;
+            }
+            in_entry = start == (uintptr_t)buf;
+            continue;
+        }
+        if (!in_entry) {
+            continue;
+        }
+
+        size_t kb = 0;
+        if (sscanf(line, "AnonHugePages: %lu kB", &kb) == 1 || sscanf(line, "Private_Hugetlb: %lu kB", &kb) == 1) {
+            nb_kb += kb;
+        }
+    }
+    return nb_kb * 1024;
+}
+
+size_t
+mmu_huge_page_bytes(const mmu_t* mmu)
+{
+    FILE* fp = fopen("/proc/self/smaps", "r");
+    if (!fp) {
+        ginger_log(ERROR, "[%s] Failed to open /proc/self/smaps!\n", __func__);
+        return 0;
+    }
+    const size_t nb_bytes = mmu_huge_page_bytes_of(fp, mmu->memory) + mmu_huge_page_bytes_of(fp, mmu->permissions);
+    fclose(fp);
+    return nb_bytes;
+}
+
 void
 print_permissions(uint8_t perms)
 {
@@ -332,7 +1266,13 @@ print_permissions(uint8_t perms)
         printf("R ");
     }
     if ((perms & (1 << 3))) {
-        printf("RAW");
+        printf("RAW ");
+    }
+    if ((perms & (1 << 4))) {
+        printf("WATCH_W ");
+    }
+    if ((perms & (1 << 5))) {
+        printf("WATCH_R ");
     }
 }
 
@@ -380,9 +1320,16 @@ mmu_create(const size_t memory_size, const size_t base_alloc_adr)
         return NULL;
     }
 
+    // The hugetlb pool might run dry between the two buffers, so report the
+    // smaller kind of pages of the two.
+    enum_huge_pages_t memory_pages = ENUM_HUGE_PAGES_NONE;
+    enum_huge_pages_t perms_pages  = ENUM_HUGE_PAGES_NONE;
+
     mmu->memory_size        = memory_size;
-    mmu->memory             = calloc(mmu->memory_size, sizeof(uint8_t));
-    mmu->permissions        = calloc(mmu->memory_size, sizeof(uint8_t));
+    mmu->mapped_size        = (memory_size + MMU_HUGE_PAGE_SIZE - 1) & ~(size_t)(MMU_HUGE_PAGE_SIZE - 1);
+    mmu->memory             = mmu_map_buffer(memory_size, global_config_get_huge_pages(), &memory_pages);
+    mmu->permissions        = mmu_map_buffer(memory_size, global_config_get_huge_pages(), &perms_pages);
+    mmu->huge_pages         = memory_pages < perms_pages ? memory_pages : perms_pages;
     mmu->dirty_state        = dirty_state_create(memory_size);
 
     if (!mmu->memory || !mmu->permissions || !mmu->dirty_state) {
@@ -398,18 +1345,42 @@ mmu_create(const size_t memory_size, const size_t base_alloc_adr)
     //
     //
     mmu->curr_alloc_adr = base_alloc_adr;
+    mmu->brk_start_adr  = base_alloc_adr;
+
+    // Nothing is mapped yet, regions are handed out from the top down.
+    mmu->mmap_floor_adr  = memory_size & ~(size_t)(MMU_PAGE_SIZE - 1);
+    mmu->nb_mmap_regions = 0;
 
     // Incremented for every loaded program header, when an elf is loaded.
     mmu->nb_adr_maps = 0;
 
+#if defined(__x86_64__)
+    mmu_cpu_has_avx2 = __builtin_cpu_supports("avx2");
+#endif
+
+    if (global_config_get_taint()) {
+        mmu->taint = taint_create(memory_size);
+    }
+
+    // Switched to copy-on-write by `mmu_cow_attach`.
+    mmu->reset_mode = ENUM_RESET_MODE_DIRTY_BLOCKS;
+    mmu->cow_fd     = -1;
+    mmu->pagemap_fd = -1;
+
     // API functions.
     mmu->allocate        = mmu_allocate;
+    mmu->shrink          = mmu_shrink;
+    mmu->map             = mmu_map;
+    mmu->unmap           = mmu_unmap;
+    mmu->protect         = mmu_protect;
     mmu->set_permissions = mmu_set_permissions;
     mmu->write           = mmu_write;
     mmu->read            = mmu_read;
     mmu->search          = mmu_search;
     mmu->print           = mmu_print_mem;
     mmu->virt_to_mapped  = mmu_virt_to_mapped;
+    mmu->reset           = mmu_reset;
+    mmu->sync            = mmu_sync;
 
     return mmu;
 }
@@ -421,8 +1392,16 @@ mmu_destroy(mmu_t* mmu)
         dirty_state_destroy(mmu->dirty_state);
     }
     if (mmu) {
-        free(mmu->memory);
-        free(mmu->permissions);
+        mmu_release_buffers(mmu);
+        taint_destroy(mmu->taint);
+        if (mmu->pagemap_fd != -1) {
+            close(mmu->pagemap_fd);
+        }
+        // The memfd is owned by the exporting snapshot, not by the MMUs
+        // attached to it.
+        if (mmu->cow_fd != -1 && mmu->reset_mode != ENUM_RESET_MODE_COW) {
+            close(mmu->cow_fd);
+        }
         free(mmu);
     }
     return;
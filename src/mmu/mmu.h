@@ -1,38 +1,69 @@
 /**
  * Guest memory layout:
  *
- * +============================+========================+================+
- * |  Loadable program headers  | <-- Guest stack (1MiB) | Guest heap --> |
- * +============================+========================+================+
- * ^                                                     ^                ^
- * |                                                     |                |
- * Address 0                                             Initial stack pointer (grows downwards)
- *                                                       |                |
- *                                                       Initial curr_alloc_adr (grows upwards)
- *                                                                        |
- *                                                                        mmu->memory_size
+ * +==========================+========================+================+ ... +===================+
+ * | Loadable program headers | <-- Guest stack        | Guest heap --> |     | <-- mmap regions  |
+ * +==========================+========================+================+ ... +===================+
+ * ^                                                   ^                ^     ^                   ^
+ * |                                                   |                |     |                   |
+ * Address 0                                           Initial stack pointer (grows downwards)    |
+ *                                                     |                |     |                   |
+ *                                                     Initial curr_alloc_adr (grows upwards)     |
+ *                                                                      |     |                   |
+ *                                                                      brk   mmap_floor_adr      mmu->memory_size
+ *                                                                            (grows downwards)
  *
  * Note that instead of having the stack and the heap growing towards eachother,
  * like they do in traditional OS'es, this emulator and mmu implements them
- * differently. This is to avoid supporting emulation of big allocations, which
- * would use the mmap syscall instead of brk/sbrk and to safely allow for
- * allocatons of big chunks of memory on the heap without overwriting the stack.
- * It will however lead to diffing values returned by the brk/sbrk syscall, but
- * this should not impact the execution flow in any meaningful way.
+ * differently. This is to safely allow for allocatons of big chunks of memory
+ * on the heap without overwriting the stack. It will however lead to diffing
+ * values returned by the brk/sbrk syscall, but this should not impact the
+ * execution flow in any meaningful way.
+ *
+ * Anonymous mmap regions are handed out downwards from the top of memory, and
+ * the heap and the mmap regions may grow until they meet. Unmapped memory
+ * keeps no permissions, so accesses after munmap are caught. Fresh addresses
+ * are preferred over reusing unmapped holes, to keep catching them for as long
+ * as possible. The region table is part of the allocation state, which is
+ * restored on reset like the allocation pointer.
+ *
+ * Reset modes:
+ *
+ * The default reset mode tracks every write in software and copies the dirtied
+ * blocks back from the snapshot. In copy-on-write mode the memory and
+ * permissions of the snapshot are placed in a memfd, which every worker maps
+ * privately. The kernel then does the dirty tracking for us. A reset finds the
+ * pages which have been copied on write in `/proc/self/pagemap` and drops them
+ * with `madvise(MADV_DONTNEED)`, after which they read as the snapshot again.
+ *
+ * Huge pages:
+ *
+ * Guest memory is accessed all over the place, so the memory and permission
+ * buffers are backed by 2MiB pages when possible to keep TLB misses down.
+ * Either explicitly from the hugetlb pool, falling back to transparent huge
+ * pages, or only transparent huge pages. Which one was obtained is recorded in
+ * `huge_pages`.
  */
 
 
 #ifndef MMU_H
 #define MMU_H
 
+#include "../main/config.h"
 #include "../utils/vector.h"
 
 #include "adr_map.h"
+#include "mmu_stats.h"
+#include "taint.h"
 
 // Amount of bytes in single block
 // TODO: Tune this value for performance
 #define DIRTY_BLOCK_SIZE  64
 
+// Host and guest page size. Guest memory sizes and mmap regions are multiples
+// of it.
+#define MMU_PAGE_SIZE     4096
+
 typedef struct dirty_state dirty_state_t;
 typedef struct mmu         mmu_t;
 
@@ -41,10 +72,41 @@ static const uint8_t MMU_PERM_WRITE = 1 << 1;
 static const uint8_t MMU_PERM_READ  = 1 << 2;
 static const uint8_t MMU_PERM_RAW   = 1 << 3; // Read after write.
 
+// Watchpoint bits. Accesses to bytes with these set are recorded in
+// `mmu->watch_hit`, and are otherwise carried out as normal.
+static const uint8_t MMU_PERM_WATCH_WRITE = 1 << 4;
+static const uint8_t MMU_PERM_WATCH_READ  = 1 << 5;
+
+// End bit. Reaching an instruction with it set ends the fuzzcase gracefully,
+// before the instruction runs. It is tested along with the fetch, which reads
+// the permissions of the instruction anyway.
+static const uint8_t MMU_PERM_END = 1 << 6;
+
+// Snapshot bit. Reaching an instruction with it set stops the emulator with
+// `EMU_EXIT_REASON_SNAPSHOT`, so that a nested snapshot can be taken there.
+static const uint8_t MMU_PERM_SNAPSHOT = 1 << 7;
+
+// Number of bytes of a watched access which are recorded.
+#define MMU_WATCH_VALUE_SIZE 8
+
+// The last access to memory with a watchpoint bit set.
+typedef struct {
+    bool     hit;                                // Set on a watched access. Cleared by whoever handles it.
+    bool     is_write;                           // Write or read access.
+    uint64_t adr;                                // First address of the access.
+    uint64_t size;                               // Size of the whole access.
+    uint8_t  old_value[MMU_WATCH_VALUE_SIZE];    // Leading bytes of the accessed memory before the access.
+    uint8_t  new_value[MMU_WATCH_VALUE_SIZE];    // Leading bytes of the accessed memory after the access.
+} mmu_watch_hit_t;
+
 static const uint8_t MMU_ALLOC_NO_ERROR            = 0; // No error.
 static const uint8_t MMU_ALLOC_ERROR_MEM_FULL      = 1; // Emulator memory is already full.
 static const uint8_t MMU_ALLOC_ERROR_WOULD_OVERRUN = 2; // Allocation would overrun the memory size.
 
+static const uint8_t MMU_MAP_NO_ERROR      = 0; // No error.
+static const uint8_t MMU_MAP_ERROR_NO_MEM  = 1; // Out of free memory or regions, or the range is not mapped.
+static const uint8_t MMU_MAP_ERROR_INVALID = 2; // Unaligned address, or range outside the mmap regions.
+
 static const uint8_t MMU_READ_NO_ERROR               = 0; // No error.
 static const uint8_t MMU_READ_ERROR_NO_PERM          = 1; // Attempted to read from an address with no read permission.
 static const uint8_t MMU_READ_ERROR_ADR_OUT_OF_RANGE = 2; // Attempted to read from an address which is outside emulator memory.
@@ -53,6 +115,30 @@ static const uint8_t MMU_WRITE_NO_ERROR               = 0; // No error.
 static const uint8_t MMU_WRITE_ERROR_NO_PERM          = 1; // Attempted to write from an address with no read permission.
 static const uint8_t MMU_WRITE_ERROR_ADR_OUT_OF_RANGE = 2; // Attempted to write from an address which is outside emulator memory.
 
+// Bytes at the bottom of the stack which are kept unmapped to catch overflows.
+#define MMU_STACK_GUARD_SIZE 4096
+
+// Max number of separate regions mapped with `mmu->map`.
+#define MMU_MAX_NB_MMAP_REGIONS 1024
+
+// Max number of program arguments whose addresses are kept.
+#define MMU_MAX_NB_ARGS 64
+
+// A range of guest memory mapped with `mmu->map`.
+typedef struct {
+    size_t adr;
+    size_t size;
+} mmu_region_t;
+
+// Allocation state of an MMU, for snapshots which are kept outside of one.
+typedef struct {
+    size_t       curr_alloc_adr;
+    size_t       brk_start_adr;
+    size_t       mmap_floor_adr;
+    mmu_region_t mmap_regions[MMU_MAX_NB_MMAP_REGIONS];
+    size_t       nb_mmap_regions;
+} mmu_allocations_t;
+
 struct dirty_state {
     void (*make_dirty)(dirty_state_t* state, size_t address);
     void (*print)(dirty_state_t* state);
@@ -75,13 +161,31 @@ struct dirty_state {
 
 struct mmu {
     size_t    (*allocate)(mmu_t* mmu, size_t size, uint8_t* error);
+
+    // Move the allocation pointer back to `adr`, which may not be below
+    // `brk_start_adr`, and drop the permissions of everything above it.
+    uint8_t   (*shrink)(mmu_t* mmu, size_t adr);
+
+    // Map, unmap and change the permissions of page aligned regions at the top
+    // of guest memory. Mapped memory is zeroed.
+    size_t    (*map)(mmu_t* mmu, size_t size, uint8_t permission, uint8_t* error);
+    uint8_t   (*unmap)(mmu_t* mmu, size_t adr, size_t size);
+    uint8_t   (*protect)(mmu_t* mmu, size_t adr, size_t size, uint8_t permission);
+
     void      (*set_permissions)(mmu_t* mmu, size_t start_adress, uint8_t permission, size_t size);
     uint8_t   (*write)(mmu_t* mmu, size_t destination_adress, const uint8_t* source_buffer, size_t size);
     uint8_t   (*read)(mmu_t* mmu, uint8_t* destination_buffer, const size_t source_adress, size_t size);
-    vector_t* (*search)(mmu_t* mmu, const uint64_t needle, const char size_letter);
+    vector_t* (*search)(mmu_t* mmu, const uint8_t* needle, size_t needle_len, size_t alignment, uint8_t perms);
     void      (*print)(mmu_t* mmu, size_t start_adr, const size_t range, const char size_letter);
     uint64_t  (*virt_to_mapped)(mmu_t* mmu, uint64_t virt_adr);
 
+    // Reset the memory state to that of `src`. Only touches what has been
+    // dirtied since the last reset or sync.
+    void      (*reset)(mmu_t* mmu, const mmu_t* src);
+
+    // Copy the whole used memory state of `src`. Slow, use once per emulator.
+    void      (*sync)(mmu_t* mmu, const mmu_t* src);
+
     // The size of the emulator memory
     size_t memory_size;
 
@@ -100,12 +204,29 @@ struct mmu {
     // memory[current_allocation - 1] == last allocated address in guest memory
     size_t curr_alloc_adr;
 
+    // Lowest address the allocation pointer may be moved back to. Set once the
+    // initial stack is built.
+    size_t brk_start_adr;
+
+    // Lowest address ever handed out by `map`. Everything in
+    // [mmap_floor_adr, memory_size) which is not in a region is unmapped.
+    size_t mmap_floor_adr;
+
+    // Mapped regions, sorted by address.
+    mmu_region_t mmap_regions[MMU_MAX_NB_MMAP_REGIONS];
+    size_t       nb_mmap_regions;
+
     // Where in the MMU buffer the stack starts. Never changes once set.
     size_t initial_stack_adr_mapped;
 
     // Virtual address where the stack starts. Never changes once set.
     size_t initial_stack_adr_virt;
 
+    // Virtual addresses of the first program arguments written by
+    // `build_stack`, each in a buffer of `ARG_MAX` bytes.
+    size_t arg_adrs[MMU_MAX_NB_ARGS];
+    size_t nb_args;
+
     // Tracker of memory blocks which have been touched by program execution.
     dirty_state_t* dirty_state;
 
@@ -114,6 +235,36 @@ struct mmu {
 
     // Number of address transation mappings in use. Should be one per loaded program header.
     uint64_t nb_adr_maps;
+
+    // How `reset` restores memory.
+    enum_reset_mode_t reset_mode;
+
+    // memfd holding memory followed by permissions of a clean snapshot. Set on
+    // exported snapshots and on MMUs attached to them. -1 otherwise.
+    int cow_fd;
+
+    // Used to find copy-on-write pages when resetting in copy-on-write mode.
+    int pagemap_fd;
+
+    // First address of the last read or write which faulted.
+    uint64_t fault_adr;
+
+    // Last access to watched memory.
+    mmu_watch_hit_t watch_hit;
+
+    // Shadow memory of fuzzcase byte labels. NULL unless taint tracking is
+    // enabled.
+    taint_t* taint;
+
+    // Access statistics, owned by the emulator stats. NULL unless enabled.
+    mmu_stats_t* stats;
+
+    // The kind of pages backing `memory` and `permissions`.
+    enum_huge_pages_t huge_pages;
+
+    // Size of the host mappings of `memory` and `permissions` each. The memory
+    // size rounded up to the page size in use.
+    size_t mapped_size;
 };
 
 mmu_t*
@@ -122,6 +273,50 @@ mmu_create(const size_t memory_size, const size_t base_alloc_adr);
 void
 mmu_destroy(mmu_t* mmu);
 
+// Write the used memory and permissions of a snapshot MMU into a memfd, which
+// other MMUs can attach to with `mmu_cow_attach`.
+bool
+mmu_cow_export(mmu_t* snapshot);
+
+// Replace the memory and permissions of `mmu` with private mappings of an
+// exported snapshot, and switch it to copy-on-write resets.
+bool
+mmu_cow_attach(mmu_t* mmu, const mmu_t* snapshot);
+
+// Copy the allocation pointer and mapped regions of `src`, without touching
+// memory.
+void
+mmu_copy_allocations(mmu_t* dst, const mmu_t* src);
+
+// Whether `adr` is in the unmapped guard at the bottom of the stack.
+bool
+mmu_in_stack_guard(const mmu_t* mmu, uint64_t adr);
+
+// Mark the blocks of `size` bytes at `adr` as dirty, for memory changed
+// without going through `write`. Does nothing in copy-on-write mode.
+void
+mmu_mark_dirty(mmu_t* mmu, size_t adr, size_t size);
+
+// Remove all watchpoint bits from the allocated part of memory.
+void
+mmu_clear_watchpoints(mmu_t* mmu);
+
+// Set the end or snapshot bit on an instruction. Returns false if the
+// address is not executable.
+bool
+mmu_mark_instruction(mmu_t* mmu, uint64_t adr, uint8_t bit);
+
+void
+mmu_save_allocations(const mmu_t* mmu, mmu_allocations_t* allocations);
+
+void
+mmu_restore_allocations(mmu_t* mmu, const mmu_allocations_t* allocations);
+
+// Number of bytes of memory and permissions which are currently backed by huge
+// pages, according to `/proc/self/smaps`.
+size_t
+mmu_huge_page_bytes(const mmu_t* mmu);
+
 void
 print_permissions(uint8_t perms);
 
@@ -0,0 +1,153 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "mmu_stats.h"
+
+#include "../utils/logger.h"
+
+static const char* region_names[MMU_STATS_REGION_LAST] = {
+    [MMU_STATS_REGION_ELF]   = "elf",
+    [MMU_STATS_REGION_STACK] = "stack",
+    [MMU_STATS_REGION_HEAP]  = "heap",
+    [MMU_STATS_REGION_MMAP]  = "mmap",
+};
+
+// Add blocks to the entry of `pc`, claiming a free entry if it has none.
+static void
+mmu_stats_add_pc(mmu_stats_t* stats, uint64_t pc, uint64_t nb_blocks)
+{
+    // Instructions are at least 4 byte aligned, so drop the low bits before
+    // hashing.
+    size_t slot = ((pc >> 2) * 0x9e3779b97f4a7c15ULL) >> 54;
+    for (size_t i = 0; i < MMU_STATS_NB_PCS; i++) {
+        mmu_stats_pc_t* entry = &stats->pcs[(slot + i) % MMU_STATS_NB_PCS];
+        if (entry->nb_blocks == 0) {
+            entry->pc = pc;
+        }
+        if (entry->pc == pc) {
+            entry->nb_blocks += nb_blocks;
+            return;
+        }
+    }
+    stats->nb_unattributed_blocks += nb_blocks;
+}
+
+void
+mmu_stats_record_dirty(mmu_stats_t* stats, uint64_t nb_blocks)
+{
+    if (nb_blocks > 0) {
+        mmu_stats_add_pc(stats, stats->curr_pc, nb_blocks);
+    }
+}
+
+void
+mmu_stats_record_reset(mmu_stats_t* stats, uint64_t nb_dirty_blocks)
+{
+    size_t bucket = 0;
+    if (nb_dirty_blocks > 0) {
+        bucket = 64 - __builtin_clzll(nb_dirty_blocks);
+        if (bucket >= MMU_STATS_NB_BUCKETS) {
+            bucket = MMU_STATS_NB_BUCKETS - 1;
+        }
+    }
+    stats->dirty_histogram[bucket]++;
+    stats->nb_resets++;
+    stats->nb_dirty_blocks   += nb_dirty_blocks;
+    stats->last_dirty_blocks  = nb_dirty_blocks;
+    if (nb_dirty_blocks > stats->max_dirty_blocks) {
+        stats->max_dirty_blocks = nb_dirty_blocks;
+    }
+}
+
+void
+mmu_stats_merge(mmu_stats_t* dst, const mmu_stats_t* src)
+{
+    dst->nb_resets         += src->nb_resets;
+    dst->nb_dirty_blocks   += src->nb_dirty_blocks;
+    dst->last_dirty_blocks  = src->last_dirty_blocks;
+    if (src->max_dirty_blocks > dst->max_dirty_blocks) {
+        dst->max_dirty_blocks = src->max_dirty_blocks;
+    }
+    for (size_t i = 0; i < MMU_STATS_NB_BUCKETS; i++) {
+        dst->dirty_histogram[i] += src->dirty_histogram[i];
+    }
+    for (size_t i = 0; i < MMU_STATS_REGION_LAST; i++) {
+        dst->nb_bytes_read[i]    += src->nb_bytes_read[i];
+        dst->nb_bytes_written[i] += src->nb_bytes_written[i];
+    }
+    for (size_t i = 0; i < MMU_STATS_NB_PCS; i++) {
+        if (src->pcs[i].nb_blocks > 0) {
+            mmu_stats_add_pc(dst, src->pcs[i].pc, src->pcs[i].nb_blocks);
+        }
+    }
+    dst->nb_unattributed_blocks += src->nb_unattributed_blocks;
+}
+
+void
+mmu_stats_print(const mmu_stats_t* stats)
+{
+    char stats_buf[1024] = {0};
+    char tmp_buf[256]    = {0};
+
+    const double avg = stats->nb_resets ? (double)stats->nb_dirty_blocks / stats->nb_resets : 0;
+    sprintf(tmp_buf, "dirty blocks / reset: %.1lf | max: %lu | histogram:", avg, stats->max_dirty_blocks);
+    strcat(stats_buf, tmp_buf);
+    for (size_t i = 0; i < MMU_STATS_NB_BUCKETS; i++) {
+        if (stats->dirty_histogram[i] == 0) {
+            continue;
+        }
+        if (i == 0) {
+            sprintf(tmp_buf, " 0: %lu", stats->dirty_histogram[i]);
+        }
+        else {
+            sprintf(tmp_buf, " %lu-%lu: %lu", 1UL << (i - 1), (1UL << i) - 1, stats->dirty_histogram[i]);
+        }
+        strcat(stats_buf, tmp_buf);
+    }
+    ginger_log(INFO, "%s\n", stats_buf);
+
+    memset(stats_buf, 0, sizeof(stats_buf));
+    strcat(stats_buf, "bytes read / written:");
+    for (size_t i = 0; i < MMU_STATS_REGION_LAST; i++) {
+        sprintf(tmp_buf, "%s %s: %lu / %lu", i == 0 ? "" : " |", region_names[i],
+                stats->nb_bytes_read[i], stats->nb_bytes_written[i]);
+        strcat(stats_buf, tmp_buf);
+    }
+    ginger_log(INFO, "%s\n", stats_buf);
+
+    // Pick the top PCs by repeatedly taking the largest entry below the
+    // previous one. The table is small and this is only done when printing.
+    memset(stats_buf, 0, sizeof(stats_buf));
+    strcat(stats_buf, "top dirtying pcs:");
+    uint64_t prev_nb_blocks = UINT64_MAX;
+    uint64_t prev_pc        = 0;
+    for (size_t n = 0; n < MMU_STATS_NB_TOP_PCS; n++) {
+        const mmu_stats_pc_t* best = NULL;
+        for (size_t i = 0; i < MMU_STATS_NB_PCS; i++) {
+            const mmu_stats_pc_t* entry = &stats->pcs[i];
+            const bool below_prev = entry->nb_blocks < prev_nb_blocks ||
+                                    (entry->nb_blocks == prev_nb_blocks && entry->pc > prev_pc);
+            if (entry->nb_blocks == 0 || !below_prev) {
+                continue;
+            }
+            if (!best || entry->nb_blocks > best->nb_blocks ||
+                (entry->nb_blocks == best->nb_blocks && entry->pc < best->pc))
+            {
+                best = entry;
+            }
+        }
+        if (!best) {
+            break;
+        }
+        sprintf(tmp_buf, " 0x%lx: %lu", best->pc, best->nb_blocks);
+        strcat(stats_buf, tmp_buf);
+        prev_nb_blocks = best->nb_blocks;
+        prev_pc        = best->pc;
+    }
+    if (stats->nb_unattributed_blocks > 0) {
+        sprintf(tmp_buf, " | unattributed: %lu", stats->nb_unattributed_blocks);
+        strcat(stats_buf, tmp_buf);
+    }
+    ginger_log(INFO, "%s\n", stats_buf);
+}
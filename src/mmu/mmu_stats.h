@@ -0,0 +1,77 @@
+/**
+ * Memory access statistics.
+ *
+ * Collected by the MMU when enabled, to show where fuzzcases spend their
+ * memory traffic and what makes resets expensive. Counts how many blocks are
+ * dirty at every reset, how many bytes are read and written in each part of
+ * guest memory, and which guest instructions dirtied the most blocks. Dirty
+ * blocks are only tracked in the dirty block reset mode.
+ *
+ * The statistics are embedded in `emu_stats_t`, so they are cleared and merged
+ * into the shared stats together with the other counters.
+ */
+
+#ifndef MMU_STATS_H
+#define MMU_STATS_H
+
+#include <stdint.h>
+
+// Number of dirty block histogram buckets. Bucket `i` counts resets with
+// [2^(i-1), 2^i) dirty blocks, bucket 0 resets with none.
+#define MMU_STATS_NB_BUCKETS 24
+
+// Max number of distinct guest PCs whose dirtied blocks are counted.
+#define MMU_STATS_NB_PCS 1024
+
+// Number of PCs listed by `mmu_stats_print`.
+#define MMU_STATS_NB_TOP_PCS 5
+
+typedef enum {
+    MMU_STATS_REGION_ELF,   // Loaded program headers, below the stack.
+    MMU_STATS_REGION_STACK, // The stack and the arguments above it.
+    MMU_STATS_REGION_HEAP,  // Memory handed out by brk.
+    MMU_STATS_REGION_MMAP,  // Memory handed out by mmap.
+    MMU_STATS_REGION_LAST,
+} enum_mmu_stats_region_t;
+
+typedef struct {
+    uint64_t pc;
+    uint64_t nb_blocks;
+} mmu_stats_pc_t;
+
+typedef struct {
+    // Guest PC of the instruction being executed. Kept up to date by the
+    // emulator, and used to attribute dirtied blocks.
+    uint64_t       curr_pc;
+
+    uint64_t       nb_resets;
+    uint64_t       nb_dirty_blocks;        // Total over all resets.
+    uint64_t       max_dirty_blocks;       // Most dirty blocks at a single reset.
+    uint64_t       last_dirty_blocks;      // Dirty blocks at the last reset.
+    uint64_t       dirty_histogram[MMU_STATS_NB_BUCKETS];
+
+    uint64_t       nb_bytes_read[MMU_STATS_REGION_LAST];
+    uint64_t       nb_bytes_written[MMU_STATS_REGION_LAST];
+
+    // Open addressing table of blocks dirtied per PC. An entry with zero
+    // blocks is free.
+    mmu_stats_pc_t pcs[MMU_STATS_NB_PCS];
+    uint64_t       nb_unattributed_blocks; // Dirtied when the table was full.
+} mmu_stats_t;
+
+// Record that `nb_blocks` blocks were made dirty by the current PC.
+void
+mmu_stats_record_dirty(mmu_stats_t* stats, uint64_t nb_blocks);
+
+// Record the number of dirty blocks found by a reset.
+void
+mmu_stats_record_reset(mmu_stats_t* stats, uint64_t nb_dirty_blocks);
+
+// Add the statistics of `src` to `dst`.
+void
+mmu_stats_merge(mmu_stats_t* dst, const mmu_stats_t* src);
+
+void
+mmu_stats_print(const mmu_stats_t* stats);
+
+#endif
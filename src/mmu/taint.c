@@ -0,0 +1,70 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "taint.h"
+
+#include "../utils/logger.h"
+
+void
+taint_label_input(taint_t* taint, uint64_t adr, uint64_t len, uint64_t offset)
+{
+    if (adr + len > taint->memory_size) {
+        ginger_log(ERROR, "[%s] Tainted range is outside of emulator memory!\n", __func__);
+        return;
+    }
+    if (offset >= TAINT_MAX_NB_OFFSETS) {
+        return;
+    }
+    if (offset + len > TAINT_MAX_NB_OFFSETS) {
+        len = TAINT_MAX_NB_OFFSETS - offset;
+    }
+    for (uint64_t i = 0; i < len; i++) {
+        taint->shadow[adr + i] = offset + i + 1;
+    }
+}
+
+void
+taint_clear(taint_t* taint, uint64_t adr, size_t size)
+{
+    memset(taint->shadow + adr, 0, size * sizeof(taint_label_t));
+}
+
+void
+taint_clear_cmps(taint_t* taint)
+{
+    memset(taint->cmp_offsets, 0, taint->nb_cmp_words * sizeof(uint64_t));
+    taint->nb_cmp_words = 0;
+}
+
+taint_t*
+taint_create(size_t memory_size)
+{
+    taint_t* taint = calloc(1, sizeof(taint_t));
+    if (!taint) {
+        ginger_log(ERROR, "[%s] Could not allocate memory for taint!\n", __func__);
+        abort();
+    }
+
+    // Only the shadow of memory which is actually tainted gets populated.
+    taint->memory_size = memory_size;
+    taint->shadow      = mmap(NULL, memory_size * sizeof(taint_label_t), PROT_READ | PROT_WRITE,
+                              MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    taint->cmp_offsets = calloc((TAINT_MAX_NB_OFFSETS + 63) / 64, sizeof(uint64_t));
+    if (taint->shadow == MAP_FAILED || !taint->cmp_offsets) {
+        ginger_log(ERROR, "[%s] Could not allocate memory for taint shadow!\n", __func__);
+        abort();
+    }
+    return taint;
+}
+
+void
+taint_destroy(taint_t* taint)
+{
+    if (taint) {
+        munmap(taint->shadow, taint->memory_size * sizeof(taint_label_t));
+        free(taint->cmp_offsets);
+        free(taint);
+    }
+}
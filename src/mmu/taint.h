@@ -0,0 +1,73 @@
+/**
+ * Byte level taint tracking of fuzzcase bytes.
+ *
+ * Every byte of guest memory has a label in the shadow memory. A label is
+ * either 0, meaning that the byte does not depend on the fuzzcase, or the
+ * offset into the fuzzcase of the byte it was derived from plus one. The cpu
+ * backend propagates labels through registers, loads and stores, and records
+ * the labels of all operands of comparisons. After a run, `cmp_offsets` holds
+ * the fuzzcase offsets which influenced control flow.
+ *
+ * Labels are reset by clearing the shadow of the dirty blocks, so taint
+ * tracking requires the dirty block reset mode.
+ */
+
+#ifndef TAINT_H
+#define TAINT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Largest fuzzcase offset which can be tracked, plus one.
+#define TAINT_MAX_NB_OFFSETS UINT16_MAX
+
+typedef uint16_t taint_label_t;
+
+typedef struct {
+    // One label per byte of guest memory.
+    taint_label_t* shadow;
+    size_t         memory_size;
+
+    // Bitmap of fuzzcase offsets which reached a comparison during this run.
+    uint64_t*      cmp_offsets;
+
+    // Number of words at the start of `cmp_offsets` which may have bits set.
+    size_t         nb_cmp_words;
+} taint_t;
+
+// Label `len` bytes starting at `adr` with the fuzzcase offsets
+// offset..offset + len.
+void
+taint_label_input(taint_t* taint, uint64_t adr, uint64_t len, uint64_t offset);
+
+// Remove the labels of `size` bytes starting at `adr`.
+void
+taint_clear(taint_t* taint, uint64_t adr, size_t size);
+
+// Forget the comparisons recorded during the last run.
+void
+taint_clear_cmps(taint_t* taint);
+
+// Record that the fuzzcase byte with `label` reached a comparison.
+static inline void
+taint_record_cmp(taint_t* taint, taint_label_t label)
+{
+    if (label == 0) {
+        return;
+    }
+    const size_t offset = label - 1;
+    const size_t word   = offset / 64;
+    taint->cmp_offsets[word] |= (uint64_t)1 << (offset % 64);
+    if (word >= taint->nb_cmp_words) {
+        taint->nb_cmp_words = word + 1;
+    }
+}
+
+taint_t*
+taint_create(size_t memory_size);
+
+void
+taint_destroy(taint_t* taint);
+
+#endif
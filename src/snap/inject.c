@@ -0,0 +1,261 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "inject.h"
+
+#include "../main/config.h"
+#include "../mmu/taint.h"
+#include "../utils/endianess.h"
+#include "../utils/logger.h"
+
+static enum_endianess_t
+guest_endianess(void)
+{
+    if (global_config_get_arch() == ENUM_SUPPORTED_ARCHS_MIPS64_MSB) {
+        return ENUM_ENDIANESS_MSB;
+    }
+    return ENUM_ENDIANESS_LSB;
+}
+
+// Write to guest memory without going through the permissions, marking the
+// blocks dirty so that the reset undoes it.
+static void
+inject_write_mem(mmu_t* mmu, uint64_t adr, const uint8_t* data, uint64_t len)
+{
+#ifndef NDEBUG
+    // The layout is checked against the memory size when it is built.
+    if (adr > mmu->memory_size || len > mmu->memory_size - adr) {
+        ginger_log(ERROR, "[%s] Injecting 0x%lx bytes at 0x%lx, outside of emulator memory!\n", __func__, len, adr);
+        abort();
+    }
+#endif
+    memcpy(mmu->memory + adr, data, len);
+    mmu_mark_dirty(mmu, adr, len);
+}
+
+// Whether `len` bytes at `adr` are inside of the emulator memory.
+static bool
+inject_in_memory(const emu_t* emu, uint64_t adr, uint64_t len)
+{
+    const uint64_t memory_size = emu->get_mmu(emu)->memory_size;
+    return adr <= memory_size && len <= memory_size - adr;
+}
+
+// Slots are written without going through the mmu, so they have to be checked
+// against the memory size before they are used.
+static bool
+inject_slot_is_valid(const emu_t* emu, const inject_slot_t* slot)
+{
+    switch (slot->kind) {
+        case INJECT_SLOT_REG:
+            if (slot->reg >= emu->get_nb_regs(emu)) {
+                ginger_log(ERROR, "No register %u to inject to!\n", slot->reg);
+                return false;
+            }
+            return true;
+        case INJECT_SLOT_MEM:
+        case INJECT_SLOT_ARG:
+            if (slot->capacity == 0) {
+                ginger_log(ERROR, "Injection slot has no room!\n");
+                return false;
+            }
+            // Arguments are followed by their null byte.
+            if (!inject_in_memory(emu, slot->adr, slot->capacity + (slot->kind == INJECT_SLOT_ARG))) {
+                ginger_log(ERROR, "Injection slot 0x%lx - 0x%lx is outside of emulator memory!\n",
+                           slot->adr, slot->adr + slot->capacity);
+                return false;
+            }
+            return true;
+    }
+    ginger_log(ERROR, "Unknown injection slot kind %d!\n", slot->kind);
+    return false;
+}
+
+bool
+inject_layout_add_slot(inject_layout_t* layout, const emu_t* emu, const inject_slot_t* slot)
+{
+    if (layout->nb_slots == INJECT_MAX_NB_SLOTS) {
+        ginger_log(ERROR, "Can not inject to more than %d slots!\n", INJECT_MAX_NB_SLOTS);
+        return false;
+    }
+    if (!inject_slot_is_valid(emu, slot)) {
+        return false;
+    }
+    layout->slots[layout->nb_slots++] = *slot;
+    return true;
+}
+
+bool
+inject_layout_set_slot(inject_layout_t* layout, const emu_t* emu, size_t idx, const inject_slot_t* slot)
+{
+    if (idx >= layout->nb_slots) {
+        ginger_log(ERROR, "No injection slot %lu!\n", idx);
+        return false;
+    }
+    if (!inject_slot_is_valid(emu, slot)) {
+        return false;
+    }
+    // Pointer sinks can not describe a register.
+    for (size_t i = 0; i < layout->nb_sinks; i++) {
+        if (layout->sinks[i].slot == idx && layout->sinks[i].kind == INJECT_SINK_PTR && slot->kind == INJECT_SLOT_REG) {
+            ginger_log(ERROR, "Register slot %lu has no address!\n", idx);
+            return false;
+        }
+    }
+    layout->slots[idx] = *slot;
+    return true;
+}
+
+bool
+inject_layout_add_sink(inject_layout_t* layout, const emu_t* emu, const inject_sink_t* sink)
+{
+    if (layout->nb_sinks == INJECT_MAX_NB_SINKS) {
+        ginger_log(ERROR, "Can not have more than %d injection sinks!\n", INJECT_MAX_NB_SINKS);
+        return false;
+    }
+    if (sink->slot >= layout->nb_slots) {
+        ginger_log(ERROR, "No injection slot %lu!\n", sink->slot);
+        return false;
+    }
+    if (sink->kind == INJECT_SINK_PTR && layout->slots[sink->slot].kind == INJECT_SLOT_REG) {
+        ginger_log(ERROR, "Register slot %lu has no address!\n", sink->slot);
+        return false;
+    }
+    if (sink->kind != INJECT_SINK_LEN && sink->kind != INJECT_SINK_PTR) {
+        ginger_log(ERROR, "Unknown injection sink kind %d!\n", sink->kind);
+        return false;
+    }
+    if (sink->to_reg && sink->reg >= emu->get_nb_regs(emu)) {
+        ginger_log(ERROR, "No register %u to write the injection sink to!\n", sink->reg);
+        return false;
+    }
+    if (!sink->to_reg && sink->width != 1 && sink->width != 2 && sink->width != 4 && sink->width != 8) {
+        ginger_log(ERROR, "Injection sink width must be 1, 2, 4 or 8 bytes!\n");
+        return false;
+    }
+    if (!sink->to_reg && !inject_in_memory(emu, sink->adr, sink->width)) {
+        ginger_log(ERROR, "Injection sink 0x%lx is outside of emulator memory!\n", sink->adr);
+        return false;
+    }
+    layout->sinks[layout->nb_sinks++] = *sink;
+    return true;
+}
+
+// Index of the last slot taking a variable number of bytes, which is the only
+// one without a length in front of it. `nb_slots` if there is none.
+static size_t
+last_variable_slot(const inject_layout_t* layout)
+{
+    size_t last = layout->nb_slots;
+    for (size_t i = 0; i < layout->nb_slots; i++) {
+        if (layout->slots[i].kind != INJECT_SLOT_REG) {
+            last = i;
+        }
+    }
+    return last;
+}
+
+uint64_t
+inject_layout_capacity(const inject_layout_t* layout)
+{
+    const size_t last     = last_variable_slot(layout);
+    uint64_t     capacity = 0;
+    for (size_t i = 0; i < layout->nb_slots; i++) {
+        const inject_slot_t* slot = &layout->slots[i];
+        if (slot->kind == INJECT_SLOT_REG) {
+            capacity += INJECT_REG_SIZE;
+            continue;
+        }
+        capacity += slot->capacity;
+        if (i != last) {
+            capacity += INJECT_PREFIX_SIZE;
+        }
+    }
+    return capacity;
+}
+
+bool
+inject_layout_is_raw(const inject_layout_t* layout)
+{
+    return layout->nb_slots == 1 && layout->slots[0].kind == INJECT_SLOT_MEM;
+}
+
+void
+inject_layout_write(const inject_layout_t* layout, emu_t* emu, const uint8_t* input, uint64_t len)
+{
+    mmu_t*         mmu  = emu->get_mmu(emu);
+    const size_t   last = last_variable_slot(layout);
+    uint64_t       slot_lens[INJECT_MAX_NB_SLOTS] = {0};
+    uint64_t       pos  = 0;
+
+    // The last variable slot leaves the bytes of the registers after it.
+    uint64_t nb_reg_bytes_after_last = 0;
+    for (size_t i = last + 1; i < layout->nb_slots; i++) {
+        nb_reg_bytes_after_last += INJECT_REG_SIZE;
+    }
+
+    for (size_t i = 0; i < layout->nb_slots; i++) {
+        const inject_slot_t* slot = &layout->slots[i];
+
+        // Registers are zero extended when the fuzzcase runs out.
+        if (slot->kind == INJECT_SLOT_REG) {
+            uint8_t        bytes[INJECT_REG_SIZE] = {0};
+            const uint64_t n = len - pos < INJECT_REG_SIZE ? len - pos : INJECT_REG_SIZE;
+            memcpy(bytes, input + pos, n);
+            emu->set_reg(emu, slot->reg, byte_arr_to_u64(bytes, INJECT_REG_SIZE, guest_endianess()));
+            slot_lens[i] = n;
+            pos += n;
+            continue;
+        }
+
+        uint64_t n = len - pos;
+        if (i != last) {
+            uint8_t        prefix[INJECT_PREFIX_SIZE] = {0};
+            const uint64_t nb_prefix = n < INJECT_PREFIX_SIZE ? n : INJECT_PREFIX_SIZE;
+            memcpy(prefix, input + pos, nb_prefix);
+            pos += nb_prefix;
+
+            const uint64_t wanted = byte_arr_to_u64(prefix, INJECT_PREFIX_SIZE, ENUM_ENDIANESS_LSB);
+            n = len - pos < wanted ? len - pos : wanted;
+        }
+        else {
+            n = n > nb_reg_bytes_after_last ? n - nb_reg_bytes_after_last : 0;
+        }
+        if (n > slot->capacity) {
+            n = slot->capacity;
+        }
+        inject_write_mem(mmu, slot->adr, input + pos, n);
+        if (slot->kind == INJECT_SLOT_ARG) {
+            const uint8_t terminator = 0;
+            inject_write_mem(mmu, slot->adr + n, &terminator, 1);
+        }
+        if (mmu->taint) {
+            taint_label_input(mmu->taint, slot->adr, n, pos);
+        }
+        slot_lens[i] = n;
+        pos += n;
+    }
+    inject_layout_write_sinks(layout, emu, slot_lens);
+}
+
+void
+inject_layout_write_sinks(const inject_layout_t* layout, emu_t* emu, const uint64_t* slot_lens)
+{
+    mmu_t* mmu = emu->get_mmu(emu);
+
+    for (size_t i = 0; i < layout->nb_sinks; i++) {
+        const inject_sink_t* sink  = &layout->sinks[i];
+        const uint64_t       value = sink->kind == INJECT_SINK_LEN ? slot_lens[sink->slot]
+                                                                   : layout->slots[sink->slot].adr;
+        if (sink->to_reg) {
+            emu->set_reg(emu, sink->reg, value);
+            continue;
+        }
+
+        // The value is truncated to the width of the variable.
+        uint8_t bytes[8] = {0};
+        u64_to_byte_arr(value, bytes, guest_endianess());
+        const uint8_t* start = guest_endianess() == ENUM_ENDIANESS_MSB ? bytes + 8 - sink->width : bytes;
+        inject_write_mem(mmu, sink->adr, start, sink->width);
+    }
+}
@@ -0,0 +1,104 @@
+/**
+ * Where fuzzcases go in the emulator.
+ *
+ * A layout is a list of slots the fuzzcase is split across, in order, and a
+ * list of sinks which tell the target about the slots. Memory and argument
+ * slots take a variable number of bytes: every one of them but the last is
+ * preceded in the fuzzcase by a little endian 16 bit length, and the last
+ * takes what is left, but for the registers after it. Register slots take the
+ * next 8 bytes, in the byte order of the guest. A layout of a single memory
+ * slot takes the fuzzcase as is.
+ *
+ *     slots:  mem 0x1000 64, reg a2, mem 0x2000 16
+ *     input:  05 00 'h' 'e' 'l' 'l' 'o' 2a 00 00 00 00 00 00 00 'w' 'o' 'r'
+ *             -> 0x1000 = "hello", a2 = 42, 0x2000 = "wor"
+ *
+ * Sinks write the number of fuzzcase bytes a slot got, or the address of the
+ * slot, to a register or to guest memory, so that the target can be handed a
+ * pointer and a length instead of a fixed size buffer.
+ */
+
+#ifndef INJECT_H
+#define INJECT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../emu/emu_generic.h"
+
+#define INJECT_MAX_NB_SLOTS 16
+#define INJECT_MAX_NB_SINKS 16
+
+// Fuzzcase bytes taken by a register slot, and by the length in front of a
+// variable slot.
+#define INJECT_REG_SIZE    8
+#define INJECT_PREFIX_SIZE 2
+
+typedef enum {
+    INJECT_SLOT_MEM,  // Region of guest memory.
+    INJECT_SLOT_ARG,  // Program argument, null terminated.
+    INJECT_SLOT_REG,  // Register.
+} enum_inject_slot_t;
+
+typedef struct {
+    enum_inject_slot_t kind;
+    uint64_t           adr;       // Memory and argument slots.
+    uint64_t           capacity;  // Most fuzzcase bytes the slot takes.
+    uint8_t            reg;       // Register slots.
+} inject_slot_t;
+
+typedef enum {
+    INJECT_SINK_LEN,  // Number of fuzzcase bytes written to the slot.
+    INJECT_SINK_PTR,  // Guest address of the slot.
+} enum_inject_sink_t;
+
+typedef struct {
+    enum_inject_sink_t kind;
+    size_t             slot;
+    bool               to_reg;
+    uint8_t            reg;
+    uint64_t           adr;
+    uint8_t            width;     // Bytes written to memory, 1, 2, 4 or 8.
+} inject_sink_t;
+
+typedef struct {
+    inject_slot_t slots[INJECT_MAX_NB_SLOTS];
+    size_t        nb_slots;
+    inject_sink_t sinks[INJECT_MAX_NB_SINKS];
+    size_t        nb_sinks;
+} inject_layout_t;
+
+// Append a slot or a sink. Return false, after logging why, if the layout is
+// full, the sink refers to a slot it can not describe, or either of them is
+// outside of the memory or the registers of `emu`.
+bool
+inject_layout_add_slot(inject_layout_t* layout, const emu_t* emu, const inject_slot_t* slot);
+
+bool
+inject_layout_add_sink(inject_layout_t* layout, const emu_t* emu, const inject_sink_t* sink);
+
+// Replace slot `idx`, with the checks of `inject_layout_add_slot`.
+bool
+inject_layout_set_slot(inject_layout_t* layout, const emu_t* emu, size_t idx, const inject_slot_t* slot);
+
+// Length of the largest fuzzcase the layout has room for.
+uint64_t
+inject_layout_capacity(const inject_layout_t* layout);
+
+// Whether the fuzzcase goes to a single memory slot as is.
+bool
+inject_layout_is_raw(const inject_layout_t* layout);
+
+// Split the `len` bytes of `input` across the slots and write them to the
+// emulator, followed by the sinks. Slots are written regardless of the
+// permissions of the guest memory, and labelled with their fuzzcase offsets
+// when taint tracking is enabled.
+void
+inject_layout_write(const inject_layout_t* layout, emu_t* emu, const uint8_t* input, uint64_t len);
+
+// Write the sinks, given the number of fuzzcase bytes each slot got.
+void
+inject_layout_write_sinks(const inject_layout_t* layout, emu_t* emu, const uint64_t* slot_lens);
+
+#endif
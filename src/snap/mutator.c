@@ -0,0 +1,876 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mutator.h"
+
+#include "../utils/logger.h"
+#include "../utils/vector.h"
+
+// Largest delta added or subtracted by the arithmetic operators.
+#define MUTATOR_ARITH_MAX 35
+
+// Sizes of blocks inserted, deleted and copied. Most blocks are small, since
+// large ones mostly break the structure of the input.
+#define MUTATOR_BLOCK_SMALL  32
+#define MUTATOR_BLOCK_MEDIUM 128
+
+// Shared yields are multiplied by this every time a worker folds in the counts
+// of `MUTATOR_SCHEDULE_INTERVAL` fuzzcases, which halves them after some 70
+// intervals.
+#define MUTATOR_SCHEDULE_DECAY 0.99
+
+// Weight of the mean yield of all operators in the yield of each one. Keeps
+// operators which have seen few fuzzcases from getting extreme weights.
+#define MUTATOR_SCHEDULE_PRIOR 256.0
+
+// Share of the fuzzcases spread evenly over the operators regardless of yield.
+#define MUTATOR_SCHEDULE_FLOOR 0.25
+
+// Sum of the weights in a cumulative weight table.
+#define MUTATOR_SCHEDULE_SCALE (1U << 20)
+
+// Yields of all the workers.
+static mutator_yield_t shared_yield;
+static pthread_mutex_t shared_yield_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const char* op_names[MUTATOR_OP_LAST] = {
+    [MUTATOR_OP_BIT_FLIP]        = "bitflip",
+    [MUTATOR_OP_BYTE_FLIP]       = "byteflip",
+    [MUTATOR_OP_RANDOM_BYTE]     = "rand8",
+    [MUTATOR_OP_ARITH_8]         = "arith8",
+    [MUTATOR_OP_ARITH_16]        = "arith16",
+    [MUTATOR_OP_ARITH_32]        = "arith32",
+    [MUTATOR_OP_ARITH_64]        = "arith64",
+    [MUTATOR_OP_INTERESTING_8]   = "int8",
+    [MUTATOR_OP_INTERESTING_16]  = "int16",
+    [MUTATOR_OP_INTERESTING_32]  = "int32",
+    [MUTATOR_OP_INTERESTING_64]  = "int64",
+    [MUTATOR_OP_BLOCK_INSERT]    = "insert",
+    [MUTATOR_OP_BLOCK_DELETE]    = "delete",
+    [MUTATOR_OP_BLOCK_DUPLICATE] = "dup",
+    [MUTATOR_OP_BLOCK_OVERWRITE] = "overwrite",
+    [MUTATOR_OP_SPLICE]          = "splice",
+    [MUTATOR_OP_DICT_INSERT]     = "dict-ins",
+    [MUTATOR_OP_DICT_OVERWRITE]  = "dict-ovr",
+    [MUTATOR_OP_CUSTOM]          = "custom",
+    [MUTATOR_OP_DETERMINISTIC]   = "det",
+    [MUTATOR_OP_TREE_GENERATE]   = "generate",
+    [MUTATOR_OP_TREE_REPLACE]    = "tree-rep",
+    [MUTATOR_OP_TREE_RECURSE]    = "tree-rec",
+    [MUTATOR_OP_TREE_SPLICE]     = "tree-spl",
+};
+
+// Values which tend to hit boundary conditions. Ordered by width, so that an
+// operator of a given width picks from the values of its width and the
+// narrower ones.
+static const int64_t interesting_values[] = {
+    // 8 bits.
+    -128, -1, 0, 1, 16, 32, 64, 100, 127,
+    // 16 bits.
+    -32768, -129, 128, 255, 256, 512, 1000, 1024, 4096, 32767,
+    // 32 bits.
+    -2147483648LL, -100663046, -32769, 32768, 65535, 65536, 100663045, 2147483647,
+    // 64 bits.
+    INT64_MIN, -2147483649LL, 2147483648LL, 4294967295LL, 4294967296LL, INT64_MAX,
+};
+#define NB_INTERESTING_8  9
+#define NB_INTERESTING_16 (NB_INTERESTING_8 + 10)
+#define NB_INTERESTING_32 (NB_INTERESTING_16 + 8)
+#define NB_INTERESTING_64 (sizeof(interesting_values) / sizeof(interesting_values[0]))
+
+static uint64_t
+load_int(const uint8_t* buf, size_t width, bool big_endian)
+{
+    uint64_t value = 0;
+    for (size_t i = 0; i < width; i++) {
+        const size_t byte = big_endian ? width - 1 - i : i;
+        value |= (uint64_t)buf[byte] << (8 * i);
+    }
+    return value;
+}
+
+static void
+store_int(uint8_t* buf, uint64_t value, size_t width, bool big_endian)
+{
+    for (size_t i = 0; i < width; i++) {
+        const size_t byte = big_endian ? width - 1 - i : i;
+        buf[byte] = value >> (8 * i);
+    }
+}
+
+// Pick the offset of a `width` byte value in an input of `len` bytes, which
+// has to be at least `width`. Three out of four times, pick one which is known
+// to reach a comparison, if any are, or else an effective byte of the input,
+// if it has an effector map.
+static uint64_t
+pick_offset(mutator_t* mutator, uint64_t len, size_t width)
+{
+    const uint64_t    nb_offsets = len - width + 1;
+    const size_t      nb_hot     = *mutator->nb_hot_offsets;
+    const effector_t* effector   = mutator->effector;
+
+    if (nb_hot > 0 && prng_below(mutator->prng, 4) != 0) {
+        const uint16_t hot = mutator->hot_offsets[prng_below(mutator->prng, nb_hot)];
+        if (hot < nb_offsets) {
+            return hot;
+        }
+    }
+    else if (effector && effector->nb_offsets > 0 && prng_below(mutator->prng, 4) != 0) {
+        const uint32_t effective = effector->offsets[prng_below(mutator->prng, effector->nb_offsets)];
+        if (effective < nb_offsets) {
+            return effective;
+        }
+    }
+    return prng_below(mutator->prng, nb_offsets);
+}
+
+// Pick a block length in [1, limit]. `limit` has to be nonzero.
+static uint64_t
+pick_block_len(mutator_t* mutator, uint64_t limit)
+{
+    uint64_t max = 0;
+    switch (prng_below(mutator->prng, 4))
+    {
+    case 0:
+    case 1:
+        max = MUTATOR_BLOCK_SMALL;
+        break;
+    case 2:
+        max = MUTATOR_BLOCK_MEDIUM;
+        break;
+    default:
+        max = limit;
+        break;
+    }
+    if (max > limit) {
+        max = limit;
+    }
+    return 1 + prng_below(mutator->prng, max);
+}
+
+static void
+op_arith(mutator_t* mutator, uint8_t* buf, uint64_t len, size_t width)
+{
+    const uint64_t offset     = pick_offset(mutator, len, width);
+    const bool     big_endian = width > 1 && prng_below(mutator->prng, 2);
+    const uint64_t delta      = 1 + prng_below(mutator->prng, MUTATOR_ARITH_MAX);
+
+    uint64_t value = load_int(buf + offset, width, big_endian);
+    value = prng_below(mutator->prng, 2) ? value + delta : value - delta;
+    store_int(buf + offset, value, width, big_endian);
+}
+
+static void
+op_interesting(mutator_t* mutator, uint8_t* buf, uint64_t len, size_t width, size_t nb_values)
+{
+    const uint64_t offset     = pick_offset(mutator, len, width);
+    const bool     big_endian = width > 1 && prng_below(mutator->prng, 2);
+    const int64_t  value      = interesting_values[prng_below(mutator->prng, nb_values)];
+
+    store_int(buf + offset, value, width, big_endian);
+}
+
+// Make room for `n` bytes at `pos`.
+static void
+open_gap(uint8_t* buf, uint64_t len, uint64_t pos, uint64_t n)
+{
+    memmove(buf + pos + n, buf + pos, len - pos);
+}
+
+static uint64_t
+op_block_insert(mutator_t* mutator, uint8_t* buf, uint64_t len, uint64_t capacity)
+{
+    const uint64_t n   = pick_block_len(mutator, capacity - len);
+    const uint64_t pos = prng_below(mutator->prng, len + 1);
+
+    open_gap(buf, len, pos, n);
+    // Half of the time a run of one byte, taken from the input or random,
+    // otherwise random bytes.
+    if (prng_below(mutator->prng, 2)) {
+        const uint8_t byte = prng_below(mutator->prng, 2) ? buf[prng_below(mutator->prng, len)] : prng_next(mutator->prng);
+        memset(buf + pos, byte, n);
+    }
+    else {
+        for (uint64_t i = 0; i < n; i++) {
+            buf[pos + i] = prng_next(mutator->prng);
+        }
+    }
+    return len + n;
+}
+
+static uint64_t
+op_block_delete(mutator_t* mutator, uint8_t* buf, uint64_t len)
+{
+    const uint64_t n   = pick_block_len(mutator, len - 1);
+    const uint64_t pos = prng_below(mutator->prng, len - n + 1);
+
+    memmove(buf + pos, buf + pos + n, len - pos - n);
+    return len - n;
+}
+
+static uint64_t
+op_block_duplicate(mutator_t* mutator, uint8_t* buf, uint64_t len, uint64_t capacity)
+{
+    const uint64_t limit = len < capacity - len ? len : capacity - len;
+    const uint64_t n     = pick_block_len(mutator, limit);
+    uint64_t       src   = prng_below(mutator->prng, len - n + 1);
+    const uint64_t dst   = prng_below(mutator->prng, len + 1);
+
+    open_gap(buf, len, dst, n);
+    // The block moved along with the gap if it was behind it.
+    if (src >= dst) {
+        src += n;
+    }
+    // A block straddling the gap is copied in two parts.
+    else if (src + n > dst) {
+        const uint64_t head = dst - src;
+        memmove(buf + dst, buf + src, head);
+        memmove(buf + dst + head, buf + dst + n, n - head);
+        return len + n;
+    }
+    memmove(buf + dst, buf + src, n);
+    return len + n;
+}
+
+static void
+op_block_overwrite(mutator_t* mutator, uint8_t* buf, uint64_t len)
+{
+    const uint64_t n   = pick_block_len(mutator, len - 1);
+    const uint64_t src = prng_below(mutator->prng, len - n + 1);
+    const uint64_t dst = prng_below(mutator->prng, len - n + 1);
+
+    memmove(buf + dst, buf + src, n);
+}
+
+// Keep the head of the input, and replace the rest with the tail of another
+// corpus input. Returns 0 if the other input is too short to splice with.
+static uint64_t
+op_splice(mutator_t* mutator, uint8_t* buf, uint64_t len, uint64_t capacity)
+{
+    const input_t* other     = corpus_get_input(mutator->corpus, prng_below(mutator->prng, mutator->nb_inputs));
+    const uint64_t other_len = other->length < capacity ? other->length : capacity;
+    const uint64_t limit     = len < other_len ? len : other_len;
+
+    if (limit < 2) {
+        return 0;
+    }
+    const uint64_t split = 1 + prng_below(mutator->prng, limit - 1);
+    memcpy(buf + split, other->data + split, other_len - split);
+    return other_len;
+}
+
+// Insert or overwrite with a random dictionary token. Returns 0 if it does not
+// fit.
+static uint64_t
+op_dict(mutator_t* mutator, uint8_t* buf, uint64_t len, uint64_t capacity, bool insert)
+{
+    const dictionary_t* dict = mutator->dictionary;
+    if (dict->nb_tokens == 0) {
+        return 0;
+    }
+    const token_t* token = &dict->tokens[prng_below(mutator->prng, dict->nb_tokens)];
+
+    if (insert) {
+        if (len + token->length > capacity) {
+            return 0;
+        }
+        const uint64_t pos = prng_below(mutator->prng, len + 1);
+        open_gap(buf, len, pos, token->length);
+        memcpy(buf + pos, token->data, token->length);
+        return len + token->length;
+    }
+    if (token->length > len) {
+        return 0;
+    }
+    memcpy(buf + pick_offset(mutator, len, token->length), token->data, token->length);
+    return len;
+}
+
+// Apply `op`. Returns the new length, or 0 if the operator can not be applied
+// to an input of length `len`.
+static uint64_t
+apply_op(mutator_t* mutator, enum_mutator_op_t op, uint8_t* buf, uint64_t len, uint64_t capacity)
+{
+    static const size_t widths[] = { 1, 2, 4, 8 };
+    static const size_t nb_interesting[] = {
+        NB_INTERESTING_8, NB_INTERESTING_16, NB_INTERESTING_32, NB_INTERESTING_64
+    };
+
+    switch (op)
+    {
+    case MUTATOR_OP_BIT_FLIP:
+        buf[pick_offset(mutator, len, 1)] ^= 1 << prng_below(mutator->prng, 8);
+        return len;
+    case MUTATOR_OP_BYTE_FLIP:
+        buf[pick_offset(mutator, len, 1)] ^= 0xff;
+        return len;
+    case MUTATOR_OP_RANDOM_BYTE:
+        buf[pick_offset(mutator, len, 1)] = prng_next(mutator->prng);
+        return len;
+    case MUTATOR_OP_ARITH_8:
+    case MUTATOR_OP_ARITH_16:
+    case MUTATOR_OP_ARITH_32:
+    case MUTATOR_OP_ARITH_64: {
+        const size_t width = widths[op - MUTATOR_OP_ARITH_8];
+        if (len < width) {
+            return 0;
+        }
+        op_arith(mutator, buf, len, width);
+        return len;
+    }
+    case MUTATOR_OP_INTERESTING_8:
+    case MUTATOR_OP_INTERESTING_16:
+    case MUTATOR_OP_INTERESTING_32:
+    case MUTATOR_OP_INTERESTING_64: {
+        const size_t width = widths[op - MUTATOR_OP_INTERESTING_8];
+        if (len < width) {
+            return 0;
+        }
+        op_interesting(mutator, buf, len, width, nb_interesting[op - MUTATOR_OP_INTERESTING_8]);
+        return len;
+    }
+    case MUTATOR_OP_BLOCK_INSERT:
+        return len < capacity ? op_block_insert(mutator, buf, len, capacity) : 0;
+    case MUTATOR_OP_BLOCK_DELETE:
+        return len > 1 ? op_block_delete(mutator, buf, len) : 0;
+    case MUTATOR_OP_BLOCK_DUPLICATE:
+        return len < capacity ? op_block_duplicate(mutator, buf, len, capacity) : 0;
+    case MUTATOR_OP_BLOCK_OVERWRITE:
+        if (len < 2) {
+            return 0;
+        }
+        op_block_overwrite(mutator, buf, len);
+        return len;
+    case MUTATOR_OP_SPLICE:
+        return op_splice(mutator, buf, len, capacity);
+    case MUTATOR_OP_DICT_INSERT:
+        return op_dict(mutator, buf, len, capacity, true);
+    case MUTATOR_OP_DICT_OVERWRITE:
+        return op_dict(mutator, buf, len, capacity, false);
+    // Only applied by plugins and `mutator_grammar`.
+    case MUTATOR_OP_CUSTOM:
+    default:
+        return 0;
+    }
+}
+
+// Width of the values written by the steps of each deterministic stage.
+static const size_t det_widths[MUTATOR_DET_LAST] = {
+    [MUTATOR_DET_BIT_FLIP]       = 1,
+    [MUTATOR_DET_BYTE_FLIP]      = 1,
+    [MUTATOR_DET_ARITH_8]        = 1,
+    [MUTATOR_DET_ARITH_16]       = 2,
+    [MUTATOR_DET_ARITH_32]       = 4,
+    [MUTATOR_DET_INTERESTING_8]  = 1,
+    [MUTATOR_DET_INTERESTING_16] = 2,
+    [MUTATOR_DET_INTERESTING_32] = 4,
+};
+
+// Number of steps taken at every offset by a deterministic stage. The wider
+// values are written in both endiannesses.
+static uint64_t
+det_nb_steps(enum_mutator_det_stage_t stage)
+{
+    switch (stage)
+    {
+    case MUTATOR_DET_BIT_FLIP:
+        return 8;
+    case MUTATOR_DET_BYTE_FLIP:
+        return 1;
+    case MUTATOR_DET_ARITH_8:
+        return 2 * MUTATOR_ARITH_MAX;
+    case MUTATOR_DET_ARITH_16:
+    case MUTATOR_DET_ARITH_32:
+        return 4 * MUTATOR_ARITH_MAX;
+    case MUTATOR_DET_INTERESTING_8:
+        return NB_INTERESTING_8;
+    case MUTATOR_DET_INTERESTING_16:
+        return 2 * NB_INTERESTING_16;
+    case MUTATOR_DET_INTERESTING_32:
+        return 2 * NB_INTERESTING_32;
+    default:
+        return 0;
+    }
+}
+
+// Whether any of the `width` bytes at `offset` is effective.
+static bool
+det_is_effective(const mutator_det_t* det, uint64_t offset, size_t width)
+{
+    for (size_t i = 0; i < width; i++) {
+        if (det->effective[offset + i]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Apply the current step of the stage to `buf`, which holds the input.
+// Returns false if the step is redundant, as it leaves the input as it was or
+// only changes what a narrower step already did.
+static bool
+det_apply(mutator_det_t* det, uint8_t* buf)
+{
+    const uint64_t offset = det->offset;
+    const uint64_t step   = det->step;
+    const size_t   width  = det_widths[det->stage];
+
+    det->flipped = -1;
+    switch (det->stage)
+    {
+    case MUTATOR_DET_BIT_FLIP:
+        buf[offset] ^= 1 << step;
+        return true;
+    case MUTATOR_DET_BYTE_FLIP:
+        buf[offset] ^= 0xff;
+        det->flipped = offset;
+        return true;
+    case MUTATOR_DET_ARITH_8:
+    case MUTATOR_DET_ARITH_16:
+    case MUTATOR_DET_ARITH_32: {
+        const bool     big_endian = step >= 2 * MUTATOR_ARITH_MAX;
+        const uint64_t delta      = step % MUTATOR_ARITH_MAX + 1;
+        const uint64_t mask       = (1ULL << (8 * width)) - 1;
+        const uint64_t old_value  = load_int(buf + offset, width, big_endian);
+        const uint64_t new_value  = step % (2 * MUTATOR_ARITH_MAX) < MUTATOR_ARITH_MAX ? old_value + delta
+                                                                                        : old_value - delta;
+        store_int(buf + offset, new_value, width, big_endian);
+        return width == 1 || ((old_value ^ new_value) & mask) >> 8 != 0;
+    }
+    case MUTATOR_DET_INTERESTING_8:
+    case MUTATOR_DET_INTERESTING_16:
+    case MUTATOR_DET_INTERESTING_32: {
+        const uint64_t nb_values  = det_nb_steps(det->stage) / (width == 1 ? 1 : 2);
+        const bool     big_endian = step >= nb_values;
+        store_int(buf + offset, interesting_values[step % nb_values], width, big_endian);
+        return memcmp(buf + offset, det->data + offset, width) != 0;
+    }
+    default:
+        return false;
+    }
+}
+
+// Move to the next step of the stage, or the next offset, or the next stage.
+static void
+det_advance(mutator_det_t* det)
+{
+    if (++det->step < det_nb_steps(det->stage)) {
+        return;
+    }
+    det->step = 0;
+    if (++det->offset + det_widths[det->stage] <= det->length) {
+        return;
+    }
+    det->offset = 0;
+    do {
+        det->stage++;
+    } while (det->stage < MUTATOR_DET_LAST && det_widths[det->stage] > det->length);
+}
+
+// Start walking the next queued input. Returns false if there is none.
+static bool
+det_start(mutator_t* mutator, uint64_t capacity)
+{
+    mutator_det_t* det = &mutator->det;
+
+    while (det->queue_head < det->queue_length) {
+        det->entry = det->queue[det->queue_head++];
+
+        const input_t* input  = corpus_get_input(mutator->corpus, det->entry.corpus_idx);
+        const uint64_t length = input->length < capacity ? input->length : capacity;
+        if (length == 0) {
+            continue;
+        }
+        det->data      = malloc(length);
+        det->effective = calloc(length, 1);
+        if (!det->data || !det->effective) {
+            ginger_log(ERROR, "[%s] Could not allocate deterministic stage!\n", __func__);
+            abort();
+        }
+        memcpy(det->data, input->data, length);
+        det->length = length;
+        det->stage  = MUTATOR_DET_BIT_FLIP;
+        det->offset = 0;
+        det->step   = 0;
+        return true;
+    }
+    det->queue_head   = 0;
+    det->queue_length = 0;
+    return false;
+}
+
+// Hand the effector map of the walked input to the corpus.
+static void
+det_finish(mutator_t* mutator)
+{
+    mutator_det_t* det = &mutator->det;
+
+    uint64_t nb_offsets = 0;
+    for (uint64_t i = 0; i < det->length; i++) {
+        nb_offsets += det->effective[i];
+    }
+    effector_t* effector = malloc(sizeof(effector_t) + nb_offsets * sizeof(uint32_t));
+    if (!effector) {
+        ginger_log(ERROR, "[%s] Could not allocate effector map!\n", __func__);
+        abort();
+    }
+    effector->nb_offsets = 0;
+    for (uint64_t i = 0; i < det->length; i++) {
+        if (det->effective[i]) {
+            effector->offsets[effector->nb_offsets++] = i;
+        }
+    }
+    corpus_set_effector(mutator->corpus, det->entry.corpus_idx, effector);
+
+    free(det->data);
+    free(det->effective);
+    det->data      = NULL;
+    det->effective = NULL;
+}
+
+void
+mutator_det_enqueue(mutator_t* mutator, uint64_t corpus_idx, uint64_t path_hash)
+{
+    mutator_det_t* det = &mutator->det;
+
+    // Grammar inputs are mutated as trees, and byte level steps would only
+    // break them.
+    if (mutator->corpus->grammar) {
+        return;
+    }
+    if (det->queue_length == det->queue_capacity) {
+        det->queue_capacity = det->queue_capacity ? det->queue_capacity * 2 : 16;
+        det->queue          = realloc(det->queue, det->queue_capacity * sizeof(mutator_det_entry_t));
+        if (!det->queue) {
+            ginger_log(ERROR, "[%s] Could not grow deterministic queue!\n", __func__);
+            abort();
+        }
+    }
+    det->queue[det->queue_length++] = (mutator_det_entry_t){ .corpus_idx = corpus_idx, .path_hash = path_hash };
+}
+
+bool
+mutator_det_next(mutator_t* mutator, uint8_t* buf, uint64_t capacity, uint64_t* len, uint64_t* parent)
+{
+    mutator_det_t* det = &mutator->det;
+
+    for (;;) {
+        if (!det->data && !det_start(mutator, capacity)) {
+            return false;
+        }
+        if (det->stage == MUTATOR_DET_LAST) {
+            det_finish(mutator);
+            continue;
+        }
+
+        // Past the byte flips, only the effective bytes are walked.
+        if (det->stage >= MUTATOR_DET_ARITH_8 && !det_is_effective(det, det->offset, det_widths[det->stage])) {
+            det->step = det_nb_steps(det->stage) - 1;
+            det_advance(det);
+            continue;
+        }
+
+        memcpy(buf, det->data, det->length);
+        const bool useful = det_apply(det, buf);
+        det_advance(det);
+        if (useful) {
+            memset(mutator->applied, 0, sizeof(mutator->applied));
+            mutator->applied[MUTATOR_OP_DETERMINISTIC] = true;
+            mutator->havoc = false;
+            det->pending   = true;
+            *len           = det->length;
+            *parent        = det->entry.corpus_idx;
+            return true;
+        }
+    }
+}
+
+// Draw an index from a cumulative weight table of `n` entries.
+static size_t
+draw_weighted(prng_t* prng, const uint32_t* cdf, size_t n)
+{
+    const uint32_t r = prng_below(prng, cdf[n - 1]);
+    size_t i = 0;
+    while (r >= cdf[i]) {
+        i++;
+    }
+    return i;
+}
+
+// Turn the yields of `n` operators or depths into a cumulative weight table.
+static void
+yield_to_cdf(const double* cases, const double* hits, size_t n, uint32_t* cdf)
+{
+    double total_cases = 0;
+    double total_hits  = 0;
+    for (size_t i = 0; i < n; i++) {
+        total_cases += cases[i];
+        total_hits  += hits[i];
+    }
+    const double mean = total_cases > 0 ? total_hits / total_cases : 0;
+
+    double scores[MUTATOR_NB_HAVOC_OPS] = {0};
+    double total_scores = 0;
+    for (size_t i = 0; i < n; i++) {
+        scores[i]     = (hits[i] + mean * MUTATOR_SCHEDULE_PRIOR) / (cases[i] + MUTATOR_SCHEDULE_PRIOR);
+        total_scores += scores[i];
+    }
+
+    uint32_t sum = 0;
+    for (size_t i = 0; i < n; i++) {
+        const double share = total_scores > 0 ? scores[i] / total_scores : 1.0 / n;
+        const double mixed = MUTATOR_SCHEDULE_FLOOR / n + (1 - MUTATOR_SCHEDULE_FLOOR) * share;
+        const uint32_t weight = mixed * MUTATOR_SCHEDULE_SCALE;
+        sum   += weight ? weight : 1;
+        cdf[i] = sum;
+    }
+}
+
+static void
+yield_fold(double* dst, const double* src, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        dst[i] = dst[i] * MUTATOR_SCHEDULE_DECAY + src[i];
+    }
+}
+
+// Fold the yields of the mutator into the shared ones, and redraw its weights
+// from the result.
+static void
+mutator_schedule_update(mutator_t* mutator)
+{
+    pthread_mutex_lock(&shared_yield_lock);
+    yield_fold(shared_yield.op_cases,    mutator->yield.op_cases,    MUTATOR_NB_HAVOC_OPS);
+    yield_fold(shared_yield.op_hits,     mutator->yield.op_hits,     MUTATOR_NB_HAVOC_OPS);
+    yield_fold(shared_yield.depth_cases, mutator->yield.depth_cases, MUTATOR_MAX_STACK_POW2);
+    yield_fold(shared_yield.depth_hits,  mutator->yield.depth_hits,  MUTATOR_MAX_STACK_POW2);
+    const mutator_yield_t yield = shared_yield;
+    pthread_mutex_unlock(&shared_yield_lock);
+
+    memset(&mutator->yield, 0, sizeof(mutator->yield));
+    yield_to_cdf(yield.op_cases, yield.op_hits, MUTATOR_NB_HAVOC_OPS, mutator->op_cdf);
+    yield_to_cdf(yield.depth_cases, yield.depth_hits, MUTATOR_MAX_STACK_POW2, mutator->depth_cdf);
+}
+
+uint64_t
+mutator_havoc(mutator_t* mutator, uint8_t* buf, uint64_t len, uint64_t capacity)
+{
+    memset(mutator->applied, 0, sizeof(mutator->applied));
+    mutator->havoc   = true;
+    mutator->depth   = draw_weighted(mutator->prng, mutator->depth_cdf, MUTATOR_MAX_STACK_POW2);
+    mutator->max_len = len;
+
+    const uint64_t nb_stacked = 1UL << mutator->depth;
+    for (uint64_t i = 0; i < nb_stacked; i++) {
+        // Draw until an operator fits the input. The flips always do, as the
+        // input is never empty, and never weigh nothing.
+        uint64_t new_len = 0;
+        enum_mutator_op_t op;
+        do {
+            op      = draw_weighted(mutator->prng, mutator->op_cdf, MUTATOR_NB_HAVOC_OPS);
+            new_len = apply_op(mutator, op, buf, len, capacity);
+        } while (new_len == 0);
+
+        len = new_len;
+        mutator->applied[op] = true;
+        if (len > mutator->max_len) {
+            mutator->max_len = len;
+        }
+    }
+    return len;
+}
+
+// Pick a random corpus input with a derivation tree to splice with. Returns
+// NULL if none of a few picks has one.
+static const tree_t*
+pick_corpus_tree(mutator_t* mutator)
+{
+    for (int attempt = 0; attempt < 4; attempt++) {
+        const input_t* input = corpus_get_input(mutator->corpus, prng_below(mutator->prng, mutator->nb_inputs));
+        if (input && input->tree) {
+            return input->tree;
+        }
+    }
+    return NULL;
+}
+
+tree_t*
+mutator_grammar(mutator_t* mutator, const tree_t* parent, uint8_t* buf, uint64_t capacity, uint64_t* len)
+{
+    const grammar_t* grammar = mutator->corpus->grammar;
+    memset(mutator->applied, 0, sizeof(mutator->applied));
+    mutator->havoc = false;
+
+    tree_t* tree = NULL;
+    if (!parent) {
+        tree = tree_generate(grammar, mutator->prng);
+        mutator->applied[MUTATOR_OP_TREE_GENERATE] = true;
+    }
+    else {
+        tree = tree_copy(parent);
+        const uint64_t nb_stacked = 1 + prng_below(mutator->prng, MUTATOR_MAX_TREE_OPS);
+        for (uint64_t i = 0; i < nb_stacked; i++) {
+            const enum_mutator_op_t op = MUTATOR_OP_TREE_REPLACE + prng_below(mutator->prng, 3);
+            const tree_t* other = NULL;
+            bool applied = false;
+            switch (op)
+            {
+            case MUTATOR_OP_TREE_REPLACE:
+                applied = tree_mutate_replace(grammar, tree, mutator->prng);
+                break;
+            case MUTATOR_OP_TREE_RECURSE:
+                applied = tree_mutate_recurse(grammar, tree, mutator->prng);
+                break;
+            default:
+                other   = pick_corpus_tree(mutator);
+                applied = other && tree_mutate_splice(tree, other, mutator->prng);
+                break;
+            }
+            mutator->applied[op] |= applied;
+        }
+    }
+
+    // The fuzz buffer can not be empty, so a tree without terminals is
+    // injected as a single zero byte.
+    *len = tree_serialize(grammar, tree, buf, capacity);
+    if (*len == 0) {
+        buf[0] = 0;
+        *len   = 1;
+    }
+    return tree;
+}
+
+void
+mutator_record_custom(mutator_t* mutator)
+{
+    memset(mutator->applied, 0, sizeof(mutator->applied));
+    mutator->applied[MUTATOR_OP_CUSTOM] = true;
+    mutator->havoc = false;
+}
+
+void
+mutator_report(mutator_t* mutator, bool new_coverage, bool crashed, uint64_t path_hash)
+{
+    // A byte flip which changes the path marks the byte as effective.
+    mutator_det_t* det = &mutator->det;
+    if (det->pending) {
+        det->pending = false;
+        if (det->flipped >= 0 && path_hash != det->entry.path_hash) {
+            det->effective[det->flipped] = 1;
+        }
+    }
+
+    for (size_t op = 0; op < MUTATOR_OP_LAST; op++) {
+        if (mutator->applied[op]) {
+            mutator->stats->nb_cases[op]++;
+            mutator->stats->nb_new_coverage[op] += new_coverage;
+        }
+    }
+
+    // Only havoc fuzzcases were drawn with the weights.
+    if (!mutator->havoc) {
+        return;
+    }
+    const bool hit = new_coverage || crashed;
+    for (size_t op = 0; op < MUTATOR_NB_HAVOC_OPS; op++) {
+        if (mutator->applied[op]) {
+            mutator->yield.op_cases[op]++;
+            mutator->yield.op_hits[op] += hit;
+        }
+    }
+    mutator->yield.depth_cases[mutator->depth]++;
+    mutator->yield.depth_hits[mutator->depth] += hit;
+
+    if (++mutator->nb_havoc_cases % MUTATOR_SCHEDULE_INTERVAL == 0) {
+        mutator_schedule_update(mutator);
+    }
+}
+
+void
+mutator_stats_merge(mutator_stats_t* dst, const mutator_stats_t* src)
+{
+    for (size_t op = 0; op < MUTATOR_OP_LAST; op++) {
+        dst->nb_cases[op]        += src->nb_cases[op];
+        dst->nb_new_coverage[op] += src->nb_new_coverage[op];
+    }
+}
+
+void
+mutator_stats_print(const mutator_stats_t* stats)
+{
+    char stats_buf[2048] = {0};
+    char tmp_buf[64]     = {0};
+
+    strcat(stats_buf, "new coverage / cases:");
+    for (size_t op = 0; op < MUTATOR_OP_LAST; op++) {
+        sprintf(tmp_buf, "%s %s: %lu / %lu", op == 0 ? "" : " |", op_names[op],
+                stats->nb_new_coverage[op], stats->nb_cases[op]);
+        strcat(stats_buf, tmp_buf);
+    }
+    ginger_log(INFO, "%s\n", stats_buf);
+}
+
+void
+mutator_schedule_print(void)
+{
+    pthread_mutex_lock(&shared_yield_lock);
+    const mutator_yield_t yield = shared_yield;
+    pthread_mutex_unlock(&shared_yield_lock);
+
+    uint32_t op_cdf[MUTATOR_NB_HAVOC_OPS];
+    uint32_t depth_cdf[MUTATOR_MAX_STACK_POW2];
+    yield_to_cdf(yield.op_cases, yield.op_hits, MUTATOR_NB_HAVOC_OPS, op_cdf);
+    yield_to_cdf(yield.depth_cases, yield.depth_hits, MUTATOR_MAX_STACK_POW2, depth_cdf);
+
+    char stats_buf[1024] = {0};
+    char tmp_buf[64]     = {0};
+
+    strcat(stats_buf, "havoc mix:");
+    for (size_t op = 0; op < MUTATOR_NB_HAVOC_OPS; op++) {
+        const uint32_t weight = op_cdf[op] - (op == 0 ? 0 : op_cdf[op - 1]);
+        sprintf(tmp_buf, "%s %s: %.1lf%%", op == 0 ? "" : " |", op_names[op],
+                100.0 * weight / op_cdf[MUTATOR_NB_HAVOC_OPS - 1]);
+        strcat(stats_buf, tmp_buf);
+    }
+    strcat(stats_buf, " || depth:");
+    for (size_t depth = 0; depth < MUTATOR_MAX_STACK_POW2; depth++) {
+        const uint32_t weight = depth_cdf[depth] - (depth == 0 ? 0 : depth_cdf[depth - 1]);
+        sprintf(tmp_buf, "%s %lu: %.1lf%%", depth == 0 ? "" : " |", 1UL << depth,
+                100.0 * weight / depth_cdf[MUTATOR_MAX_STACK_POW2 - 1]);
+        strcat(stats_buf, tmp_buf);
+    }
+    ginger_log(INFO, "%s\n", stats_buf);
+}
+
+mutator_t*
+mutator_create(prng_t* prng, corpus_t* corpus, const dictionary_t* dictionary, const uint16_t* hot_offsets,
+               const size_t* nb_hot_offsets, mutator_stats_t* stats)
+{
+    mutator_t* mutator = calloc(1, sizeof(mutator_t));
+    if (!mutator) {
+        ginger_log(ERROR, "[%s] Could not allocate mutator!\n", __func__);
+        abort();
+    }
+    mutator->prng           = prng;
+    mutator->corpus         = corpus;
+    mutator->dictionary     = dictionary;
+    mutator->hot_offsets    = hot_offsets;
+    mutator->nb_hot_offsets = nb_hot_offsets;
+    mutator->stats          = stats;
+
+    // Start from the yields the other workers have gathered so far, which are
+    // none for the first ones, giving even weights.
+    mutator_schedule_update(mutator);
+    return mutator;
+}
+
+void
+mutator_destroy(mutator_t* mutator)
+{
+    free(mutator->det.queue);
+    free(mutator->det.data);
+    free(mutator->det.effective);
+    free(mutator);
+}
@@ -0,0 +1,223 @@
+/**
+ * Havoc style mutation engine.
+ *
+ * A fuzzcase is mutated by a stack of randomly chosen operators, applied one
+ * after another. The depth of the stack is picked per fuzzcase. The operators
+ * range from flipping single bits to splicing in the tail of another corpus
+ * input and inserting dictionary tokens, and the ones which change the length
+ * keep the input within the capacity of the fuzz buffer.
+ *
+ * With a grammar, fuzzcases are instead derivation trees, which are generated
+ * from the grammar or mutated with a stack of tree operators, and serialized.
+ *
+ * Inputs added to the corpus first go through a deterministic stage, which
+ * walks bit flips, byte flips, arithmetic and interesting values over every
+ * offset. Byte flips which change the path of the target mark the byte as
+ * effective, the later steps of the stage skip the other bytes, and havoc
+ * picks offsets among the effective bytes of an input most of the time.
+ *
+ * The havoc operators and stack depths are not drawn uniformly. Every worker
+ * counts how many of the fuzzcases each of them was part of found new coverage
+ * or a crash, and every `MUTATOR_SCHEDULE_INTERVAL` havoc fuzzcases folds the
+ * counts into yields shared by all workers, which decay so that operators
+ * which stopped paying off lose their weight. The weights are then redrawn
+ * from the shared yields, keeping a floor so that every operator is still
+ * tried now and then.
+ *
+ * Every engine counts, per operator, how many fuzzcases it was part of and how
+ * many of those generated new coverage. The counters are embedded in
+ * `emu_stats_t`, and merged into the shared stats with the other counters.
+ */
+
+#ifndef MUTATOR_H
+#define MUTATOR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../corpus/corpus.h"
+#include "../corpus/dictionary.h"
+#include "../utils/prng.h"
+
+// The stack depth of a fuzzcase is 2^n, with n picked from [0, MUTATOR_MAX_STACK_POW2).
+#define MUTATOR_MAX_STACK_POW2 7
+
+// Largest number of tree operators applied to a grammar fuzzcase.
+#define MUTATOR_MAX_TREE_OPS 4
+
+// Havoc fuzzcases a worker runs between updates of its operator weights.
+#define MUTATOR_SCHEDULE_INTERVAL 4096
+
+typedef enum {
+    MUTATOR_OP_BIT_FLIP,          // Flip a single bit.
+    MUTATOR_OP_BYTE_FLIP,         // Invert a byte.
+    MUTATOR_OP_RANDOM_BYTE,       // Set a byte to a random value.
+    MUTATOR_OP_ARITH_8,           // Add or subtract a small delta, 8 bits.
+    MUTATOR_OP_ARITH_16,          // Likewise 16 bits, in either endianness.
+    MUTATOR_OP_ARITH_32,
+    MUTATOR_OP_ARITH_64,
+    MUTATOR_OP_INTERESTING_8,     // Set an interesting value, 8 bits.
+    MUTATOR_OP_INTERESTING_16,    // Likewise 16 bits, in either endianness.
+    MUTATOR_OP_INTERESTING_32,
+    MUTATOR_OP_INTERESTING_64,
+    MUTATOR_OP_BLOCK_INSERT,      // Insert a block of random or repeated bytes.
+    MUTATOR_OP_BLOCK_DELETE,      // Remove a block.
+    MUTATOR_OP_BLOCK_DUPLICATE,   // Insert a copy of a block of the input.
+    MUTATOR_OP_BLOCK_OVERWRITE,   // Copy a block of the input over another part of it.
+    MUTATOR_OP_SPLICE,            // Replace the tail with the tail of another corpus input.
+    MUTATOR_OP_DICT_INSERT,       // Insert a dictionary token.
+    MUTATOR_OP_DICT_OVERWRITE,    // Overwrite part of the input with a dictionary token.
+    MUTATOR_OP_CUSTOM,            // Mutated by a custom mutator plugin instead.
+    MUTATOR_OP_DETERMINISTIC,     // A step of the deterministic stage.
+    MUTATOR_OP_TREE_GENERATE,     // Generated from the grammar.
+    MUTATOR_OP_TREE_REPLACE,      // Replace a subtree with a generated one.
+    MUTATOR_OP_TREE_RECURSE,      // Repeat a recursive part of the tree.
+    MUTATOR_OP_TREE_SPLICE,       // Replace a subtree with one from another corpus input.
+    MUTATOR_OP_LAST,
+} enum_mutator_op_t;
+
+// The havoc operators are the ones before `MUTATOR_OP_CUSTOM`.
+#define MUTATOR_NB_HAVOC_OPS MUTATOR_OP_CUSTOM
+
+typedef struct {
+    uint64_t nb_cases[MUTATOR_OP_LAST];        // Fuzzcases the operator was applied to.
+    uint64_t nb_new_coverage[MUTATOR_OP_LAST]; // Of those, the ones which generated new coverage.
+} mutator_stats_t;
+
+typedef enum {
+    MUTATOR_DET_BIT_FLIP,
+    MUTATOR_DET_BYTE_FLIP,        // Also builds the effector map.
+    MUTATOR_DET_ARITH_8,
+    MUTATOR_DET_ARITH_16,
+    MUTATOR_DET_ARITH_32,
+    MUTATOR_DET_INTERESTING_8,
+    MUTATOR_DET_INTERESTING_16,
+    MUTATOR_DET_INTERESTING_32,
+    MUTATOR_DET_LAST,
+} enum_mutator_det_stage_t;
+
+typedef struct {
+    uint64_t corpus_idx;
+    uint64_t path_hash;           // Of the run which added the input.
+} mutator_det_entry_t;
+
+// Deterministic stage of a worker.
+typedef struct {
+    // Inputs waiting for the stage, in the order they were added.
+    mutator_det_entry_t*     queue;
+    size_t                   queue_head;
+    size_t                   queue_length;
+    size_t                   queue_capacity;
+
+    // Input being walked, NULL between inputs.
+    uint8_t*                 data;
+    uint64_t                 length;
+    mutator_det_entry_t      entry;
+    uint8_t*                 effective;   // Per byte, whether flipping it changed the path.
+
+    // Next step to take.
+    enum_mutator_det_stage_t stage;
+    uint64_t                 offset;
+    uint64_t                 step;
+
+    bool                     pending;     // The current fuzzcase is a step of the stage.
+    int64_t                  flipped;     // Byte it flipped, if it is a byte flip, otherwise -1.
+} mutator_det_t;
+
+// Yield of the havoc operators and stack depths, as decayed counts of the
+// fuzzcases they were part of, and of the ones which found new coverage or a
+// crash.
+typedef struct {
+    double op_cases[MUTATOR_NB_HAVOC_OPS];
+    double op_hits[MUTATOR_NB_HAVOC_OPS];
+    double depth_cases[MUTATOR_MAX_STACK_POW2];
+    double depth_hits[MUTATOR_MAX_STACK_POW2];
+} mutator_yield_t;
+
+typedef struct {
+    prng_t*             prng;           // Random number generator of the engine.
+    corpus_t*           corpus;         // Inputs to splice with.
+    const dictionary_t* dictionary;     // Tokens to insert and overwrite with.
+
+    // Fuzzcase offsets to favour, owned by the engine. See `hot_offsets` in
+    // `snapshot_engine_t`.
+    const uint16_t*     hot_offsets;
+    const size_t*       nb_hot_offsets;
+
+    // Effector map of the input being mutated, or NULL.
+    const effector_t*   effector;
+
+    // Number of corpus inputs to pick from, fixed when the fuzzcase starts so
+    // that its mutations can be replayed while other workers grow the corpus.
+    size_t              nb_inputs;
+
+    mutator_stats_t*    stats;          // Statistics of the engine.
+    bool                applied[MUTATOR_OP_LAST]; // Operators applied to the current fuzzcase.
+
+    mutator_det_t       det;
+
+    // Adaptive scheduling. The yield of the havoc fuzzcases since the last
+    // update, and the cumulative weights operators and depths are drawn with.
+    mutator_yield_t     yield;
+    uint64_t            nb_havoc_cases;
+    uint32_t            op_cdf[MUTATOR_NB_HAVOC_OPS];
+    uint32_t            depth_cdf[MUTATOR_MAX_STACK_POW2];
+    bool                havoc;          // Whether the current fuzzcase was mutated by `mutator_havoc`.
+    size_t              depth;          // Its stack depth is 2^depth.
+    uint64_t            max_len;        // Largest length the fuzzcase had while `mutator_havoc` stacked operators.
+} mutator_t;
+
+// Mutate the `len` bytes of `buf`, which has room for `capacity` bytes.
+// Returns the new length, which is in [1, capacity].
+uint64_t
+mutator_havoc(mutator_t* mutator, uint8_t* buf, uint64_t len, uint64_t capacity);
+
+// Mutate a copy of the derivation tree `parent`, or generate a new tree if it
+// is NULL, and serialize it to `buf`, which has room for `capacity` bytes.
+// Returns the tree, and the length of the data, in [1, capacity], in `len`.
+tree_t*
+mutator_grammar(mutator_t* mutator, const tree_t* parent, uint8_t* buf, uint64_t capacity, uint64_t* len);
+
+// Queue corpus input `corpus_idx`, whose run took the path `path_hash`, for
+// the deterministic stage. Grammar inputs are not queued.
+void
+mutator_det_enqueue(mutator_t* mutator, uint64_t corpus_idx, uint64_t path_hash);
+
+// Write the next step of the deterministic stage to `buf`, which has room for
+// `capacity` bytes, along with its length and the corpus index of the input
+// it was derived from. Returns false if no input is waiting for the stage.
+bool
+mutator_det_next(mutator_t* mutator, uint8_t* buf, uint64_t capacity, uint64_t* len, uint64_t* parent);
+
+// Record that the current fuzzcase was mutated by a custom mutator instead
+// of `mutator_havoc`.
+void
+mutator_record_custom(mutator_t* mutator);
+
+// Credit the operators applied to the current fuzzcase with its outcome, and
+// update the operator weights when it is time to. `path_hash` is the hash of
+// the branches it took, see `get_path_hash` in `emu_t`.
+void
+mutator_report(mutator_t* mutator, bool new_coverage, bool crashed, uint64_t path_hash);
+
+// Add the statistics of `src` to `dst`.
+void
+mutator_stats_merge(mutator_stats_t* dst, const mutator_stats_t* src);
+
+void
+mutator_stats_print(const mutator_stats_t* stats);
+
+// Print the share of havoc fuzzcases each operator and stack depth currently
+// gets, from the yields shared by the workers.
+void
+mutator_schedule_print(void);
+
+mutator_t*
+mutator_create(prng_t* prng, corpus_t* corpus, const dictionary_t* dictionary, const uint16_t* hot_offsets,
+               const size_t* nb_hot_offsets, mutator_stats_t* stats);
+
+void
+mutator_destroy(mutator_t* mutator);
+
+#endif
@@ -0,0 +1,71 @@
+#include <dlfcn.h>
+#include <stdlib.h>
+
+#include "mutator_plugin.h"
+
+#include "../utils/logger.h"
+
+mutator_plugin_t*
+mutator_plugin_open(const char* path)
+{
+    // Each worker opens the plugin, dlopen hands out the same mapping every
+    // time.
+    void* handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (!handle) {
+        ginger_log(ERROR, "Could not load custom mutator: %s\n", dlerror());
+        return NULL;
+    }
+
+    uint32_t (*api_version)(void) = dlsym(handle, "ginger_mutator_api_version");
+    if (!api_version) {
+        ginger_log(ERROR, "Custom mutator %s does not export ginger_mutator_api_version\n", path);
+        dlclose(handle);
+        return NULL;
+    }
+    if (api_version() != GINGER_MUTATOR_API_VERSION) {
+        ginger_log(ERROR, "Custom mutator %s was built for API version %u, expected %u\n",
+                   path, api_version(), GINGER_MUTATOR_API_VERSION);
+        dlclose(handle);
+        return NULL;
+    }
+
+    mutator_plugin_t* plugin = calloc(1, sizeof(mutator_plugin_t));
+    if (!plugin) {
+        ginger_log(ERROR, "[%s] Could not allocate custom mutator!\n", __func__);
+        abort();
+    }
+    plugin->handle       = handle;
+    plugin->init         = dlsym(handle, "ginger_mutator_init");
+    plugin->mutate       = dlsym(handle, "ginger_mutator_mutate");
+    plugin->post_process = dlsym(handle, "ginger_mutator_post_process");
+    plugin->deinit       = dlsym(handle, "ginger_mutator_deinit");
+
+    if (!plugin->init) {
+        ginger_log(ERROR, "Custom mutator %s does not export ginger_mutator_init\n", path);
+        dlclose(handle);
+        free(plugin);
+        return NULL;
+    }
+    return plugin;
+}
+
+bool
+mutator_plugin_init(mutator_plugin_t* plugin, const ginger_mutator_info_t* info)
+{
+    plugin->info  = *info;
+    plugin->state = plugin->init(&plugin->info);
+    return plugin->state != NULL;
+}
+
+void
+mutator_plugin_close(mutator_plugin_t* plugin)
+{
+    if (!plugin) {
+        return;
+    }
+    if (plugin->state && plugin->deinit) {
+        plugin->deinit(plugin->state);
+    }
+    dlclose(plugin->handle);
+    free(plugin);
+}
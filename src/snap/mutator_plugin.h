@@ -0,0 +1,36 @@
+#ifndef MUTATOR_PLUGIN_H
+#define MUTATOR_PLUGIN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mutator_plugin_api.h"
+
+// A custom mutator loaded from a shared object, along with the state of the
+// worker using it. See `mutator_plugin_api.h` for the hooks.
+typedef struct {
+    void*                 handle;
+    void*                 state;
+    ginger_mutator_info_t info;
+
+    void*  (*init)(const ginger_mutator_info_t* info);
+    size_t (*mutate)(void* state, uint8_t* buf, size_t length, size_t capacity);
+    size_t (*post_process)(void* state, uint8_t* buf, size_t length, size_t capacity);
+    void   (*deinit)(void* state);
+} mutator_plugin_t;
+
+// Load the plugin at `path` and look up its hooks. Returns NULL, after
+// logging why, if it can not be loaded or was built for another ABI version.
+mutator_plugin_t*
+mutator_plugin_open(const char* path);
+
+// Call the init hook of the plugin with `info`.
+bool
+mutator_plugin_init(mutator_plugin_t* plugin, const ginger_mutator_info_t* info);
+
+// Call the deinit hook, if the plugin has been initialized, and unload it.
+void
+mutator_plugin_close(mutator_plugin_t* plugin);
+
+#endif
@@ -0,0 +1,67 @@
+/**
+ * Custom mutator plugin ABI.
+ *
+ * A custom mutator is a shared object passed with `--mutator`. It is loaded
+ * with dlopen, and the symbols below are looked up in it. Only
+ * `ginger_mutator_api_version` and `ginger_mutator_init` are required, a
+ * plugin leaving out `ginger_mutator_mutate` only post-processes the inputs of
+ * the built-in mutator.
+ *
+ * Every worker thread calls `ginger_mutator_init` once, and passes the state
+ * it returns to the other hooks, which are only ever called from that thread.
+ * Plugins should draw random numbers with `random` in `ginger_mutator_info_t`,
+ * so that fuzzcases can still be regenerated from their seed.
+ *
+ * This header only depends on the C standard library, so that plugins can be
+ * built without the rest of the gingersnap source tree.
+ */
+
+#ifndef MUTATOR_PLUGIN_API_H
+#define MUTATOR_PLUGIN_API_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Bumped whenever the ABI changes in an incompatible way.
+#define GINGER_MUTATOR_API_VERSION 1
+
+typedef struct {
+    uint64_t worker;  // Number of the worker thread.
+    void*    ctx;     // Passed back to the callbacks below.
+
+    // Number of inputs in the shared corpus. It only grows.
+    size_t         (*corpus_size)(void* ctx);
+    // Input `idx` of the corpus. The data must not be modified.
+    const uint8_t* (*corpus_get)(void* ctx, size_t idx, size_t* length);
+    // Random number from the generator of the worker.
+    uint64_t       (*random)(void* ctx);
+    // Apply the built-in havoc mutations to `buf`, returning the new length.
+    size_t         (*havoc)(void* ctx, uint8_t* buf, size_t length, size_t capacity);
+} ginger_mutator_info_t;
+
+// Returns `GINGER_MUTATOR_API_VERSION` as the plugin was built with.
+uint32_t
+ginger_mutator_api_version(void);
+
+// Set up the state of one worker. `info` stays valid until `ginger_mutator_deinit`.
+// Returns NULL on failure, which aborts the fuzzer.
+void*
+ginger_mutator_init(const ginger_mutator_info_t* info);
+
+// Mutate the `length` bytes of `buf`, which has room for `capacity` bytes.
+// Returns the new length, at most `capacity`. Returning 0 leaves the input to
+// the built-in mutator.
+size_t
+ginger_mutator_mutate(void* state, uint8_t* buf, size_t length, size_t capacity);
+
+// Called with every mutated input right before it is injected into the
+// target, for fixing up checksums, lengths and the like. Returns the new
+// length, which has to be in [1, capacity].
+size_t
+ginger_mutator_post_process(void* state, uint8_t* buf, size_t length, size_t capacity);
+
+// Free the state of one worker.
+void
+ginger_mutator_deinit(void* state);
+
+#endif
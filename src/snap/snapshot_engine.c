@@ -7,47 +7,249 @@
 #include "snapshot_engine.h"
 
 #include "../emu/emu_generic.h"
+#include "../main/config.h"
 #include "../utils/dir.h"
 #include "../utils/logger.h"
 
-// Change randomize random amount of bytes in a buffer, up to the total number
-// of bytes in buffer.
-static void
-snapshot_engine_mutate(uint8_t* input, const uint64_t len)
+// Mutate the input with the custom mutator, if there is one and it accepts
+// the input, otherwise with a stack of havoc operators.
+static uint64_t
+snapshot_engine_mutate(snapshot_engine_t* engine, uint8_t* input, const uint64_t len, const uint64_t capacity)
 {
-    const int nb_mut = rand() % len; // The random number of bytes to mutate.
-    // Mutate atleast one byte. Max amount is equal to the size of the buffer.
-    for (int i = 0; i < nb_mut + 1; i++) {
-        // Pick a random byte to mutate.
-        const uint64_t rand_idx = rand() % len;
+    mutator_plugin_t* plugin = engine->plugin;
+    if (plugin && plugin->mutate) {
+        const size_t new_len = plugin->mutate(plugin->state, input, len, capacity);
+        if (new_len > capacity) {
+            ginger_log(ERROR, "Custom mutator returned length %lu, larger than the capacity %lu!\n", new_len, capacity);
+            abort();
+        }
+        if (new_len != 0) {
+            mutator_record_custom(engine->mutator);
+            return new_len;
+        }
+    }
+    return mutator_havoc(engine->mutator, input, len, capacity);
+}
 
-        // Mutate the chosen index to a random byte.
-        // TODO: 0xff + 1, to enable setting the rand_byte to 0xff?
-        const uint8_t rand_byte = rand() % 0xff;
+// Callbacks handed to the custom mutator, with the engine as context.
+static size_t
+plugin_corpus_size(void* ctx)
+{
+    const snapshot_engine_t* engine = ctx;
+    return corpus_nb_inputs(engine->emu->get_corpus(engine->emu));
+}
 
-        // Set the random byte to the random value.
-        input[rand_idx] = rand_byte;
+static const uint8_t*
+plugin_corpus_get(void* ctx, size_t idx, size_t* length)
+{
+    const snapshot_engine_t* engine = ctx;
+    corpus_t*                corpus = engine->emu->get_corpus(engine->emu);
+    if (idx >= corpus_nb_inputs(corpus)) {
+        *length = 0;
+        return NULL;
     }
+    const input_t* input = corpus_get_input(corpus, idx);
+    *length = input->length;
+    return input->data;
+}
+
+static uint64_t
+plugin_random(void* ctx)
+{
+    snapshot_engine_t* engine = ctx;
+    return prng_next(&engine->prng);
 }
 
-// Inject a fuzzcase into emulator memory.
+static size_t
+plugin_havoc(void* ctx, uint8_t* buf, size_t length, size_t capacity)
+{
+    snapshot_engine_t* engine = ctx;
+    return mutator_havoc(engine->mutator, buf, length, capacity);
+}
+
+// Inject a fuzzcase into the emulator.
 static void
 snapshot_engine_inject(snapshot_engine_t* engine, const uint8_t* input, const uint64_t len)
 {
-    mmu_t* mmu = engine->emu->get_mmu(engine->emu);
+    inject_layout_write(&engine->layout, engine->emu, input, len);
+}
 
-    // Save current permissions of the target buffer.
-    uint8_t tmp_perms[len];
-    memcpy(tmp_perms, mmu->permissions + engine->fuzz_buf_adr, len);
+// Add the fuzzcase offsets which reached a comparison during the last run to
+// the hot offsets of the engine.
+static void
+snapshot_engine_collect_hot_offsets(snapshot_engine_t* engine)
+{
+    const taint_t* taint = engine->emu->get_mmu(engine->emu)->taint;
+
+    for (size_t word = 0; word < taint->nb_cmp_words; word++) {
+        uint64_t new_bits = taint->cmp_offsets[word] & ~engine->hot_offsets_seen[word];
+        engine->hot_offsets_seen[word] |= new_bits;
+        while (new_bits) {
+            const int bit = __builtin_ctzll(new_bits);
+            engine->hot_offsets[engine->nb_hot_offsets++] = word * 64 + bit;
+            new_bits &= new_bits - 1;
+        }
+    }
+}
 
-    // Change permissions of the target buffer to writeable.
-    mmu->set_permissions(mmu, engine->fuzz_buf_adr, MMU_PERM_WRITE, len);
+// Pick a random input from the shared corpus.
+static const input_t*
+snapshot_engine_pick_parent(snapshot_engine_t* engine, corpus_t* corpus)
+{
+    // `nb_inputs` was read with `corpus_nb_inputs`, so the inputs below it are
+    // all written.
+    engine->parent              = prng_below(&engine->prng, engine->mutator->nb_inputs);
+    const input_t* chosen_input = corpus_get_input(corpus, engine->parent);
+    if (!chosen_input) {
+        ginger_log(ERROR, "Abort! Failed to pick an input from the corpus!\n");
+        abort();
+    }
+    return chosen_input;
+}
 
-    // Write the input into the target buffer.
-    mmu->write(mmu, engine->fuzz_buf_adr, input, len);
+// Write a mutation of `parent` to `buf`, which has room for a fuzzcase, and
+// return its length.
+static uint64_t
+snapshot_engine_mutate_parent(snapshot_engine_t* engine, const input_t* parent, uint8_t* buf)
+{
+    // If the input length is less than the snapshot_engines buffer length, use that instead, as there
+    // is no reason to memcpy a bunch of zeroes.
+    uint64_t effective_len = 0;
+    if (parent->length < engine->fuzz_buf_size) {
+        effective_len = parent->length;
+    }
+    else {
+        effective_len = engine->fuzz_buf_size;
+    }
+    if (effective_len == 0) {
+        ginger_log(ERROR, "Abort! Fuzz case length is 0!\n");
+        abort();
+    }
+    memcpy(buf, parent->data, effective_len);
+    return engine->mutate(engine, buf, effective_len, engine->fuzz_buf_size);
+}
 
-    // Change the permissions of the target buffer back.
-    memcpy(mmu->permissions + engine->fuzz_buf_adr, tmp_perms, len);
+// Mutate `parent` directly in the fuzz buffer of the emulator, instead of in
+// the current input, which then only gets the length of the fuzzcase. Its data
+// is rebuilt by `snapshot_engine_materialise` if the fuzzcase is kept.
+static void
+snapshot_engine_mutate_in_guest(snapshot_engine_t* engine, const input_t* parent)
+{
+    mmu_t*         mmu       = engine->emu->get_mmu(engine->emu);
+    const uint64_t adr       = engine->layout.slots[0].adr;
+    uint8_t*       guest_buf = mmu->memory + adr;
+    const uint8_t* clean_buf = engine->clean_snapshot->get_mmu(engine->clean_snapshot)->memory + adr;
+
+    const uint64_t len = snapshot_engine_mutate_parent(engine, parent, guest_buf);
+
+    // Bytes past the end of the fuzzcase which the operators moved data
+    // through are restored, so the target sees what it would after a copy.
+    const uint64_t touched = engine->mutator->max_len;
+    memcpy(guest_buf + len, clean_buf + len, touched - len);
+    mmu_mark_dirty(mmu, adr, touched);
+
+    if (mmu->taint) {
+        taint_label_input(mmu->taint, adr, len, 0);
+    }
+    inject_layout_write_sinks(&engine->layout, engine->emu, &len);
+    engine->curr_input->length = len;
+    engine->in_guest           = true;
+}
+
+// Rebuild the data of an in-place fuzzcase in the current input, by replaying
+// its mutations from its seed. The fuzz buffer can not be copied back, as the
+// target may have written to it.
+static void
+snapshot_engine_materialise(snapshot_engine_t* engine)
+{
+    corpus_t*      corpus = engine->emu->get_corpus(engine->emu);
+    const uint64_t len    = engine->curr_input->length;
+
+    // The parent is picked with the corpus size the fuzzcase started with,
+    // and mutated with the effector map it was mutated with the first time.
+    prng_seed(&engine->prng, prng_mix(engine->seed, engine->worker, engine->iteration));
+    const input_t* parent = snapshot_engine_pick_parent(engine, corpus);
+    engine->curr_input->length = snapshot_engine_mutate_parent(engine, parent, engine->curr_input->data);
+    if (engine->curr_input->length != len) {
+        ginger_log(ERROR, "Abort! Replayed fuzzcase has length %lu, expected %lu!\n", engine->curr_input->length, len);
+        abort();
+    }
+    engine->in_guest = false;
+}
+
+// Pick a random input from the shared corpus, and write a mutation of it to
+// the current input, or to the fuzz buffer in in-place mode.
+static void
+snapshot_engine_mutate_corpus_input(snapshot_engine_t* engine, corpus_t* corpus)
+{
+    const input_t* chosen_input = snapshot_engine_pick_parent(engine, corpus);
+
+    // With a grammar, derive the input from the tree of the chosen one. Inputs
+    // without a tree, like the ones read from the corpus directory, are
+    // replaced by a newly generated tree.
+    if (corpus->grammar) {
+        engine->curr_input->tree = mutator_grammar(engine->mutator, chosen_input->tree, engine->curr_input->data,
+                                                   engine->fuzz_buf_size, &engine->curr_input->length);
+        return;
+    }
+
+    // Mutate the input, favouring its effective bytes if its deterministic
+    // stage is done.
+    engine->mutator->effector = corpus_input_effector(chosen_input);
+    if (engine->in_place) {
+        snapshot_engine_mutate_in_guest(engine, chosen_input);
+        return;
+    }
+    engine->curr_input->length = snapshot_engine_mutate_parent(engine, chosen_input, engine->curr_input->data);
+}
+
+// Run until the emulator exits or crashes, taking nested snapshots at the
+// snapshot addresses on the way. A fuzzcase run from a nested snapshot first
+// stops at the address the snapshot was taken at, which is stepped over.
+static enum_emu_exit_reasons_t
+snapshot_engine_run_nested(snapshot_engine_t* engine)
+{
+    emu_t*                  emu         = engine->emu;
+    enum_emu_exit_reasons_t exit_reason = emu->run(emu, engine->stats);
+    bool                    at_node     = engine->tree->current != SNAPSHOT_TREE_ROOT;
+
+    while (exit_reason == EMU_EXIT_REASON_SNAPSHOT) {
+        if (!at_node) {
+            const size_t idx = snapshot_tree_take(engine->tree, emu, engine->iteration);
+            if (idx != SNAPSHOT_TREE_ROOT) {
+                const snapshot_node_t* node = &engine->tree->nodes[idx];
+                ginger_log(INFO, "Worker %lu took snapshot %lu at 0x%lx, depth %lu, %lu blocks\n",
+                           engine->worker, idx, node->pc, node->depth, node->nb_blocks);
+            }
+        }
+        at_node = false;
+        emu->step_over(emu);
+        emu_stats_inc(engine->stats, EMU_COUNTERS_EXECUTED_INSTRUCTIONS);
+        exit_reason = emu->run(emu, engine->stats);
+    }
+    return exit_reason;
+}
+
+static enum_emu_exit_reasons_t
+snapshot_engine_run(snapshot_engine_t* engine)
+{
+    if (engine->tree) {
+        return snapshot_engine_run_nested(engine);
+    }
+    if (!engine->harness) {
+        return engine->emu->run(engine->emu, engine->stats);
+    }
+
+    // The emulator stops short of the sentinel, so a return from the function
+    // is the only way to get there without an exit reason.
+    const enum_emu_exit_reasons_t exit_reason = engine->emu->run_until(engine->emu, engine->stats,
+                                                                       EMU_RETURN_SENTINEL);
+    if (exit_reason != EMU_EXIT_REASON_NO_EXIT) {
+        return exit_reason;
+    }
+    engine->return_value = engine->emu->get_return_value(engine->emu);
+    emu_stats_report_exit_reason(engine->stats, EMU_EXIT_REASON_GRACEFUL);
+    return EMU_EXIT_REASON_GRACEFUL;
 }
 
 static enum_emu_exit_reasons_t
@@ -62,58 +264,135 @@ snapshot_engine_fuzz(snapshot_engine_t* engine)
         abort();
     }
 
-    if (corpus->inputs->length == 0) {
+    if (corpus_nb_inputs(corpus) == 0) {
         ginger_log(ERROR, "Abort! Empty corpus!\n");
         abort();
     }
 
-    // Pick a random input from the shared corpus.
-    // TODO: Make atomic?
-    const int r                 = rand() % corpus->inputs->length;
-    const input_t* chosen_input = vector_get(corpus->inputs, r);
-    if (!chosen_input) {
-        ginger_log(ERROR, "Abort! Failed to pick an input from the corpus!\n");
-        abort();
+    // Seed the fuzzcase, so that it can be regenerated from what is written
+    // to the `.meta` file if it crashes or is saved.
+    engine->iteration++;
+    prng_seed(&engine->prng, prng_mix(engine->seed, engine->worker, engine->iteration));
+
+    // The fuzzcase is built in the snapshot_engine owned input buffer, which is reused
+    // for every fuzzcase. A derivation tree still attached to it belongs to the last
+    // fuzzcase, which was not promoted to the corpus.
+    tree_destroy(engine->curr_input->tree);
+    engine->curr_input->tree   = NULL;
+    engine->curr_input->length = 0;
+    engine->in_guest           = false;
+    engine->mutator->nb_inputs = corpus_nb_inputs(corpus);
+
+    // Inputs this engine added to the corpus go through the deterministic
+    // stage before anything is picked at random.
+    if (!mutator_det_next(engine->mutator, engine->curr_input->data, engine->fuzz_buf_size,
+                          &engine->curr_input->length, &engine->parent)) {
+        snapshot_engine_mutate_corpus_input(engine, corpus);
     }
 
-    // If the input length is less than the snapshot_engines buffer length, use that instead, as there
-    // is no reason to memcpy a bunch of zeroes.
-    uint64_t effective_len = 0;
-    if (chosen_input->length < engine->fuzz_buf_size) {
-        effective_len = chosen_input->length;
+    // Let the custom mutator fix up the input.
+    if (engine->plugin && engine->plugin->post_process) {
+        const size_t len = engine->plugin->post_process(engine->plugin->state, engine->curr_input->data,
+                                                        engine->curr_input->length, engine->fuzz_buf_size);
+        if (len == 0 || len > engine->fuzz_buf_size) {
+            ginger_log(ERROR, "Custom mutator post-processed input to invalid length %lu!\n", len);
+            abort();
+        }
+        engine->curr_input->length = len;
     }
-    else {
-        effective_len = engine->fuzz_buf_size;
+
+    // Inject the input, unless it was mutated in place.
+    if (!engine->in_guest) {
+        engine->inject(engine, engine->curr_input->data, engine->curr_input->length);
     }
-    if (effective_len == 0) {
-        ginger_log(ERROR, "Abort! Fuzz case length is 0!\n");
-        abort();
+
+    // Run the emulator until it exits, crashes or the function returns.
+    const enum_emu_exit_reasons_t exit_reason = engine->run(engine);
+    const bool new_coverage = engine->emu->get_new_coverage(engine->emu);
+    const bool crashed      = exit_reason != EMU_EXIT_REASON_GRACEFUL;
+
+    // Only fuzzcases which are written to disk need their data.
+    if (engine->in_guest && (new_coverage || crashed)) {
+        snapshot_engine_materialise(engine);
     }
 
-    // Copy the data from the corpus to a snapshot_engine owned buffer, which we will mutate.
-    // If the mutation crashes the emulator after injecton, we write this input
-    // to disk.
-    engine->curr_input = corpus_input_copy(chosen_input);
-    if (!engine->curr_input) {
-        ginger_log(ERROR, "[%s] Could not reallocate buffer for input data! Requested size: %lu\n",
-                   engine->curr_input->length, __func__);
-        abort();
+    mutator_report(engine->mutator, new_coverage, crashed, engine->emu->get_path_hash(engine->emu));
+
+    if (engine->hot_offsets) {
+        snapshot_engine_collect_hot_offsets(engine);
+    }
+    return exit_reason;
+}
+
+static void
+snapshot_engine_reset(snapshot_engine_t* engine)
+{
+    if (engine->tree) {
+        snapshot_tree_report(engine->tree, engine->emu->get_new_coverage(engine->emu));
+    }
+    engine->emu->reset(engine->emu, engine->clean_snapshot);
+    if (engine->tree) {
+        snapshot_tree_restore(engine->tree, engine->emu);
     }
+}
 
-    // Mutate the input.
-    engine->mutate(engine->curr_input->data, engine->curr_input->length);
+// Write the current input to `dir`/`filename`, and what is needed to
+// regenerate it to `dir`/`filename`.meta.
+static void
+snapshot_engine_write_current_input(snapshot_engine_t* engine, const char* dir, const char* filename)
+{
+    char filepath[4096] = {0};
+
+    // Build filepath.
+    snprintf(filepath, sizeof(filepath), "%s/%s", dir, filename);
 
-    // Inject the input.
-    engine->inject(engine, engine->curr_input->data, engine->curr_input->length);
+    // Write input to file.
+    FILE* fp = fopen(filepath, "wb");
+    if (!fp) {
+        ginger_log(ERROR, "Failed to open %s for writing!\n", filepath);
+        return;
+    }
+    if (!fwrite(engine->curr_input->data, 1, engine->curr_input->length, fp)) {
+        ginger_log(ERROR, "Failed to write to %s!\n", filepath);
+    }
+    fclose(fp);
 
-    // Run the emulator until it exits or crashes.
-    return engine->emu->run(engine->emu, engine->stats);
+    // Write the seed of the fuzzcase next to it.
+    strcat(filepath, ".meta");
+    fp = fopen(filepath, "w");
+    if (!fp) {
+        ginger_log(ERROR, "Failed to open %s for writing!\n", filepath);
+        return;
+    }
+    fprintf(fp, "seed: 0x%lx\n", engine->seed);
+    fprintf(fp, "worker: %lu\n", engine->worker);
+    fprintf(fp, "iteration: %lu\n", engine->iteration);
+    fprintf(fp, "parent: %lu\n", engine->parent);
+    if (engine->harness) {
+        fprintf(fp, "return: 0x%lx\n", engine->return_value);
+    }
+
+    // The fuzzcases which took the nested snapshots the fuzzcase ran from,
+    // from the top down.
+    if (engine->tree && engine->tree->current != SNAPSHOT_TREE_ROOT) {
+        size_t path[SNAPSHOT_TREE_MAX_NB_NODES];
+        size_t nb_path = 0;
+        for (size_t idx = engine->tree->current; idx != SNAPSHOT_TREE_ROOT; idx = engine->tree->nodes[idx].parent) {
+            path[nb_path++] = idx;
+        }
+        fprintf(fp, "snapshot_pc: 0x%lx\n", engine->tree->nodes[engine->tree->current].pc);
+        fprintf(fp, "snapshot_iterations:");
+        while (nb_path > 0) {
+            fprintf(fp, " %lu", engine->tree->nodes[path[--nb_path]].iteration);
+        }
+        fprintf(fp, "\n");
+    }
+    fclose(fp);
 }
 
 static void
 snapshot_engine_write_crash(snapshot_engine_t* engine)
 {
-    char filepath[4096] = {0};
     char filename[255]  = {0};
     char timestamp[21]  = {0};
 
@@ -127,6 +406,9 @@ snapshot_engine_write_crash(snapshot_engine_t* engine)
     case EMU_EXIT_REASON_SEGFAULT_WRITE:
         memcpy(filename, "segfault-write-", 15);
         break;
+    case EMU_EXIT_REASON_STACK_OVERFLOW:
+        memcpy(filename, "stack-overflow-", 15);
+        break;
     default:
         return;
     }
@@ -147,47 +429,139 @@ snapshot_engine_write_crash(snapshot_engine_t* engine)
     // Extension.
     strcat(filename, ".crash");
 
-    // Build filepath.
-    strcat(filepath, engine->crash_dir);
-    strcat(filepath, "/");
-    strcat(filepath, filename);
+    snapshot_engine_write_current_input(engine, engine->crash_dir, filename);
+}
 
-    // Write crash to file.
-    FILE* fp = fopen(filepath, "wb");
-    if (!fp) {
-        ginger_log(ERROR, "Failed to open crash file for writing!\n");
+static void
+snapshot_engine_write_input(snapshot_engine_t* engine)
+{
+    char filename[255] = {0};
+
+    // Name the input after the fuzzcase which generated it, which is unique.
+    snprintf(filename, sizeof(filename), "input-%lu-%lu", engine->worker, engine->iteration);
+    snapshot_engine_write_current_input(engine, global_config_get_inputs_dir(), filename);
+}
+
+static bool
+snapshot_engine_promote_input(snapshot_engine_t* engine, uint64_t* idx)
+{
+    input_t input = {
+        .data   = malloc(engine->curr_input->length),
+        .length = engine->curr_input->length,
+        .tree   = engine->curr_input->tree,
+    };
+    if (!input.data) {
+        ginger_log(ERROR, "[%s] Could not allocate input of %lu bytes!\n", __func__, input.length);
+        abort();
     }
-    if (!fwrite(engine->curr_input->data, 1, engine->curr_input->length, fp)) {
-        ginger_log(ERROR, "Failed to write to crash file!\n");
+    memcpy(input.data, engine->curr_input->data, input.length);
+
+    if (!corpus_add_input(engine->emu->get_corpus(engine->emu), &input, idx)) {
+        free(input.data);
+        return false;
     }
-    fclose(fp);
+    engine->curr_input->tree = NULL;
+    return true;
 }
 
 snapshot_engine_t*
-snapshot_engine_create(enum_supported_archs_t arch, corpus_t* corpus, uint64_t fuzz_buf_adr, uint64_t fuzz_buf_size,
-              const target_t* target, const emu_t* snapshot, const char* crash_dir)
+snapshot_engine_create(enum_supported_archs_t arch, corpus_t* corpus, const inject_layout_t* layout,
+              const target_t* target, const emu_t* snapshot, const char* crash_dir, uint64_t worker)
 {
     snapshot_engine_t* engine = calloc(1, sizeof(snapshot_engine_t));
 
     // Create and setup the emulator this snapshot_engine will use.
-    emu_t* emu = emu_create(arch, EMU_TOTAL_MEM, corpus);
+    emu_t* emu = emu_create(arch, global_config_get_memory_size(), global_config_get_stack_size(), corpus);
 
     emu->load_elf(emu, target);
     emu->build_stack(emu, target);
 
+    // Bring the emulator up to the snapshot, so that the first case starts
+    // from the snapshot like every following one. Snapshots which have been
+    // exported are attached to copy-on-write.
+    mmu_t* mmu = emu->get_mmu(emu);
+    if (snapshot->get_mmu(snapshot)->cow_fd != -1) {
+        if (!mmu_cow_attach(mmu, snapshot->get_mmu(snapshot))) {
+            ginger_log(ERROR, "[%s] Failed to attach to the snapshot!\n", __func__);
+            abort();
+        }
+    }
+    else {
+        mmu->sync(mmu, snapshot->get_mmu(snapshot));
+    }
+    emu->reset(emu, snapshot);
+
     engine->tid               = syscall(__NR_gettid);
     engine->emu               = emu;
-    engine->fuzz_buf_adr      = fuzz_buf_adr;
-    engine->fuzz_buf_size     = fuzz_buf_size;
+    engine->layout            = *layout;
+    engine->fuzz_buf_size     = inject_layout_capacity(layout);
     engine->crash_dir         = crash_dir;
     engine->clean_snapshot    = snapshot;
     engine->stats             = emu_stats_create();
+    engine->seed              = global_config_get_seed();
+    engine->worker            = worker;
+    engine->in_place          = global_config_get_inject_mode() == ENUM_INJECT_MODE_IN_PLACE;
+    engine->harness           = global_config_get_function() != NULL;
+
+    if (global_config_get_nested_adrs()) {
+        engine->tree = snapshot_tree_create(snapshot);
+        if (!engine->tree) {
+            abort();
+        }
+    }
+
+    // Scratch buffers for the fuzzcases, sized for the largest one, so that
+    // the fuzz loop does not allocate.
+    engine->curr_input = corpus_input_create(engine->fuzz_buf_size);
+    if (!engine->curr_input || !engine->curr_input->data) {
+        ginger_log(ERROR, "[%s] Could not allocate fuzzcase buffer! Requested size: %lu\n", __func__,
+                   engine->fuzz_buf_size);
+        abort();
+    }
+
+    // Collect memory access statistics straight into the engine stats.
+    if (global_config_get_mmu_stats()) {
+        mmu->stats = &engine->stats->mmu;
+    }
+
+    if (mmu->taint) {
+        engine->hot_offsets      = calloc(TAINT_MAX_NB_OFFSETS, sizeof(uint16_t));
+        engine->hot_offsets_seen = calloc((TAINT_MAX_NB_OFFSETS + 63) / 64, sizeof(uint64_t));
+        if (!engine->hot_offsets || !engine->hot_offsets_seen) {
+            ginger_log(ERROR, "[%s] Could not allocate hot offsets!\n", __func__);
+            abort();
+        }
+    }
+
+    engine->mutator = mutator_create(&engine->prng, corpus, target->elf->dictionary, engine->hot_offsets,
+                                     &engine->nb_hot_offsets, &engine->stats->mutator);
+
+    // Load the custom mutator, with state of its own for this engine.
+    if (global_config_get_mutator()) {
+        engine->plugin = mutator_plugin_open(global_config_get_mutator());
+        const ginger_mutator_info_t info = {
+            .worker      = worker,
+            .ctx         = engine,
+            .corpus_size = plugin_corpus_size,
+            .corpus_get  = plugin_corpus_get,
+            .random      = plugin_random,
+            .havoc       = plugin_havoc,
+        };
+        if (!engine->plugin || !mutator_plugin_init(engine->plugin, &info)) {
+            ginger_log(ERROR, "[%s] Failed to set up the custom mutator!\n", __func__);
+            abort();
+        }
+    }
 
     // API
     engine->fuzz              = snapshot_engine_fuzz;
+    engine->run               = snapshot_engine_run;
+    engine->reset             = snapshot_engine_reset;
     engine->mutate            = snapshot_engine_mutate;
     engine->inject            = snapshot_engine_inject;
     engine->write_crash       = snapshot_engine_write_crash;
+    engine->write_input       = snapshot_engine_write_input;
+    engine->promote_input     = snapshot_engine_promote_input;
 
     return engine;
 }
@@ -197,5 +571,11 @@ snapshot_engine_destroy(snapshot_engine_t* engine)
 {
     emu_destroy(engine->emu);
     emu_stats_destroy(engine->stats);
+    free(engine->hot_offsets);
+    free(engine->hot_offsets_seen);
+    corpus_input_destroy(engine->curr_input);
+    mutator_destroy(engine->mutator);
+    mutator_plugin_close(engine->plugin);
+    snapshot_tree_destroy(engine->tree);
     free(engine);
 }
@@ -5,7 +5,13 @@
 #include <stdint.h>
 
 #include "../corpus/corpus.h"
+#include "inject.h"
+#include "mutator.h"
+#include "mutator_plugin.h"
+#include "snapshot_tree.h"
+
 #include "../emu/emu_generic.h"
+#include "../utils/prng.h"
 
 typedef struct snapshot_engine snapshot_engine_t;
 
@@ -13,30 +19,83 @@ struct snapshot_engine {
     emu_t*          emu;               // Emulator used by the engine.
     emu_stats_t*    stats;             // Engine local stats.
     const emu_t*    clean_snapshot;    // Pre-fuzzed emulator state.
-    uint64_t        fuzz_buf_adr;      // Guest address to inject fuzzcases at, assuming that the emulator state is the clean snapshot.
-    uint64_t        fuzz_buf_size;     // Size of the buffer to fuzz.
+    inject_layout_t layout;            // Where fuzzcases are injected, assuming that the emulator state is the clean snapshot.
+    uint64_t        fuzz_buf_size;     // Length of the largest fuzzcase, which is what the layout has room for.
     pid_t           tid;               // ID of thread which runs the engine.
-    input_t*        curr_input;        // The input data of the current fuzzcase.
+    input_t*        curr_input;        // The input data of the current fuzzcase. Reused for every fuzzcase.
+
+    // In-place mode, for layouts of a single memory slot. Havoc fuzzcases are
+    // mutated in the slot, and `in_guest` is set while the current input only
+    // has their length.
+    bool            in_place;
+    bool            in_guest;
+    // Harness mode. The snapshot calls a function, and the fuzzcase ends
+    // when it returns to `EMU_RETURN_SENTINEL`, with `return_value` set.
+    bool            harness;
+    uint64_t        return_value;
+
+    // Nested snapshots taken at snapshot addresses. NULL unless any were
+    // given.
+    snapshot_tree_t* tree;
     const char*     crash_dir;         // The path to the directory where inputs which caused crashes are stored.
 
+    // Random number generator. It is reseeded before every fuzzcase from the
+    // master seed, the worker number and the iteration, so that any fuzzcase
+    // can be regenerated from those and the corpus it was picked from.
+    prng_t          prng;
+    uint64_t        seed;              // Master seed.
+    uint64_t        worker;            // Number of the worker running the engine.
+    uint64_t        iteration;         // Number of the current fuzzcase, counting from one.
+    uint64_t        parent;            // Corpus index of the input the current fuzzcase was mutated from.
+
+    // Fuzzcase offsets which have reached a comparison, learned from taint
+    // tracking. Empty unless taint tracking is enabled.
+    uint16_t*       hot_offsets;
+    size_t          nb_hot_offsets;
+    uint64_t*       hot_offsets_seen;  // Bitmap of the offsets in `hot_offsets`.
+
+    mutator_t*      mutator;
+    mutator_plugin_t* plugin;        // Custom mutator, if one was given.
+
     // Pick a random input from the corpus, mutate it, inject int into emulator memory
     // and run the emulator.
     enum_emu_exit_reasons_t (*fuzz)(snapshot_engine_t* engine);
 
-    // Mutate random amount of bytes in a buffer, up to the total number of bytes in buffer.
-    void (*mutate)(uint8_t* input, const uint64_t len);
+    // Run the emulator from the injected fuzzcase until it exits, crashes or,
+    // in harness mode, the function returns, which counts as graceful.
+    enum_emu_exit_reasons_t (*run)(snapshot_engine_t* engine);
+
+    // Restore the emulator to the node of the snapshot tree the next
+    // fuzzcase runs from, or to the clean snapshot.
+    void (*reset)(snapshot_engine_t* engine);
+
+    // Mutate the `len` bytes of `input`, which has room for `capacity` bytes,
+    // and return the new length. Prefers offsets in `hot_offsets` when there
+    // are any.
+    uint64_t (*mutate)(snapshot_engine_t* engine, uint8_t* input, const uint64_t len, const uint64_t capacity);
 
-    // Inject a fuzzcase into emulator memory.
+    // Split a fuzzcase across the slots of the layout and write it to the
+    // emulator.
     void (*inject)(snapshot_engine_t* snap, const uint8_t* input, const uint64_t len);
 
     // Write input which caused a crash to disk. Assumes that the fuzzcase
-    // which is currently loaded is the one which caused the crash.
+    // which is currently loaded is the one which caused the crash. A `.meta`
+    // file next to it records the seed, worker and iteration of the fuzzcase.
     void (*write_crash)(snapshot_engine_t* snap);
+
+    // Write the current input to the inputs directory, after it generated
+    // new coverage. Also writes a `.meta` file.
+    void (*write_input)(snapshot_engine_t* snap);
+
+    // Add a copy of the current input, trimmed to its length, to the corpus,
+    // and write its index to `idx`. Its derivation tree moves to the corpus
+    // along with it. Returns false if the corpus is full.
+    bool (*promote_input)(snapshot_engine_t* snap, uint64_t* idx);
 };
 
 snapshot_engine_t*
-snapshot_engine_create(enum_supported_archs_t arch, corpus_t* corpus, uint64_t fuzz_buf_adr, uint64_t fuzz_buf_size,
-              const target_t* target, const emu_t* snapshot, const char* crash_dir);
+snapshot_engine_create(enum_supported_archs_t arch, corpus_t* corpus, const inject_layout_t* layout,
+              const target_t* target, const emu_t* snapshot, const char* crash_dir, uint64_t worker);
 
 void
 snapshot_engine_destroy(snapshot_engine_t* snap);
@@ -0,0 +1,381 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "snapshot_file.h"
+
+#include "../utils/logger.h"
+
+// "gngrsnap", followed by the version of the layout.
+#define SNAPSHOT_FILE_MAGIC   0x70616e7372676e67
+#define SNAPSHOT_FILE_VERSION 1
+
+struct snapshot_file_header {
+    uint64_t          magic;
+    uint64_t          version;
+    uint64_t          header_size;             // Catches builds with other limits.
+    uint64_t          arch;
+    uint64_t          memory_size;
+    uint64_t          stack_size;
+    uint64_t          nb_regs;
+    uint64_t          regs[EMU_MAX_NB_REGS];
+    mmu_allocations_t allocations;
+    uint64_t          initial_stack_adr_mapped;
+    uint64_t          initial_stack_adr_virt;
+    uint64_t          nb_args;
+    uint64_t          arg_adrs[MMU_MAX_NB_ARGS];
+    uint64_t          nb_adr_maps;
+    adr_map_t         adr_maps[SNAPSHOT_FILE_MAX_NB_ADR_MAPS];
+    inject_layout_t   layout;
+    uint64_t          nb_end_adrs;
+    uint64_t          end_adrs[SNAPSHOT_FILE_MAX_NB_END_ADRS];
+    uint64_t          nb_pages;                // Pages following the header.
+};
+
+typedef struct {
+    uint64_t page;                             // Index of the page in guest memory.
+    uint8_t  memory[MMU_PAGE_SIZE];
+    uint8_t  permissions[MMU_PAGE_SIZE];
+} snapshot_file_page_t;
+
+static bool
+is_zero(const uint8_t* buf, size_t len)
+{
+    static const uint8_t zeroes[MMU_PAGE_SIZE];
+    return memcmp(buf, zeroes, len) == 0;
+}
+
+// End of the part of guest memory below the mmap regions which has been
+// handed out, rounded up to a whole page.
+static size_t
+used_end(size_t curr_alloc_adr, size_t mmap_floor_adr)
+{
+    const size_t end = (curr_alloc_adr + MMU_PAGE_SIZE - 1) & ~(size_t)(MMU_PAGE_SIZE - 1);
+    return end < mmap_floor_adr ? end : mmap_floor_adr;
+}
+
+// Write the pages in [start, end) which are not all zero.
+static bool
+snapshot_file_write_pages(FILE* fp, const mmu_t* mmu, size_t start, size_t end, uint64_t* nb_pages)
+{
+    snapshot_file_page_t page;
+    for (size_t adr = start; adr < end; adr += MMU_PAGE_SIZE) {
+        if (is_zero(mmu->memory + adr, MMU_PAGE_SIZE) && is_zero(mmu->permissions + adr, MMU_PAGE_SIZE)) {
+            continue;
+        }
+        page.page = adr / MMU_PAGE_SIZE;
+        memcpy(page.memory,      mmu->memory + adr,      MMU_PAGE_SIZE);
+        memcpy(page.permissions, mmu->permissions + adr, MMU_PAGE_SIZE);
+        if (fwrite(&page, sizeof(page), 1, fp) != 1) {
+            return false;
+        }
+        (*nb_pages)++;
+    }
+    return true;
+}
+
+bool
+snapshot_file_save(const char* path, const emu_t* emu, const inject_layout_t* layout,
+                   const uint64_t* end_adrs, size_t nb_end_adrs)
+{
+    const mmu_t* mmu = emu->get_mmu(emu);
+    if (mmu->nb_adr_maps > SNAPSHOT_FILE_MAX_NB_ADR_MAPS) {
+        ginger_log(ERROR, "Can not save more than %d program headers!\n", SNAPSHOT_FILE_MAX_NB_ADR_MAPS);
+        return false;
+    }
+    if (nb_end_adrs > SNAPSHOT_FILE_MAX_NB_END_ADRS) {
+        ginger_log(ERROR, "Can not save more than %d end addresses!\n", SNAPSHOT_FILE_MAX_NB_END_ADRS);
+        return false;
+    }
+
+    // Zeroed, so that no padding of the host leaks into the file.
+    snapshot_file_header_t* header = calloc(1, sizeof(snapshot_file_header_t));
+    if (!header) {
+        ginger_log(ERROR, "[%s] Could not allocate the header!\n", __func__);
+        return false;
+    }
+    header->magic                    = SNAPSHOT_FILE_MAGIC;
+    header->version                  = SNAPSHOT_FILE_VERSION;
+    header->header_size              = sizeof(snapshot_file_header_t);
+    header->arch                     = emu->get_arch(emu);
+    header->memory_size              = mmu->memory_size;
+    header->stack_size               = emu->get_stack_size(emu);
+    header->nb_regs                  = emu->get_nb_regs(emu);
+    header->initial_stack_adr_mapped = mmu->initial_stack_adr_mapped;
+    header->initial_stack_adr_virt   = mmu->initial_stack_adr_virt;
+    header->nb_args                  = mmu->nb_args;
+    header->nb_adr_maps              = mmu->nb_adr_maps;
+    header->layout                   = *layout;
+    header->nb_end_adrs              = nb_end_adrs;
+    for (uint8_t i = 0; i < header->nb_regs; i++) {
+        header->regs[i] = emu->get_reg(emu, i);
+    }
+    mmu_save_allocations(mmu, &header->allocations);
+    memcpy(header->arg_adrs, mmu->arg_adrs, sizeof(header->arg_adrs));
+    for (uint64_t i = 0; i < mmu->nb_adr_maps; i++) {
+        header->adr_maps[i] = *mmu->adr_maps[i];
+    }
+    memcpy(header->end_adrs, end_adrs, nb_end_adrs * sizeof(uint64_t));
+
+    FILE* fp = fopen(path, "wb");
+    if (!fp) {
+        ginger_log(ERROR, "Could not open %s for writing!\n", path);
+        free(header);
+        return false;
+    }
+
+    // The header is written again once the number of pages is known.
+    const size_t end = used_end(mmu->curr_alloc_adr, mmu->mmap_floor_adr);
+    bool ok = fwrite(header, sizeof(*header), 1, fp) == 1 &&
+              snapshot_file_write_pages(fp, mmu, 0, end, &header->nb_pages) &&
+              snapshot_file_write_pages(fp, mmu, mmu->mmap_floor_adr, mmu->memory_size, &header->nb_pages) &&
+              fseek(fp, 0, SEEK_SET) == 0 &&
+              fwrite(header, sizeof(*header), 1, fp) == 1;
+    ok = fclose(fp) == 0 && ok;
+    if (!ok) {
+        ginger_log(ERROR, "Could not write the snapshot to %s!\n", path);
+    }
+    else {
+        ginger_log(INFO, "Saved snapshot with %lu pages to %s\n", header->nb_pages, path);
+    }
+    free(header);
+    return ok;
+}
+
+// Whether `len` bytes at `adr` are inside of `memory_size` bytes of memory.
+static bool
+in_memory(uint64_t adr, uint64_t len, uint64_t memory_size)
+{
+    return adr <= memory_size && len <= memory_size - adr;
+}
+
+// Files may come from other hosts, or be truncated or edited, and everything
+// in them ends up as an offset into the memory of the emulators. Check all of
+// it which does not need an emulator to check against, logging the first
+// problem found. The injection layout is checked when it is loaded.
+static bool
+snapshot_file_is_valid(const snapshot_file_header_t* header, size_t size)
+{
+    if (header->magic != SNAPSHOT_FILE_MAGIC ||
+        header->version != SNAPSHOT_FILE_VERSION ||
+        header->header_size != sizeof(snapshot_file_header_t)) {
+        ginger_log(ERROR, "Bad snapshot file header!\n");
+        return false;
+    }
+    if (header->nb_regs > EMU_MAX_NB_REGS ||
+        header->nb_args > MMU_MAX_NB_ARGS ||
+        header->nb_adr_maps > SNAPSHOT_FILE_MAX_NB_ADR_MAPS ||
+        header->nb_end_adrs > SNAPSHOT_FILE_MAX_NB_END_ADRS ||
+        header->allocations.nb_mmap_regions > MMU_MAX_NB_MMAP_REGIONS ||
+        header->layout.nb_slots > INJECT_MAX_NB_SLOTS ||
+        header->layout.nb_sinks > INJECT_MAX_NB_SINKS) {
+        ginger_log(ERROR, "Snapshot file counts are out of range!\n");
+        return false;
+    }
+    // Divide instead of multiplying, which could overflow.
+    const size_t pages_size = size - sizeof(*header);
+    if (pages_size % sizeof(snapshot_file_page_t) != 0 ||
+        header->nb_pages != pages_size / sizeof(snapshot_file_page_t)) {
+        ginger_log(ERROR, "Snapshot file size does not match its %lu pages!\n", header->nb_pages);
+        return false;
+    }
+
+    const uint64_t memory_size = header->memory_size;
+    if (memory_size == 0 || memory_size % MMU_PAGE_SIZE != 0) {
+        ginger_log(ERROR, "Invalid snapshot memory size 0x%lx!\n", memory_size);
+        return false;
+    }
+    if (header->stack_size <= MMU_STACK_GUARD_SIZE || header->stack_size % 16 != 0 ||
+        header->stack_size >= memory_size) {
+        ginger_log(ERROR, "Invalid snapshot stack size 0x%lx!\n", header->stack_size);
+        return false;
+    }
+
+    // The allocation state bounds the memsets and copies of the resets.
+    const mmu_allocations_t* allocations = &header->allocations;
+    if (allocations->brk_start_adr > allocations->curr_alloc_adr ||
+        allocations->curr_alloc_adr > allocations->mmap_floor_adr ||
+        allocations->mmap_floor_adr > memory_size) {
+        ginger_log(ERROR, "Invalid snapshot allocation state!\n");
+        return false;
+    }
+    uint64_t prev_end = allocations->mmap_floor_adr;
+    for (size_t i = 0; i < allocations->nb_mmap_regions; i++) {
+        const mmu_region_t* region = &allocations->mmap_regions[i];
+        if (region->size == 0 || region->adr < prev_end || !in_memory(region->adr, region->size, memory_size)) {
+            ginger_log(ERROR, "Snapshot mmap region %lu is out of order or outside of memory!\n", i);
+            return false;
+        }
+        prev_end = region->adr + region->size;
+    }
+
+    if (header->initial_stack_adr_mapped >= memory_size) {
+        ginger_log(ERROR, "Snapshot stack is outside of memory!\n");
+        return false;
+    }
+    for (uint64_t i = 0; i < header->nb_args; i++) {
+        if (header->arg_adrs[i] >= memory_size) {
+            ginger_log(ERROR, "Snapshot argument %lu is outside of memory!\n", i);
+            return false;
+        }
+    }
+    for (uint64_t i = 0; i < header->nb_end_adrs; i++) {
+        if (header->end_adrs[i] >= memory_size) {
+            ginger_log(ERROR, "Snapshot end address 0x%lx is outside of memory!\n", header->end_adrs[i]);
+            return false;
+        }
+    }
+    for (uint64_t i = 0; i < header->nb_adr_maps; i++) {
+        if (header->adr_maps[i].low > header->adr_maps[i].high) {
+            ginger_log(ERROR, "Invalid snapshot address map %lu!\n", i);
+            return false;
+        }
+    }
+
+    const snapshot_file_page_t* pages = (const snapshot_file_page_t*)(header + 1);
+    for (uint64_t i = 0; i < header->nb_pages; i++) {
+        if (pages[i].page >= memory_size / MMU_PAGE_SIZE) {
+            ginger_log(ERROR, "Snapshot page 0x%lx is outside of memory!\n", pages[i].page);
+            return false;
+        }
+    }
+    return true;
+}
+
+snapshot_file_t*
+snapshot_file_open(const char* path)
+{
+    const int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        ginger_log(ERROR, "Could not open snapshot file %s!\n", path);
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(snapshot_file_header_t)) {
+        ginger_log(ERROR, "%s is not a snapshot file!\n", path);
+        close(fd);
+        return NULL;
+    }
+    void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        ginger_log(ERROR, "Could not map snapshot file %s!\n", path);
+        return NULL;
+    }
+
+    if (!snapshot_file_is_valid(data, st.st_size)) {
+        ginger_log(ERROR, "%s is not a snapshot file of this build!\n", path);
+        munmap(data, st.st_size);
+        return NULL;
+    }
+    const snapshot_file_header_t* header = data;
+
+    snapshot_file_t* file = calloc(1, sizeof(snapshot_file_t));
+    if (!file) {
+        ginger_log(ERROR, "[%s] Could not allocate the snapshot file!\n", __func__);
+        munmap(data, st.st_size);
+        return NULL;
+    }
+    file->header      = header;
+    file->size        = st.st_size;
+    file->arch        = header->arch;
+    file->memory_size = header->memory_size;
+    file->stack_size  = header->stack_size;
+    return file;
+}
+
+void
+snapshot_file_close(snapshot_file_t* file)
+{
+    if (!file) {
+        return;
+    }
+    munmap((void*)file->header, file->size);
+    free(file);
+}
+
+bool
+snapshot_file_load(const snapshot_file_t* file, emu_t* emu, inject_layout_t* layout,
+                   uint64_t* end_adrs, size_t* nb_end_adrs)
+{
+    const snapshot_file_header_t* header = file->header;
+    mmu_t*                        mmu    = emu->get_mmu(emu);
+    if (file->arch != emu->get_arch(emu) || header->nb_regs != emu->get_nb_regs(emu)) {
+        ginger_log(ERROR, "The snapshot is of another arch!\n");
+        return false;
+    }
+    if (file->memory_size != mmu->memory_size) {
+        ginger_log(ERROR, "The snapshot has 0x%lx bytes of memory, not 0x%lx!\n", file->memory_size, mmu->memory_size);
+        return false;
+    }
+
+    // Rebuild the layout with the checks of the debug CLI, before touching
+    // the emulator.
+    inject_layout_t loaded_layout = {0};
+    for (size_t i = 0; i < header->layout.nb_slots; i++) {
+        if (!inject_layout_add_slot(&loaded_layout, emu, &header->layout.slots[i])) {
+            ginger_log(ERROR, "Invalid injection slot %lu in the snapshot!\n", i);
+            return false;
+        }
+    }
+    for (size_t i = 0; i < header->layout.nb_sinks; i++) {
+        if (!inject_layout_add_sink(&loaded_layout, emu, &header->layout.sinks[i])) {
+            ginger_log(ERROR, "Invalid injection sink %lu in the snapshot!\n", i);
+            return false;
+        }
+    }
+
+    // Pages which are not in the file are all zero, in what either the
+    // emulator or the snapshot has allocated.
+    const mmu_allocations_t* allocations = &header->allocations;
+    const size_t curr_end   = used_end(mmu->curr_alloc_adr, mmu->mmap_floor_adr);
+    const size_t saved_end  = used_end(allocations->curr_alloc_adr, allocations->mmap_floor_adr);
+    const size_t end        = curr_end > saved_end ? curr_end : saved_end;
+    const size_t floor      = mmu->mmap_floor_adr < allocations->mmap_floor_adr ?
+                              mmu->mmap_floor_adr : allocations->mmap_floor_adr;
+    memset(mmu->memory,              0, end);
+    memset(mmu->permissions,         0, end);
+    memset(mmu->memory + floor,      0, mmu->memory_size - floor);
+    memset(mmu->permissions + floor, 0, mmu->memory_size - floor);
+
+    const snapshot_file_page_t* pages = (const snapshot_file_page_t*)(header + 1);
+    for (uint64_t i = 0; i < header->nb_pages; i++) {
+        const uint64_t adr = pages[i].page * MMU_PAGE_SIZE;
+        memcpy(mmu->memory + adr,      pages[i].memory,      MMU_PAGE_SIZE);
+        memcpy(mmu->permissions + adr, pages[i].permissions, MMU_PAGE_SIZE);
+    }
+
+    for (uint8_t i = 0; i < header->nb_regs; i++) {
+        emu->set_reg(emu, i, header->regs[i]);
+    }
+    mmu_restore_allocations(mmu, &header->allocations);
+    mmu->initial_stack_adr_mapped = header->initial_stack_adr_mapped;
+    mmu->initial_stack_adr_virt   = header->initial_stack_adr_virt;
+    mmu->nb_args                  = header->nb_args;
+    memcpy(mmu->arg_adrs, header->arg_adrs, sizeof(mmu->arg_adrs));
+
+    for (uint64_t i = 0; i < mmu->nb_adr_maps; i++) {
+        adr_map_destroy(mmu->adr_maps[i]);
+    }
+    free(mmu->adr_maps);
+    mmu->adr_maps    = calloc(header->nb_adr_maps, sizeof(adr_map_t*));
+    mmu->nb_adr_maps = 0;
+    for (uint64_t i = 0; i < header->nb_adr_maps; i++) {
+        mmu->adr_maps[i] = malloc(sizeof(adr_map_t));
+        if (!mmu->adr_maps[i]) {
+            ginger_log(ERROR, "[%s] Could not allocate address map!\n", __func__);
+            return false;
+        }
+        *mmu->adr_maps[i] = header->adr_maps[i];
+        mmu->nb_adr_maps++;
+    }
+
+    *layout      = loaded_layout;
+    *nb_end_adrs = header->nb_end_adrs;
+    memcpy(end_adrs, header->end_adrs, header->nb_end_adrs * sizeof(uint64_t));
+    return true;
+}
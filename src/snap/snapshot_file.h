@@ -0,0 +1,67 @@
+/**
+ * Snapshots saved to disk.
+ *
+ * A snapshot file holds everything the debug CLI hands to the fuzzer: the
+ * registers, the allocation state, the program header address maps, the stack
+ * and argument addresses, the injection layout and the end addresses, followed
+ * by the pages of memory and permissions which are not all zero.
+ *
+ *     header | page, memory, permissions | page, memory, permissions | ...
+ *
+ * Loading maps the file and copies the pages into a fresh emulator, so that
+ * restarting skips loading the elf, building the stack, running the target up
+ * to the snapshot and the debug CLI. Everything is stored in the byte order
+ * and layout of the host, so files are only portable between hosts running
+ * the same build.
+ */
+
+#ifndef SNAPSHOT_FILE_H
+#define SNAPSHOT_FILE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "inject.h"
+
+#include "../emu/emu_generic.h"
+
+// Most program headers and end addresses a snapshot file keeps.
+#define SNAPSHOT_FILE_MAX_NB_ADR_MAPS 16
+#define SNAPSHOT_FILE_MAX_NB_END_ADRS 64
+
+typedef struct snapshot_file_header snapshot_file_header_t;
+
+// A snapshot file mapped into memory.
+typedef struct {
+    const snapshot_file_header_t* header;
+    size_t                        size;
+    enum_supported_archs_t        arch;
+    uint64_t                      memory_size;
+    uint64_t                      stack_size;
+} snapshot_file_t;
+
+// Save the state of `emu`, and where fuzzcases are injected into it. Returns
+// false, after logging why, if the file could not be written.
+bool
+snapshot_file_save(const char* path, const emu_t* emu, const inject_layout_t* layout,
+                   const uint64_t* end_adrs, size_t nb_end_adrs);
+
+// Map a snapshot file and check that its header, allocation state and pages
+// are inside of the memory it was saved with. Returns NULL, after logging why,
+// if it is not a valid snapshot file of this build.
+snapshot_file_t*
+snapshot_file_open(const char* path);
+
+void
+snapshot_file_close(snapshot_file_t* file);
+
+// Bring `emu`, which has to have the memory size and arch of the file, to the
+// saved state, and fill in the layout and end addresses. `end_adrs` has room
+// for `SNAPSHOT_FILE_MAX_NB_END_ADRS`. The layout is checked against `emu`
+// like in the debug CLI, before anything is changed.
+bool
+snapshot_file_load(const snapshot_file_t* file, emu_t* emu, inject_layout_t* layout,
+                   uint64_t* end_adrs, size_t* nb_end_adrs);
+
+#endif
@@ -0,0 +1,309 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "snapshot_tree.h"
+
+#include "../utils/logger.h"
+
+snapshot_tree_t*
+snapshot_tree_create(const emu_t* root)
+{
+    snapshot_tree_t* tree = calloc(1, sizeof(snapshot_tree_t));
+    if (!tree) {
+        ginger_log(ERROR, "[%s] Could not allocate the snapshot tree!\n", __func__);
+        return NULL;
+    }
+    tree->root     = root;
+    tree->nb_nodes = 1;
+    tree->current  = SNAPSHOT_TREE_ROOT;
+    return tree;
+}
+
+void
+snapshot_tree_destroy(snapshot_tree_t* tree)
+{
+    if (!tree) {
+        return;
+    }
+    for (size_t i = 0; i < tree->nb_nodes; i++) {
+        free(tree->nodes[i].blocks);
+    }
+    free(tree);
+}
+
+static const snapshot_block_t*
+snapshot_node_find_block(const snapshot_node_t* node, uint64_t block)
+{
+    size_t lo = 0;
+    size_t hi = node->nb_blocks;
+    while (lo < hi) {
+        const size_t mid = lo + ((hi - lo) / 2);
+        if (node->blocks[mid].block < block) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    return lo < node->nb_blocks && node->blocks[lo].block == block ? &node->blocks[lo] : NULL;
+}
+
+// Memory and permissions of a block as seen from a node, which is the block
+// of the deepest node on the way up which has it, or the one of the root.
+static void
+snapshot_tree_view_block(const snapshot_tree_t* tree, size_t idx, uint64_t block,
+                         const uint8_t** memory, const uint8_t** permissions)
+{
+    for (; idx != SNAPSHOT_TREE_ROOT; idx = tree->nodes[idx].parent) {
+        const snapshot_block_t* found = snapshot_node_find_block(&tree->nodes[idx], block);
+        if (found) {
+            *memory      = found->memory;
+            *permissions = found->permissions;
+            return;
+        }
+    }
+    const mmu_t* root_mmu = tree->root->get_mmu(tree->root);
+    *memory      = root_mmu->memory      + (block * DIRTY_BLOCK_SIZE);
+    *permissions = root_mmu->permissions + (block * DIRTY_BLOCK_SIZE);
+}
+
+// Append the block to the node if it differs from the parent.
+static bool
+snapshot_tree_diff_block(const snapshot_tree_t* tree, snapshot_node_t* node, const mmu_t* mmu,
+                         uint64_t block, size_t* capacity)
+{
+    const uint64_t adr = block * DIRTY_BLOCK_SIZE;
+    const uint8_t* parent_memory;
+    const uint8_t* parent_permissions;
+    snapshot_tree_view_block(tree, node->parent, block, &parent_memory, &parent_permissions);
+    if (memcmp(mmu->memory + adr, parent_memory, DIRTY_BLOCK_SIZE) == 0 &&
+        memcmp(mmu->permissions + adr, parent_permissions, DIRTY_BLOCK_SIZE) == 0) {
+        return true;
+    }
+
+    if (node->nb_blocks == *capacity) {
+        *capacity = *capacity ? *capacity * 2 : 64;
+        snapshot_block_t* blocks = realloc(node->blocks, *capacity * sizeof(snapshot_block_t));
+        if (!blocks) {
+            return false;
+        }
+        node->blocks = blocks;
+    }
+    snapshot_block_t* dst = &node->blocks[node->nb_blocks++];
+    dst->block = block;
+    memcpy(dst->memory,      mmu->memory + adr,      DIRTY_BLOCK_SIZE);
+    memcpy(dst->permissions, mmu->permissions + adr, DIRTY_BLOCK_SIZE);
+    return true;
+}
+
+// Append the blocks in [start, end) of `mmu` which differ from the parent.
+static bool
+snapshot_tree_diff_range(const snapshot_tree_t* tree, snapshot_node_t* node, const mmu_t* mmu,
+                         uint64_t start, uint64_t end, size_t* capacity)
+{
+    for (uint64_t block = start / DIRTY_BLOCK_SIZE; block * DIRTY_BLOCK_SIZE < end; block++) {
+        if (!snapshot_tree_diff_block(tree, node, mmu, block, capacity)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static int
+snapshot_block_compare(const void* a, const void* b)
+{
+    const uint64_t block_a = ((const snapshot_block_t*)a)->block;
+    const uint64_t block_b = ((const snapshot_block_t*)b)->block;
+    return (block_a > block_b) - (block_a < block_b);
+}
+
+// Collect the blocks which differ from the parent. The emulator was reset to
+// the root, and every block which can differ from it since, written by the
+// restore of the parent or by the fuzzcase, is in the dirty list. In
+// copy-on-write mode there is no dirty list, and everything allocated now or
+// in the parent is compared, since memory freed by the fuzzcase differs in
+// its permissions.
+static bool
+snapshot_tree_diff(const snapshot_tree_t* tree, snapshot_node_t* node, const mmu_t* mmu,
+                   const mmu_allocations_t* parent_allocations)
+{
+    size_t capacity = 0;
+
+    if (mmu->reset_mode == ENUM_RESET_MODE_DIRTY_BLOCKS) {
+        const dirty_state_t* dirty = mmu->dirty_state;
+        for (uint64_t i = 0; i < dirty->nb_dirty_blocks; i++) {
+            if (!snapshot_tree_diff_block(tree, node, mmu, dirty->dirty_blocks[i], &capacity)) {
+                return false;
+            }
+        }
+        // Blocks are looked up by binary search.
+        qsort(node->blocks, node->nb_blocks, sizeof(snapshot_block_t), snapshot_block_compare);
+        return true;
+    }
+
+    const uint64_t alloc_end  = mmu->curr_alloc_adr > parent_allocations->curr_alloc_adr ?
+                                mmu->curr_alloc_adr : parent_allocations->curr_alloc_adr;
+    const uint64_t mmap_start = mmu->mmap_floor_adr < parent_allocations->mmap_floor_adr ?
+                                mmu->mmap_floor_adr : parent_allocations->mmap_floor_adr;
+    return snapshot_tree_diff_range(tree, node, mmu, 0, alloc_end < mmap_start ? alloc_end : mmap_start, &capacity) &&
+           snapshot_tree_diff_range(tree, node, mmu, mmap_start, mmu->memory_size, &capacity);
+}
+
+// Whether node `a` has a better recent yield than node `b`. Nodes which have
+// not been fuzzed from yet score as if all of their cases found something.
+static bool
+snapshot_node_better(const snapshot_node_t* a, const snapshot_node_t* b)
+{
+    return (a->nb_finds + 1) * (b->nb_cases + 1) > (b->nb_finds + 1) * (a->nb_cases + 1);
+}
+
+// Find the slot for a new child of the current node. When the tree or the
+// current node is full, the leaf with the worst recent yield makes room, as
+// long as it has done worse than a node which has not been fuzzed from yet.
+// Only children of the current node are considered when it is the one which
+// is full. Returns `SNAPSHOT_TREE_ROOT` if there is no room.
+static size_t
+snapshot_tree_make_room(snapshot_tree_t* tree)
+{
+    const bool parent_full = tree->nodes[tree->current].nb_children == SNAPSHOT_TREE_MAX_NB_CHILDREN;
+    if (!parent_full && tree->nb_nodes < SNAPSHOT_TREE_MAX_NB_NODES) {
+        return tree->nb_nodes++;
+    }
+
+    const snapshot_node_t fresh = {0};
+    size_t                worst = SNAPSHOT_TREE_ROOT;
+    for (size_t i = 1; i < tree->nb_nodes; i++) {
+        const snapshot_node_t* node = &tree->nodes[i];
+        if (node->nb_children != 0 || i == tree->current || (parent_full && node->parent != tree->current)) {
+            continue;
+        }
+        if (worst == SNAPSHOT_TREE_ROOT || snapshot_node_better(&tree->nodes[worst], node)) {
+            worst = i;
+        }
+    }
+    if (worst == SNAPSHOT_TREE_ROOT || !snapshot_node_better(&fresh, &tree->nodes[worst])) {
+        return SNAPSHOT_TREE_ROOT;
+    }
+
+    snapshot_node_t* evicted = &tree->nodes[worst];
+    tree->nodes[evicted->parent].nb_children--;
+    free(evicted->blocks);
+    memset(evicted, 0, sizeof(*evicted));
+    return worst;
+}
+
+size_t
+snapshot_tree_take(snapshot_tree_t* tree, const emu_t* emu, uint64_t iteration)
+{
+    // Nearly every fuzzcase takes a path of its own, so only the ones which
+    // found new coverage on the way are a new state worth keeping.
+    if (!emu->get_new_coverage(emu)) {
+        return SNAPSHOT_TREE_ROOT;
+    }
+
+    // Built on the side, so that a failure leaves the tree as it was.
+    snapshot_node_t* parent = &tree->nodes[tree->current];
+    snapshot_node_t* node   = calloc(1, sizeof(snapshot_node_t));
+    if (!node) {
+        ginger_log(ERROR, "[%s] Could not allocate the snapshot!\n", __func__);
+        return SNAPSHOT_TREE_ROOT;
+    }
+    node->parent    = tree->current;
+    node->depth     = parent->depth + 1;
+    node->pc        = emu->get_pc(emu);
+    node->iteration = iteration;
+    for (uint8_t i = 0; i < emu->get_nb_regs(emu); i++) {
+        node->regs[i] = emu->get_reg(emu, i);
+    }
+
+    const mmu_t* mmu = emu->get_mmu(emu);
+    mmu_save_allocations(mmu, &node->allocations);
+
+    const mmu_allocations_t* parent_allocations = NULL;
+    mmu_allocations_t        root_allocations;
+    if (tree->current == SNAPSHOT_TREE_ROOT) {
+        mmu_save_allocations(tree->root->get_mmu(tree->root), &root_allocations);
+        parent_allocations = &root_allocations;
+    }
+    else {
+        parent_allocations = &parent->allocations;
+    }
+
+    // The leaf evicted to make room is never an ancestor of the current node,
+    // so the blocks can be compared before it goes.
+    size_t idx = SNAPSHOT_TREE_ROOT;
+    if (!snapshot_tree_diff(tree, node, mmu, parent_allocations)) {
+        ginger_log(ERROR, "[%s] Could not allocate the blocks of the snapshot!\n", __func__);
+    }
+    else {
+        idx = snapshot_tree_make_room(tree);
+    }
+    if (idx == SNAPSHOT_TREE_ROOT) {
+        free(node->blocks);
+        free(node);
+        return SNAPSHOT_TREE_ROOT;
+    }
+
+    tree->nodes[idx] = *node;
+    free(node);
+    parent->nb_children++;
+    return idx;
+}
+
+void
+snapshot_tree_report(snapshot_tree_t* tree, bool new_coverage)
+{
+    snapshot_node_t* node = &tree->nodes[tree->current];
+    node->nb_cases++;
+    node->nb_finds += new_coverage;
+
+    if (++tree->nb_epoch_cases < SNAPSHOT_TREE_EPOCH) {
+        return;
+    }
+    tree->nb_epoch_cases = 0;
+
+    size_t best = SNAPSHOT_TREE_ROOT;
+    for (size_t i = 1; i < tree->nb_nodes; i++) {
+        if (snapshot_node_better(&tree->nodes[i], &tree->nodes[best])) {
+            best = i;
+        }
+    }
+    for (size_t i = 0; i < tree->nb_nodes; i++) {
+        tree->nodes[i].nb_cases /= 2;
+        tree->nodes[i].nb_finds /= 2;
+    }
+    tree->current = best;
+}
+
+void
+snapshot_tree_restore(const snapshot_tree_t* tree, emu_t* emu)
+{
+    if (tree->current == SNAPSHOT_TREE_ROOT) {
+        return;
+    }
+
+    // Write the blocks of the nodes from the top down, so that deeper nodes
+    // win. They are marked dirty so that the next reset undoes them.
+    size_t path[SNAPSHOT_TREE_MAX_NB_NODES];
+    size_t nb_path = 0;
+    for (size_t idx = tree->current; idx != SNAPSHOT_TREE_ROOT; idx = tree->nodes[idx].parent) {
+        path[nb_path++] = idx;
+    }
+
+    mmu_t* mmu = emu->get_mmu(emu);
+    while (nb_path > 0) {
+        const snapshot_node_t* node = &tree->nodes[path[--nb_path]];
+        for (size_t i = 0; i < node->nb_blocks; i++) {
+            const uint64_t adr = node->blocks[i].block * DIRTY_BLOCK_SIZE;
+            memcpy(mmu->memory + adr,      node->blocks[i].memory,      DIRTY_BLOCK_SIZE);
+            memcpy(mmu->permissions + adr, node->blocks[i].permissions, DIRTY_BLOCK_SIZE);
+            mmu_mark_dirty(mmu, adr, DIRTY_BLOCK_SIZE);
+        }
+    }
+
+    const snapshot_node_t* node = &tree->nodes[tree->current];
+    for (uint8_t i = 0; i < emu->get_nb_regs(emu); i++) {
+        emu->set_reg(emu, i, node->regs[i]);
+    }
+    mmu_restore_allocations(mmu, &node->allocations);
+}
@@ -0,0 +1,89 @@
+/**
+ * Nested snapshots, taken by a worker while it fuzzes.
+ *
+ * The root of the tree is the snapshot taken in the debug CLI. When a fuzzcase
+ * which has found new coverage reaches an instruction with the snapshot bit
+ * set, the state of the emulator is taken as a child of the current node. A
+ * child keeps its registers and allocation state, and the dirty blocks which
+ * differ from its parent, so that deep nodes stay small. When the tree is
+ * full, leaves which have yielded less than a fresh node would are replaced.
+ *
+ *     root ── 0x10400 (handshake done) ── 0x10400 (second message)
+ *          └─ 0x10400 (other path)
+ *
+ * Fuzzcases run from the current node. Resetting to it resets to the root and
+ * writes the blocks of every node on the way down, which is much cheaper than
+ * running the prefix of the input which got there. Every epoch the node with
+ * the best recent yield of new coverage becomes the current node.
+ */
+
+#ifndef SNAPSHOT_TREE_H
+#define SNAPSHOT_TREE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../emu/emu_generic.h"
+#include "../mmu/mmu.h"
+
+#define SNAPSHOT_TREE_MAX_NB_NODES    64
+#define SNAPSHOT_TREE_MAX_NB_CHILDREN 8
+#define SNAPSHOT_TREE_ROOT            0
+
+// Fuzzcases between picks of the node to fuzz from. The yield counters of all
+// nodes are halved at every pick, so that recent cases weigh the most.
+#define SNAPSHOT_TREE_EPOCH 256
+
+typedef struct {
+    uint64_t block;                            // Index of the dirty block.
+    uint8_t  memory[DIRTY_BLOCK_SIZE];
+    uint8_t  permissions[DIRTY_BLOCK_SIZE];
+} snapshot_block_t;
+
+typedef struct {
+    size_t            parent;
+    size_t            depth;
+    size_t            nb_children;
+    uint64_t          pc;                      // Snapshot address the node was taken at.
+    uint64_t          iteration;               // Fuzzcase which took the node.
+    uint64_t          regs[EMU_MAX_NB_REGS];
+    mmu_allocations_t allocations;
+    snapshot_block_t* blocks;                  // Blocks which differ from the parent, sorted.
+    size_t            nb_blocks;
+    uint64_t          nb_cases;                // Recent fuzzcases run from the node.
+    uint64_t          nb_finds;                // Recent fuzzcases from the node with new coverage.
+} snapshot_node_t;
+
+typedef struct {
+    const emu_t*    root;                      // The snapshot taken in the debug CLI.
+    snapshot_node_t nodes[SNAPSHOT_TREE_MAX_NB_NODES];
+    size_t          nb_nodes;
+    size_t          current;                   // Node fuzzcases run from.
+    uint64_t        nb_epoch_cases;
+} snapshot_tree_t;
+
+snapshot_tree_t*
+snapshot_tree_create(const emu_t* root);
+
+void
+snapshot_tree_destroy(snapshot_tree_t* tree);
+
+// Take the state of `emu`, which was reset to the current node and is stopped
+// at a snapshot address, as a child of the current node. Returns the index of
+// the child, or `SNAPSHOT_TREE_ROOT` if the fuzzcase has not found new
+// coverage, or the tree or the current node is full of leaves which are still
+// worth fuzzing from.
+size_t
+snapshot_tree_take(snapshot_tree_t* tree, const emu_t* emu, uint64_t iteration);
+
+// Count a fuzzcase run from the current node, and pick the node to fuzz from
+// at the end of every epoch.
+void
+snapshot_tree_report(snapshot_tree_t* tree, bool new_coverage);
+
+// Bring `emu`, which has just been reset to the root, to the current node.
+void
+snapshot_tree_restore(const snapshot_tree_t* tree, emu_t* emu);
+
+#endif
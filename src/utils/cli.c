@@ -275,10 +275,97 @@ cli_search_exact_match(vector_t* commands, const char* substr)
     }
 }
 
+// Tokenize a line of input, and complete its first token to the command it
+// is the start of. Returns NULL if it is not the start of exactly one command.
+static token_str_t*
+cli_parse_command(const cli_t* cli, const char* line)
+{
+    char input_buf[MAX_LENGTH_DEBUG_CLI_COMMAND] = {0};
+    snprintf(input_buf, sizeof(input_buf), "%s", line);
+
+    token_str_t* input_tokens = token_str_tokenize(input_buf, " ");
+    if (input_tokens->nb_tokens == 0) {
+        token_str_destroy(input_tokens);
+        return NULL;
+    }
+    const int match = cli_search_exact_match(cli->commands, input_tokens->tokens[0]);
+    if (match == -1) {
+        token_str_destroy(input_tokens);
+        return NULL;
+    }
+
+    char* completion = calloc(MAX_LENGTH_DEBUG_CLI_COMMAND, sizeof(char));
+    if (!completion) {
+        printf("Could not realloc memory for completion!\n");
+        abort();
+    }
+    const size_t   nb_read  = strlen(input_tokens->tokens[0]);
+    const uint64_t comp_len = cli_complete_command(cli, input_tokens->tokens[0], completion);
+    if ((nb_read + comp_len) > MAX_LENGTH_DEBUG_CLI_COMMAND) {
+        printf("Command to long!\n");
+        free(completion);
+        token_str_destroy(input_tokens);
+        return NULL;
+    }
+
+    // Add the completion to input.
+    input_tokens->tokens[0] = realloc(input_tokens->tokens[0], nb_read + comp_len + 1);
+    if (!input_tokens->tokens[0]) {
+        printf("Could not realloc memory for completion!\n");
+        abort();
+    }
+    memcpy(input_tokens->tokens[0] + nb_read, completion, comp_len);
+    input_tokens->tokens[0][nb_read + comp_len] = '\0';
+    free(completion);
+
+    return input_tokens;
+}
+
+// When stdin is not a terminal, e.g. when commands are piped in, there are no
+// keypresses to react to, and raw mode can not be set. Read whole lines
+// instead, without completion on tab.
+static token_str_t*
+cli_get_line_command(cli_t* cli)
+{
+    char*  line     = NULL;
+    size_t line_cap = 0;
+
+    for (;;) {
+        const ssize_t line_len = getline(&line, &line_cap, stdin);
+        if (line_len == -1) {
+            free(line);
+            printf("\n");
+            ginger_log(ERROR, "Reached the end of stdin, before the debug CLI was done!\n");
+            exit(1);
+        }
+        line[strcspn(line, "\r\n")] = '\0';
+
+        // Echo the line, as the terminal does when typing.
+        printf("%s", line);
+        fflush(stdout);
+
+        if (line[strspn(line, " \t")] == '\0') {
+            free(line);
+            return NULL;
+        }
+        token_str_t* input_tokens = cli_parse_command(cli, line);
+        if (input_tokens) {
+            free(line);
+            return input_tokens;
+        }
+        printf("\nCommand not found!\n");
+        cli_print_prompt(cli);
+    }
+}
+
 // Returns heap allocated user input string. Support command autocompletion.
 token_str_t*
 cli_get_command(cli_t* cli)
 {
+    if (!isatty(STDIN_FILENO)) {
+        return cli_get_line_command(cli);
+    }
+
     char   input_buf[MAX_LENGTH_DEBUG_CLI_COMMAND] = {0};
     size_t nb_read   = 0; // Increments on character input or autocompletion.
     char   prev_char = '\0';
@@ -356,31 +443,8 @@ cli_get_command(cli_t* cli)
                 cli_disable_raw_mode();
                 return NULL;
             }
-            token_str_t* input_tokens = token_str_tokenize(input_buf, " ");
-            nb_read = strlen(input_tokens->tokens[0]);
-            const int match = cli_search_exact_match(cli->commands, input_tokens->tokens[0]);
-            if (match != -1) {
-                char* completion = calloc(MAX_LENGTH_DEBUG_CLI_COMMAND, sizeof(char));
-                if (!completion) {
-                    printf("Could not realloc memory for completion!\n");
-                    abort();
-                }
-                const uint64_t comp_len = cli_complete_command(cli, input_tokens->tokens[0], completion);
-                if ((nb_read + comp_len) > MAX_LENGTH_DEBUG_CLI_COMMAND) {
-                    printf("Command to long!\n");
-                    return NULL;
-                }
-
-                // Add the completion to input.
-                input_tokens->tokens[0] = realloc(input_tokens->tokens[0],
-                                                  nb_read + comp_len + 1);
-                if (!input_tokens->tokens[0]) {
-                    printf("Could not realloc memory for completion!\n");
-                    abort();
-                }
-                memcpy(input_tokens->tokens[0] + nb_read, completion, comp_len);
-                free(completion);
-
+            token_str_t* input_tokens = cli_parse_command(cli, input_buf);
+            if (input_tokens) {
                 cli_disable_raw_mode();
                 return input_tokens;
             }
@@ -463,6 +527,7 @@ cli_create(const char* prompt_str)
     // Set the function pointers for the API.
     cli->print_prompt    = cli_print_prompt;
     cli->get_command     = cli_get_command;
+    cli->parse_command   = cli_parse_command;
     cli->free_user_input = cli_free_user_input;
     cli->add_command     = cli_add_command;
 
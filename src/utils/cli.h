@@ -17,12 +17,16 @@ struct cli_cmd {
     char description[MAX_LENGTH_DEBUG_CLI_COMMAND_DESCRIPTION];
 };
 
-typedef struct {
+typedef struct cli {
     // The CLI API.
     void         (*print_prompt)();
     token_str_t* (*get_command)();
     void         (*free_user_input)(token_str_t* token_str);
 
+    // Tokenize a command given as a string, completing the command like on
+    // enter. Returns NULL if it does not match exactly one command.
+    token_str_t* (*parse_command)(const struct cli* cli, const char* line);
+
     // Takes a command struct and copies the data over to the cli->commands vector.
     // There is no need for the callee to allocate data for the command as this is
     // handled by the vector.
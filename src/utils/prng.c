@@ -0,0 +1,29 @@
+#include "prng.h"
+
+static uint64_t
+splitmix64(uint64_t* x)
+{
+    uint64_t z = (*x += 0x9e3779b97f4a7c15);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
+}
+
+void
+prng_seed(prng_t* prng, uint64_t seed)
+{
+    // Splitmix64 never yields four zeroes in a row, which is the one state
+    // xoshiro can not leave.
+    for (int i = 0; i < 4; i++) {
+        prng->s[i] = splitmix64(&seed);
+    }
+}
+
+uint64_t
+prng_mix(uint64_t a, uint64_t b, uint64_t c)
+{
+    uint64_t x = a;
+    x = splitmix64(&x) ^ b;
+    x = splitmix64(&x) ^ c;
+    return splitmix64(&x);
+}
@@ -0,0 +1,51 @@
+#ifndef PRNG_H
+#define PRNG_H
+
+#include <stdint.h>
+
+// Pseudo random number generator, xoshiro256**. Every snapshot engine owns
+// one, so that no locks are taken when drawing numbers and the sequence of
+// fuzzcases can be regenerated from a seed.
+typedef struct {
+    uint64_t s[4];
+} prng_t;
+
+// Seed the state from a single 64 bit value, expanded with splitmix64.
+void
+prng_seed(prng_t* prng, uint64_t seed);
+
+// Mix several 64 bit values into one, suitable as a seed.
+uint64_t
+prng_mix(uint64_t a, uint64_t b, uint64_t c);
+
+static inline uint64_t
+prng_rotl(const uint64_t x, int k)
+{
+    return (x << k) | (x >> (64 - k));
+}
+
+static inline uint64_t
+prng_next(prng_t* prng)
+{
+    uint64_t* s = prng->s;
+    const uint64_t result = prng_rotl(s[1] * 5, 7) * 9;
+    const uint64_t t = s[1] << 17;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = prng_rotl(s[3], 45);
+
+    return result;
+}
+
+// Random number in [0, bound). `bound` has to be nonzero.
+static inline uint64_t
+prng_below(prng_t* prng, uint64_t bound)
+{
+    return (uint64_t)(((unsigned __int128)prng_next(prng) * bound) >> 64);
+}
+
+#endif
@@ -12,11 +12,17 @@
 
 vector_t*
 vector_create(size_t entry_size)
+{
+    return vector_create_with_capacity(entry_size, VECTOR_INITIAL_CAPACITY);
+}
+
+vector_t*
+vector_create_with_capacity(size_t entry_size, size_t capacity)
 {
     vector_t* vector   = calloc(1, sizeof(vector_t));
-    vector->data       = calloc(VECTOR_INITIAL_CAPACITY, entry_size);
+    vector->data       = calloc(capacity, entry_size);
     vector->length     = 0;
-    vector->capacity   = VECTOR_INITIAL_CAPACITY;
+    vector->capacity   = capacity;
     vector->entry_size = entry_size;
 
     return vector;
@@ -14,6 +14,11 @@ typedef struct {
 vector_t*
 vector_create(size_t entry_size);
 
+// Create a vector with room for `capacity` entries, which does not move until
+// it grows past them.
+vector_t*
+vector_create_with_capacity(size_t entry_size, size_t capacity);
+
 void
 vector_destroy(vector_t* vector);
 